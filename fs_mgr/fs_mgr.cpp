@@ -38,8 +38,10 @@
 
 #include <array>
 #include <chrono>
+#include <condition_variable>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -1468,9 +1470,208 @@ static FstabEntry* LocateFormattableEntry(FstabEntry* const begin, FstabEntry* c
     return f2fs_entry;
 }
 
+// Number of threads used by fs_mgr_mount_all when ro.fs_mgr.parallel_mount_all
+// is set.
+static constexpr int kParallelMountThreads = 4;
+
+// Returns true if the fstab entries [start_idx, end_idx], which share a mount
+// point, can be mounted concurrently with other entries. Anything which has to
+// talk to vold (checkpointing, encryption, formatting) or whose mount the rest
+// of fs_mgr_mount_all depends on keeps being mounted in fstab order.
+static bool CanMountInParallel(const Fstab& fstab, int start_idx, int end_idx) {
+    for (int i = start_idx; i <= end_idx; i++) {
+        const auto& entry = fstab[i];
+        if (entry.mount_point == "/data" || entry.fs_mgr_flags.first_stage_mount ||
+            entry.fs_mgr_flags.late_mount || entry.fs_mgr_flags.formattable ||
+            entry.fs_mgr_flags.file_encryption || should_use_metadata_encryption(entry) ||
+            entry.fs_mgr_flags.checkpoint_blk || entry.fs_mgr_flags.checkpoint_fs ||
+            WasMetadataEncryptionInterrupted(entry)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Mount points which have to be mounted in fstab order relative to each
+// other: the same mount point, or one nested in the other.
+static bool MountPointsOverlap(const std::string& a, const std::string& b) {
+    return a == b || StartsWith(a, b + "/") || StartsWith(b, a + "/");
+}
+
+// Mounts independent fstab entries concurrently on a small pool of threads.
+//
+// Each queued mount runs prepare_fs_for_mount (e2fsck, tune2fs, ...) and
+// mount(2) for one mount point and its alternatives. A mount only starts once
+// every earlier queued mount it depends on has finished, i.e. those on the
+// same block device or on an overlapping mount point, so the dependency graph
+// is the one implied by the fstab order.
+class ParallelMounter {
+  public:
+    ParallelMounter(Fstab* fstab, bool* scratch_can_be_mounted)
+        : fstab_(fstab), scratch_can_be_mounted_(scratch_can_be_mounted) {}
+    ~ParallelMounter();
+
+    // Queues the mount of fstab entries [start_idx, end_idx].
+    void Mount(int start_idx, int end_idx);
+
+    // Waits for all queued mounts to finish. Returns the number of mounts
+    // which failed.
+    int Wait();
+
+  private:
+    struct Job {
+        int start_idx;
+        int end_idx;
+        std::vector<size_t> deps;
+        bool running = false;
+        bool done = false;
+    };
+
+    void ThreadLoop();
+    bool IsReady(const Job& job);
+    void RunJob(const Job& job);
+
+    Fstab* fstab_;
+    bool* scratch_can_be_mounted_;
+
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::vector<Job> jobs_;
+    size_t jobs_done_ = 0;
+    int error_count_ = 0;
+    bool stopped_ = false;
+    std::vector<std::thread> threads_;
+
+    // Serializes the overlayfs setup which follows a successful mount.
+    std::mutex overlayfs_lock_;
+};
+
+ParallelMounter::~ParallelMounter() {
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stopped_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ParallelMounter::Mount(int start_idx, int end_idx) {
+    if (threads_.empty()) {
+        for (int i = 0; i < kParallelMountThreads; i++) {
+            threads_.emplace_back(&ParallelMounter::ThreadLoop, this);
+        }
+    }
+
+    const auto& entry = (*fstab_)[start_idx];
+    Job job = {.start_idx = start_idx, .end_idx = end_idx};
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        for (size_t i = 0; i < jobs_.size(); i++) {
+            const auto& other = (*fstab_)[jobs_[i].start_idx];
+            if (entry.blk_device == other.blk_device ||
+                MountPointsOverlap(entry.mount_point, other.mount_point)) {
+                job.deps.emplace_back(i);
+            }
+        }
+        jobs_.emplace_back(std::move(job));
+    }
+    cv_.notify_all();
+}
+
+int ParallelMounter::Wait() {
+    std::unique_lock<std::mutex> lock(lock_);
+    cv_.wait(lock, [this]() -> bool { return jobs_done_ == jobs_.size(); });
+
+    int error_count = error_count_;
+    jobs_.clear();
+    jobs_done_ = 0;
+    error_count_ = 0;
+    return error_count;
+}
+
+bool ParallelMounter::IsReady(const Job& job) {
+    if (job.running || job.done) {
+        return false;
+    }
+    for (auto dep : job.deps) {
+        if (!jobs_[dep].done) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ParallelMounter::ThreadLoop() {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true) {
+        Job* job = nullptr;
+        cv_.wait(lock, [&, this]() -> bool {
+            for (auto& candidate : jobs_) {
+                if (IsReady(candidate)) {
+                    job = &candidate;
+                    return true;
+                }
+            }
+            return stopped_;
+        });
+        if (!job) {
+            return;
+        }
+
+        job->running = true;
+        size_t index = job - jobs_.data();
+        Job to_run = *job;
+        lock.unlock();
+
+        RunJob(to_run);
+
+        lock.lock();
+        jobs_[index].done = true;
+        jobs_done_++;
+        cv_.notify_all();
+    }
+}
+
+void ParallelMounter::RunJob(const Job& job) {
+    int last_idx_inspected = -1;
+    int attempted_idx = -1;
+    bool mret = mount_with_alternatives(*fstab_, job.start_idx, false, &last_idx_inspected,
+                                        &attempted_idx);
+    int mount_errno = errno;
+    const auto& attempted_entry = (*fstab_)[attempted_idx];
+
+    if (mret) {
+        std::lock_guard<std::mutex> lock(overlayfs_lock_);
+        MountOverlayfs(attempted_entry, scratch_can_be_mounted_);
+        return;
+    }
+
+    // Entries which are formattable or encrypted are never mounted here, so
+    // there is nothing to retry.
+    errno = mount_errno;
+    if (attempted_entry.fs_mgr_flags.no_fail) {
+        PERROR << StringPrintf("Ignoring failure to mount partition on %s at %s options: %s",
+                               attempted_entry.blk_device.c_str(),
+                               attempted_entry.mount_point.c_str(),
+                               attempted_entry.fs_options.c_str());
+        return;
+    }
+    PERROR << StringPrintf("Failed to mount partition on %s at %s options: %s",
+                           attempted_entry.blk_device.c_str(), attempted_entry.mount_point.c_str(),
+                           attempted_entry.fs_options.c_str());
+    std::lock_guard<std::mutex> lock(lock_);
+    error_count_++;
+}
+
 // When multiple fstab records share the same mount_point, it will try to mount each
 // one in turn, and ignore any duplicates after a first successful mount.
 // Returns -1 on error, and  FS_MGR_MNTALL_* otherwise.
+//
+// If ro.fs_mgr.parallel_mount_all is set, entries which CanMountInParallel are
+// checked and mounted concurrently; see ParallelMounter.
 int fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
     int encryptable = FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE;
     int error_count = 0;
@@ -1485,6 +1686,11 @@ int fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
 
     bool scratch_can_be_mounted = true;
 
+    std::unique_ptr<ParallelMounter> parallel_mounter;
+    if (GetBoolProperty("ro.fs_mgr.parallel_mount_all", false)) {
+        parallel_mounter = std::make_unique<ParallelMounter>(fstab, &scratch_can_be_mounted);
+    }
+
     // Keep i int to prevent unsigned integer overflow from (i = top_idx - 1),
     // where top_idx is 0. It will give SIGABRT
     for (int i = 0; i < static_cast<int>(fstab->size()); i++) {
@@ -1527,6 +1733,19 @@ int fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
             continue;
         }
 
+        int last_alternative_idx = i;
+        while (last_alternative_idx + 1 < static_cast<int>(fstab->size()) &&
+               (*fstab)[last_alternative_idx + 1].mount_point == current_entry.mount_point) {
+            last_alternative_idx++;
+        }
+        const bool mount_in_parallel =
+                parallel_mounter && CanMountInParallel(*fstab, i, last_alternative_idx);
+        if (parallel_mounter && !mount_in_parallel) {
+            // Entries which can't be mounted in parallel keep their place in
+            // the fstab order.
+            error_count += parallel_mounter->Wait();
+        }
+
         // Translate LABEL= file system labels into block devices.
         if (is_extfs(current_entry.fs_type)) {
             if (!TranslateExtLabels(&current_entry)) {
@@ -1578,6 +1797,12 @@ int fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
             }
         }
 
+        if (mount_in_parallel) {
+            parallel_mounter->Mount(i, last_alternative_idx);
+            i = last_alternative_idx;
+            continue;
+        }
+
         int last_idx_inspected = -1;
         const int top_idx = i;
         int attempted_idx = -1;
@@ -1720,6 +1945,10 @@ int fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
             continue;
         }
     }
+    if (parallel_mounter) {
+        error_count += parallel_mounter->Wait();
+    }
+
     if (userdata_mounted) {
         Fstab mounted_fstab;
         if (!ReadFstabFromFile("/proc/mounts", &mounted_fstab)) {
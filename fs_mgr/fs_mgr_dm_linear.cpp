@@ -31,6 +31,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <sstream>
 
 #include <android-base/file.h>
@@ -152,10 +153,7 @@ std::unique_ptr<LpMetadata> ReadCurrentMetadata(const std::string& block_device)
 }
 
 bool CreateLogicalPartitions(const LpMetadata& metadata, const std::string& super_device) {
-    CreateLogicalPartitionParams params = {
-            .block_device = super_device,
-            .metadata = &metadata,
-    };
+    std::vector<CreateLogicalPartitionParams> params_list;
     for (const auto& partition : metadata.partitions) {
         if (!partition.num_extents) {
             LINFO << "Skipping zero-length logical partition: " << GetPartitionName(partition);
@@ -166,15 +164,15 @@ bool CreateLogicalPartitions(const LpMetadata& metadata, const std::string& supe
             continue;
         }
 
-        params.partition = &partition;
-
-        std::string ignore_path;
-        if (!CreateLogicalPartition(params, &ignore_path)) {
-            LERROR << "Could not create logical partition: " << GetPartitionName(partition);
-            return false;
-        }
+        params_list.emplace_back(CreateLogicalPartitionParams{
+                .block_device = super_device,
+                .metadata = &metadata,
+                .partition = &partition,
+        });
     }
-    return true;
+
+    std::vector<std::string> ignore_paths;
+    return CreateLogicalPartitions(params_list, &ignore_paths);
 }
 
 bool CreateLogicalPartitionParams::InitDefaults(CreateLogicalPartitionParams::OwnedData* owned) {
@@ -248,6 +246,34 @@ bool CreateLogicalPartition(CreateLogicalPartitionParams params, std::string* pa
     return true;
 }
 
+bool CreateLogicalPartitions(const std::vector<CreateLogicalPartitionParams>& params_list,
+                             std::vector<std::string>* paths) {
+    std::vector<CreateLogicalPartitionParams::OwnedData> owned_data(params_list.size());
+    std::vector<DeviceMapper::DeviceSpec> devices(params_list.size());
+    std::chrono::milliseconds timeout_ms = {};
+    for (size_t i = 0; i < params_list.size(); i++) {
+        auto params = params_list[i];
+        if (!params.InitDefaults(&owned_data[i])) return false;
+
+        devices[i].name = params.device_name;
+        if (!CreateDmTableInternal(params, &devices[i].table)) {
+            LERROR << "Could not create logical partition: " << params.GetPartitionName();
+            return false;
+        }
+        timeout_ms = std::max(timeout_ms, params.timeout_ms);
+    }
+
+    DeviceMapper& dm = DeviceMapper::Instance();
+    if (!dm.CreateDevices(devices, paths, timeout_ms)) {
+        LERROR << "Could not create " << devices.size() << " logical partitions";
+        return false;
+    }
+    for (size_t i = 0; i < devices.size(); i++) {
+        LINFO << "Created logical partition " << devices[i].name << " on device " << (*paths)[i];
+    }
+    return true;
+}
+
 std::string CreateLogicalPartitionParams::GetDeviceName() const {
     if (!device_name.empty()) return device_name;
     return GetPartitionName();
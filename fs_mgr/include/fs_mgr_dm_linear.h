@@ -100,6 +100,13 @@ struct CreateLogicalPartitionParams {
 
 bool CreateLogicalPartition(CreateLogicalPartitionParams params, std::string* path);
 
+// Create a batch of logical partitions. All devices are created before any
+// of them is waited for, and the wait uses the largest |timeout_ms| in
+// |params_list|. |paths| receives the device paths in the same order. If any
+// partition fails, none of the devices created by this call are left behind.
+bool CreateLogicalPartitions(const std::vector<CreateLogicalPartitionParams>& params_list,
+                             std::vector<std::string>* paths);
+
 // Destroy the block device for a logical partition, by name. If |timeout_ms|
 // is non-zero, then this will block until the device path has been unlinked.
 bool DestroyLogicalPartition(const std::string& name);
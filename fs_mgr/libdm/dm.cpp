@@ -178,6 +178,21 @@ static bool IsRecovery() {
     return access("/system/bin/recovery", F_OK) == 0;
 }
 
+// Old ueventd in recovery does not create the by-uuid links, so fall back to
+// waiting on the dm-N path there.
+static bool UseLegacyWaitPath() {
+    if (!IsRecovery()) {
+        return false;
+    }
+    bool non_ab_device = android::base::GetProperty("ro.build.ab_update", "").empty();
+    int sdk = android::base::GetIntProperty("ro.build.version.sdk", 0);
+    if (non_ab_device && sdk && sdk <= 29) {
+        LOG(INFO) << "Detected ueventd incompatibility, reverting to legacy libdm behavior.";
+        return true;
+    }
+    return false;
+}
+
 bool DeviceMapper::CreateEmptyDevice(const std::string& name) {
     std::string uuid = GenerateUuid();
     return CreateDevice(name, uuid);
@@ -198,13 +213,8 @@ bool DeviceMapper::WaitForDevice(const std::string& name,
         return true;
     }
 
-    if (IsRecovery()) {
-        bool non_ab_device = android::base::GetProperty("ro.build.ab_update", "").empty();
-        int sdk = android::base::GetIntProperty("ro.build.version.sdk", 0);
-        if (non_ab_device && sdk && sdk <= 29) {
-            LOG(INFO) << "Detected ueventd incompatibility, reverting to legacy libdm behavior.";
-            unique_path = *path;
-        }
+    if (UseLegacyWaitPath()) {
+        unique_path = *path;
     }
 
     if (!WaitForFile(unique_path, timeout_ms)) {
@@ -234,6 +244,57 @@ bool DeviceMapper::CreateDevice(const std::string& name, const DmTable& table, s
     return true;
 }
 
+bool DeviceMapper::CreateDevices(const std::vector<DeviceSpec>& devices,
+                                 std::vector<std::string>* paths,
+                                 const std::chrono::milliseconds& timeout_ms) {
+    std::vector<std::string> created;
+    auto cleanup = [&, this]() -> bool {
+        for (const auto& name : created) {
+            DeleteDevice(name);
+        }
+        return false;
+    };
+
+    // Create and activate everything before waiting, so that ueventd can
+    // work through the whole batch while we block once.
+    for (const auto& device : devices) {
+        if (!CreateEmptyDevice(device.name)) {
+            return cleanup();
+        }
+        created.emplace_back(device.name);
+
+        if (!LoadTableAndActivate(device.name, device.table)) {
+            return cleanup();
+        }
+    }
+
+    paths->clear();
+    std::vector<std::string> wait_paths;
+    bool legacy = timeout_ms > std::chrono::milliseconds::zero() && UseLegacyWaitPath();
+    for (const auto& device : devices) {
+        std::string unique_path, path;
+        if (!GetDeviceUniquePath(device.name, &unique_path) ||
+            !GetDmDevicePathByName(device.name, &path)) {
+            return cleanup();
+        }
+        wait_paths.emplace_back(legacy ? path : unique_path);
+        paths->emplace_back(path);
+    }
+
+    if (timeout_ms <= std::chrono::milliseconds::zero()) {
+        return true;
+    }
+    if (!WaitForFiles(wait_paths, timeout_ms)) {
+        for (const auto& path : wait_paths) {
+            if (access(path.c_str(), F_OK) != 0) {
+                LOG(ERROR) << "Failed waiting for device path: " << path;
+            }
+        }
+        return cleanup();
+    }
+    return true;
+}
+
 bool DeviceMapper::GetDeviceUniquePath(const std::string& name, std::string* path) {
     struct dm_ioctl io;
     InitIo(&io, name);
@@ -562,26 +623,10 @@ void RedactTableInfo(const struct dm_target_spec& spec, std::string* data) {
     }
 }
 
-// private methods of DeviceMapper
-bool DeviceMapper::GetTable(const std::string& name, uint32_t flags,
-                            std::vector<TargetInfo>* table) {
-    std::vector<char> buffer;
-    struct dm_ioctl* io = nullptr;
-
-    for (buffer.resize(4096);; buffer.resize(buffer.size() * 2)) {
-        io = reinterpret_cast<struct dm_ioctl*>(&buffer[0]);
-
-        InitIo(io, name);
-        io->data_size = buffer.size();
-        io->data_start = sizeof(*io);
-        io->flags = flags;
-        if (ioctl(fd_, DM_TABLE_STATUS, io) < 0) {
-            PLOG(ERROR) << "DM_TABLE_STATUS failed for " << name;
-            return false;
-        }
-        if (!(io->flags & DM_BUFFER_FULL_FLAG)) break;
-    }
-
+// Parses the targets returned by DM_TABLE_STATUS into |buffer|.
+static void ParseTargets(const std::vector<char>& buffer, uint32_t flags,
+                         std::vector<DeviceMapper::TargetInfo>* table) {
+    const struct dm_ioctl* io = reinterpret_cast<const struct dm_ioctl*>(&buffer[0]);
     uint32_t cursor = io->data_start;
     uint32_t data_end = std::min(io->data_size, uint32_t(buffer.size()));
     for (uint32_t i = 0; i < io->target_count; i++) {
@@ -591,7 +636,8 @@ bool DeviceMapper::GetTable(const std::string& name, uint32_t flags,
         // After each dm_target_spec is a status string. spec->next is an
         // offset from |io->data_start|, and we clamp it to the size of our
         // buffer.
-        struct dm_target_spec* spec = reinterpret_cast<struct dm_target_spec*>(&buffer[cursor]);
+        const struct dm_target_spec* spec =
+                reinterpret_cast<const struct dm_target_spec*>(&buffer[cursor]);
         uint32_t data_offset = cursor + sizeof(dm_target_spec);
         uint32_t next_cursor = std::min(io->data_start + spec->next, data_end);
 
@@ -606,9 +652,94 @@ bool DeviceMapper::GetTable(const std::string& name, uint32_t flags,
         table->emplace_back(*spec, data);
         cursor = next_cursor;
     }
+}
+
+bool DeviceMapper::QueryDevices(uint32_t flags, DmDeviceSnapshot* devices) {
+    std::vector<DmBlockDevice> block_devices;
+    if (!GetAvailableDevices(&block_devices)) {
+        return false;
+    }
+
+    *devices = DmDeviceSnapshot(flags);
+    std::vector<char> buffer;
+    for (const auto& block_device : block_devices) {
+        DmDeviceSnapshot::Device device;
+        device.name = block_device.name();
+        device.dev = makedev(block_device.Major(), block_device.Minor());
+
+        // DM_TABLE_STATUS reports the device flags and uuid along with the
+        // status or table, so the state never needs a DM_DEV_STATUS of its own.
+        std::vector<uint32_t> queries;
+        if (flags & (kDmQueryState | kDmQueryStatus)) {
+            queries.emplace_back(0);
+        }
+        if (flags & kDmQueryTable) {
+            queries.emplace_back(DM_STATUS_TABLE_FLAG);
+        }
+
+        bool removed = false;
+        for (uint32_t query : queries) {
+            struct dm_ioctl* io = TableStatus(device.name, query, &buffer);
+            if (!io) {
+                if (errno == ENXIO) {
+                    // Removed since it was listed.
+                    removed = true;
+                    break;
+                }
+                PLOG(ERROR) << "DM_TABLE_STATUS failed for " << device.name;
+                return false;
+            }
+            device.uuid = io->uuid;
+            device.dev = io->dev;
+            device.flags = io->flags & ~DM_STATUS_TABLE_FLAG;
+            if (query & DM_STATUS_TABLE_FLAG) {
+                ParseTargets(buffer, query, &device.table);
+            } else if (flags & kDmQueryStatus) {
+                ParseTargets(buffer, query, &device.status);
+            }
+        }
+        if (!removed) {
+            devices->AddDevice(std::move(device));
+        }
+    }
     return true;
 }
 
+// private methods of DeviceMapper
+bool DeviceMapper::GetTable(const std::string& name, uint32_t flags,
+                            std::vector<TargetInfo>* table) {
+    std::vector<char> buffer;
+    if (!TableStatus(name, flags, &buffer)) {
+        PLOG(ERROR) << "DM_TABLE_STATUS failed for " << name;
+        return false;
+    }
+    ParseTargets(buffer, flags, table);
+    return true;
+}
+
+// Issues DM_TABLE_STATUS for |name|, growing |buffer| until the result fits.
+// Returns the ioctl header at the start of |buffer|, or nullptr with errno set.
+struct dm_ioctl* DeviceMapper::TableStatus(const std::string& name, uint32_t flags,
+                                           std::vector<char>* buffer) {
+    if (buffer->size() < 4096) {
+        buffer->resize(4096);
+    }
+    for (;; buffer->resize(buffer->size() * 2)) {
+        struct dm_ioctl* io = reinterpret_cast<struct dm_ioctl*>(buffer->data());
+
+        InitIo(io, name);
+        io->data_size = buffer->size();
+        io->data_start = sizeof(*io);
+        io->flags = flags;
+        if (ioctl(fd_, DM_TABLE_STATUS, io) < 0) {
+            return nullptr;
+        }
+        if (!(io->flags & DM_BUFFER_FULL_FLAG)) {
+            return io;
+        }
+    }
+}
+
 void DeviceMapper::InitIo(struct dm_ioctl* io, const std::string& name) const {
     CHECK(io != nullptr) << "nullptr passed to dm_ioctl initialization";
     memset(io, 0, sizeof(*io));
@@ -803,5 +934,49 @@ bool DeviceMapper::SendMessage(const std::string& name, uint64_t sector,
     return true;
 }
 
+const DmDeviceSnapshot::Device* DmDeviceSnapshot::Find(const std::string& name) const {
+    auto iter = index_.find(name);
+    if (iter == index_.end()) {
+        return nullptr;
+    }
+    return &devices_[iter->second];
+}
+
+DmDeviceState DmDeviceSnapshot::GetState(const std::string& name) const {
+    auto device = Find(name);
+    if (!device || !(query_flags_ & (kDmQueryState | kDmQueryStatus | kDmQueryTable))) {
+        return DmDeviceState::INVALID;
+    }
+    if ((device->flags & DM_ACTIVE_PRESENT_FLAG) && !(device->flags & DM_SUSPEND_FLAG)) {
+        return DmDeviceState::ACTIVE;
+    }
+    return DmDeviceState::SUSPENDED;
+}
+
+bool DmDeviceSnapshot::GetTableStatus(const std::string& name,
+                                      std::vector<IDeviceMapper::TargetInfo>* table) const {
+    auto device = Find(name);
+    if (!device || !(query_flags_ & kDmQueryStatus)) {
+        return false;
+    }
+    *table = device->status;
+    return true;
+}
+
+bool DmDeviceSnapshot::GetTableInfo(const std::string& name,
+                                    std::vector<IDeviceMapper::TargetInfo>* table) const {
+    auto device = Find(name);
+    if (!device || !(query_flags_ & kDmQueryTable)) {
+        return false;
+    }
+    *table = device->table;
+    return true;
+}
+
+void DmDeviceSnapshot::AddDevice(Device&& device) {
+    index_[device.name] = devices_.size();
+    devices_.emplace_back(std::move(device));
+}
+
 }  // namespace dm
 }  // namespace android
@@ -763,6 +763,107 @@ TEST_F(DmTest, UeventAfterLoadTable) {
     ASSERT_TRUE(dm.DeleteDevice(test_name_));
 }
 
+TEST_F(DmTest, CreateDevices) {
+    std::vector<DeviceMapper::DeviceSpec> devices(3);
+    for (size_t i = 0; i < devices.size(); i++) {
+        devices[i].name = test_name_ + "-" + std::to_string(i);
+        ASSERT_TRUE(devices[i].table.Emplace<DmTargetError>(0, 1));
+    }
+
+    auto& dm = DeviceMapper::Instance();
+    auto guard = make_scope_guard([&]() {
+        for (const auto& device : devices) {
+            dm.DeleteDeviceIfExists(device.name, 5s);
+        }
+    });
+
+    std::vector<std::string> paths;
+    ASSERT_TRUE(dm.CreateDevices(devices, &paths, 5s));
+    ASSERT_EQ(paths.size(), devices.size());
+    for (size_t i = 0; i < devices.size(); i++) {
+        std::string path;
+        ASSERT_TRUE(dm.GetDmDevicePathByName(devices[i].name, &path));
+        ASSERT_EQ(paths[i], path);
+        ASSERT_EQ(dm.GetState(devices[i].name), DmDeviceState::ACTIVE);
+
+        std::string unique_path;
+        ASSERT_TRUE(dm.GetDeviceUniquePath(devices[i].name, &unique_path));
+        ASSERT_EQ(0, access(unique_path.c_str(), F_OK));
+    }
+}
+
+TEST_F(DmTest, CreateDevicesCleansUpOnFailure) {
+    std::vector<DeviceMapper::DeviceSpec> devices(2);
+    devices[0].name = test_name_ + "-0";
+    ASSERT_TRUE(devices[0].table.Emplace<DmTargetError>(0, 1));
+    // An empty table cannot be activated.
+    devices[1].name = test_name_ + "-1";
+
+    auto& dm = DeviceMapper::Instance();
+    std::vector<std::string> paths;
+    ASSERT_FALSE(dm.CreateDevices(devices, &paths, 5s));
+    ASSERT_EQ(dm.GetState(devices[0].name), DmDeviceState::INVALID);
+    ASSERT_EQ(dm.GetState(devices[1].name), DmDeviceState::INVALID);
+}
+
+TEST_F(DmTest, QueryDevices) {
+    std::vector<DeviceMapper::DeviceSpec> devices(2);
+    for (size_t i = 0; i < devices.size(); i++) {
+        devices[i].name = test_name_ + "-" + std::to_string(i);
+        ASSERT_TRUE(devices[i].table.Emplace<DmTargetError>(0, i + 1));
+    }
+
+    auto& dm = DeviceMapper::Instance();
+    auto guard = make_scope_guard([&]() {
+        for (const auto& device : devices) {
+            dm.DeleteDeviceIfExists(device.name, 5s);
+        }
+    });
+    std::vector<std::string> paths;
+    ASSERT_TRUE(dm.CreateDevices(devices, &paths, 5s));
+    ASSERT_TRUE(dm.ChangeState(devices[1].name, DmDeviceState::SUSPENDED));
+
+    DmDeviceSnapshot snapshot;
+    ASSERT_TRUE(dm.QueryDevices(kDmQueryStatus | kDmQueryTable, &snapshot));
+    for (size_t i = 0; i < devices.size(); i++) {
+        const auto& name = devices[i].name;
+        auto device = snapshot.Find(name);
+        ASSERT_NE(device, nullptr);
+
+        // The snapshot must agree with the per-device queries.
+        std::string uuid;
+        ASSERT_TRUE(dm.GetDmDeviceUuidByName(name, &uuid));
+        EXPECT_EQ(device->uuid, uuid);
+        dev_t dev;
+        ASSERT_TRUE(dm.GetDeviceNumber(name, &dev));
+        EXPECT_EQ(device->dev, dev);
+        EXPECT_EQ(snapshot.GetState(name), dm.GetState(name));
+
+        std::vector<DeviceMapper::TargetInfo> expected, actual;
+        ASSERT_TRUE(dm.GetTableStatus(name, &expected));
+        ASSERT_TRUE(snapshot.GetTableStatus(name, &actual));
+        ASSERT_EQ(actual.size(), 1);
+        EXPECT_EQ(DeviceMapper::GetTargetType(actual[0].spec), "error");
+        EXPECT_EQ(actual[0].spec.length, i + 1);
+        EXPECT_EQ(actual[0].data, expected[0].data);
+
+        ASSERT_TRUE(snapshot.GetTableInfo(name, &actual));
+        ASSERT_EQ(actual.size(), 1);
+        EXPECT_EQ(DeviceMapper::GetTargetType(actual[0].spec), "error");
+    }
+    EXPECT_EQ(snapshot.GetState(devices[0].name), DmDeviceState::ACTIVE);
+    EXPECT_EQ(snapshot.GetState(devices[1].name), DmDeviceState::SUSPENDED);
+    EXPECT_EQ(snapshot.Find(test_name_ + "-missing"), nullptr);
+    EXPECT_EQ(snapshot.GetState(test_name_ + "-missing"), DmDeviceState::INVALID);
+
+    // Only what was asked for is available.
+    ASSERT_TRUE(dm.QueryDevices(kDmQueryState, &snapshot));
+    std::vector<DeviceMapper::TargetInfo> targets;
+    EXPECT_EQ(snapshot.GetState(devices[0].name), DmDeviceState::ACTIVE);
+    EXPECT_FALSE(snapshot.GetTableStatus(devices[0].name, &targets));
+    EXPECT_FALSE(snapshot.GetTableInfo(devices[0].name, &targets));
+}
+
 TEST_F(DmTest, GetNameAndUuid) {
     auto& dm = DeviceMapper::Instance();
     ASSERT_TRUE(dm.CreatePlaceholderDevice(test_name_));
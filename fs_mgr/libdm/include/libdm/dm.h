@@ -32,6 +32,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -56,6 +57,8 @@ static constexpr uint64_t kSectorSize = 512;
 // Or, if `path` is a symlink, do the same with its real path.
 std::optional<std::string> ExtractBlockDeviceName(const std::string& path);
 
+class DmDeviceSnapshot;
+
 // This interface is for testing purposes. See DeviceMapper proper for what these methods do.
 class IDeviceMapper {
   public:
@@ -82,6 +85,55 @@ class IDeviceMapper {
     virtual bool GetDmDevicePathByName(const std::string& name, std::string* path) = 0;
     virtual bool GetDeviceString(const std::string& name, std::string* dev) = 0;
     virtual bool DeleteDeviceIfExists(const std::string& name) = 0;
+    virtual bool QueryDevices(uint32_t flags, DmDeviceSnapshot* devices) = 0;
+};
+
+// Flags for QueryDevices(), selecting what is fetched for each device.
+enum DmQueryFlags : uint32_t {
+    // State flags and uuid, as returned by GetDetailedInfo() and GetState().
+    kDmQueryState = 1 << 0,
+    // Target status, as returned by GetTableStatus().
+    kDmQueryStatus = 1 << 1,
+    // Active table, as returned by GetTableInfo().
+    kDmQueryTable = 1 << 2,
+};
+
+// A point-in-time view of every device-mapper device, filled by
+// QueryDevices(). It is never refreshed: callers should query again rather
+// than keep it across changes they make to the devices.
+class DmDeviceSnapshot {
+  public:
+    struct Device {
+        std::string name;
+        std::string uuid;
+        dev_t dev = 0;
+        // DM_*_FLAG bits reported by the kernel.
+        uint32_t flags = 0;
+        std::vector<IDeviceMapper::TargetInfo> status;
+        std::vector<IDeviceMapper::TargetInfo> table;
+    };
+
+    explicit DmDeviceSnapshot(uint32_t query_flags = 0) : query_flags_(query_flags) {}
+
+    uint32_t query_flags() const { return query_flags_; }
+    const std::vector<Device>& devices() const { return devices_; }
+
+    // Returns nullptr if there was no device named |name|.
+    const Device* Find(const std::string& name) const;
+
+    // These answer like the DeviceMapper methods of the same names. They fail
+    // if the device did not exist or its status or table was not queried.
+    DmDeviceState GetState(const std::string& name) const;
+    bool GetTableStatus(const std::string& name,
+                        std::vector<IDeviceMapper::TargetInfo>* table) const;
+    bool GetTableInfo(const std::string& name, std::vector<IDeviceMapper::TargetInfo>* table) const;
+
+    void AddDevice(Device&& device);
+
+  private:
+    uint32_t query_flags_;
+    std::vector<Device> devices_;
+    std::unordered_map<std::string, size_t> index_;
 };
 
 class DeviceMapper final : public IDeviceMapper {
@@ -189,6 +241,21 @@ class DeviceMapper final : public IDeviceMapper {
     bool CreateDevice(const std::string& name, const DmTable& table, std::string* path,
                       const std::chrono::milliseconds& timeout_ms) override;
 
+    struct DeviceSpec {
+        std::string name;
+        DmTable table;
+    };
+
+    // Same as the CreateDevice variant above, for a batch of devices. All of
+    // the devices are created and activated before waiting, and their paths
+    // are then waited for together, so the uevents of the whole batch are
+    // processed while the caller blocks only once. On success, |paths|
+    // contains the dm-N path of each device, in the order of |devices|. If
+    // any device fails to be created or does not appear within |timeout_ms|,
+    // every device created by this call is deleted and false is returned.
+    bool CreateDevices(const std::vector<DeviceSpec>& devices, std::vector<std::string>* paths,
+                       const std::chrono::milliseconds& timeout_ms);
+
     // Create a device and activate the given table, without waiting to acquire
     // a valid path. If the caller will use GetDmDevicePathByName(), it should
     // use the timeout variant above.
@@ -278,6 +345,13 @@ class DeviceMapper final : public IDeviceMapper {
     // mapper device from the kernel.
     bool GetTableInfo(const std::string& name, std::vector<TargetInfo>* table) override;
 
+    // Fetches the state of all devices at once, rather than device by device:
+    // one DM_LIST_DEVICES, then one DM_TABLE_STATUS per device for each of
+    // kDmQueryStatus and kDmQueryTable in |flags| (or one for kDmQueryState
+    // alone). With no flags, only the names and device numbers are filled in.
+    // Devices removed while this runs are left out.
+    bool QueryDevices(uint32_t flags, DmDeviceSnapshot* devices) override;
+
     static std::string GetTargetType(const struct dm_target_spec& spec);
 
     // Returns true if given path is a path to a dm block device.
@@ -324,6 +398,8 @@ class DeviceMapper final : public IDeviceMapper {
 
     bool CreateDevice(const std::string& name, const std::string& uuid = {});
     bool GetTable(const std::string& name, uint32_t flags, std::vector<TargetInfo>* table);
+    struct dm_ioctl* TableStatus(const std::string& name, uint32_t flags,
+                                 std::vector<char>* buffer);
     void InitIo(struct dm_ioctl* io, const std::string& name = std::string()) const;
 
     DeviceMapper();
@@ -58,6 +58,29 @@ bool WaitForFile(const std::string& path, const std::chrono::milliseconds& timeo
     return WaitForCondition(condition, timeout_ms);
 }
 
+// Waits for all of |paths| within a single |timeout_ms| window. Paths are
+// dropped from the set as they show up, so each poll only checks the ones
+// still missing.
+bool WaitForFiles(const std::vector<std::string>& paths,
+                  const std::chrono::milliseconds& timeout_ms) {
+    std::vector<std::string> pending = paths;
+    auto condition = [&]() -> WaitResult {
+        for (auto iter = pending.begin(); iter != pending.end();) {
+            if (access(iter->c_str(), F_OK) != 0) {
+                if (errno == ENOENT) {
+                    iter++;
+                    continue;
+                }
+                PLOG(ERROR) << "access failed: " << *iter;
+                return WaitResult::Fail;
+            }
+            iter = pending.erase(iter);
+        }
+        return pending.empty() ? WaitResult::Done : WaitResult::Wait;
+    };
+    return WaitForCondition(condition, timeout_ms);
+}
+
 bool WaitForFileDeleted(const std::string& path, const std::chrono::milliseconds& timeout_ms) {
     auto condition = [&]() -> WaitResult {
         if (access(path.c_str(), F_OK) == 0) {
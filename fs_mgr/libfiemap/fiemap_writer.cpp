@@ -20,6 +20,8 @@
 #include <fcntl.h>
 #include <linux/fs.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
@@ -27,6 +29,7 @@
 #include <sys/vfs.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <limits>
 #include <string>
 #include <utility>
@@ -383,9 +386,9 @@ static bool PinFile(int file_fd, const std::string& file_path, uint32_t fs_type)
 // write zeroes in 'blocksz' byte increments until we reach file_size to make sure the data
 // blocks are actually written to by the file system and thus getting rid of the holes in the
 // file.
-static FiemapStatus WriteZeroes(int file_fd, const std::string& file_path, size_t blocksz,
-                                uint64_t file_size,
-                                const std::function<bool(uint64_t, uint64_t)>& on_progress) {
+FiemapStatus WriteZeroes(int file_fd, const std::string& file_path, size_t blocksz,
+                         uint64_t file_size,
+                         const std::function<bool(uint64_t, uint64_t)>& on_progress) {
     auto buffer = std::unique_ptr<void, decltype(&free)>(calloc(1, blocksz), free);
     if (buffer == nullptr) {
         LOG(ERROR) << "failed to allocate memory for writing file";
@@ -426,6 +429,65 @@ static FiemapStatus WriteZeroes(int file_fd, const std::string& file_path, size_
     return FiemapStatus::Ok();
 }
 
+// Same as WriteZeroes, but with large O_DIRECT writes through a separate file
+// descriptor. The writes still go through the file system, so the extents are
+// converted to written ones, but the data bypasses the page cache and each
+// syscall covers kDirectWriteSize bytes rather than a single block. If direct
+// I/O is not available for the file, |supported| is set to false and nothing
+// is written.
+FiemapStatus WriteZeroesDirect(const std::string& file_path, size_t blocksz, uint64_t file_size,
+                               const std::function<bool(uint64_t, uint64_t)>& on_progress,
+                               bool* supported) {
+    *supported = false;
+    if (blocksz > kDirectWriteSize || kDirectWriteSize % blocksz) {
+        return FiemapStatus::Ok();
+    }
+
+    android::base::unique_fd fd(
+            TEMP_FAILURE_RETRY(open(file_path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC)));
+    if (fd < 0) {
+        PLOG(INFO) << "Could not open " << file_path << " for direct I/O";
+        return FiemapStatus::Ok();
+    }
+
+    void* ptr;
+    if (posix_memalign(&ptr, std::max(blocksz, size_t(4096)), kDirectWriteSize)) {
+        LOG(ERROR) << "failed to allocate memory for writing file";
+        return FiemapStatus::Error();
+    }
+    auto buffer = std::unique_ptr<void, decltype(&free)>(ptr, free);
+    memset(buffer.get(), 0, kDirectWriteSize);
+
+    uint64_t offset = 0;
+    int permille = -1;
+    while (offset < file_size) {
+        size_t to_write = std::min(static_cast<uint64_t>(kDirectWriteSize), file_size - offset);
+        ssize_t rv = TEMP_FAILURE_RETRY(pwrite64(fd.get(), buffer.get(), to_write, offset));
+        if (rv < 0 && errno == EINVAL && offset == 0) {
+            // Some configurations (e.g. file encryption without inline
+            // crypto on older kernels) reject direct I/O on the write itself.
+            PLOG(INFO) << "Direct I/O not supported for " << file_path;
+            return FiemapStatus::Ok();
+        }
+        if (rv <= 0) {
+            PLOG(ERROR) << "Failed to write " << to_write << " bytes at offset " << offset
+                        << " in file " << file_path;
+            return rv < 0 ? FiemapStatus::FromErrno(errno) : FiemapStatus::Error();
+        }
+        *supported = true;
+        offset += rv;
+
+        int new_permille = (offset * 1000) / file_size;
+        if (new_permille != permille && offset != file_size) {
+            if (on_progress && !on_progress(offset, file_size)) {
+                return FiemapStatus::Error();
+            }
+            permille = new_permille;
+        }
+    }
+    return FiemapStatus::Ok();
+}
+
 // Reserve space for the file on the file system and write it out to make sure the extents
 // don't come back unwritten. Return from this function with the kernel file offset set to 0.
 // If the filesystem is f2fs, then we also PIN the file on disk to make sure the blocks
@@ -490,10 +552,17 @@ static FiemapStatus AllocateFile(int file_fd, const std::string& file_path, uint
     }
 
     if (need_explicit_writes) {
-        auto status = WriteZeroes(file_fd, file_path, blocksz, file_size, on_progress);
+        bool direct = false;
+        auto status = WriteZeroesDirect(file_path, blocksz, file_size, on_progress, &direct);
         if (!status.is_ok()) {
             return status;
         }
+        if (!direct) {
+            status = WriteZeroes(file_fd, file_path, blocksz, file_size, on_progress);
+            if (!status.is_ok()) {
+                return status;
+            }
+        }
     }
 
     // flush all writes here ..
@@ -0,0 +1,100 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <storage_literals/storage_literals.h>
+
+#include "utility.h"
+
+namespace android {
+namespace fiemap {
+
+using android::base::unique_fd;
+using namespace android::storage_literals;
+
+// Compares the two ways AllocateFile() can write out an fallocated file.
+// Run on the filesystem that holds images, e.g. with TMPDIR=/data/local/tmp.
+static void BM_WriteZeroes(benchmark::State& state, bool direct) {
+    const uint64_t file_size = state.range(0);
+
+    TemporaryDir dir;
+    std::string path = std::string(dir.path) + "/image";
+
+    struct statfs sfs;
+    if (statfs(dir.path, &sfs)) {
+        state.SkipWithError("statfs failed");
+        return;
+    }
+    size_t blocksz = sfs.f_bsize;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        unique_fd fd(open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0600));
+        if (fd < 0 || fallocate(fd, 0, 0, file_size)) {
+            state.SkipWithError("Failed to create image file");
+            return;
+        }
+        fsync(fd);
+        state.ResumeTiming();
+
+        bool supported = false;
+        auto status = FiemapStatus::Ok();
+        if (direct) {
+            status = WriteZeroesDirect(path, blocksz, file_size, {}, &supported);
+            if (status.is_ok() && !supported) {
+                state.SkipWithError("Direct I/O is not supported here");
+                return;
+            }
+        } else {
+            status = WriteZeroes(fd, path, blocksz, file_size, {});
+        }
+        if (!status.is_ok() || fsync(fd)) {
+            state.SkipWithError("Failed to write image file");
+            return;
+        }
+
+        state.PauseTiming();
+        fd = {};
+        unlink(path.c_str());
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(state.iterations() * file_size);
+}
+
+BENCHMARK_CAPTURE(BM_WriteZeroes, buffered, false)
+        ->Arg(64_MiB)
+        ->Arg(256_MiB)
+        ->Arg(1_GiB)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+BENCHMARK_CAPTURE(BM_WriteZeroes, direct, true)
+        ->Arg(64_MiB)
+        ->Arg(256_MiB)
+        ->Arg(1_GiB)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+}  // namespace fiemap
+}  // namespace android
+
+BENCHMARK_MAIN();
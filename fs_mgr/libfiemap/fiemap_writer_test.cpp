@@ -150,6 +150,47 @@ TEST_F(FiemapWriterTest, CheckProgress) {
     EXPECT_EQ(invocations, expected.size());
 }
 
+TEST_F(FiemapWriterTest, CheckProgressLargeFile) {
+    // Large enough to need several direct writes.
+    const uint64_t size = 16_MiB;
+    uint64_t last = 0;
+    size_t invocations = 0;
+    auto callback = [&](uint64_t done, uint64_t total) -> bool {
+        EXPECT_GT(done, last);
+        EXPECT_LE(done, total);
+        EXPECT_EQ(total, size);
+        last = done;
+        invocations++;
+        return true;
+    };
+
+    auto ptr = FiemapWriter::Open(testfile, size, true, std::move(callback));
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_GT(invocations, 1);
+    EXPECT_EQ(last, size);
+}
+
+TEST_F(FiemapWriterTest, WriteZeroesDirect) {
+    unique_fd fd(open(testfile.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600));
+    ASSERT_GE(fd, 0);
+    const uint64_t size = 4_MiB;
+    ASSERT_EQ(fallocate(fd, 0, 0, size), 0);
+
+    bool supported = false;
+    ASSERT_TRUE(WriteZeroesDirect(testfile, gBlockSize, size, {}, &supported).is_ok());
+    if (!supported) {
+        GTEST_SKIP() << "Direct I/O is not supported for " << testfile;
+    }
+
+    struct stat s;
+    ASSERT_EQ(fstat(fd, &s), 0);
+    EXPECT_EQ(static_cast<uint64_t>(s.st_size), size);
+
+    std::string data(size, 'x');
+    ASSERT_TRUE(android::base::ReadFullyAtOffset(fd, data.data(), data.size(), 0));
+    EXPECT_EQ(data, std::string(size, '\0'));
+}
+
 TEST_F(FiemapWriterTest, CheckPinning) {
     auto ptr = FiemapWriter::Open(testfile, 4096);
     ASSERT_NE(ptr, nullptr);
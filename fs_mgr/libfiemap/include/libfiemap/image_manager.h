@@ -59,7 +59,7 @@ class IImageManager {
     // is true, the image will be zero-filled. Otherwise, the initial content
     // of the image is undefined. If zero-fill is requested, and the operation
     // cannot be completed, the image will be deleted and this function will
-    // return false.
+    // return false. Images with different names may be created concurrently.
     virtual FiemapStatus CreateBackingImage(
             const std::string& name, uint64_t size, int flags,
             std::function<bool(uint64_t, uint64_t)>&& on_progress = nullptr) = 0;
@@ -20,6 +20,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <mutex>
+
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <liblp/builder.h>
@@ -34,6 +36,10 @@ using android::base::unique_fd;
 
 static constexpr uint32_t kMaxMetadataSize = 256 * 1024;
 
+// Serializes read-modify-write cycles of the metadata file, so that several
+// images can be created or removed from different threads at once.
+static std::mutex metadata_lock;
+
 std::string GetMetadataFile(const std::string& metadata_dir) {
     return JoinPaths(metadata_dir, "lp_metadata");
 }
@@ -165,6 +171,7 @@ bool FillPartitionExtents(MetadataBuilder* builder, Partition* partition, SplitF
 }
 
 bool RemoveImageMetadata(const std::string& metadata_dir, const std::string& partition_name) {
+    std::lock_guard<std::mutex> guard(metadata_lock);
     if (!MetadataExists(metadata_dir)) {
         return true;
     }
@@ -184,6 +191,7 @@ bool RemoveImageMetadata(const std::string& metadata_dir, const std::string& par
 
 bool UpdateMetadata(const std::string& metadata_dir, const std::string& partition_name,
                     SplitFiemap* file, uint64_t partition_size, bool readonly) {
+    std::lock_guard<std::mutex> guard(metadata_lock);
     auto builder = OpenOrCreateMetadata(metadata_dir, file);
     if (!builder) {
         return false;
@@ -208,6 +216,7 @@ bool UpdateMetadata(const std::string& metadata_dir, const std::string& partitio
 
 bool AddAttributes(const std::string& metadata_dir, const std::string& partition_name,
                    uint32_t attributes) {
+    std::lock_guard<std::mutex> guard(metadata_lock);
     auto metadata = OpenMetadata(metadata_dir);
     if (!metadata) {
         return false;
@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 
+#include <functional>
 #include <string>
 
 #include <libfiemap/split_fiemap_writer.h>
@@ -51,6 +52,22 @@ bool BlockDeviceToName(uint32_t major, uint32_t minor, std::string* bdev_name);
 // cases (such as snapshots or adb remount).
 bool FilesystemHasReliablePinning(const std::string& file, bool* supported);
 
+// Size of each write when WriteZeroesDirect initializes a file.
+static constexpr size_t kDirectWriteSize = 1024 * 1024;
+
+// Write zeroes over the first |file_size| bytes of an fallocated file, so
+// that none of its extents are left unwritten. WriteZeroes uses buffered
+// |blocksz| writes on |file_fd|. WriteZeroesDirect uses kDirectWriteSize
+// O_DIRECT writes, and sets |supported| to false without writing anything if
+// direct I/O cannot be used for the file. These are used by FiemapWriter, and
+// exposed for benchmarking.
+FiemapStatus WriteZeroes(int file_fd, const std::string& file_path, size_t blocksz,
+                         uint64_t file_size,
+                         const std::function<bool(uint64_t, uint64_t)>& on_progress);
+FiemapStatus WriteZeroesDirect(const std::string& file_path, size_t blocksz, uint64_t file_size,
+                               const std::function<bool(uint64_t, uint64_t)>& on_progress,
+                               bool* supported);
+
 // Crude implementation to check if |child| is a subdir of |parent|.
 // Assume both are absolute paths.
 bool IsSubdir(const std::string& child, const std::string& parent);
@@ -18,8 +18,10 @@
 
 #include <fcntl.h>
 #include <libgen.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <algorithm>
@@ -181,6 +183,81 @@ bool AvbVerifier::VerifyVbmetaImages(const std::vector<VBMetaData>& vbmeta_image
     return true;
 }
 
+// vbmeta cache
+// ------------
+// Serialized form of the vbmeta chain verified by AvbHandle::Open(), written by
+// first-stage init to tmpfs for later stages. All values are in host byte
+// order, as the cache never leaves the device that wrote it:
+//   VbmetaCacheHeader
+//   slot suffix:   uint32 length + bytes
+//   for each image:
+//     partition name: uint32 length + bytes
+//     block device:   uint64 st_rdev, 0 if there is no by-name node
+//     vbmeta image:   uint64 length + bytes
+static constexpr uint32_t kVbmetaCacheMagic = 0x43425641;  // "AVBC"
+static constexpr uint32_t kVbmetaCacheVersion = 2;
+
+// The handle status is not stored: nothing authenticates it. It is derived
+// again from the digest-checked images when the cache is loaded.
+struct VbmetaCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t allow_verification_error;
+    uint32_t num_images;
+};
+
+// Identifies the block device a partition was loaded from, so that a cache
+// made before partitions were remapped is not reused.
+static uint64_t GetPartitionDeviceId(const std::string& partition_name,
+                                     const std::string& slot_suffix) {
+    for (const auto& name : {partition_name + slot_suffix, partition_name}) {
+        struct stat st;
+        if (stat(("/dev/block/by-name/" + name).c_str(), &st) == 0 && S_ISBLK(st.st_mode)) {
+            return st.st_rdev;
+        }
+    }
+    return 0;
+}
+
+template <typename T>
+static void AppendValue(std::string* out, const T& value) {
+    out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename Length>
+static void AppendBytes(std::string* out, const void* data, Length size) {
+    AppendValue(out, size);
+    out->append(reinterpret_cast<const char*>(data), size);
+}
+
+class VbmetaCacheReader {
+  public:
+    explicit VbmetaCacheReader(const std::string& data) : data_(data) {}
+
+    template <typename T>
+    bool ReadValue(T* value) {
+        if (data_.size() - pos_ < sizeof(*value)) return false;
+        memcpy(value, data_.data() + pos_, sizeof(*value));
+        pos_ += sizeof(*value);
+        return true;
+    }
+
+    template <typename Length>
+    bool ReadBytes(std::string* out, size_t max_size) {
+        Length size;
+        if (!ReadValue(&size) || size > max_size || data_.size() - pos_ < size) return false;
+        out->assign(data_, pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    bool done() const { return pos_ == data_.size(); }
+
+  private:
+    const std::string& data_;
+    size_t pos_ = 0;
+};
+
 // class AvbHandle
 // ---------------
 AvbHandle::AvbHandle() : status_(AvbHandleStatus::kUninitialized) {
@@ -450,8 +527,139 @@ AvbUniquePtr AvbHandle::LoadAndVerifyVbmeta(const std::string& slot_suffix) {
                                nullptr /* custom_device_path */);
 }
 
+bool AvbHandle::SaveToCache(const std::string& path) const {
+    if (status_ == AvbHandleStatus::kUninitialized || vbmeta_images_.empty()) {
+        LERROR << "No verified vbmeta images to cache";
+        return false;
+    }
+    // A verification error can't be told apart from success by the digest
+    // check in LoadFromCache(), so such chains are verified again each time.
+    if (status_ == AvbHandleStatus::kVerificationError) {
+        LINFO << "Not caching vbmeta images with verification errors";
+        return false;
+    }
+
+    VbmetaCacheHeader header = {
+            .magic = kVbmetaCacheMagic,
+            .version = kVbmetaCacheVersion,
+            .allow_verification_error = IsAvbPermissive(),
+            .num_images = static_cast<uint32_t>(vbmeta_images_.size()),
+    };
+    std::string data;
+    AppendValue(&data, header);
+    AppendBytes(&data, slot_suffix_.data(), static_cast<uint32_t>(slot_suffix_.size()));
+    for (const auto& vbmeta : vbmeta_images_) {
+        const auto& name = vbmeta.partition();
+        AppendBytes(&data, name.data(), static_cast<uint32_t>(name.size()));
+        AppendValue(&data, GetPartitionDeviceId(name, slot_suffix_));
+        AppendBytes(&data, vbmeta.data(), static_cast<uint64_t>(vbmeta.size()));
+    }
+
+    // Only root may read or replace the cache.
+    std::string dir = android::base::Dirname(path);
+    if (mkdir(dir.c_str(), 0700) && errno != EEXIST) {
+        PERROR << "Failed to create " << dir;
+        return false;
+    }
+    std::string temp_path = path + ".tmp";
+    if (!android::base::WriteStringToFile(data, temp_path, 0600, getuid(), getgid())) {
+        PERROR << "Failed to write " << temp_path;
+        return false;
+    }
+    if (rename(temp_path.c_str(), path.c_str())) {
+        PERROR << "Failed to rename " << temp_path << " to " << path;
+        unlink(temp_path.c_str());
+        return false;
+    }
+    LINFO << "Saved " << vbmeta_images_.size() << " vbmeta images to " << path;
+    return true;
+}
+
+AvbUniquePtr AvbHandle::LoadFromCache(const std::string& path) {
+    bool allow_verification_error = IsAvbPermissive();
+    std::string data;
+    if (!ReadFileToString(path, &data)) {
+        return nullptr;
+    }
+
+    AvbUniquePtr avb_handle(new AvbHandle());
+    VbmetaCacheReader reader(data);
+    VbmetaCacheHeader header;
+    std::string slot_suffix;
+    if (!reader.ReadValue(&header) || header.magic != kVbmetaCacheMagic ||
+        header.version != kVbmetaCacheVersion ||
+        !reader.ReadBytes<uint32_t>(&slot_suffix, data.size())) {
+        LWARNING << "Ignoring invalid vbmeta cache: " << path;
+        return nullptr;
+    }
+    if (slot_suffix != avb_handle->slot_suffix_ ||
+        header.allow_verification_error != allow_verification_error) {
+        LINFO << "Ignoring vbmeta cache for another slot or lock state";
+        return nullptr;
+    }
+
+    for (uint32_t i = 0; i < header.num_images; i++) {
+        std::string name, image;
+        uint64_t device_id;
+        if (!reader.ReadBytes<uint32_t>(&name, data.size()) || !reader.ReadValue(&device_id) ||
+            !reader.ReadBytes<uint64_t>(&image, VBMetaData::kMaxVBMetaSize)) {
+            LWARNING << "Ignoring truncated vbmeta cache: " << path;
+            return nullptr;
+        }
+        if (device_id != GetPartitionDeviceId(name, slot_suffix)) {
+            LINFO << "Ignoring vbmeta cache, block device changed for: " << name;
+            return nullptr;
+        }
+        avb_handle->vbmeta_images_.emplace_back(reinterpret_cast<const uint8_t*>(image.data()),
+                                                image.size(), name);
+    }
+    if (!reader.done() || avb_handle->vbmeta_images_.empty()) {
+        LWARNING << "Ignoring invalid vbmeta cache: " << path;
+        return nullptr;
+    }
+
+    // The bootloader-provided digest covers every image of the chain, so a
+    // match means these are the images it verified. Without it, the cache
+    // can't be trusted and the chain is verified again.
+    std::unique_ptr<AvbVerifier> avb_verifier = AvbVerifier::Create();
+    if (!avb_verifier || !avb_verifier->VerifyVbmetaImages(avb_handle->vbmeta_images_)) {
+        LWARNING << "Ignoring vbmeta cache that doesn't match the vbmeta digest";
+        return nullptr;
+    }
+
+    // Same as Open(), the status comes from the flags of the top-level vbmeta
+    // struct, which the digest check above covers.
+    AvbVBMetaImageHeader vbmeta_header;
+    avb_vbmeta_image_header_to_host_byte_order(
+            (AvbVBMetaImageHeader*)avb_handle->vbmeta_images_[0].data(), &vbmeta_header);
+    bool verification_disabled = ((AvbVBMetaImageFlags)vbmeta_header.flags &
+                                  AVB_VBMETA_IMAGE_FLAGS_VERIFICATION_DISABLED);
+    bool hashtree_disabled =
+            ((AvbVBMetaImageFlags)vbmeta_header.flags & AVB_VBMETA_IMAGE_FLAGS_HASHTREE_DISABLED);
+    if ((verification_disabled || hashtree_disabled) && !allow_verification_error) {
+        LWARNING << "Ignoring vbmeta cache with verity disabled on a locked device";
+        return nullptr;
+    }
+    if (verification_disabled) {
+        avb_handle->status_ = AvbHandleStatus::kVerificationDisabled;
+    } else if (hashtree_disabled) {
+        avb_handle->status_ = AvbHandleStatus::kHashtreeDisabled;
+    } else {
+        avb_handle->status_ = AvbHandleStatus::kSuccess;
+    }
+
+    avb_handle->avb_version_ = StringPrintf("%d.%d", AVB_VERSION_MAJOR, AVB_VERSION_MINOR);
+    return avb_handle;
+}
+
 // TODO(b/128807537): removes this function.
 AvbUniquePtr AvbHandle::Open() {
+    // Reuses the chain already verified by an earlier stage, if any.
+    if (auto avb_handle = LoadFromCache()) {
+        LINFO << "Returning cached avb_handle with status: " << avb_handle->status_;
+        return avb_handle;
+    }
+
     bool allow_verification_error = IsAvbPermissive();
 
     AvbUniquePtr avb_handle(new AvbHandle());
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fs_avb/fs_avb_hashtree.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <openssl/evp.h>
+
+#include "util.h"
+
+namespace android {
+namespace fs_mgr {
+
+using android::base::borrowed_fd;
+
+// Data blocks are read from disk in chunks of this size, one chunk per thread
+// at a time.
+static constexpr size_t kReadChunkSize = 1024 * 1024;
+
+using EvpMdCtxPtr = std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)>;
+
+static EvpMdCtxPtr NewEvpMdCtx() {
+    return EvpMdCtxPtr(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+}
+
+static uint32_t GetNumThreads(uint32_t num_threads) {
+    if (num_threads) {
+        return num_threads;
+    }
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+static uint64_t DivRoundUp(uint64_t x, uint64_t y) {
+    return (x + y - 1) / y;
+}
+
+std::unique_ptr<HashtreeHasher> HashtreeHasher::Create(const std::string& hash_algorithm,
+                                                       const std::vector<uint8_t>& salt) {
+    const EVP_MD* md = nullptr;
+    if (hash_algorithm == "sha1") {
+        md = EVP_sha1();
+    } else if (hash_algorithm == "sha256") {
+        md = EVP_sha256();
+    } else if (hash_algorithm == "sha512") {
+        md = EVP_sha512();
+    } else {
+        LERROR << "Unsupported hash algorithm: " << hash_algorithm;
+        return nullptr;
+    }
+
+    std::unique_ptr<HashtreeHasher> hasher(new HashtreeHasher());
+    hasher->md_ = md;
+    hasher->salted_ctx_ = EVP_MD_CTX_new();
+    if (!hasher->salted_ctx_ || !EVP_DigestInit_ex(hasher->salted_ctx_, md, nullptr) ||
+        !EVP_DigestUpdate(hasher->salted_ctx_, salt.data(), salt.size())) {
+        LERROR << "Failed to initialize " << hash_algorithm << " digest";
+        return nullptr;
+    }
+    hasher->digest_size_ = EVP_MD_size(md);
+    hasher->padded_digest_size_ = 1;
+    while (hasher->padded_digest_size_ < hasher->digest_size_) {
+        hasher->padded_digest_size_ *= 2;
+    }
+    return hasher;
+}
+
+HashtreeHasher::~HashtreeHasher() {
+    if (salted_ctx_) {
+        EVP_MD_CTX_free(salted_ctx_);
+    }
+}
+
+bool HashtreeHasher::Hash(const void* data, size_t size, uint8_t* digest) const {
+    auto ctx = NewEvpMdCtx();
+    return ctx && EVP_MD_CTX_copy_ex(ctx.get(), salted_ctx_) &&
+           EVP_DigestUpdate(ctx.get(), data, size) &&
+           EVP_DigestFinal_ex(ctx.get(), digest, nullptr);
+}
+
+bool HashtreeHasher::HashBlocks(const void* data, size_t size, size_t block_size, uint8_t* out,
+                                size_t stride, uint32_t num_threads) const {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    const uint64_t num_blocks = DivRoundUp(size, block_size);
+
+    // Hash blocks [first, last) on the calling thread, reusing one context.
+    auto hash_range = [&, this](uint64_t first, uint64_t last) -> bool {
+        auto ctx = NewEvpMdCtx();
+        if (!ctx) {
+            return false;
+        }
+        for (uint64_t i = first; i < last; i++) {
+            size_t offset = i * block_size;
+            size_t len = std::min(block_size, size - offset);
+            if (!EVP_MD_CTX_copy_ex(ctx.get(), salted_ctx_) ||
+                !EVP_DigestUpdate(ctx.get(), bytes + offset, len)) {
+                return false;
+            }
+            if (len < block_size) {
+                std::vector<uint8_t> zeroes(block_size - len);
+                if (!EVP_DigestUpdate(ctx.get(), zeroes.data(), zeroes.size())) {
+                    return false;
+                }
+            }
+            if (!EVP_DigestFinal_ex(ctx.get(), out + i * stride, nullptr)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    num_threads = std::min<uint64_t>(num_threads, num_blocks);
+    if (num_threads <= 1) {
+        return hash_range(0, num_blocks);
+    }
+
+    std::atomic<bool> ok = true;
+    std::vector<std::thread> threads;
+    uint64_t per_thread = DivRoundUp(num_blocks, num_threads);
+    for (uint64_t first = 0; first < num_blocks; first += per_thread) {
+        uint64_t last = std::min(first + per_thread, num_blocks);
+        threads.emplace_back([&, first, last]() {
+            if (!hash_range(first, last)) {
+                ok = false;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return ok;
+}
+
+// Hash every data block of |fd| into |level|, which holds one padded digest
+// per block. Each thread reads and hashes whole chunks.
+static bool HashDataBlocks(borrowed_fd fd, const FsAvbHashtreeDescriptor& descriptor,
+                           const HashtreeHasher& hasher, uint32_t num_threads, std::string* level) {
+    const uint64_t block_size = descriptor.data_block_size;
+    const uint64_t chunk_size = std::max(kReadChunkSize / block_size, uint64_t(1)) * block_size;
+    const uint64_t num_chunks = DivRoundUp(descriptor.image_size, chunk_size);
+
+    std::atomic<uint64_t> next_chunk = 0;
+    std::atomic<bool> ok = true;
+    auto worker = [&]() {
+        std::vector<uint8_t> buffer(chunk_size);
+        uint8_t* out = reinterpret_cast<uint8_t*>(level->data());
+        for (uint64_t chunk = next_chunk++; chunk < num_chunks && ok; chunk = next_chunk++) {
+            uint64_t offset = chunk * chunk_size;
+            size_t len = std::min(chunk_size, descriptor.image_size - offset);
+            if (!android::base::ReadFullyAtOffset(fd, buffer.data(), len, offset)) {
+                PERROR << "Failed to read " << len << " bytes at offset " << offset;
+                ok = false;
+                return;
+            }
+            uint64_t first_block = offset / block_size;
+            if (!hasher.HashBlocks(buffer.data(), len, block_size,
+                                   out + first_block * hasher.padded_digest_size(),
+                                   hasher.padded_digest_size(), 1)) {
+                LERROR << "Failed to hash data blocks at offset " << offset;
+                ok = false;
+                return;
+            }
+        }
+    };
+
+    num_threads = std::min<uint64_t>(num_threads, num_chunks);
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < num_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return ok;
+}
+
+std::unique_ptr<Hashtree> Hashtree::Build(borrowed_fd fd, const FsAvbHashtreeDescriptor& descriptor,
+                                          uint32_t num_threads) {
+    std::string hash_algorithm(reinterpret_cast<const char*>(descriptor.hash_algorithm),
+                               strnlen(reinterpret_cast<const char*>(descriptor.hash_algorithm),
+                                       sizeof(descriptor.hash_algorithm)));
+    std::vector<uint8_t> salt(descriptor.salt.size() / 2);
+    if (!HexToBytes(salt.data(), salt.size(), descriptor.salt)) {
+        LERROR << "Invalid hashtree salt: " << descriptor.salt;
+        return nullptr;
+    }
+    auto hasher = HashtreeHasher::Create(hash_algorithm, salt);
+    if (!hasher) {
+        return nullptr;
+    }
+
+    const uint64_t data_block_size = descriptor.data_block_size;
+    const uint64_t hash_block_size = descriptor.hash_block_size;
+    if (!data_block_size || hash_block_size < hasher->padded_digest_size()) {
+        LERROR << "Invalid hashtree block sizes: data " << data_block_size << ", hash "
+               << hash_block_size;
+        return nullptr;
+    }
+    if (descriptor.image_size <= data_block_size) {
+        LERROR << "Image is too small for a hashtree: " << descriptor.image_size << " bytes";
+        return nullptr;
+    }
+    num_threads = GetNumThreads(num_threads);
+
+    std::unique_ptr<Hashtree> tree(new Hashtree());
+    tree->digest_size_ = hasher->digest_size();
+    tree->padded_digest_size_ = hasher->padded_digest_size();
+    tree->num_data_blocks_ = DivRoundUp(descriptor.image_size, data_block_size);
+
+    auto level_size = [&](uint64_t num_blocks) -> uint64_t {
+        return DivRoundUp(num_blocks * tree->padded_digest_size_, hash_block_size) *
+               hash_block_size;
+    };
+
+    std::string level(level_size(tree->num_data_blocks_), '\0');
+    if (!HashDataBlocks(fd, descriptor, *hasher, num_threads, &level)) {
+        return nullptr;
+    }
+    tree->levels_.emplace_back(std::move(level));
+
+    // Each further level hashes the blocks of the one below it, until a level
+    // fits in a single hash block.
+    while (tree->levels_.back().size() > hash_block_size) {
+        const auto& prev = tree->levels_.back();
+        std::string next(level_size(prev.size() / hash_block_size), '\0');
+        if (!hasher->HashBlocks(prev.data(), prev.size(), hash_block_size,
+                                reinterpret_cast<uint8_t*>(next.data()), tree->padded_digest_size_,
+                                num_threads)) {
+            LERROR << "Failed to hash level " << tree->levels_.size() << " of the hashtree";
+            return nullptr;
+        }
+        tree->levels_.emplace_back(std::move(next));
+    }
+
+    const auto& top = tree->levels_.back();
+    tree->root_digest_.resize(tree->digest_size_);
+    if (!hasher->Hash(top.data(), top.size(), reinterpret_cast<uint8_t*>(tree->root_digest_.data()))) {
+        LERROR << "Failed to compute the hashtree root digest";
+        return nullptr;
+    }
+    return tree;
+}
+
+std::string Hashtree::GetDataBlockDigest(uint64_t index) const {
+    CHECK(index < num_data_blocks_);
+    return levels_[0].substr(index * padded_digest_size_, digest_size_);
+}
+
+std::string Hashtree::Serialize() const {
+    std::string out;
+    for (auto iter = levels_.rbegin(); iter != levels_.rend(); iter++) {
+        out.append(*iter);
+    }
+    return out;
+}
+
+bool VerifyHashtree(borrowed_fd fd, const FsAvbHashtreeDescriptor& descriptor,
+                    bool check_stored_tree, uint32_t num_threads) {
+    auto tree = Hashtree::Build(fd, descriptor, num_threads);
+    if (!tree) {
+        return false;
+    }
+
+    const auto& root_digest = tree->root_digest();
+    if (BytesToHex(reinterpret_cast<const uint8_t*>(root_digest.data()), root_digest.size()) !=
+        descriptor.root_digest) {
+        LERROR << "Hashtree root digest mismatch for " << descriptor.partition_name;
+        return false;
+    }
+    if (!check_stored_tree) {
+        return true;
+    }
+
+    std::string expected = tree->Serialize();
+    if (expected.size() != descriptor.tree_size) {
+        LERROR << "Hashtree size mismatch for " << descriptor.partition_name << ": expected "
+               << expected.size() << ", descriptor has " << descriptor.tree_size;
+        return false;
+    }
+    std::string stored(descriptor.tree_size, '\0');
+    if (!android::base::ReadFullyAtOffset(fd, stored.data(), stored.size(),
+                                          descriptor.tree_offset)) {
+        PERROR << "Failed to read the hashtree of " << descriptor.partition_name;
+        return false;
+    }
+    if (stored != expected) {
+        LERROR << "Stored hashtree mismatch for " << descriptor.partition_name;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace fs_mgr
+}  // namespace android
@@ -25,6 +25,12 @@
 #include <fstab/fstab.h>
 #include <libavb/libavb.h>
 
+#ifndef FRIEND_TEST
+#define FRIEND_TEST(test_set_name, individual_test) \
+    friend class test_set_name##_##individual_test##_Test
+#define DEFINED_FRIEND_TEST
+#endif
+
 namespace android {
 namespace fs_mgr {
 
@@ -39,6 +45,11 @@ struct VBMetaInfo {
         : digest(std::move(digest_value)), hash_algorithm(algorithm), total_size(size) {}
 };
 
+// Where first-stage init hands the verified vbmeta chain over to later stages.
+// It is written before the SELinux policy is loaded, so init relabels the
+// directory in SelinuxRestoreContext().
+inline constexpr char kVbmetaCachePath[] = "/dev/fs_avb/vbmeta_cache";
+
 class FsManagerAvbOps;
 
 class AvbHandle;
@@ -82,6 +93,11 @@ class AvbHandle {
     //   - a valid unique_ptr with status AvbHandleStatus::Success: the metadata
     //     is verified and can be trusted.
     //
+    // If an earlier stage saved its handle with SaveToCache(), Open() reuses the
+    // cached vbmeta images instead of re-reading and re-verifying the chain. The
+    // cache is only used if it was made for the same slot, lock state and block
+    // devices, and if its images still match androidboot.vbmeta.digest.
+    //
     // TODO(bowgotsai): remove Open() and switch to LoadAndVerifyVbmeta().
     static AvbUniquePtr Open();  // loads inline vbmeta, via libavb.
     static AvbUniquePtr LoadAndVerifyVbmeta(const std::string& slot_suffix = {});
@@ -124,6 +140,10 @@ class AvbHandle {
 
     static bool IsDeviceUnlocked();
 
+    // Writes the verified vbmeta images of this handle to |path|, keyed by the
+    // slot suffix and the block device of each partition, for Open() to reuse.
+    bool SaveToCache(const std::string& path = kVbmetaCachePath) const;
+
     std::string GetSecurityPatchLevel(const FstabEntry& fstab_entry) const;
 
     const std::string& avb_version() const { return avb_version_; }
@@ -137,8 +157,16 @@ class AvbHandle {
     AvbHandle& operator=(AvbHandle&&) noexcept = delete;  // no move assignment
 
   private:
+    FRIEND_TEST(AvbHandleTest, LoadFromCacheIgnoresTamperedStatus);
+
     AvbHandle();
 
+    // Loads the vbmeta images saved by SaveToCache(). Returns nullptr if the
+    // cache is missing, stale, or its images don't match the vbmeta digest.
+    // The status is derived from the top-level vbmeta flags and the lock
+    // state, as in Open().
+    static AvbUniquePtr LoadFromCache(const std::string& path = kVbmetaCachePath);
+
     std::vector<VBMetaData> vbmeta_images_;
     VBMetaInfo vbmeta_info_;  // A summary info for vbmeta_images_.
     AvbHandleStatus status_;
@@ -149,3 +177,8 @@ class AvbHandle {
 
 }  // namespace fs_mgr
 }  // namespace android
+
+#ifdef DEFINED_FRIEND_TEST
+#undef DEFINED_FRIEND_TEST
+#undef FRIEND_TEST
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+#include <fs_avb/types.h>
+#include <openssl/base.h>
+
+namespace android {
+namespace fs_mgr {
+
+// Computes the salted digests used by AVB hashtrees: the salt is hashed
+// before the data, as avbtool does. Supports sha1, sha256 and sha512.
+class HashtreeHasher {
+  public:
+    // Returns nullptr if |hash_algorithm| is not supported.
+    static std::unique_ptr<HashtreeHasher> Create(const std::string& hash_algorithm,
+                                                  const std::vector<uint8_t>& salt);
+    ~HashtreeHasher();
+
+    size_t digest_size() const { return digest_size_; }
+    // Size of each digest inside a hash block: the digest size rounded up
+    // to a power of two.
+    size_t padded_digest_size() const { return padded_digest_size_; }
+
+    // Write the digest of |data| to |digest|, which must hold digest_size()
+    // bytes. This can be called from several threads at once.
+    bool Hash(const void* data, size_t size, uint8_t* digest) const;
+
+    // Hash each |block_size| block of |data| on up to |num_threads| threads.
+    // A short final block is zero padded. The digest of block N is written to
+    // |out| + N * |stride|.
+    bool HashBlocks(const void* data, size_t size, size_t block_size, uint8_t* out, size_t stride,
+                    uint32_t num_threads) const;
+
+  private:
+    HashtreeHasher() = default;
+
+    const EVP_MD* md_ = nullptr;
+    EVP_MD_CTX* salted_ctx_ = nullptr;
+    size_t digest_size_ = 0;
+    size_t padded_digest_size_ = 0;
+};
+
+// An AVB hashtree, built level by level. Data blocks are read and hashed on
+// a pool of threads, as is every level of the tree above them.
+class Hashtree {
+  public:
+    // Build the hashtree of the data described by |descriptor|, reading it
+    // from |fd|. If |num_threads| is 0, one thread per CPU is used.
+    static std::unique_ptr<Hashtree> Build(android::base::borrowed_fd fd,
+                                           const FsAvbHashtreeDescriptor& descriptor,
+                                           uint32_t num_threads = 0);
+
+    // The root digest, as raw bytes.
+    const std::string& root_digest() const { return root_digest_; }
+
+    uint64_t num_data_blocks() const { return num_data_blocks_; }
+    // The digest of data block |index|, as raw bytes.
+    std::string GetDataBlockDigest(uint64_t index) const;
+
+    // The tree as avbtool stores it at |tree_offset|: top level first.
+    std::string Serialize() const;
+
+  private:
+    Hashtree() = default;
+
+    std::vector<std::string> levels_;
+    std::string root_digest_;
+    uint64_t num_data_blocks_ = 0;
+    size_t digest_size_ = 0;
+    size_t padded_digest_size_ = 0;
+};
+
+// Rebuild the hashtree of the data in |fd| and check it against the root
+// digest in |descriptor|. If |check_stored_tree| is true, the tree stored in
+// |fd| at |descriptor.tree_offset| must match as well.
+bool VerifyHashtree(android::base::borrowed_fd fd, const FsAvbHashtreeDescriptor& descriptor,
+                    bool check_stored_tree, uint32_t num_threads = 0);
+
+}  // namespace fs_mgr
+}  // namespace android
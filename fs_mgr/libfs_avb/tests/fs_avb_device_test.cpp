@@ -14,12 +14,17 @@
  * limitations under the License.
  */
 
+#include <android-base/file.h>
 #include <android-base/properties.h>
 #include <fs_avb/fs_avb.h>
 #include <fs_avb/fs_avb_util.h>
 #include <fstab/fstab.h>
 #include <gtest/gtest.h>
+#include <libavb/libavb.h>
 
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -144,4 +149,72 @@ TEST(AvbHandleTest, GetSecurityPatchLevel) {
     EXPECT_EQ(10UL, avb_handle->GetSecurityPatchLevel(*product_entry).length());
 }
 
+TEST(AvbHandleTest, SaveToCache) {
+    auto avb_handle = AvbHandle::Open();
+    ASSERT_NE(nullptr, avb_handle) << "Failed to open AvbHandle. Try 'adb root'?";
+
+    TemporaryDir temp_dir;
+    std::string cache_path = std::string(temp_dir.path) + "/fs_avb/vbmeta_cache";
+    ASSERT_TRUE(avb_handle->SaveToCache(cache_path));
+
+    // The cache is only accessible to root.
+    struct stat st;
+    ASSERT_EQ(0, stat(cache_path.c_str(), &st));
+    EXPECT_EQ(0600U, st.st_mode & 0777);
+    EXPECT_GT(st.st_size, 0);
+    ASSERT_EQ(0, unlink(cache_path.c_str()));
+    ASSERT_EQ(0, rmdir(android::base::Dirname(cache_path).c_str()));
+}
+
 }  // namespace fs_avb_device_test
+
+// LoadFromCache() is private, so this test lives in AvbHandle's namespace.
+namespace android {
+namespace fs_mgr {
+
+TEST(AvbHandleTest, LoadFromCacheIgnoresTamperedStatus) {
+    auto avb_handle = AvbHandle::Open();
+    ASSERT_NE(nullptr, avb_handle) << "Failed to open AvbHandle. Try 'adb root'?";
+    if (avb_handle->status() != AvbHandleStatus::kSuccess) {
+        GTEST_SKIP() << "Only a successfully verified chain is cached";
+    }
+
+    TemporaryDir temp_dir;
+    std::string cache_path = std::string(temp_dir.path) + "/vbmeta_cache";
+    ASSERT_TRUE(avb_handle->SaveToCache(cache_path));
+    std::string cache;
+    ASSERT_TRUE(android::base::ReadFileToString(cache_path, &cache));
+
+    auto cached_handle = AvbHandle::LoadFromCache(cache_path);
+    ASSERT_NE(nullptr, cached_handle);
+    EXPECT_EQ(AvbHandleStatus::kSuccess, cached_handle->status());
+
+    // A version 1 header, which carried the status after the lock state.
+    std::string tampered = cache;
+    uint32_t version = 1;
+    uint32_t status = static_cast<uint32_t>(AvbHandleStatus::kHashtreeDisabled);
+    memcpy(tampered.data() + 4, &version, sizeof(version));
+    tampered.insert(12, reinterpret_cast<const char*>(&status), sizeof(status));
+    ASSERT_TRUE(android::base::WriteStringToFile(tampered, cache_path));
+    EXPECT_EQ(nullptr, AvbHandle::LoadFromCache(cache_path));
+
+    // HASHTREE_DISABLED set in the cached top-level vbmeta, which no longer
+    // matches the vbmeta digest.
+    tampered = cache;
+    size_t pos = 16;
+    uint32_t size;
+    memcpy(&size, tampered.data() + pos, sizeof(size));  // slot suffix
+    pos += sizeof(size) + size;
+    memcpy(&size, tampered.data() + pos, sizeof(size));  // partition name
+    pos += sizeof(size) + size + sizeof(uint64_t) + sizeof(uint64_t);
+    pos += offsetof(AvbVBMetaImageHeader, flags) + 3;  // big-endian low byte
+    ASSERT_LT(pos, tampered.size());
+    tampered[pos] |= AVB_VBMETA_IMAGE_FLAGS_HASHTREE_DISABLED;
+    ASSERT_TRUE(android::base::WriteStringToFile(tampered, cache_path));
+    EXPECT_EQ(nullptr, AvbHandle::LoadFromCache(cache_path));
+
+    ASSERT_EQ(0, unlink(cache_path.c_str()));
+}
+
+}  // namespace fs_mgr
+}  // namespace android
@@ -14,10 +14,17 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <fs_avb/fs_avb_hashtree.h>
 #include <fs_avb/fs_avb_util.h>
 
 #include "fs_avb_test_util.h"
 
+using android::fs_mgr::Hashtree;
+
 namespace fs_avb_host_test {
 
 class PublicFsAvbUtilTest : public BaseFsAvbTest {
@@ -119,4 +126,42 @@ TEST_F(PublicFsAvbUtilTest, GetHashtreeDescriptor_NotFound) {
     EXPECT_EQ(nullptr, hashtree_desc);
 }
 
+TEST_F(PublicFsAvbUtilTest, VerifyHashtree) {
+    const size_t system_image_size = 10 * 1024 * 1024;
+    const size_t system_partition_size = 15 * 1024 * 1024;
+
+    for (const std::string algorithm : {"sha1", "sha256", "sha512"}) {
+        SCOPED_TRACE(algorithm);
+        base::FilePath system_path = GenerateImage("system.img", system_image_size);
+        AddAvbFooter(system_path, "hashtree", "system", system_partition_size, "SHA512_RSA4096",
+                     20, data_dir_.Append("testkey_rsa4096.pem"), "d00df00d",
+                     "--hash_algorithm " + algorithm);
+        auto system_vbmeta = ExtractAndLoadVBMetaData(system_path, "system-vbmeta.img");
+        auto hashtree_desc = GetHashtreeDescriptor("system", std::move(system_vbmeta));
+        ASSERT_NE(nullptr, hashtree_desc);
+
+        android::base::unique_fd fd(open(system_path.value().c_str(), O_RDWR | O_CLOEXEC));
+        ASSERT_GE(fd, 0);
+
+        // The tree built on several threads must match the one avbtool wrote.
+        auto tree = Hashtree::Build(fd, *hashtree_desc, 4);
+        ASSERT_NE(nullptr, tree);
+        EXPECT_EQ(system_image_size / 4096, tree->num_data_blocks());
+        std::string stored_tree(hashtree_desc->tree_size, '\0');
+        ASSERT_TRUE(android::base::ReadFullyAtOffset(fd, stored_tree.data(), stored_tree.size(),
+                                                     hashtree_desc->tree_offset));
+        EXPECT_EQ(stored_tree, tree->Serialize());
+        EXPECT_TRUE(VerifyHashtree(fd, *hashtree_desc, true /* check_stored_tree */));
+        EXPECT_TRUE(VerifyHashtree(fd, *hashtree_desc, true /* check_stored_tree */, 1));
+
+        // Corrupting a single data block must be caught.
+        char byte;
+        const off_t offset = system_image_size / 2 + 17;
+        ASSERT_TRUE(android::base::ReadFullyAtOffset(fd, &byte, 1, offset));
+        byte ^= 0xff;
+        ASSERT_TRUE(android::base::WriteFullyAtOffset(fd, &byte, 1, offset));
+        EXPECT_FALSE(VerifyHashtree(fd, *hashtree_desc, false /* check_stored_tree */));
+    }
+}
+
 }  // namespace fs_avb_host_test
@@ -102,6 +102,9 @@ void Partition::AddExtent(std::unique_ptr<Extent>&& extent) {
     size_ += extent->num_sectors() * LP_SECTOR_SIZE;
 
     if (LinearExtent* new_extent = extent->AsLinearExtent()) {
+        if (builder_) {
+            builder_->ReserveRegion(*new_extent);
+        }
         if (!extents_.empty() && extents_.back()->AsLinearExtent()) {
             LinearExtent* prev_extent = extents_.back()->AsLinearExtent();
             if (prev_extent->end_sector() == new_extent->physical_sector() &&
@@ -119,6 +122,14 @@ void Partition::AddExtent(std::unique_ptr<Extent>&& extent) {
 }
 
 void Partition::RemoveExtents() {
+    if (builder_) {
+        for (const auto& extent : extents_) {
+            if (LinearExtent* linear = extent->AsLinearExtent()) {
+                builder_->ReleaseRegion(linear->device_index(), linear->physical_sector(),
+                                        linear->end_sector());
+            }
+        }
+    }
     size_ = 0;
     extents_.clear();
 }
@@ -134,11 +145,21 @@ void Partition::ShrinkTo(uint64_t aligned_size) {
     uint64_t sectors_to_remove = (size_ - aligned_size) / LP_SECTOR_SIZE;
     while (sectors_to_remove) {
         Extent* extent = extents_.back().get();
+        LinearExtent* linear = builder_ ? extent->AsLinearExtent() : nullptr;
         if (extent->num_sectors() > sectors_to_remove) {
+            if (linear) {
+                builder_->ReleaseRegion(linear->device_index(),
+                                        linear->end_sector() - sectors_to_remove,
+                                        linear->end_sector());
+            }
             size_ -= sectors_to_remove * LP_SECTOR_SIZE;
             extent->set_num_sectors(extent->num_sectors() - sectors_to_remove);
             break;
         }
+        if (linear) {
+            builder_->ReleaseRegion(linear->device_index(), linear->physical_sector(),
+                                    linear->end_sector());
+        }
         size_ -= (extent->num_sectors() * LP_SECTOR_SIZE);
         sectors_to_remove -= extent->num_sectors();
         extents_.pop_back();
@@ -316,6 +337,7 @@ MetadataBuilder::MetadataBuilder() : auto_slot_suffixing_(false) {
 bool MetadataBuilder::Init(const LpMetadata& metadata) {
     geometry_ = metadata.geometry;
     block_devices_ = metadata.block_devices;
+    InitFreeSpace();
 
     // Bump the version as necessary to copy any newer fields.
     if (metadata.header.minor_version >= LP_METADATA_VERSION_FOR_EXPANDED_HEADER) {
@@ -506,6 +528,7 @@ bool MetadataBuilder::Init(const std::vector<BlockDeviceInfo>& block_devices,
     geometry_.metadata_max_size = metadata_max_size;
     geometry_.metadata_slot_count = metadata_slot_count;
     geometry_.logical_block_size = logical_block_size;
+    InitFreeSpace();
 
     if (!AddGroup(std::string(kDefaultGroup), 0)) {
         return false;
@@ -541,6 +564,7 @@ Partition* MetadataBuilder::AddPartition(std::string_view name, std::string_view
         return nullptr;
     }
     partitions_.push_back(std::make_unique<Partition>(name, group_name, attributes));
+    partitions_.back()->builder_ = this;
     return partitions_.back().get();
 }
 
@@ -576,72 +600,110 @@ uint64_t MetadataBuilder::TotalSizeOfGroup(PartitionGroup* group) const {
 void MetadataBuilder::RemovePartition(std::string_view name) {
     for (auto iter = partitions_.begin(); iter != partitions_.end(); iter++) {
         if ((*iter)->name() == name) {
+            (*iter)->RemoveExtents();
             partitions_.erase(iter);
             return;
         }
     }
 }
 
-void MetadataBuilder::ExtentsToFreeList(const std::vector<Interval>& extents,
-                                        std::vector<Interval>* free_regions) const {
-    // Convert the extent list into a list of gaps between the extents; i.e.,
-    // the list of ranges that are free on the disk.
-    for (size_t i = 1; i < extents.size(); i++) {
-        const Interval& previous = extents[i - 1];
-        const Interval& current = extents[i];
-        DCHECK(previous.device_index == current.device_index);
+void MetadataBuilder::InitFreeSpace() {
+    // Everything between the metadata area and the end of each block device
+    // starts out free.
+    free_space_.clear();
+    free_space_.resize(block_devices_.size());
+    for (size_t i = 0; i < block_devices_.size(); i++) {
+        const auto& block_device = block_devices_[i];
+        uint64_t first_sector = block_device.first_logical_sector;
+        uint64_t last_sector = block_device.size / LP_SECTOR_SIZE;
+        if (first_sector < last_sector) {
+            free_space_[i].emplace(first_sector, last_sector);
+        }
+    }
+}
 
-        uint64_t aligned;
-        if (!AlignSector(block_devices_[current.device_index], previous.end, &aligned)) {
-            LERROR << "Sector " << previous.end << " caused integer overflow.";
-            continue;
+void MetadataBuilder::ReserveRegion(const LinearExtent& extent) {
+    if (extent.device_index() >= free_space_.size()) {
+        return;
+    }
+    auto& regions = free_space_[extent.device_index()];
+    uint64_t start = extent.physical_sector();
+    uint64_t end = extent.end_sector();
+
+    // Find the first free region ending after |start|, then carve the extent
+    // out of every free region it overlaps.
+    auto iter = regions.upper_bound(start);
+    if (iter != regions.begin() && std::prev(iter)->second > start) {
+        iter = std::prev(iter);
+    }
+    while (iter != regions.end() && iter->first < end) {
+        uint64_t region_start = iter->first;
+        uint64_t region_end = iter->second;
+        iter = regions.erase(iter);
+        if (region_start < start) {
+            regions.emplace(region_start, start);
         }
-        if (aligned >= current.start) {
-            // There is no gap between these two extents, try the next one.
-            // Note that we check with >= instead of >, since alignment may
-            // bump the ending sector past the beginning of the next extent.
-            continue;
+        if (region_end > end) {
+            regions.emplace(end, region_end);
+            break;
         }
+    }
+}
+
+void MetadataBuilder::ReleaseRegion(uint32_t device_index, uint64_t start, uint64_t end) {
+    if (device_index >= free_space_.size()) {
+        return;
+    }
+    // Never hand out space outside the logical area, even if a (corrupt)
+    // extent pointed there.
+    const auto& block_device = block_devices_[device_index];
+    start = std::max(start, block_device.first_logical_sector);
+    end = std::min(end, block_device.size / LP_SECTOR_SIZE);
+    if (start >= end) {
+        return;
+    }
 
-        // The new interval represents the free space starting at the end of
-        // the previous interval, and ending at the start of the next interval.
-        free_regions->emplace_back(current.device_index, aligned, current.start);
+    // Merge with any neighboring free regions, so that the map stays the
+    // minimal set of gaps between extents.
+    auto& regions = free_space_[device_index];
+    auto next = regions.lower_bound(start);
+    while (next != regions.end() && next->first <= end) {
+        end = std::max(end, next->second);
+        next = regions.erase(next);
+    }
+    if (next != regions.begin()) {
+        auto prev = std::prev(next);
+        if (prev->second >= start) {
+            start = prev->first;
+            end = std::max(end, prev->second);
+            regions.erase(prev);
+        }
     }
+    regions.emplace(start, end);
 }
 
 auto MetadataBuilder::GetFreeRegions() const -> std::vector<Interval> {
     std::vector<Interval> free_regions;
 
-    // Collect all extents in the partition table, per-device, then sort them
-    // by starting sector.
-    std::vector<std::vector<Interval>> device_extents(block_devices_.size());
-    for (const auto& partition : partitions_) {
-        for (const auto& extent : partition->extents()) {
-            LinearExtent* linear = extent->AsLinearExtent();
-            if (!linear) {
+    // |free_space_| is kept sorted and up to date as extents are added and
+    // removed, so all that is left is to apply the device's alignment to the
+    // start of each gap.
+    for (size_t i = 0; i < free_space_.size(); i++) {
+        for (const auto& [start, end] : free_space_[i]) {
+            uint64_t aligned;
+            if (!AlignSector(block_devices_[i], start, &aligned)) {
+                LERROR << "Sector " << start << " caused integer overflow.";
                 continue;
             }
-            CHECK(linear->device_index() < device_extents.size());
-            auto& extents = device_extents[linear->device_index()];
-            extents.emplace_back(linear->device_index(), linear->physical_sector(),
-                                 linear->physical_sector() + extent->num_sectors());
+            if (aligned >= end) {
+                // Alignment consumed the whole gap. Note that we check with
+                // >= instead of >, since alignment may bump the starting
+                // sector past the end of the region.
+                continue;
+            }
+            free_regions.emplace_back(i, aligned, end);
         }
     }
-
-    // Add 0-length intervals for the first and last sectors. This will cause
-    // ExtentToFreeList() to treat the space in between as available.
-    for (size_t i = 0; i < device_extents.size(); i++) {
-        auto& extents = device_extents[i];
-        const auto& block_device = block_devices_[i];
-
-        uint64_t first_sector = block_device.first_logical_sector;
-        uint64_t last_sector = block_device.size / LP_SECTOR_SIZE;
-        extents.emplace_back(i, first_sector, first_sector);
-        extents.emplace_back(i, last_sector, last_sector);
-
-        std::sort(extents.begin(), extents.end());
-        ExtentsToFreeList(extents, &free_regions);
-    }
     return free_regions;
 }
 
@@ -854,18 +916,25 @@ bool MetadataBuilder::IsAnyRegionCovered(const std::vector<Interval>& regions,
 }
 
 bool MetadataBuilder::IsAnyRegionAllocated(const LinearExtent& candidate) const {
-    for (const auto& partition : partitions_) {
-        for (const auto& extent : partition->extents()) {
-            LinearExtent* linear = extent->AsLinearExtent();
-            if (!linear) {
-                continue;
-            }
-            if (linear->OverlapsWith(candidate)) {
-                return true;
-            }
-        }
+    if (candidate.device_index() >= free_space_.size()) {
+        return false;
     }
-    return false;
+    const auto& block_device = block_devices_[candidate.device_index()];
+    uint64_t start = std::max(candidate.physical_sector(), block_device.first_logical_sector);
+    uint64_t end = std::min(candidate.end_sector(), block_device.size / LP_SECTOR_SIZE);
+    if (start >= end) {
+        return false;
+    }
+
+    // Free regions are merged, so the candidate is unallocated only if a
+    // single free region covers all of it.
+    const auto& regions = free_space_[candidate.device_index()];
+    auto iter = regions.upper_bound(start);
+    if (iter == regions.begin()) {
+        return true;
+    }
+    --iter;
+    return iter->second < end;
 }
 
 void MetadataBuilder::ShrinkPartition(Partition* partition, uint64_t aligned_size) {
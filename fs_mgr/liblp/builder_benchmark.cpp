@@ -0,0 +1,108 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <liblp/builder.h>
+#include <storage_literals/storage_literals.h>
+
+namespace android {
+namespace fs_mgr {
+
+using namespace android::storage_literals;
+
+static constexpr uint64_t kSuperSize = 64_GiB;
+
+static std::unique_ptr<MetadataBuilder> NewSuper() {
+    BlockDeviceInfo super("super", kSuperSize, 0, 0, 4096);
+    return MetadataBuilder::New(super, 65536, 2);
+}
+
+// Build a super with |state.range(0)| partitions, each grown in two steps so
+// that every partition ends up with interleaved extents.
+static void BM_BuildSuper(benchmark::State& state) {
+    const int num_partitions = state.range(0);
+
+    for (auto _ : state) {
+        auto builder = NewSuper();
+        if (!builder) {
+            state.SkipWithError("Failed to create builder");
+            return;
+        }
+        std::vector<Partition*> partitions;
+        for (int i = 0; i < num_partitions; i++) {
+            auto partition = builder->AddPartition("partition_" + std::to_string(i), 0);
+            if (!partition || !builder->ResizePartition(partition, 1_MiB)) {
+                state.SkipWithError("Failed to add partition");
+                return;
+            }
+            partitions.emplace_back(partition);
+        }
+        for (auto partition : partitions) {
+            if (!builder->ResizePartition(partition, 2_MiB)) {
+                state.SkipWithError("Failed to grow partition");
+                return;
+            }
+        }
+        benchmark::DoNotOptimize(builder->Export());
+    }
+    state.SetItemsProcessed(state.iterations() * num_partitions);
+}
+BENCHMARK(BM_BuildSuper)->Arg(100)->Arg(400)->Arg(1000)->Unit(benchmark::kMillisecond);
+
+// Resize partitions in a fragmented super, the way an OTA reshuffles the
+// target slot: free every other partition, then grow the rest into the holes.
+static void BM_ResizeFragmented(benchmark::State& state) {
+    const int num_partitions = state.range(0);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto builder = NewSuper();
+        if (!builder) {
+            state.SkipWithError("Failed to create builder");
+            return;
+        }
+        std::vector<Partition*> partitions;
+        for (int i = 0; i < num_partitions; i++) {
+            auto partition = builder->AddPartition("partition_" + std::to_string(i), 0);
+            if (!partition || !builder->ResizePartition(partition, 1_MiB)) {
+                state.SkipWithError("Failed to add partition");
+                return;
+            }
+            partitions.emplace_back(partition);
+        }
+        state.ResumeTiming();
+
+        for (int i = 0; i < num_partitions; i += 2) {
+            if (!builder->ResizePartition(partitions[i], 0)) {
+                state.SkipWithError("Failed to shrink partition");
+                return;
+            }
+        }
+        for (int i = 1; i < num_partitions; i += 2) {
+            if (!builder->ResizePartition(partitions[i], 4_MiB)) {
+                state.SkipWithError("Failed to grow partition");
+                return;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * num_partitions);
+}
+BENCHMARK(BM_ResizeFragmented)->Arg(100)->Arg(400)->Arg(1000)->Unit(benchmark::kMillisecond);
+
+}  // namespace fs_mgr
+}  // namespace android
+
+BENCHMARK_MAIN();
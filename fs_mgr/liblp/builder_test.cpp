@@ -615,6 +615,58 @@ TEST_F(BuilderTest, RemoveAndAddFirstPartition) {
     ASSERT_TRUE(p && builder->ResizePartition(p, 1_GiB));
 }
 
+TEST_F(BuilderTest, FreeRegionsTrackExtents) {
+    BlockDeviceInfo device_info("super", 1024 * 1024, 0, 0, 4096);
+    unique_ptr<MetadataBuilder> builder = MetadataBuilder::New(device_info, 1024, 1);
+    ASSERT_NE(builder, nullptr);
+
+    auto free_regions = builder->GetFreeRegions();
+    ASSERT_EQ(free_regions.size(), 1);
+    const uint64_t first_sector = free_regions[0].start;
+    const uint64_t last_sector = free_regions[0].end;
+
+    Partition* system = builder->AddPartition("system", 0);
+    ASSERT_TRUE(system && builder->ResizePartition(system, 32 * 1024));
+    Partition* vendor = builder->AddPartition("vendor", 0);
+    ASSERT_TRUE(vendor && builder->ResizePartition(vendor, 32 * 1024));
+    Partition* product = builder->AddPartition("product", 0);
+    ASSERT_TRUE(product && builder->ResizePartition(product, 32 * 1024));
+
+    free_regions = builder->GetFreeRegions();
+    ASSERT_EQ(free_regions.size(), 1);
+    EXPECT_EQ(free_regions[0].start, first_sector + 192);
+    EXPECT_EQ(free_regions[0].end, last_sector);
+
+    // Removing a partition in the middle opens a hole.
+    builder->RemovePartition("vendor");
+    free_regions = builder->GetFreeRegions();
+    ASSERT_EQ(free_regions.size(), 2);
+    EXPECT_EQ(free_regions[0].start, first_sector + 64);
+    EXPECT_EQ(free_regions[0].end, first_sector + 128);
+
+    // Shrinking the partition before it grows the hole.
+    ASSERT_TRUE(builder->ResizePartition(system, 16 * 1024));
+    free_regions = builder->GetFreeRegions();
+    ASSERT_EQ(free_regions.size(), 2);
+    EXPECT_EQ(free_regions[0].start, first_sector + 32);
+    EXPECT_EQ(free_regions[0].end, first_sector + 128);
+
+    system->RemoveExtents();
+    builder->RemovePartition("product");
+    free_regions = builder->GetFreeRegions();
+    ASSERT_EQ(free_regions.size(), 1);
+    EXPECT_EQ(free_regions[0].start, first_sector);
+    EXPECT_EQ(free_regions[0].end, last_sector);
+
+    // The hole is reused before space at the end of the device.
+    vendor = builder->AddPartition("vendor", 0);
+    ASSERT_TRUE(vendor && builder->ResizePartition(vendor, 32 * 1024));
+    ASSERT_EQ(vendor->extents().size(), 1);
+    LinearExtent* extent = vendor->extents()[0]->AsLinearExtent();
+    ASSERT_NE(extent, nullptr);
+    EXPECT_EQ(extent->physical_sector(), first_sector);
+}
+
 TEST_F(BuilderTest, ListGroups) {
     BlockDeviceInfo device_info("super", 1024 * 1024, 0, 0, 4096);
     unique_ptr<MetadataBuilder> builder = MetadataBuilder::New(device_info, 1024, 1);
@@ -18,8 +18,14 @@
 
 #include <limits.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
 
 #include <android-base/file.h>
+#include <liblp/super_layout_builder.h>
+#include <sparse/sparse_format.h>
 
 #include "reader.h"
 #include "utility.h"
@@ -511,8 +517,130 @@ int ImageBuilder::OpenImageFile(const std::string& file) {
     return temp_fds_.back().get();
 }
 
+#if !defined(_WIN32)
+// Describe the image that ImageBuilder would produce as a list of extents for
+// WriteSuperImage(). Returns false if the metadata or the images aren't
+// suitable, in which case ImageBuilder is used: for retrofit devices, sparse
+// partition images, and anything that ImageBuilder would reject.
+static bool GetImageLayout(const LpMetadata& metadata, uint32_t block_size,
+                           const std::map<std::string, std::string>& images,
+                           std::vector<SuperImageExtent>* extents) {
+    if (metadata.block_devices.size() != 1 || !block_size || block_size % LP_SECTOR_SIZE != 0 ||
+        metadata.geometry.metadata_max_size % block_size != 0 ||
+        LP_PARTITION_RESERVED_BYTES % block_size != 0) {
+        return false;
+    }
+    const uint64_t device_size = metadata.block_devices[0].size;
+    if (device_size % block_size != 0) {
+        return false;
+    }
+
+    // Reserved zeroes, two copies of geometry, then two copies of each
+    // metadata slot.
+    std::string geometry_blob = SerializeGeometry(metadata.geometry);
+    std::string metadata_blob = SerializeMetadata(metadata);
+    metadata_blob.resize(metadata.geometry.metadata_max_size);
+    auto all_metadata = std::make_shared<std::string>(geometry_blob + geometry_blob);
+    for (size_t i = 0; i < metadata.geometry.metadata_slot_count * 2; i++) {
+        *all_metadata += metadata_blob;
+    }
+
+    std::vector<SuperImageExtent> used;
+    used.emplace_back(0, LP_PARTITION_RESERVED_BYTES, SuperImageExtent::Type::ZERO);
+    used.emplace_back(LP_PARTITION_RESERVED_BYTES, all_metadata);
+
+    size_t images_found = 0;
+    for (const auto& partition : metadata.partitions) {
+        auto iter = images.find(GetPartitionName(partition));
+        if (iter == images.end()) {
+            continue;
+        }
+        images_found++;
+        if (partition.num_extents == 0) {
+            return false;
+        }
+
+        unique_fd fd = GetControlFileOrOpen(iter->second.c_str(), O_RDONLY | O_CLOEXEC);
+        uint32_t magic;
+        uint64_t image_size;
+        if (fd < 0 || !GetDescriptorSize(fd.get(), &image_size) ||
+            (pread(fd.get(), &magic, sizeof(magic), 0) == sizeof(magic) &&
+             magic == SPARSE_HEADER_MAGIC)) {
+            return false;
+        }
+
+        // Only the part of each extent that the image covers is written;
+        // the rest is left as don't-care, as ImageBuilder does.
+        uint64_t image_offset = 0;
+        for (uint32_t i = 0; i < partition.num_extents; i++) {
+            const auto& extent = metadata.extents[partition.first_extent_index + i];
+            uint64_t offset = extent.target_data * LP_SECTOR_SIZE;
+            uint64_t size = extent.num_sectors * LP_SECTOR_SIZE;
+            if (extent.target_type != LP_TARGET_TYPE_LINEAR || offset % block_size != 0 ||
+                size % block_size != 0) {
+                return false;
+            }
+            if (image_offset < image_size) {
+                uint64_t to_write;
+                if (!AlignTo(std::min(size, image_size - image_offset), block_size, &to_write)) {
+                    return false;
+                }
+                used.emplace_back(offset, to_write, iter->second, image_offset);
+            }
+            image_offset += size;
+        }
+        if (image_size > image_offset) {
+            return false;
+        }
+    }
+    if (images_found != images.size()) {
+        return false;
+    }
+
+    std::sort(used.begin(), used.end());
+    extents->clear();
+    uint64_t offset = 0;
+    for (const auto& extent : used) {
+        if (extent.offset < offset) {
+            return false;
+        }
+        if (extent.offset > offset) {
+            extents->emplace_back(offset, extent.offset - offset,
+                                  SuperImageExtent::Type::DONTCARE);
+        }
+        extents->emplace_back(extent);
+        offset = extent.offset + extent.size;
+    }
+    if (offset > device_size) {
+        return false;
+    }
+    if (offset < device_size) {
+        extents->emplace_back(offset, device_size - offset, SuperImageExtent::Type::DONTCARE);
+    }
+    return true;
+}
+#endif
+
 bool WriteToImageFile(const std::string& file, const LpMetadata& metadata, uint32_t block_size,
                       const std::map<std::string, std::string>& images, bool sparsify) {
+#if !defined(_WIN32)
+    // Stream the image when possible, rather than building it in memory with
+    // libsparse first. Partition images are then read in parallel, and raw
+    // output can share extents with them.
+    std::vector<SuperImageExtent> extents;
+    if (GetImageLayout(metadata, block_size, images, &extents)) {
+        unique_fd fd(open(file.c_str(), O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0644));
+        if (fd < 0) {
+            PERROR << "open failed: " << file;
+            return false;
+        }
+        SuperImageWriteOptions options = {
+                .sparse = sparsify,
+                .block_size = block_size,
+        };
+        return WriteSuperImage(fd, extents, options);
+    }
+#endif
     ImageBuilder builder(metadata, block_size, images, sparsify);
     return builder.IsValid() && builder.Build() && builder.Export(file);
 }
@@ -33,6 +33,7 @@ namespace android {
 namespace fs_mgr {
 
 class LinearExtent;
+class MetadataBuilder;
 struct Interval;
 
 // By default, partitions are aligned on a 1MiB boundary.
@@ -161,6 +162,8 @@ class Partition final {
     std::vector<std::unique_ptr<Extent>> extents_;
     uint32_t attributes_;
     uint64_t size_;
+    // The builder tracking free space for this partition's extents, if any.
+    MetadataBuilder* builder_ = nullptr;
 };
 
 // An interval in the metadata. This is similar to a LinearExtent with one difference.
@@ -193,6 +196,8 @@ struct Interval {
 };
 
 class MetadataBuilder {
+    friend class Partition;
+
   public:
     // Construct an empty logical partition table builder given the specified
     // map of partitions that are available for storing logical partitions.
@@ -408,8 +413,9 @@ class MetadataBuilder {
     bool IsAnyRegionCovered(const std::vector<Interval>& regions,
                             const LinearExtent& candidate) const;
     bool IsAnyRegionAllocated(const LinearExtent& candidate) const;
-    void ExtentsToFreeList(const std::vector<Interval>& extents,
-                           std::vector<Interval>* free_regions) const;
+    void InitFreeSpace();
+    void ReserveRegion(const LinearExtent& extent);
+    void ReleaseRegion(uint32_t device_index, uint64_t start, uint64_t end);
     std::vector<Interval> PrioritizeSecondHalfOfSuper(const std::vector<Interval>& free_list);
     std::unique_ptr<LinearExtent> ExtendFinalExtent(Partition* partition,
                                                     const std::vector<Interval>& free_list,
@@ -424,6 +430,12 @@ class MetadataBuilder {
     std::vector<std::unique_ptr<PartitionGroup>> groups_;
     std::vector<LpMetadataBlockDevice> block_devices_;
     bool auto_slot_suffixing_;
+
+    // Unallocated space on each block device, indexed like |block_devices_|.
+    // Each map goes from the first sector of a free region to its end
+    // sector. Regions are not aligned, and adjacent regions are merged, so
+    // this is the exact complement of the linear extents in |partitions_|.
+    std::vector<std::map<uint64_t, uint64_t>> free_space_;
 };
 
 // Read BlockDeviceInfo for a given block device. This always returns false
@@ -22,6 +22,7 @@
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 #include <liblp/builder.h>
@@ -100,5 +101,29 @@ class SuperLayoutBuilder final {
 
 std::ostream& operator<<(std::ostream& stream, const SuperImageExtent& extent);
 
+struct SuperImageWriteOptions {
+    // Write an Android sparse image instead of a raw image.
+    bool sparse = false;
+    // Block size of the sparse image. Every extent must be aligned to it.
+    uint32_t block_size = 4096;
+    // Number of threads reading partition images. If 0, one per CPU is used
+    // (up to a limit).
+    uint32_t num_threads = 0;
+};
+
+// Write the super image described by |extents|, as returned by
+// SuperLayoutBuilder::GetImageLayout(), to |fd|. |fd| must be a regular
+// file; it is truncated first. Partition images must be raw images.
+//
+// The layout is walked once, without building a sparse_file in memory.
+// Partition images are read on a pool of threads and written out in order.
+// Raw images are copied with copy_file_range() where possible, which shares
+// extents instead of copying data on filesystems that support reflinks.
+//
+// WriteToImageFile() (and so lpmake) uses this for single-device layouts
+// with raw partition images. This is not available on Windows.
+bool WriteSuperImage(android::base::borrowed_fd fd, const std::vector<SuperImageExtent>& extents,
+                     const SuperImageWriteOptions& options = {});
+
 }  // namespace fs_mgr
 }  // namespace android
@@ -592,6 +592,50 @@ TEST_F(LiblpTest, UpdateMetadataCleanFailure) {
     ASSERT_EQ(GetPartitionName(new_table->partitions[0]), GetPartitionName(imported->partitions[0]));
 }
 
+// Test that an update only rewrites the sectors that changed.
+TEST_F(LiblpTest, UpdateMetadataIncremental) {
+    static const size_t kLargeDiskSize = 1024 * 1024;
+    static const BlockDeviceInfo kLargeSuperInfo{"super", kLargeDiskSize, 0, 0, 4096};
+
+    unique_ptr<MetadataBuilder> builder = MetadataBuilder::New(kLargeDiskSize, 4096, 2);
+    ASSERT_NE(builder, nullptr);
+    for (int i = 0; i < 20; i++) {
+        Partition* partition = builder->AddPartition("part" + std::to_string(i), 0);
+        ASSERT_NE(partition, nullptr);
+        ASSERT_TRUE(builder->ResizePartition(partition, 4096));
+    }
+    unique_ptr<LpMetadata> exported = builder->Export();
+    ASSERT_NE(exported, nullptr);
+
+    unique_fd fd = CreateFakeDisk(kLargeDiskSize);
+    ASSERT_GE(fd, 0);
+    TestPartitionOpener opener({{"super", fd}}, {{"super", kLargeSuperInfo}});
+    ASSERT_TRUE(FlashPartitionTable(opener, "super", *exported.get()));
+
+    // Rename the last partition, whose entry lives in the third sector of
+    // the metadata. Only that sector and the header should be rewritten, in
+    // both copies.
+    exported->partitions.back().name[0] = 'x';
+
+    std::vector<size_t> writes;
+    auto writer = [&](int fd, const std::string& blob) -> bool {
+        writes.emplace_back(blob.size());
+        return android::base::WriteFully(fd, blob.data(), blob.size());
+    };
+    ASSERT_TRUE(UpdatePartitionTable(opener, "super", *exported.get(), 0, writer));
+    EXPECT_EQ(writes, std::vector<size_t>(4, LP_SECTOR_SIZE));
+
+    unique_ptr<LpMetadata> imported = ReadMetadata(opener, "super", 0);
+    ASSERT_NE(imported, nullptr);
+    ASSERT_EQ(imported->partitions.size(), 20);
+    EXPECT_EQ(GetPartitionName(imported->partitions.back()), "xart19");
+
+    // The backup copy must match as well.
+    unique_ptr<LpMetadata> backup = ReadBackupMetadata(fd, imported->geometry, 0);
+    ASSERT_NE(backup, nullptr);
+    EXPECT_EQ(GetPartitionName(backup->partitions.back()), "xart19");
+}
+
 // Test that writing a sparse image can be read back.
 TEST_F(LiblpTest, FlashSparseImage) {
     unique_fd fd = CreateFakeDisk();
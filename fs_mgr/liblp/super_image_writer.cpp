@@ -0,0 +1,486 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+#include <liblp/super_layout_builder.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include <android-base/file.h>
+#include <sparse/sparse_format.h>
+
+#include "utility.h"
+
+namespace android {
+namespace fs_mgr {
+
+using android::base::borrowed_fd;
+using android::base::unique_fd;
+
+// Partition images are read in pieces of this size.
+static constexpr size_t kReadSize = 1024 * 1024;
+static constexpr uint32_t kMaxReadThreads = 8;
+
+namespace {
+
+// One step of the walk over the layout. Partition extents are split into
+// several steps so they can be read in parallel.
+struct WriteStep {
+    const SuperImageExtent* extent;
+    // Image to read from, or -1 if there is nothing to read.
+    int image_fd;
+    uint64_t image_offset;
+    uint64_t super_offset;
+    uint64_t size;
+};
+
+class SuperImageWriter final {
+  public:
+    SuperImageWriter(borrowed_fd fd, const SuperImageWriteOptions& options);
+
+    bool Write(const std::vector<SuperImageExtent>& extents);
+
+  private:
+    bool OpenImages(const std::vector<SuperImageExtent>& extents);
+    bool CheckLayout(const std::vector<SuperImageExtent>& extents);
+    bool CopyImageRange(const WriteStep& step, bool* supported);
+    bool WriteRaw(const std::vector<SuperImageExtent>& extents);
+    bool WriteSparse(const std::vector<SuperImageExtent>& extents);
+    bool WriteSparseStep(const WriteStep& step, const std::string& data);
+    bool AddChunk(uint16_t type, uint64_t size, const void* data, size_t data_size);
+    bool AddDataChunks(const char* data, uint64_t size);
+    bool RunSteps(const std::vector<WriteStep>& steps,
+                  const std::function<bool(const WriteStep&, const std::string&)>& consume);
+    std::vector<WriteStep> SplitIntoSteps(const std::vector<SuperImageExtent>& extents) const;
+
+    borrowed_fd fd_;
+    SuperImageWriteOptions options_;
+    std::map<std::string, unique_fd> images_;
+    uint64_t image_size_ = 0;
+    uint32_t total_chunks_ = 0;
+};
+
+}  // namespace
+
+SuperImageWriter::SuperImageWriter(borrowed_fd fd, const SuperImageWriteOptions& options)
+    : fd_(fd), options_(options) {
+    if (!options_.num_threads) {
+        options_.num_threads = std::clamp(std::thread::hardware_concurrency(), 1u, kMaxReadThreads);
+    }
+}
+
+bool SuperImageWriter::OpenImages(const std::vector<SuperImageExtent>& extents) {
+    for (const auto& extent : extents) {
+        if (extent.type != SuperImageExtent::Type::PARTITION ||
+            images_.count(extent.image_name)) {
+            continue;
+        }
+        unique_fd fd = GetControlFileOrOpen(extent.image_name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            PERROR << "open image file failed: " << extent.image_name;
+            return false;
+        }
+        uint32_t magic;
+        if (pread(fd.get(), &magic, sizeof(magic), 0) == sizeof(magic) &&
+            magic == SPARSE_HEADER_MAGIC) {
+            LERROR << "Sparse partition images are not supported: " << extent.image_name;
+            return false;
+        }
+        images_.emplace(extent.image_name, std::move(fd));
+    }
+    return true;
+}
+
+bool SuperImageWriter::CheckLayout(const std::vector<SuperImageExtent>& extents) {
+    if (extents.empty()) {
+        LERROR << "Super image layout is empty";
+        return false;
+    }
+    uint64_t offset = 0;
+    for (const auto& extent : extents) {
+        if (extent.offset != offset) {
+            LERROR << "Super image layout is not contiguous at offset " << offset;
+            return false;
+        }
+        if (options_.sparse && (extent.size % options_.block_size) != 0) {
+            LERROR << "Extent at offset " << extent.offset << " is not aligned to block size "
+                   << options_.block_size;
+            return false;
+        }
+        if (extent.type == SuperImageExtent::Type::DATA && extent.blob->size() != extent.size) {
+            LERROR << "Data extent at offset " << extent.offset << " has the wrong size";
+            return false;
+        }
+        offset += extent.size;
+    }
+    if (options_.sparse && offset / options_.block_size > UINT_MAX) {
+        LERROR << "Super image is too large to encode as a sparse image";
+        return false;
+    }
+    image_size_ = offset;
+    return true;
+}
+
+bool SuperImageWriter::Write(const std::vector<SuperImageExtent>& extents) {
+    if (!options_.block_size || options_.block_size % LP_SECTOR_SIZE != 0) {
+        LERROR << "Invalid sparse block size: " << options_.block_size;
+        return false;
+    }
+    if (!CheckLayout(extents) || !OpenImages(extents)) {
+        return false;
+    }
+    if (ftruncate(fd_.get(), 0) < 0) {
+        PERROR << "ftruncate failed";
+        return false;
+    }
+    return options_.sparse ? WriteSparse(extents) : WriteRaw(extents);
+}
+
+std::vector<WriteStep> SuperImageWriter::SplitIntoSteps(
+        const std::vector<SuperImageExtent>& extents) const {
+    // Steps end on block boundaries, so that each one becomes whole sparse
+    // chunks.
+    const uint64_t step_size =
+            std::max<uint64_t>(kReadSize - kReadSize % options_.block_size, options_.block_size);
+
+    std::vector<WriteStep> steps;
+    for (const auto& extent : extents) {
+        if (extent.type != SuperImageExtent::Type::PARTITION) {
+            steps.emplace_back(WriteStep{&extent, -1, 0, extent.offset, extent.size});
+            continue;
+        }
+        int image_fd = images_.at(extent.image_name).get();
+        for (uint64_t pos = 0; pos < extent.size; pos += step_size) {
+            uint64_t size = std::min<uint64_t>(step_size, extent.size - pos);
+            steps.emplace_back(WriteStep{&extent, image_fd, extent.image_offset + pos,
+                                         extent.offset + pos, size});
+        }
+    }
+    return steps;
+}
+
+// Read each step's data on a pool of threads, and hand it to |consume| in
+// order. Only a bounded number of reads run ahead of |consume|.
+bool SuperImageWriter::RunSteps(
+        const std::vector<WriteStep>& steps,
+        const std::function<bool(const WriteStep&, const std::string&)>& consume) {
+    const size_t window = options_.num_threads * 2;
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::vector<std::optional<std::string>> results(steps.size());
+    size_t next_read = 0;
+    size_t next_consume = 0;
+    bool failed = false;
+
+    auto worker = [&]() -> void {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            cv.wait(guard, [&]() -> bool {
+                return failed || next_read >= steps.size() || next_read < next_consume + window;
+            });
+            if (failed || next_read >= steps.size()) {
+                return;
+            }
+            const WriteStep& step = steps[next_read++];
+            guard.unlock();
+
+            // Anything past the end of the image reads as zeroes, since
+            // partitions are rounded up to the logical block size.
+            std::string data;
+            bool ok = true;
+            if (step.image_fd >= 0) {
+                data.resize(step.size, '\0');
+                size_t pos = 0;
+                while (pos < data.size()) {
+                    ssize_t rv = TEMP_FAILURE_RETRY(pread(step.image_fd, data.data() + pos,
+                                                          data.size() - pos,
+                                                          step.image_offset + pos));
+                    if (rv < 0) {
+                        PERROR << "read image file failed";
+                        ok = false;
+                        break;
+                    }
+                    if (rv == 0) {
+                        break;
+                    }
+                    pos += rv;
+                }
+            }
+
+            guard.lock();
+            if (!ok) {
+                failed = true;
+            } else {
+                results[&step - steps.data()] = std::move(data);
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < options_.num_threads; i++) {
+        threads.emplace_back(worker);
+    }
+
+    for (size_t i = 0; i < steps.size(); i++) {
+        std::string data;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cv.wait(guard, [&]() -> bool { return failed || results[i].has_value(); });
+            if (failed) {
+                break;
+            }
+            data = std::move(*results[i]);
+            results[i].reset();
+            next_consume = i + 1;
+            cv.notify_all();
+        }
+        if (!consume(steps[i], data)) {
+            std::lock_guard<std::mutex> guard(lock);
+            failed = true;
+            cv.notify_all();
+            break;
+        }
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return !failed;
+}
+
+// Copy a partition extent to the raw output inside the kernel. On failure,
+// |supported| is set to false if the caller should fall back to reading and
+// writing the data itself.
+bool SuperImageWriter::CopyImageRange(const WriteStep& step, bool* supported) {
+    *supported = false;
+#if defined(__linux__)
+    loff_t in_offset = step.image_offset;
+    loff_t out_offset = step.super_offset;
+    uint64_t remaining = step.size;
+    while (remaining) {
+        ssize_t rv = copy_file_range(step.image_fd, &in_offset, fd_.get(), &out_offset,
+                                     remaining, 0);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP) {
+                return false;
+            }
+            *supported = true;
+            PERROR << "copy_file_range failed";
+            return false;
+        }
+        if (rv == 0) {
+            // End of the image. The rest of the extent is left as a hole.
+            break;
+        }
+        remaining -= rv;
+    }
+    *supported = true;
+    return true;
+#else
+    (void)step;
+    return false;
+#endif
+}
+
+bool SuperImageWriter::WriteRaw(const std::vector<SuperImageExtent>& extents) {
+    // Zero and don't-care extents are left as holes.
+    if (ftruncate(fd_.get(), image_size_) < 0) {
+        PERROR << "ftruncate failed";
+        return false;
+    }
+
+    bool use_copy_file_range = true;
+    std::vector<WriteStep> steps;
+    for (const auto& step : SplitIntoSteps(extents)) {
+        if (step.extent->type == SuperImageExtent::Type::DATA) {
+            steps.emplace_back(step);
+            continue;
+        }
+        if (step.extent->type != SuperImageExtent::Type::PARTITION) {
+            continue;
+        }
+        if (use_copy_file_range) {
+            bool supported;
+            if (CopyImageRange(step, &supported)) {
+                continue;
+            }
+            if (supported) {
+                return false;
+            }
+            use_copy_file_range = false;
+        }
+        steps.emplace_back(step);
+    }
+
+    return RunSteps(steps, [this](const WriteStep& step, const std::string& data) -> bool {
+        const void* buffer = data.data();
+        size_t size = data.size();
+        if (step.extent->type == SuperImageExtent::Type::DATA) {
+            buffer = step.extent->blob->data();
+            size = step.extent->blob->size();
+        }
+        if (!size) {
+            return true;
+        }
+        if (SeekFile64(fd_.get(), step.super_offset, SEEK_SET) < 0) {
+            PERROR << "lseek failed";
+            return false;
+        }
+        if (!android::base::WriteFully(fd_, buffer, size)) {
+            PERROR << "write " << size << " bytes failed";
+            return false;
+        }
+        return true;
+    });
+}
+
+bool SuperImageWriter::AddChunk(uint16_t type, uint64_t size, const void* data,
+                                size_t data_size) {
+    chunk_header_t header = {};
+    header.chunk_type = type;
+    header.chunk_sz = size / options_.block_size;
+    header.total_sz = sizeof(header) + data_size;
+    if (!android::base::WriteFully(fd_, &header, sizeof(header)) ||
+        !android::base::WriteFully(fd_, data, data_size)) {
+        PERROR << "write sparse chunk failed";
+        return false;
+    }
+    total_chunks_++;
+    return true;
+}
+
+// Emit |data| as a series of raw and fill chunks, folding runs of blocks
+// that repeat a single 32-bit value into fill chunks.
+bool SuperImageWriter::AddDataChunks(const char* data, uint64_t size) {
+    const size_t block_size = options_.block_size;
+
+    auto fill_value = [&](uint64_t block_offset, uint32_t* value) -> bool {
+        const char* block = data + block_offset;
+        memcpy(value, block, sizeof(*value));
+        for (size_t i = sizeof(*value); i < block_size; i += sizeof(*value)) {
+            if (memcmp(block + i, value, sizeof(*value)) != 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    uint64_t run_start = 0;
+    std::optional<uint32_t> run_fill;
+    auto flush = [&](uint64_t run_end) -> bool {
+        if (run_end == run_start) {
+            return true;
+        }
+        uint64_t run_size = run_end - run_start;
+        if (run_fill) {
+            uint32_t value = *run_fill;
+            return AddChunk(CHUNK_TYPE_FILL, run_size, &value, sizeof(value));
+        }
+        return AddChunk(CHUNK_TYPE_RAW, run_size, data + run_start, run_size);
+    };
+
+    for (uint64_t offset = 0; offset < size; offset += block_size) {
+        uint32_t value;
+        std::optional<uint32_t> block_fill;
+        if (fill_value(offset, &value)) {
+            block_fill = value;
+        }
+        if (offset != run_start && block_fill != run_fill) {
+            if (!flush(offset)) {
+                return false;
+            }
+            run_start = offset;
+        }
+        run_fill = block_fill;
+    }
+    return flush(size);
+}
+
+bool SuperImageWriter::WriteSparseStep(const WriteStep& step, const std::string& data) {
+    switch (step.extent->type) {
+        case SuperImageExtent::Type::DONTCARE:
+            return AddChunk(CHUNK_TYPE_DONT_CARE, step.size, nullptr, 0);
+        case SuperImageExtent::Type::ZERO: {
+            uint32_t value = 0;
+            return AddChunk(CHUNK_TYPE_FILL, step.size, &value, sizeof(value));
+        }
+        case SuperImageExtent::Type::DATA:
+            return AddChunk(CHUNK_TYPE_RAW, step.size, step.extent->blob->data(), step.size);
+        case SuperImageExtent::Type::PARTITION:
+            return AddDataChunks(data.data(), data.size());
+        default:
+            LERROR << "Unrecognized extent type in super image layout";
+            return false;
+    }
+}
+
+bool SuperImageWriter::WriteSparse(const std::vector<SuperImageExtent>& extents) {
+    // The chunk count is only known at the end, so write the header last.
+    sparse_header_t header = {};
+    if (!android::base::WriteFully(fd_, &header, sizeof(header))) {
+        PERROR << "write sparse header failed";
+        return false;
+    }
+
+    auto steps = SplitIntoSteps(extents);
+    if (!RunSteps(steps, [this](const WriteStep& step, const std::string& data) -> bool {
+            return WriteSparseStep(step, data);
+        })) {
+        return false;
+    }
+
+    header.magic = SPARSE_HEADER_MAGIC;
+    header.major_version = 1;
+    header.minor_version = 0;
+    header.file_hdr_sz = sizeof(sparse_header_t);
+    header.chunk_hdr_sz = sizeof(chunk_header_t);
+    header.blk_sz = options_.block_size;
+    header.total_blks = image_size_ / options_.block_size;
+    header.total_chunks = total_chunks_;
+    if (SeekFile64(fd_.get(), 0, SEEK_SET) < 0) {
+        PERROR << "lseek failed";
+        return false;
+    }
+    if (!android::base::WriteFully(fd_, &header, sizeof(header))) {
+        PERROR << "write sparse header failed";
+        return false;
+    }
+    return true;
+}
+
+bool WriteSuperImage(borrowed_fd fd, const std::vector<SuperImageExtent>& extents,
+                     const SuperImageWriteOptions& options) {
+    SuperImageWriter writer(fd, options);
+    return writer.Write(extents);
+}
+
+}  // namespace fs_mgr
+}  // namespace android
@@ -14,10 +14,14 @@
 // limitations under the License.
 //
 
+#include <fcntl.h>
+
+#include <android-base/file.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <liblp/builder.h>
 #include <liblp/super_layout_builder.h>
+#include <sparse/sparse.h>
 #include <storage_literals/storage_literals.h>
 
 #include "images.h"
@@ -25,6 +29,8 @@
 
 using namespace android::fs_mgr;
 using namespace android::storage_literals;
+using android::base::ReadFileToString;
+using android::base::WriteStringToFile;
 
 TEST(SuperImageTool, Layout) {
     auto builder = MetadataBuilder::New(4_MiB, 8_KiB, 2);
@@ -139,3 +145,161 @@ TEST(SuperImageTool, LargeAlignedMetadata) {
     auto extents = tool.GetImageLayout();
     ASSERT_TRUE(extents.empty());
 }
+
+TEST(SuperImageTool, WriteImage) {
+    auto builder = MetadataBuilder::New(4_MiB, 8_KiB, 2);
+    ASSERT_NE(builder, nullptr);
+    ASSERT_NE(builder->AddPartition("system_a", LP_PARTITION_ATTR_READONLY), nullptr);
+    ASSERT_NE(builder->AddPartition("vendor_a", LP_PARTITION_ATTR_READONLY), nullptr);
+
+    auto metadata = builder->Export();
+    ASSERT_NE(metadata, nullptr);
+
+    // Mix data and zero blocks, and leave the last block partially filled.
+    std::string system_data(2_MiB + 6_KiB, '\0');
+    for (size_t i = 0; i < system_data.size(); i += 3) {
+        if ((i / 4_KiB) % 3 != 1) {
+            system_data[i] = static_cast<char>(i);
+        }
+    }
+    std::string vendor_data(8_KiB, 'v');
+
+    TemporaryFile system_image;
+    TemporaryFile vendor_image;
+    ASSERT_TRUE(WriteStringToFile(system_data, system_image.path));
+    ASSERT_TRUE(WriteStringToFile(vendor_data, vendor_image.path));
+
+    SuperLayoutBuilder tool;
+    ASSERT_TRUE(tool.Open(*metadata.get()));
+    ASSERT_TRUE(tool.AddPartition("system_a", system_image.path, system_data.size()));
+    ASSERT_TRUE(tool.AddPartition("vendor_a", vendor_image.path, vendor_data.size()));
+
+    auto extents = tool.GetImageLayout();
+    ASSERT_FALSE(extents.empty());
+    uint64_t image_size = extents.back().offset + extents.back().size;
+
+    std::string expected(image_size, '\0');
+    for (const auto& extent : extents) {
+        if (extent.type == SuperImageExtent::Type::DATA) {
+            expected.replace(extent.offset, extent.size, *extent.blob);
+        } else if (extent.type == SuperImageExtent::Type::PARTITION) {
+            const auto& data = extent.image_name == system_image.path ? system_data : vendor_data;
+            auto piece = data.substr(extent.image_offset, extent.size);
+            expected.replace(extent.offset, piece.size(), piece);
+        }
+    }
+
+    TemporaryFile raw;
+    ASSERT_TRUE(WriteSuperImage(raw.fd, extents));
+    std::string actual;
+    ASSERT_TRUE(ReadFileToString(raw.path, &actual));
+    EXPECT_EQ(actual, expected);
+
+    SuperImageWriteOptions options;
+    options.sparse = true;
+    options.num_threads = 3;
+    TemporaryFile sparse;
+    ASSERT_TRUE(WriteSuperImage(sparse.fd, extents, options));
+
+    ASSERT_EQ(lseek(sparse.fd, 0, SEEK_SET), 0);
+    std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)> file(
+            sparse_file_import(sparse.fd, false, false), sparse_file_destroy);
+    ASSERT_NE(file, nullptr);
+    TemporaryFile unsparsed;
+    ASSERT_EQ(sparse_file_write(file.get(), unsparsed.fd, false, false, false), 0);
+    ASSERT_TRUE(ReadFileToString(unsparsed.path, &actual));
+    EXPECT_EQ(actual, expected);
+}
+
+TEST(SuperImageTool, WriteSparseImageOddBlockSize) {
+    // 1536 doesn't divide the 1MiB read size, so reads must be cut on block
+    // boundaries for the chunks to be whole blocks.
+    static constexpr uint32_t kBlockSize = 1536;
+
+    std::string data(kBlockSize * 1400, '\0');
+    for (size_t i = 0; i < data.size(); i++) {
+        size_t block = i / kBlockSize;
+        data[i] = static_cast<char>(block % 3 == 0 ? 'a' + block % 5 : i * 7);
+    }
+    TemporaryFile image;
+    ASSERT_TRUE(WriteStringToFile(data, image.path));
+
+    std::vector<SuperImageExtent> extents = {
+            SuperImageExtent(0, data.size(), image.path, 0),
+            SuperImageExtent(data.size(), kBlockSize * 4, SuperImageExtent::Type::ZERO),
+    };
+    std::string expected = data + std::string(kBlockSize * 4, '\0');
+
+    SuperImageWriteOptions options;
+    options.sparse = true;
+    options.block_size = kBlockSize;
+    options.num_threads = 2;
+    TemporaryFile sparse;
+    ASSERT_TRUE(WriteSuperImage(sparse.fd, extents, options));
+
+    ASSERT_EQ(lseek(sparse.fd, 0, SEEK_SET), 0);
+    std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)> file(
+            sparse_file_import(sparse.fd, false, false), sparse_file_destroy);
+    ASSERT_NE(file, nullptr);
+    TemporaryFile unsparsed;
+    ASSERT_EQ(sparse_file_write(file.get(), unsparsed.fd, false, false, false), 0);
+    std::string actual;
+    ASSERT_TRUE(ReadFileToString(unsparsed.path, &actual));
+    EXPECT_EQ(actual, expected);
+}
+
+// Unsparse |path| if it's a sparse image.
+static std::string ReadImage(const std::string& path) {
+    android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)> file(
+            sparse_file_import(fd.get(), false, false), sparse_file_destroy);
+    std::string data;
+    if (!file) {
+        ReadFileToString(path, &data);
+        return data;
+    }
+    TemporaryFile unsparsed;
+    if (sparse_file_write(file.get(), unsparsed.fd, false, false, false) == 0) {
+        ReadFileToString(unsparsed.path, &data);
+    }
+    return data;
+}
+
+TEST(SuperImageTool, WriteToImageFileMatchesImageBuilder) {
+    auto builder = MetadataBuilder::New(8_MiB, 8_KiB, 2);
+    ASSERT_NE(builder, nullptr);
+    auto system = builder->AddPartition("system", LP_PARTITION_ATTR_READONLY);
+    auto vendor = builder->AddPartition("vendor", LP_PARTITION_ATTR_READONLY);
+    ASSERT_NE(system, nullptr);
+    ASSERT_NE(vendor, nullptr);
+    ASSERT_TRUE(builder->ResizePartition(system, 3_MiB));
+    ASSERT_TRUE(builder->ResizePartition(vendor, 1_MiB));
+    auto metadata = builder->Export();
+    ASSERT_NE(metadata, nullptr);
+
+    // The system image doesn't fill its partition, and ends mid-block.
+    std::string system_data(2_MiB + 6_KiB, '\0');
+    for (size_t i = 0; i < system_data.size(); i += 3) {
+        system_data[i] = static_cast<char>(i);
+    }
+    TemporaryFile system_image;
+    TemporaryFile vendor_image;
+    ASSERT_TRUE(WriteStringToFile(system_data, system_image.path));
+    ASSERT_TRUE(WriteStringToFile(std::string(1_MiB, 'v'), vendor_image.path));
+    std::map<std::string, std::string> images = {
+            {"system", system_image.path},
+            {"vendor", vendor_image.path},
+    };
+
+    for (bool sparsify : {false, true}) {
+        TemporaryFile expected;
+        ImageBuilder image_builder(*metadata.get(), 4096, images, sparsify);
+        ASSERT_TRUE(image_builder.IsValid());
+        ASSERT_TRUE(image_builder.Build());
+        ASSERT_TRUE(image_builder.Export(expected.path));
+
+        TemporaryFile actual;
+        ASSERT_TRUE(WriteToImageFile(actual.path, *metadata.get(), 4096, images, sparsify));
+        EXPECT_EQ(ReadImage(actual.path), ReadImage(expected.path)) << "sparsify: " << sparsify;
+    }
+}
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
 
 #include <android-base/file.h>
@@ -237,6 +238,81 @@ static bool WriteMetadata(int fd, const LpMetadata& metadata, uint32_t slot_numb
     return true;
 }
 
+// Write |blob| over the copy of the metadata at |offset|, touching only the
+// sectors whose contents differ from what is on disk. The header sector is
+// always written, since its checksums change with any update. A partial
+// write leaves this copy with a bad checksum, just like an interrupted full
+// write, so callers keep the same primary-then-backup ordering.
+static bool WriteMetadataDelta(int fd, const LpMetadata& metadata, int64_t offset,
+                               const std::string& blob,
+                               const std::function<bool(int, const std::string&)>& writer) {
+    if (!ValidateMetadataRegion(metadata, offset, blob.size())) {
+        return false;
+    }
+
+    std::string old_blob(blob.size(), '\0');
+    if (SeekFile64(fd, offset, SEEK_SET) < 0 ||
+        !android::base::ReadFully(fd, old_blob.data(), old_blob.size())) {
+        PWARNING << __PRETTY_FUNCTION__ << " read " << old_blob.size()
+                 << " bytes failed, rewriting the whole copy";
+        old_blob.clear();
+    }
+
+    auto sector_changed = [&](size_t start) -> bool {
+        if (start == 0 || old_blob.empty()) {
+            return true;
+        }
+        size_t length = std::min(static_cast<size_t>(LP_SECTOR_SIZE), blob.size() - start);
+        return memcmp(blob.data() + start, old_blob.data() + start, length) != 0;
+    };
+
+    size_t start = 0;
+    while (start < blob.size()) {
+        if (!sector_changed(start)) {
+            start += LP_SECTOR_SIZE;
+            continue;
+        }
+        // Coalesce adjacent changed sectors into a single write.
+        size_t end = start + LP_SECTOR_SIZE;
+        while (end < blob.size() && sector_changed(end)) {
+            end += LP_SECTOR_SIZE;
+        }
+        end = std::min(end, blob.size());
+
+        if (SeekFile64(fd, offset + start, SEEK_SET) < 0) {
+            PERROR << __PRETTY_FUNCTION__ << " lseek failed: offset " << offset + start;
+            return false;
+        }
+        if (!writer(fd, blob.substr(start, end - start))) {
+            PERROR << __PRETTY_FUNCTION__ << " write " << end - start << " bytes at offset "
+                   << offset + start << " failed";
+            return false;
+        }
+        start = end;
+    }
+    return true;
+}
+
+// Same as WriteMetadata, for a slot whose primary and backup copies are known
+// to be identical.
+static bool UpdateMetadata(int fd, const LpMetadata& metadata, uint32_t slot_number,
+                           const std::string& blob,
+                           const std::function<bool(int, const std::string&)>& writer) {
+    if (slot_number >= metadata.geometry.metadata_slot_count) {
+        LERROR << "Invalid logical partition metadata slot number.";
+        return false;
+    }
+    int64_t primary_offset = GetPrimaryMetadataOffset(metadata.geometry, slot_number);
+    if (!WriteMetadataDelta(fd, metadata, primary_offset, blob, writer)) {
+        return false;
+    }
+    int64_t backup_offset = GetBackupMetadataOffset(metadata.geometry, slot_number);
+    if (!WriteMetadataDelta(fd, metadata, backup_offset, blob, writer)) {
+        return false;
+    }
+    return true;
+}
+
 static bool DefaultWriter(int fd, const std::string& blob) {
     return android::base::WriteFully(fd, blob.data(), blob.size());
 }
@@ -389,8 +465,15 @@ bool UpdatePartitionTable(const IPartitionOpener& opener, const std::string& sup
         }
     }
 
-    // Both copies should now be in sync, so we can continue the update.
-    if (!WriteMetadata(fd, metadata, slot_number, blob, writer)) {
+    // Both copies should now be in sync, so we can continue the update. If
+    // neither could be read, there is nothing to diff against.
+    bool ok;
+    if (primary || backup) {
+        ok = UpdateMetadata(fd, metadata, slot_number, blob, writer);
+    } else {
+        ok = WriteMetadata(fd, metadata, slot_number, blob, writer);
+    }
+    if (!ok) {
         return false;
     }
 
@@ -38,10 +38,13 @@ class ICompressor {
     static std::unique_ptr<ICompressor> Lz4(const int32_t compression_level,
                                             const uint32_t block_size);
     static std::unique_ptr<ICompressor> Zstd(const int32_t compression_level,
-                                             const uint32_t block_size);
+                                             const uint32_t block_size,
+                                             const std::vector<uint8_t>& dictionary = {});
 
+    // |dictionary| is only supported by zstd. Returns nullptr if it can't be loaded.
     static std::unique_ptr<ICompressor> Create(CowCompression compression,
-                                               const uint32_t block_size);
+                                               const uint32_t block_size,
+                                               const std::vector<uint8_t>& dictionary = {});
 
     int32_t GetCompressionLevel() const { return compression_level_; }
     uint32_t GetBlockSize() const { return block_size_; }
@@ -51,5 +54,12 @@ class ICompressor {
     const int32_t compression_level_;
     const uint32_t block_size_;
 };
+
+// Train a zstd dictionary of at most |max_dictionary_size| bytes from
+// |samples|, which holds |sample_sizes.size()| samples back to back. Returns an
+// empty vector on failure, e.g. if there are too few samples.
+std::vector<uint8_t> TrainZstdDictionary(const void* samples, const std::vector<size_t>& sample_sizes,
+                                         size_t max_dictionary_size);
+
 }  // namespace snapshot
 }  // namespace android
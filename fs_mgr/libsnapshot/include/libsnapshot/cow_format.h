@@ -115,8 +115,16 @@ struct CowHeaderV3 : public CowHeader {
     uint32_t compression_algorithm;
     // Max compression size supported
     uint32_t max_compression_size;
+    // Size of the zstd compression dictionary stored after the operation
+    // buffer; 0 if the COW has no dictionary.
+    uint32_t dictionary_size;
 } __attribute__((packed));
 
+// Size of the v3 header before |dictionary_size| was added. COWs without a
+// dictionary are still written with this header size, so that readers which
+// predate the dictionary keep working.
+static constexpr uint16_t kCowHeaderV3BaseSize = sizeof(CowHeaderV3) - sizeof(uint32_t);
+
 enum class CowOperationType : uint8_t {
     kCowCopyOp = 1,
     kCowReplaceOp = 2,
@@ -307,10 +315,14 @@ static constexpr off_t GetOpOffset(uint32_t op_index, const CowHeaderV3& header)
            (op_index * sizeof(CowOperationV3));
 }
 
-static constexpr off_t GetDataOffset(const CowHeaderV3& header) {
+static constexpr off_t GetDictionaryOffset(const CowHeaderV3& header) {
     return GetOpOffset(header.op_count_max, header);
 }
 
+static constexpr off_t GetDataOffset(const CowHeaderV3& header) {
+    return GetDictionaryOffset(header) + header.dictionary_size;
+}
+
 struct CowFooter {
     CowFooterOperation op;
     uint8_t unused[64];
@@ -28,10 +28,14 @@ namespace chromeos_update_engine {
 class FileDescriptor;
 }  // namespace chromeos_update_engine
 
+// Digested zstd dictionary (ZSTD_DDict), see CowHeaderV3::dictionary_size.
+struct ZSTD_DDict_s;
+
 namespace android {
 namespace snapshot {
 
 class ICowOpIter;
+class IDecompressor;
 
 // Interface for reading from a snapuserd COW.
 class ICowReader {
@@ -119,7 +123,7 @@ class CowReader final : public ICowReader {
     };
 
     CowReader(ReaderFlags reader_flag = ReaderFlags::DEFAULT, bool is_merge = false);
-    ~CowReader() { owned_fd_ = {}; }
+    ~CowReader();
 
     // Parse the COW, optionally, up to the given label. If no label is
     // specified, the COW must have an intact footer.
@@ -168,6 +172,15 @@ class CowReader final : public ICowReader {
 
     void UpdateMergeOpsCompleted(int num_merge_ops) { header_.num_merge_ops += num_merge_ops; }
 
+    // Position in the operation table of an op returned by one of the
+    // iterators, and back. The table is shared with cloned readers, so a
+    // position is valid for all of them.
+    uint32_t GetOpIndex(const CowOperation* op) const { return op - ops_->data(); }
+    const CowOperation* GetOp(uint32_t index) const { return &ops_->data()[index]; }
+
+    // Bytes of heap memory held by the operation table and merge indices.
+    size_t GetMemoryUsage() const;
+
   private:
     bool ParseV2(android::base::borrowed_fd fd, std::optional<uint64_t> label);
     bool PrepMergeOps();
@@ -179,6 +192,7 @@ class CowReader final : public ICowReader {
                          std::unordered_map<uint32_t, int>* block_map);
     uint64_t FindNumCopyops();
     uint8_t GetCompressionType();
+    bool ReadCompressionDictionary();
 
     android::base::unique_fd owned_fd_;
     android::base::borrowed_fd fd_;
@@ -193,6 +207,9 @@ class CowReader final : public ICowReader {
     uint64_t num_ordered_ops_to_merge_{};
     bool has_seq_ops_{};
     std::shared_ptr<std::unordered_map<uint64_t, uint64_t>> xor_data_loc_;
+    std::shared_ptr<ZSTD_DDict_s> zstd_dictionary_;
+    // Not shared with clones: a decompressor is used by one thread only.
+    std::unique_ptr<IDecompressor> zstd_decompressor_;
     ReaderFlags reader_flag_;
     bool is_merge_{};
 };
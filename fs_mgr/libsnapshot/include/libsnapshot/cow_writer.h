@@ -63,6 +63,19 @@ struct CowOptions {
 
     // Compression factor
     uint64_t compression_factor = 4096;
+
+    // Compress data ops on |num_compress_threads| threads in the background
+    // while the caller keeps adding blocks; used in v3 only. Ops are still
+    // written in order, so the COW is the same as without it. Failures to
+    // compress or write a block may be reported by a later call. Enabled by
+    // create_cow --pipelined_compression, and for OTAs by
+    // ro.virtual_ab.compression.pipelined.
+    bool pipelined_compression = false;
+
+    // Dictionary used to compress every data op, see TrainZstdDictionary().
+    // It is stored in the COW for the readers; v3 with zstd only. Appending
+    // to a COW requires the dictionary it was created with.
+    std::vector<uint8_t> compression_dictionary;
 };
 
 // Interface for writing to a snapuserd COW. All operations are ordered; merges
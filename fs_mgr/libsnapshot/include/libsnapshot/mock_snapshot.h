@@ -38,6 +38,10 @@ class MockSnapshotManager : public ISnapshotManager {
     MOCK_METHOD(bool, UpdateUsesUserSnapshots, (), (override));
     MOCK_METHOD(Return, CreateUpdateSnapshots,
                 (const chromeos_update_engine::DeltaArchiveManifest& manifest), (override));
+    MOCK_METHOD(Return, CreateUpdateSnapshots,
+                (const chromeos_update_engine::DeltaArchiveManifest& manifest,
+                 const CreateUpdateSnapshotsOptions& options),
+                (override));
     MOCK_METHOD(bool, MapUpdateSnapshot,
                 (const android::fs_mgr::CreateLogicalPartitionParams& params,
                  std::string* snapshot_path),
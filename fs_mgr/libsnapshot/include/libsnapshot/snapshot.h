@@ -18,6 +18,7 @@
 #include <unistd.h>
 
 #include <chrono>
+#include <functional>
 #include <map>
 #include <memory>
 #include <optional>
@@ -95,6 +96,33 @@ enum class CancelResult : unsigned int {
     NEEDS_MERGE,
 };
 
+// Progress of CreateUpdateSnapshots(). While allocating COW images, |done| and
+// |total| are in bytes; while initializing snapshots, they count snapshots.
+struct CreateSnapshotsProgress {
+    enum class Stage {
+        AllocatingCowImages,
+        InitializingSnapshots,
+    };
+    Stage stage;
+    uint64_t done;
+    uint64_t total;
+};
+
+struct CreateUpdateSnapshotsOptions {
+    // Number of COW images allocated or initialized at once. 1 keeps the
+    // images strictly one after another; 0 uses one job per CPU. This only
+    // applies when the ImageManager is local, i.e. in recovery and first-stage
+    // init. Otherwise images go through gsid, which handles one request at a
+    // time, and the jobs always run one after another.
+    uint32_t max_jobs = 1;
+    // Upper bound, in bytes, on the COW images being allocated at once. An
+    // image larger than this is still allocated, on its own. 0 is no limit.
+    uint64_t io_budget = 0;
+    // Called from the jobs, one call at a time. Returning false cancels the
+    // remaining work, and CreateUpdateSnapshots() fails.
+    std::function<bool(const CreateSnapshotsProgress&)> progress;
+};
+
 class ISnapshotManager {
   public:
     // Dependency injection for testing.
@@ -217,6 +245,12 @@ class ISnapshotManager {
     virtual Return CreateUpdateSnapshots(
             const chromeos_update_engine::DeltaArchiveManifest& manifest) = 0;
 
+    // Same as above, but COW images may be allocated and initialized
+    // concurrently, and progress is reported, as set in |options|.
+    virtual Return CreateUpdateSnapshots(
+            const chromeos_update_engine::DeltaArchiveManifest& manifest,
+            const CreateUpdateSnapshotsOptions& options) = 0;
+
     // Map a snapshotted partition for OTA clients to write to. Write-protected regions are
     // determined previously in CreateSnapshots.
     //
@@ -382,6 +416,8 @@ class SnapshotManager final : public ISnapshotManager {
     bool UpdateUsesCompression() override;
     bool UpdateUsesUserSnapshots() override;
     Return CreateUpdateSnapshots(const DeltaArchiveManifest& manifest) override;
+    Return CreateUpdateSnapshots(const DeltaArchiveManifest& manifest,
+                                 const CreateUpdateSnapshotsOptions& options) override;
     bool MapUpdateSnapshot(const CreateLogicalPartitionParams& params,
                            std::string* snapshot_path) override;
     std::unique_ptr<ICowWriter> OpenSnapshotWriter(
@@ -414,6 +450,13 @@ class SnapshotManager final : public ISnapshotManager {
         uevent_regen_callback_ = callback;
     }
 
+    // Same as above, for a set of devices which were created together. If
+    // not set, the single-device callback is used for each device.
+    void SetUeventRegenBatchCallback(
+            std::function<bool(const std::vector<std::string>&)> callback) {
+        uevent_regen_batch_callback_ = callback;
+    }
+
     // If true, compression is enabled for this update. This is used by
     // first-stage to decide whether to launch snapuserd.
     bool IsSnapuserdRequired();
@@ -538,7 +581,8 @@ class SnapshotManager final : public ISnapshotManager {
 
     // |name| should be the base partition name (e.g. "system_a"). Create the
     // backing COW image using the size previously passed to CreateSnapshot().
-    Return CreateCowImage(LockedFile* lock, const std::string& name);
+    Return CreateCowImage(LockedFile* lock, const std::string& name,
+                          std::function<bool(uint64_t, uint64_t)>&& on_progress = nullptr);
 
     // Map a snapshot device that was previously created with CreateSnapshot.
     // If a merge was previously initiated, the device-mapper table will have a
@@ -658,10 +702,13 @@ class SnapshotManager final : public ISnapshotManager {
                                                      const std::string& name);
 
     // Note that these require the name of the device containing the snapshot,
-    // which may be the "inner" device. Use GetsnapshotDeviecName().
+    // which may be the "inner" device. Use GetsnapshotDeviecName(). If
+    // |devices| is given, the status is read from it rather than the kernel.
     bool QuerySnapshotStatus(const std::string& dm_name, std::string* target_type,
-                             DmTargetSnapshot::Status* status);
-    bool IsSnapshotDevice(const std::string& dm_name, TargetInfo* target = nullptr);
+                             DmTargetSnapshot::Status* status,
+                             const android::dm::DmDeviceSnapshot* devices = nullptr);
+    bool IsSnapshotDevice(const std::string& dm_name, TargetInfo* target = nullptr,
+                          const android::dm::DmDeviceSnapshot* devices = nullptr);
 
     // Internal callback for when merging is complete.
     bool OnSnapshotMergeComplete(LockedFile* lock, const std::string& name,
@@ -685,7 +732,8 @@ class SnapshotManager final : public ISnapshotManager {
     MergeResult CheckMergeState(const std::function<bool()>& before_cancel);
     MergeResult CheckMergeState(LockedFile* lock, const std::function<bool()>& before_cancel);
     MergeResult CheckTargetMergeState(LockedFile* lock, const std::string& name,
-                                      const SnapshotUpdateStatus& update_status);
+                                      const SnapshotUpdateStatus& update_status,
+                                      const android::dm::DmDeviceSnapshot* devices = nullptr);
 
     auto UpdateStateToStr(enum UpdateState state);
     // Get status or table information about a device-mapper node with a single target.
@@ -694,7 +742,8 @@ class SnapshotManager final : public ISnapshotManager {
         Status,
     };
     bool GetSingleTarget(const std::string& dm_name, TableQuery query,
-                         android::dm::DeviceMapper::TargetInfo* target);
+                         android::dm::DeviceMapper::TargetInfo* target,
+                         const android::dm::DmDeviceSnapshot* devices = nullptr);
 
     // Interact with status files under /metadata/ota/snapshots.
     bool WriteSnapshotStatus(LockedFile* lock, const SnapshotStatus& status);
@@ -741,6 +790,13 @@ class SnapshotManager final : public ISnapshotManager {
                                                              const SnapshotPaths& paths,
                                                              std::optional<uint64_t> label);
 
+    // Determine if there is a live snapshot for the SnapshotStatus of the
+    // partition in |params|, which must have been filled by InitDefaults. If
+    // there is no live snapshot or the merge has completed, |status| is set to
+    // nullopt.
+    bool GetLiveSnapshotStatus(LockedFile* lock, const CreateLogicalPartitionParams& params,
+                               std::optional<SnapshotStatus>* status);
+
     // Map the base device, COW devices, and snapshot device.
     bool MapPartitionWithSnapshot(LockedFile* lock, CreateLogicalPartitionParams params,
                                   SnapshotContext context, SnapshotPaths* paths);
@@ -776,7 +832,8 @@ class SnapshotManager final : public ISnapshotManager {
     // Creates all underlying images, COW partitions and snapshot files. Does not initialize them.
     Return CreateUpdateSnapshotsInternal(
             LockedFile* lock, const DeltaArchiveManifest& manifest,
-            PartitionCowCreator* cow_creator, AutoDeviceList* created_devices,
+            const CreateUpdateSnapshotsOptions& options, PartitionCowCreator* cow_creator,
+            AutoDeviceList* created_devices,
             std::map<std::string, SnapshotStatus>* all_snapshot_status);
 
     // Initialize snapshots so that they can be mapped later.
@@ -784,8 +841,18 @@ class SnapshotManager final : public ISnapshotManager {
     Return InitializeUpdateSnapshots(
             LockedFile* lock, uint32_t cow_version, MetadataBuilder* target_metadata,
             const LpMetadata* exported_target_metadata, const std::string& target_suffix,
+            const CreateUpdateSnapshotsOptions& options,
             const std::map<std::string, SnapshotStatus>& all_snapshot_status);
 
+    // The number of jobs to use for |options|, see CreateUpdateSnapshotsOptions.
+    uint32_t GetCowJobLimit(const CreateUpdateSnapshotsOptions& options);
+
+    // Helper for InitializeUpdateSnapshots, for a single snapshot. This can be
+    // called from several threads at once.
+    Return InitializeUpdateSnapshot(LockedFile* lock, uint32_t cow_version,
+                                    const CreateLogicalPartitionParams& cow_params,
+                                    const SnapshotStatus& status);
+
     // Implementation of UnmapAllSnapshots(), with the lock provided.
     bool UnmapAllSnapshots(LockedFile* lock);
 
@@ -832,6 +899,10 @@ class SnapshotManager final : public ISnapshotManager {
     // returns true.
     bool WaitForDevice(const std::string& device, std::chrono::milliseconds timeout_ms);
 
+    // Same as WaitForDevice, for devices which were created in one batch.
+    bool WaitForDevices(const std::vector<std::string>& devices,
+                        std::chrono::milliseconds timeout_ms);
+
     enum class InitTransition { SELINUX_DETACH, SECOND_STAGE };
 
     // Initiate the transition from first-stage to second-stage snapuserd. This
@@ -874,6 +945,21 @@ class SnapshotManager final : public ISnapshotManager {
     // Get the number of verification threads
     uint32_t GetNumVerificationThreads(LockedFile* lock);
 
+    // Get the number of read-ahead decompression threads
+    uint32_t GetNumDecompressThreads(LockedFile* lock);
+
+    // Get the number of in-flight dm-user requests per worker
+    uint32_t GetBlockServerQueueDepth(LockedFile* lock);
+
+    // Get the size of the decompressed block cache
+    uint64_t GetBlockCacheSize(LockedFile* lock);
+
+    // Get the I/O pressure target of the merge governor
+    uint32_t GetMergeIoPressureTarget(LockedFile* lock);
+
+    // Record the merge rate held by the snapuserd merge governor.
+    void UpdateMergeRateStats();
+
     // Wrapper around libdm, with diagnostics.
     bool DeleteDeviceIfExists(const std::string& name,
                               const std::chrono::milliseconds& timeout_ms = {});
@@ -890,6 +976,7 @@ class SnapshotManager final : public ISnapshotManager {
     std::unique_ptr<IImageManager> images_;
     bool use_first_stage_snapuserd_ = false;
     std::function<bool(const std::string&)> uevent_regen_callback_;
+    std::function<bool(const std::vector<std::string>&)> uevent_regen_batch_callback_;
     std::unique_ptr<SnapuserdClient> snapuserd_client_;
     std::unique_ptr<LpMetadata> old_partition_metadata_;
     std::optional<bool> is_snapshot_userspace_;
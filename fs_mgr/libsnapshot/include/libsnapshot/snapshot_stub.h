@@ -38,6 +38,8 @@ class SnapshotManagerStub : public ISnapshotManager {
     bool UpdateUsesUserSnapshots() override;
     Return CreateUpdateSnapshots(
             const chromeos_update_engine::DeltaArchiveManifest& manifest) override;
+    Return CreateUpdateSnapshots(const chromeos_update_engine::DeltaArchiveManifest& manifest,
+                                 const CreateUpdateSnapshotsOptions& options) override;
     bool MapUpdateSnapshot(const android::fs_mgr::CreateLogicalPartitionParams& params,
                            std::string* snapshot_path) override;
     std::unique_ptr<ICowWriter> OpenSnapshotWriter(
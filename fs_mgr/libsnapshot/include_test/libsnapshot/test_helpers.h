@@ -173,6 +173,9 @@ class DeviceMapperWrapper : public android::dm::IDeviceMapper {
     virtual bool DeleteDeviceIfExists(const std::string& name) {
         return impl_.DeleteDeviceIfExists(name);
     }
+    virtual bool QueryDevices(uint32_t flags, android::dm::DmDeviceSnapshot* devices) {
+        return impl_.QueryDevices(flags, devices);
+    }
 
   private:
     android::dm::IDeviceMapper& impl_;
@@ -0,0 +1,123 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "compression_pool.h"
+
+#include <string.h>
+
+#include <android-base/logging.h>
+
+namespace android {
+namespace snapshot {
+
+CompressionPool::CompressionPool(const CowCompression& compression, uint32_t max_compression_size,
+                                 int num_threads)
+    : compression_(compression),
+      max_compression_size_(max_compression_size),
+      num_threads_(num_threads) {}
+
+CompressionPool::~CompressionPool() {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stopped_ = true;
+    }
+    work_cv_.notify_all();
+    done_cv_.notify_all();
+
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+bool CompressionPool::Init(const std::vector<uint8_t>& dictionary) {
+    for (int i = 0; i < num_threads_; i++) {
+        auto compressor = ICompressor::Create(compression_, max_compression_size_, dictionary);
+        if (!compressor) {
+            LOG(ERROR) << "Failed to create compressor for " << compression_.algorithm;
+            return false;
+        }
+        compressors_.emplace_back(std::move(compressor));
+    }
+    for (auto& compressor : compressors_) {
+        threads_.emplace_back(&CompressionPool::ThreadLoop, this, compressor.get());
+    }
+    return true;
+}
+
+void CompressionPool::Submit(std::shared_ptr<CompressJob> job) {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        queue_.emplace_back(std::move(job));
+    }
+    work_cv_.notify_one();
+}
+
+bool CompressionPool::IsDone(const CompressJob* job) {
+    std::lock_guard<std::mutex> lock(lock_);
+    return job->done;
+}
+
+bool CompressionPool::Wait(const CompressJob* job) {
+    std::unique_lock<std::mutex> lock(lock_);
+    done_cv_.wait(lock, [&]() -> bool { return job->done || stopped_; });
+    return job->done && job->ok;
+}
+
+bool CompressionPool::CompressJobUnits(ICompressor* compressor, CompressJob* job) {
+    const uint8_t* iter = job->data.data();
+
+    job->compressed.clear();
+    job->compressed.reserve(job->unit_sizes.size());
+    for (size_t unit_size : job->unit_sizes) {
+        auto data = compressor->Compress(iter, unit_size);
+        if (data.empty()) {
+            PLOG(ERROR) << "Compression failed";
+            return false;
+        }
+        // Check if the buffer was indeed compressed
+        if (data.size() >= unit_size) {
+            data.resize(unit_size);
+            memcpy(data.data(), iter, unit_size);
+        }
+        job->compressed.emplace_back(std::move(data));
+        iter += unit_size;
+    }
+    return true;
+}
+
+void CompressionPool::ThreadLoop(ICompressor* compressor) {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true) {
+        work_cv_.wait(lock, [this]() -> bool { return stopped_ || !queue_.empty(); });
+        if (stopped_) {
+            return;
+        }
+
+        auto job = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        bool ok = CompressJobUnits(compressor, job.get());
+
+        lock.lock();
+        job->ok = ok;
+        job->done = true;
+        done_cv_.notify_all();
+    }
+}
+
+}  // namespace snapshot
+}  // namespace android
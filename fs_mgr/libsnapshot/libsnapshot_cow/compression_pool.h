@@ -0,0 +1,89 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <libsnapshot/cow_compress.h>
+
+namespace android {
+namespace snapshot {
+
+// A chunk of blocks to be compressed by a CompressionPool.
+struct CompressJob {
+    // Input data. The job owns a copy so that the caller's buffer can be
+    // reused as soon as the job is submitted.
+    std::vector<uint8_t> data;
+    // Size of each compression unit, in order; they add up to data.size().
+    std::vector<size_t> unit_sizes;
+    // Output of each unit. A unit which did not compress holds its input
+    // as-is, same as the synchronous writer path.
+    std::vector<std::vector<uint8_t>> compressed;
+
+    // Guarded by the pool lock.
+    bool done = false;
+    bool ok = false;
+};
+
+// Pool of threads compressing CompressJobs, each with its own ICompressor.
+// Jobs may complete in any order; callers wait on them in the order they
+// need the output.
+class CompressionPool {
+  public:
+    CompressionPool(const CowCompression& compression, uint32_t max_compression_size,
+                    int num_threads);
+    ~CompressionPool();
+
+    // |dictionary| is passed on to the compressors, see ICompressor::Create.
+    bool Init(const std::vector<uint8_t>& dictionary = {});
+
+    void Submit(std::shared_ptr<CompressJob> job);
+
+    // Returns true if |job| has been processed.
+    bool IsDone(const CompressJob* job);
+
+    // Wait for |job| to be processed. Returns false if compression failed.
+    bool Wait(const CompressJob* job);
+
+    size_t num_threads() const { return threads_.size(); }
+
+  private:
+    void ThreadLoop(ICompressor* compressor);
+    bool CompressJobUnits(ICompressor* compressor, CompressJob* job);
+
+    CowCompression compression_;
+    uint32_t max_compression_size_;
+    int num_threads_;
+
+    std::vector<std::unique_ptr<ICompressor>> compressors_;
+    std::vector<std::thread> threads_;
+
+    std::mutex lock_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::deque<std::shared_ptr<CompressJob>> queue_;
+    bool stopped_ = false;
+};
+
+}  // namespace snapshot
+}  // namespace android
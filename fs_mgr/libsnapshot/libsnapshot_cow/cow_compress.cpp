@@ -34,6 +34,7 @@
 #include <libsnapshot/cow_reader.h>
 #include <libsnapshot/cow_writer.h>
 #include <lz4.h>
+#include <zdict.h>
 #include <zlib.h>
 #include <zstd.h>
 
@@ -58,7 +59,12 @@ std::optional<CowCompressionAlgorithm> CompressionAlgorithmFromString(std::strin
 }
 
 std::unique_ptr<ICompressor> ICompressor::Create(CowCompression compression,
-                                                 const uint32_t block_size) {
+                                                 const uint32_t block_size,
+                                                 const std::vector<uint8_t>& dictionary) {
+    if (!dictionary.empty() && compression.algorithm != kCowCompressZstd) {
+        LOG(ERROR) << "Compression dictionaries are only supported with zstd";
+        return nullptr;
+    }
     switch (compression.algorithm) {
         case kCowCompressLz4:
             return ICompressor::Lz4(compression.compression_level, block_size);
@@ -67,7 +73,7 @@ std::unique_ptr<ICompressor> ICompressor::Create(CowCompression compression,
         case kCowCompressGz:
             return ICompressor::Gz(compression.compression_level, block_size);
         case kCowCompressZstd:
-            return ICompressor::Zstd(compression.compression_level, block_size);
+            return ICompressor::Zstd(compression.compression_level, block_size, dictionary);
         case kCowCompressNone:
             return nullptr;
     }
@@ -188,6 +194,17 @@ class ZstdCompressor final : public ICompressor {
         ZSTD_CCtx_setParameter(zstd_context_.get(), ZSTD_c_windowLog, log2(GetBlockSize()));
     };
 
+    // The dictionary is digested once and reused for every block.
+    bool LoadDictionary(const std::vector<uint8_t>& dictionary) {
+        auto rv = ZSTD_CCtx_loadDictionary(zstd_context_.get(), dictionary.data(),
+                                           dictionary.size());
+        if (ZSTD_isError(rv)) {
+            LOG(ERROR) << "ZSTD_CCtx_loadDictionary failed: " << ZSTD_getErrorName(rv);
+            return false;
+        }
+        return true;
+    }
+
     std::vector<uint8_t> Compress(const void* data, size_t length) const override {
         std::vector<uint8_t> buffer(ZSTD_compressBound(length), '\0');
         const auto compressed_size =
@@ -335,8 +352,26 @@ std::unique_ptr<ICompressor> ICompressor::Lz4(const int32_t compression_level,
 }
 
 std::unique_ptr<ICompressor> ICompressor::Zstd(const int32_t compression_level,
-                                               const uint32_t block_size) {
-    return std::make_unique<ZstdCompressor>(compression_level, block_size);
+                                               const uint32_t block_size,
+                                               const std::vector<uint8_t>& dictionary) {
+    auto compressor = std::make_unique<ZstdCompressor>(compression_level, block_size);
+    if (!dictionary.empty() && !compressor->LoadDictionary(dictionary)) {
+        return nullptr;
+    }
+    return compressor;
+}
+
+std::vector<uint8_t> TrainZstdDictionary(const void* samples, const std::vector<size_t>& sample_sizes,
+                                         size_t max_dictionary_size) {
+    std::vector<uint8_t> dictionary(max_dictionary_size);
+    auto rv = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples,
+                                    sample_sizes.data(), sample_sizes.size());
+    if (ZDICT_isError(rv)) {
+        LOG(ERROR) << "ZDICT_trainFromBuffer failed: " << ZDICT_getErrorName(rv);
+        return {};
+    }
+    dictionary.resize(rv);
+    return dictionary;
 }
 
 void CompressWorker::Finalize() {
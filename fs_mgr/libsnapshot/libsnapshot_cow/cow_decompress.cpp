@@ -336,6 +336,9 @@ class Lz4Decompressor final : public IDecompressor {
 
 class ZstdDecompressor final : public IDecompressor {
   public:
+    explicit ZstdDecompressor(std::shared_ptr<ZSTD_DDict> dictionary)
+        : dictionary_(std::move(dictionary)), context_(ZSTD_createDCtx(), ZSTD_freeDCtx) {}
+
     ssize_t Decompress(void* buffer, size_t buffer_size, size_t decompressed_size,
                        size_t ignore_bytes = 0) override {
         if (buffer_size < decompressed_size - ignore_bytes) {
@@ -358,16 +361,26 @@ class ZstdDecompressor final : public IDecompressor {
         return decompressed_size;
     }
     bool Decompress(void* output_buffer, const size_t output_size) {
-        std::string input_buffer;
-        input_buffer.resize(stream_->Size());
-        size_t bytes_read = stream_->Read(input_buffer.data(), input_buffer.size());
-        if (bytes_read != input_buffer.size()) {
-            LOG(ERROR) << "Failed to read all input at once. Expected: " << input_buffer.size()
+        if (!context_) {
+            LOG(ERROR) << "ZSTD_createDCtx failed";
+            return false;
+        }
+        input_buffer_.resize(stream_->Size());
+        size_t bytes_read = stream_->Read(input_buffer_.data(), input_buffer_.size());
+        if (bytes_read != input_buffer_.size()) {
+            LOG(ERROR) << "Failed to read all input at once. Expected: " << input_buffer_.size()
                        << " actual: " << bytes_read;
             return false;
         }
-        const auto bytes_decompressed = ZSTD_decompress(output_buffer, output_size,
-                                                        input_buffer.data(), input_buffer.size());
+        size_t bytes_decompressed;
+        if (dictionary_) {
+            bytes_decompressed = ZSTD_decompress_usingDDict(
+                    context_.get(), output_buffer, output_size, input_buffer_.data(),
+                    input_buffer_.size(), dictionary_.get());
+        } else {
+            bytes_decompressed = ZSTD_decompressDCtx(context_.get(), output_buffer, output_size,
+                                                     input_buffer_.data(), input_buffer_.size());
+        }
         if (bytes_decompressed != output_size) {
             LOG(ERROR) << "Failed to decompress ZSTD block, expected output size: " << output_size
                        << ", actual: " << bytes_decompressed;
@@ -375,6 +388,12 @@ class ZstdDecompressor final : public IDecompressor {
         }
         return true;
     }
+
+  private:
+    std::shared_ptr<ZSTD_DDict> dictionary_;
+    // Reused across blocks; a decompressor is only used by one thread.
+    std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context_;
+    std::string input_buffer_;
 };
 
 std::unique_ptr<IDecompressor> IDecompressor::Brotli() {
@@ -389,8 +408,17 @@ std::unique_ptr<IDecompressor> IDecompressor::Lz4() {
     return std::make_unique<Lz4Decompressor>();
 }
 
-std::unique_ptr<IDecompressor> IDecompressor::Zstd() {
-    return std::make_unique<ZstdDecompressor>();
+std::unique_ptr<IDecompressor> IDecompressor::Zstd(std::shared_ptr<ZSTD_DDict_s> dictionary) {
+    return std::make_unique<ZstdDecompressor>(std::move(dictionary));
+}
+
+std::shared_ptr<ZSTD_DDict_s> IDecompressor::CreateZstdDictionary(const void* data, size_t size) {
+    ZSTD_DDict* dictionary = ZSTD_createDDict(data, size);
+    if (!dictionary) {
+        LOG(ERROR) << "ZSTD_createDDict failed for dictionary of size " << size;
+        return nullptr;
+    }
+    return std::shared_ptr<ZSTD_DDict>(dictionary, ZSTD_freeDDict);
 }
 
 }  // namespace snapshot
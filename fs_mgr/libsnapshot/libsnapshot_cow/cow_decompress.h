@@ -47,7 +47,11 @@ class IDecompressor {
     static std::unique_ptr<IDecompressor> Gz();
     static std::unique_ptr<IDecompressor> Brotli();
     static std::unique_ptr<IDecompressor> Lz4();
-    static std::unique_ptr<IDecompressor> Zstd();
+    // |dictionary| must be set if the data was compressed with a dictionary.
+    static std::unique_ptr<IDecompressor> Zstd(std::shared_ptr<ZSTD_DDict_s> dictionary = nullptr);
+
+    // Digest a zstd dictionary so that it can be shared by decompressors.
+    static std::shared_ptr<ZSTD_DDict_s> CreateZstdDictionary(const void* data, size_t size);
 
     static std::unique_ptr<IDecompressor> FromString(std::string_view compressor);
 
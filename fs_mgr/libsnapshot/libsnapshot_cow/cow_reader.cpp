@@ -76,6 +76,10 @@ CowReader::CowReader(ReaderFlags reader_flag, bool is_merge)
       reader_flag_(reader_flag),
       is_merge_(is_merge) {}
 
+CowReader::~CowReader() {
+    owned_fd_ = {};
+}
+
 std::unique_ptr<CowReader> CowReader::CloneCowReader() {
     auto cow = std::make_unique<CowReader>();
     cow->owned_fd_.reset();
@@ -88,6 +92,7 @@ std::unique_ptr<CowReader> CowReader::CloneCowReader() {
     cow->num_total_data_ops_ = num_total_data_ops_;
     cow->num_ordered_ops_to_merge_ = num_ordered_ops_to_merge_;
     cow->xor_data_loc_ = xor_data_loc_;
+    cow->zstd_dictionary_ = zstd_dictionary_;
     cow->block_pos_index_ = block_pos_index_;
     cow->is_merge_ = is_merge_;
     return cow;
@@ -160,11 +165,37 @@ bool CowReader::Parse(android::base::borrowed_fd fd, std::optional<uint64_t> lab
     last_label_ = parser->last_label();
     xor_data_loc_ = parser->xor_data_loc();
 
+    if (!ReadCompressionDictionary()) {
+        return false;
+    }
+
     // If we're resuming a write, we're not ready to merge
     if (label.has_value()) return true;
     return PrepMergeOps();
 }
 
+bool CowReader::ReadCompressionDictionary() {
+    zstd_dictionary_ = nullptr;
+    zstd_decompressor_ = nullptr;
+    if (header_.prefix.major_version < 3 || !header_.dictionary_size) {
+        return true;
+    }
+    if (GetCompressionType() != kCowCompressZstd) {
+        LOG(ERROR) << "Compression dictionary found with compression type: "
+                   << static_cast<int>(GetCompressionType());
+        return false;
+    }
+
+    std::vector<uint8_t> dictionary(header_.dictionary_size);
+    if (!android::base::ReadFullyAtOffset(fd_, dictionary.data(), dictionary.size(),
+                                          GetDictionaryOffset(header_))) {
+        PLOG(ERROR) << "read compression dictionary failed";
+        return false;
+    }
+    zstd_dictionary_ = IDecompressor::CreateZstdDictionary(dictionary.data(), dictionary.size());
+    return zstd_dictionary_ != nullptr;
+}
+
 uint32_t CowReader::GetMaxCompressionSize() {
     switch (header_.prefix.major_version) {
         case 1:
@@ -180,6 +211,22 @@ uint32_t CowReader::GetMaxCompressionSize() {
     }
 }
 
+size_t CowReader::GetMemoryUsage() const {
+    size_t usage = 0;
+    if (ops_) {
+        usage += ops_->capacity() * sizeof(CowOperation);
+    }
+    if (block_pos_index_) {
+        usage += block_pos_index_->capacity() * sizeof(int);
+    }
+    if (xor_data_loc_) {
+        // Approximate: one node per entry plus the bucket array.
+        usage += xor_data_loc_->size() * (sizeof(std::pair<uint64_t, uint64_t>) + sizeof(void*)) +
+                 xor_data_loc_->bucket_count() * sizeof(void*);
+    }
+    return usage;
+}
+
 //
 // This sets up the data needed for MergeOpIter. MergeOpIter presents
 // data in the order we intend to merge in.
@@ -723,7 +770,8 @@ uint8_t CowReader::GetCompressionType() {
 
 ssize_t CowReader::ReadData(const CowOperation* op, void* buffer, size_t buffer_size,
                             size_t ignore_bytes) {
-    std::unique_ptr<IDecompressor> decompressor;
+    std::unique_ptr<IDecompressor> owned_decompressor;
+    IDecompressor* decompressor = nullptr;
     const size_t op_buf_size = CowOpCompressionSize(op, header_.block_size);
     if (!op_buf_size) {
         LOG(ERROR) << "Compression size is zero. op: " << *op;
@@ -733,19 +781,26 @@ ssize_t CowReader::ReadData(const CowOperation* op, void* buffer, size_t buffer_
         case kCowCompressNone:
             break;
         case kCowCompressGz:
-            decompressor = IDecompressor::Gz();
+            owned_decompressor = IDecompressor::Gz();
+            decompressor = owned_decompressor.get();
             break;
         case kCowCompressBrotli:
-            decompressor = IDecompressor::Brotli();
+            owned_decompressor = IDecompressor::Brotli();
+            decompressor = owned_decompressor.get();
             break;
         case kCowCompressZstd:
             if (op_buf_size != op->data_length) {
-                decompressor = IDecompressor::Zstd();
+                // Kept across calls so its zstd context is reused.
+                if (!zstd_decompressor_) {
+                    zstd_decompressor_ = IDecompressor::Zstd(zstd_dictionary_);
+                }
+                decompressor = zstd_decompressor_.get();
             }
             break;
         case kCowCompressLz4:
             if (op_buf_size != op->data_length) {
-                decompressor = IDecompressor::Lz4();
+                owned_decompressor = IDecompressor::Lz4();
+                decompressor = owned_decompressor.get();
             }
             break;
         default:
@@ -28,6 +28,7 @@
 #include <android-base/unique_fd.h>
 #include <android/snapshot/snapshot.pb.h>
 #include <ext4_utils/ext4_utils.h>
+#include <fs_avb/fs_avb_hashtree.h>
 #include <fs_avb/fs_avb_util.h>
 #include <gflags/gflags.h>
 #include <libsnapshot/cow_writer.h>
@@ -43,6 +44,12 @@ DEFINE_string(
 DEFINE_string(compression, "lz4",
               "Compression algorithm. Default is set to lz4. Available options: lz4, zstd, gz");
 DEFINE_bool(merkel_tree, false, "If true, source image hash is obtained from verity merkel tree");
+DEFINE_uint32(zstd_dictionary_size, 0,
+              "If non-zero, train a zstd dictionary of up to this many bytes from the target "
+              "image and use it to compress the patch. Requires zstd compression.");
+DEFINE_bool(pipelined_compression, false,
+            "If true, compress blocks in the background while the next ones are read. The "
+            "patch is the same either way.");
 
 namespace android {
 namespace snapshot {
@@ -58,7 +65,7 @@ class CreateSnapshot {
   public:
     CreateSnapshot(const std::string& src_file, const std::string& target_file,
                    const std::string& patch_file, const std::string& compression,
-                   const bool& merkel_tree);
+                   const bool& merkel_tree, size_t dictionary_size, bool pipelined_compression);
     bool CreateSnapshotPatch();
 
   private:
@@ -112,17 +119,19 @@ class CreateSnapshot {
     size_t PrepareWrite(size_t* pending_ops, size_t start_index);
 
     bool CreateSnapshotWriter();
+    bool TrainCompressionDictionary(std::vector<uint8_t>* dictionary);
     bool WriteOrderedSnapshots();
     bool WriteNonOrderedSnapshots();
     bool VerifyMergeOrder();
 
-    bool CalculateDigest(const void* buffer, size_t size, const void* salt, uint32_t salt_length,
-                         uint8_t* digest);
     bool ParseSourceMerkelTree();
 
     bool use_merkel_tree_ = false;
-    std::vector<uint8_t> target_salt_;
-    std::vector<uint8_t> source_salt_;
+    size_t dictionary_size_ = 0;
+    bool pipelined_compression_ = false;
+    // Salted sha256 hashers for the source and target verity salts.
+    std::unique_ptr<android::fs_mgr::HashtreeHasher> source_hasher_;
+    std::unique_ptr<android::fs_mgr::HashtreeHasher> target_hasher_;
 };
 
 void CreateSnapshotLogger(android::base::LogId, android::base::LogSeverity severity, const char*,
@@ -136,11 +145,14 @@ void CreateSnapshotLogger(android::base::LogId, android::base::LogSeverity sever
 
 CreateSnapshot::CreateSnapshot(const std::string& src_file, const std::string& target_file,
                                const std::string& patch_file, const std::string& compression,
-                               const bool& merkel_tree)
+                               const bool& merkel_tree, size_t dictionary_size,
+                               bool pipelined_compression)
     : src_file_(src_file),
       target_file_(target_file),
       patch_file_(patch_file),
-      use_merkel_tree_(merkel_tree) {
+      use_merkel_tree_(merkel_tree),
+      dictionary_size_(dictionary_size),
+      pipelined_compression_(pipelined_compression) {
     if (!compression.empty()) {
         compression_ = compression;
     }
@@ -183,24 +195,6 @@ bool CreateSnapshot::FindSourceBlockHash() {
     }
 }
 
-bool CreateSnapshot::CalculateDigest(const void* buffer, size_t size, const void* salt,
-                                     uint32_t salt_length, uint8_t* digest) {
-    SHA256_CTX ctx;
-    if (SHA256_Init(&ctx) != 1) {
-        return false;
-    }
-    if (SHA256_Update(&ctx, salt, salt_length) != 1) {
-        return false;
-    }
-    if (SHA256_Update(&ctx, buffer, size) != 1) {
-        return false;
-    }
-    if (SHA256_Final(digest, &ctx) != 1) {
-        return false;
-    }
-    return true;
-}
-
 bool CreateSnapshot::ParseSourceMerkelTree() {
     std::string fname = android::base::Basename(target_file_.c_str());
     std::string partitionName = fname.substr(0, fname.find(".img"));
@@ -226,22 +220,46 @@ bool CreateSnapshot::ParseSourceMerkelTree() {
 
     std::string source_salt = hash.salt();
     source_salt.erase(std::remove(source_salt.begin(), source_salt.end(), '\0'), source_salt.end());
-    if (!android::base::HexToBytes(source_salt, &source_salt_)) {
+    std::vector<uint8_t> source_salt_bytes;
+    if (!android::base::HexToBytes(source_salt, &source_salt_bytes)) {
         LOG(ERROR) << "HexToBytes conversion failed for source salt: " << source_salt;
         return false;
     }
 
     std::string target_salt = descriptor->salt;
-    if (!android::base::HexToBytes(target_salt, &target_salt_)) {
+    std::vector<uint8_t> target_salt_bytes;
+    if (!android::base::HexToBytes(target_salt, &target_salt_bytes)) {
         LOG(ERROR) << "HexToBytes conversion failed for target salt: " << target_salt;
         return false;
     }
 
-    std::vector<uint8_t> digest(32, 0);
+    source_hasher_ = android::fs_mgr::HashtreeHasher::Create("sha256", source_salt_bytes);
+    target_hasher_ = android::fs_mgr::HashtreeHasher::Create("sha256", target_salt_bytes);
+    if (!source_hasher_ || !target_hasher_) {
+        return false;
+    }
+    const size_t digest_size = target_hasher_->digest_size();
+
+    // Re-salt every source block digest with the target salt, on all CPUs.
+    std::string source_digests;
+    source_digests.reserve(hash.block_hash_size() * digest_size);
+    for (int i = 0; i < hash.block_hash_size(); i++) {
+        if (hash.block_hash(i).size() != digest_size) {
+            LOG(ERROR) << "Invalid digest size for block " << i << ": "
+                       << hash.block_hash(i).size();
+            return false;
+        }
+        source_digests.append(hash.block_hash(i));
+    }
+    std::vector<uint8_t> digests(source_digests.size());
+    if (!target_hasher_->HashBlocks(source_digests.data(), source_digests.size(), digest_size,
+                                    digests.data(), digest_size,
+                                    std::max(std::thread::hardware_concurrency(), 1u))) {
+        LOG(ERROR) << "Failed to hash source block digests";
+        return false;
+    }
     for (int i = 0; i < hash.block_hash_size(); i++) {
-        CalculateDigest(hash.block_hash(i).data(), hash.block_hash(i).size(), target_salt_.data(),
-                        target_salt_.size(), digest.data());
-        source_block_hash_[ToHexString(digest.data(), 32)] = i;
+        source_block_hash_[ToHexString(digests.data() + i * digest_size, digest_size)] = i;
     }
 
     return true;
@@ -335,10 +353,52 @@ bool CreateSnapshot::CreateSnapshotWriter() {
     options.cluster_ops = 600;
     options.compression_factor = compression_factor_;
     options.max_blocks = {dev_sz / options.block_size};
+    options.pipelined_compression = pipelined_compression_;
+    if (dictionary_size_ && !TrainCompressionDictionary(&options.compression_dictionary)) {
+        return false;
+    }
     writer_ = CreateCowWriter(3, options, std::move(cow_fd_));
     return true;
 }
 
+// Train the dictionary on compression-unit sized samples spread evenly over
+// the target image.
+bool CreateSnapshot::TrainCompressionDictionary(std::vector<uint8_t>* dictionary) {
+    if (!android::base::StartsWith(compression_, "zstd")) {
+        LOG(ERROR) << "Compression dictionary requires zstd, got: " << compression_;
+        return false;
+    }
+
+    uint64_t dev_sz = lseek(target_fd_.get(), 0, SEEK_END);
+    const size_t sample_size = compression_factor_;
+    // zstd recommends about 100 times the dictionary size worth of samples.
+    const uint64_t num_samples =
+            std::min<uint64_t>(dev_sz / sample_size, (dictionary_size_ * 100) / sample_size);
+    if (!num_samples) {
+        LOG(ERROR) << "Target image too small to train a compression dictionary";
+        return false;
+    }
+    const uint64_t stride = (dev_sz / sample_size / num_samples) * sample_size;
+
+    std::vector<uint8_t> samples(num_samples * sample_size);
+    std::vector<size_t> sample_sizes(num_samples, sample_size);
+    for (uint64_t i = 0; i < num_samples; i++) {
+        if (!android::base::ReadFullyAtOffset(target_fd_.get(), samples.data() + i * sample_size,
+                                              sample_size, i * stride)) {
+            PLOG(ERROR) << "Failed to read dictionary sample at offset: " << i * stride;
+            return false;
+        }
+    }
+
+    *dictionary = TrainZstdDictionary(samples.data(), sample_sizes, dictionary_size_);
+    if (dictionary->empty()) {
+        return false;
+    }
+    LOG(INFO) << "Trained compression dictionary of " << dictionary->size() << " bytes from "
+              << num_samples << " samples";
+    return true;
+}
+
 bool CreateSnapshot::WriteNonOrderedSnapshots() {
     zero_ops_ = zero_blocks_.size();
     for (auto it = zero_blocks_.begin(); it != zero_blocks_.end(); it++) {
@@ -471,20 +531,31 @@ bool CreateSnapshot::ReadBlocks(off_t offset, const int skip_blocks, const uint6
         uint64_t buffer_offset = 0;
         off_t foffset = file_offset;
 
+        // With a merkel tree, hash the whole read with the source salt, then
+        // each resulting digest with the target salt.
+        std::vector<uint8_t> final_digests;
+        if (create_snapshot_patch_ && use_merkel_tree_) {
+            const size_t digest_size = source_hasher_->digest_size();
+            std::vector<uint8_t> digests(num_blocks * digest_size);
+            final_digests.resize(digests.size());
+            if (!source_hasher_->HashBlocks(buffer.get(), to_read, BLOCK_SZ, digests.data(),
+                                            digest_size, 1) ||
+                !target_hasher_->HashBlocks(digests.data(), digests.size(), digest_size,
+                                            final_digests.data(), digest_size, 1)) {
+                LOG(ERROR) << "Failed to hash blocks at offset: " << file_offset;
+                return false;
+            }
+        }
+
         while (num_blocks) {
             const void* bufptr = (char*)buffer.get() + buffer_offset;
             uint64_t blkindex = foffset / BLOCK_SZ;
             std::string hash;
 
             if (create_snapshot_patch_ && use_merkel_tree_) {
-                std::vector<uint8_t> digest(32, 0);
-                CalculateDigest(bufptr, BLOCK_SZ, source_salt_.data(), source_salt_.size(),
-                                digest.data());
-                std::vector<uint8_t> final_digest(32, 0);
-                CalculateDigest(digest.data(), digest.size(), target_salt_.data(),
-                                target_salt_.size(), final_digest.data());
-
-                hash = ToHexString(final_digest.data(), final_digest.size());
+                const size_t digest_size = target_hasher_->digest_size();
+                hash = ToHexString(final_digests.data() + (buffer_offset / BLOCK_SZ) * digest_size,
+                                   digest_size);
             } else {
                 uint8_t checksum[32];
                 SHA256(bufptr, BLOCK_SZ, checksum);
@@ -577,6 +648,7 @@ SYNOPSIS
     compression -> compression algorithm. Default set to lz4. Supported types are gz, lz4, zstd.
     merkel_tree -> If true, source image hash is obtained from verity merkel tree.
     output_dir -> Output directory to write the patch file to. Defaults to current working directory if not set.
+    zstd_dictionary_size -> If non-zero, train a zstd dictionary of this size from the target image and compress the patch with it.
 
 EXAMPLES
 
@@ -603,7 +675,9 @@ int main(int argc, char* argv[]) {
         snapshotfile = FLAGS_output_dir + "/" + snapshotfile;
     }
     android::snapshot::CreateSnapshot snapshot(FLAGS_source, FLAGS_target, snapshotfile,
-                                               FLAGS_compression, FLAGS_merkel_tree);
+                                               FLAGS_compression, FLAGS_merkel_tree,
+                                               FLAGS_zstd_dictionary_size,
+                                               FLAGS_pipelined_compression);
 
     if (!snapshot.CreateSnapshotPatch()) {
         LOG(ERROR) << "Snapshot creation failed";
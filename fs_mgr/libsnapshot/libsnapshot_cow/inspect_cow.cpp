@@ -145,6 +145,10 @@ static bool Inspect(const std::string& path) {
         std::cout << "Block size: " << header.block_size << "\n";
         std::cout << "Merge ops: " << header.num_merge_ops << "\n";
         std::cout << "Readahead buffer: " << header.buffer_size << " bytes\n";
+        if (header.prefix.major_version >= 3) {
+            std::cout << "Compression dictionary: " << reader.header_v3().dictionary_size
+                      << " bytes\n";
+        }
         if (has_footer) {
             std::cout << "Footer: ops usage: " << footer.op.ops_size << " bytes\n";
             std::cout << "Footer: op count: " << footer.op.num_ops << "\n";
@@ -15,6 +15,7 @@
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
+#include <libsnapshot/cow_compress.h>
 #include <libsnapshot/cow_format.h>
 #include <libsnapshot/cow_reader.h>
 #include <libsnapshot/cow_writer.h>
@@ -143,6 +144,61 @@ TEST_F(CowTestV3, MaxOpMultiThreadCompression) {
     ASSERT_TRUE(writer->Finalize());
 }
 
+static void WriteOpsForPipelineTest(ICowWriter* writer, const std::string& data) {
+    const size_t block_size = writer->GetBlockSize();
+    ASSERT_TRUE(writer->AddRawBlocks(0, data.data(), data.size()));
+    ASSERT_TRUE(writer->AddZeroBlocks(200, 5));
+    ASSERT_TRUE(writer->AddRawBlocks(300, data.data(), 3 * block_size));
+    ASSERT_TRUE(writer->AddXorBlocks(400, data.data(), 4 * block_size, 10, 20));
+    ASSERT_TRUE(writer->AddLabel(1));
+    ASSERT_TRUE(writer->AddCopy(500, 10, 5));
+    ASSERT_TRUE(writer->AddRawBlocks(600, data.data() + block_size, 17 * block_size));
+    ASSERT_TRUE(writer->Finalize());
+}
+
+TEST_F(CowTestV3, PipelinedCompression) {
+    CowOptions options;
+    options.op_count_max = 1000;
+    options.compression_factor = 4096 * 8;
+    options.compression = "lz4";
+    options.cluster_ops = 16;
+
+    std::string data;
+    for (size_t i = 0; i < 100; i++) {
+        std::string block = "Block " + std::to_string(i) + " ";
+        block.resize(options.block_size, static_cast<char>(i));
+        data += block;
+    }
+
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+    ASSERT_NE(writer, nullptr);
+    ASSERT_NO_FATAL_FAILURE(WriteOpsForPipelineTest(writer.get(), data));
+
+    TemporaryFile pipelined_cow;
+    options.num_compress_threads = 4;
+    options.pipelined_compression = true;
+    writer = CreateCowWriter(3, options, unique_fd(dup(pipelined_cow.fd)));
+    ASSERT_NE(writer, nullptr);
+    ASSERT_NO_FATAL_FAILURE(WriteOpsForPipelineTest(writer.get(), data));
+
+    std::string expected, actual;
+    ASSERT_TRUE(android::base::ReadFileToString(cow_->path, &expected));
+    ASSERT_TRUE(android::base::ReadFileToString(pipelined_cow.path, &actual));
+    ASSERT_EQ(expected, actual);
+
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(pipelined_cow.fd));
+    auto iter = reader.GetOpIter();
+    ASSERT_NE(iter, nullptr);
+    ASSERT_FALSE(iter->AtEnd());
+    auto op = iter->Get();
+    ASSERT_EQ(op->type(), kCowReplaceOp);
+    ASSERT_EQ(op->new_block, 0);
+    std::string sink(CowOpCompressionSize(op, options.block_size), '\0');
+    ASSERT_TRUE(ReadData(reader, op, sink.data(), sink.size()));
+    ASSERT_EQ(sink, data.substr(0, sink.size()));
+}
+
 TEST_F(CowTestV3, ZeroOp) {
     CowOptions options;
     options.op_count_max = 20;
@@ -523,6 +579,76 @@ TEST_F(CowTestV3, GzCompression) {
     ASSERT_TRUE(iter->AtEnd());
 }
 
+TEST_F(CowTestV3, ZstdDictionary) {
+    CowOptions options;
+    options.op_count_max = 100;
+    options.compression = "zstd";
+
+    std::string data;
+    for (size_t i = 0; i < 64; i++) {
+        std::string block;
+        while (block.size() < options.block_size) {
+            block += "entry " + std::to_string(i * 31 + block.size() % 97) + " /system/lib64 ";
+        }
+        block.resize(options.block_size);
+        data += block;
+    }
+
+    std::vector<size_t> sample_sizes(data.size() / options.block_size, options.block_size);
+    options.compression_dictionary = TrainZstdDictionary(data.data(), sample_sizes, 4096);
+    ASSERT_FALSE(options.compression_dictionary.empty());
+
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+    ASSERT_NE(writer, nullptr);
+    ASSERT_TRUE(writer->AddRawBlocks(10, data.data(), data.size()));
+    ASSERT_TRUE(writer->AddLabel(0));
+    ASSERT_TRUE(writer->Finalize());
+
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(cow_->fd));
+
+    auto header = reader.header_v3();
+    ASSERT_EQ(header.prefix.header_size, sizeof(CowHeaderV3));
+    ASSERT_EQ(header.dictionary_size, options.compression_dictionary.size());
+
+    auto iter = reader.GetOpIter();
+    ASSERT_NE(iter, nullptr);
+    std::string sink(options.block_size, '\0');
+    for (size_t i = 0; i < 64; i++) {
+        ASSERT_FALSE(iter->AtEnd());
+        auto op = iter->Get();
+        ASSERT_EQ(op->type(), kCowReplaceOp);
+        ASSERT_EQ(op->new_block, 10 + i);
+        ASSERT_TRUE(ReadData(reader, op, sink.data(), sink.size()));
+        ASSERT_EQ(sink, data.substr(i * options.block_size, options.block_size));
+        iter->Next();
+    }
+    ASSERT_TRUE(iter->AtEnd());
+
+    // Appending must use the same dictionary the existing data was written with.
+    CowWriterV3 append_writer(options, GetCowFd());
+    ASSERT_TRUE(append_writer.Initialize(0));
+
+    options.compression_dictionary[0] ^= 0xff;
+    CowWriterV3 mismatch_writer(options, GetCowFd());
+    ASSERT_FALSE(mismatch_writer.Initialize(0));
+}
+
+TEST_F(CowTestV3, NoDictionaryHeaderSize) {
+    CowOptions options;
+    options.op_count_max = 20;
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+    ASSERT_NE(writer, nullptr);
+    ASSERT_TRUE(writer->AddZeroBlocks(1, 2));
+    ASSERT_TRUE(writer->Finalize());
+
+    // COWs without a dictionary stay readable by older readers.
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(cow_->fd));
+    ASSERT_EQ(reader.header_v3().prefix.header_size, kCowHeaderV3BaseSize);
+    ASSERT_EQ(reader.header_v3().dictionary_size, 0);
+}
+
 TEST_F(CowTestV3, ResumePointTest) {
     CowOptions options;
     options.op_count_max = 100;
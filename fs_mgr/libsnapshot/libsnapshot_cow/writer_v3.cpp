@@ -78,8 +78,8 @@ void CowWriterV3::InitWorkers() {
     threads_.reserve(num_compress_threads_);
     threads_.clear();
     for (size_t i = 0; i < num_compress_threads_; i++) {
-        std::unique_ptr<ICompressor> compressor =
-                ICompressor::Create(compression_, header_.max_compression_size);
+        std::unique_ptr<ICompressor> compressor = ICompressor::Create(
+                compression_, header_.max_compression_size, options_.compression_dictionary);
         auto&& wt = compress_threads_.emplace_back(
                 std::make_unique<CompressWorker>(std::move(compressor)));
         threads_.emplace_back(std::thread([wt = wt.get()]() { wt->RunThread(); }));
@@ -92,7 +92,7 @@ void CowWriterV3::SetupHeaders() {
     header_.prefix.magic = kCowMagicNumber;
     header_.prefix.major_version = 3;
     header_.prefix.minor_version = 0;
-    header_.prefix.header_size = sizeof(CowHeaderV3);
+    header_.prefix.header_size = kCowHeaderV3BaseSize;
     header_.footer_size = 0;
     header_.op_size = sizeof(CowOperationV3);
     header_.block_size = options_.block_size;
@@ -159,8 +159,17 @@ bool CowWriterV3::ParseOptions() {
     }
 
     compression_.algorithm = *algorithm;
+    if (!options_.compression_dictionary.empty()) {
+        if (compression_.algorithm != kCowCompressZstd) {
+            LOG(ERROR) << "Compression dictionary requires zstd, got: " << options_.compression;
+            return false;
+        }
+        header_.prefix.header_size = sizeof(CowHeaderV3);
+        header_.dictionary_size = options_.compression_dictionary.size();
+    }
     if (compression_.algorithm != kCowCompressNone) {
-        compressor_ = ICompressor::Create(compression_, header_.max_compression_size);
+        compressor_ = ICompressor::Create(compression_, header_.max_compression_size,
+                                          options_.compression_dictionary);
         if (compressor_ == nullptr) {
             LOG(ERROR) << "Failed to create compressor for " << compression_.algorithm;
             return false;
@@ -185,12 +194,33 @@ bool CowWriterV3::ParseOptions() {
         options_.num_compress_threads) {
         num_compress_threads_ = options_.num_compress_threads;
     }
+    if (options_.pipelined_compression && compression_.algorithm != kCowCompressNone &&
+        num_compress_threads_ > 1 && !IsEstimating()) {
+        return InitCompressionPool();
+    }
     InitWorkers();
 
     return true;
 }
 
+bool CowWriterV3::InitCompressionPool() {
+    compression_pool_ = std::make_unique<CompressionPool>(
+            compression_, header_.max_compression_size, num_compress_threads_);
+    if (!compression_pool_->Init(options_.compression_dictionary)) {
+        return false;
+    }
+    LOG_INFO << "Pipelined compression: " << num_compress_threads_ << " threads";
+    return true;
+}
+
 CowWriterV3::~CowWriterV3() {
+    // Finalize() is the flush point for pipelined writes; anything still in
+    // flight here never makes it into the COW.
+    if (!pending_writes_.empty()) {
+        LOG(ERROR) << "Dropping " << pending_writes_.size()
+                   << " pending writes, Finalize() was not called";
+        pending_writes_.clear();
+    }
     for (const auto& t : compress_threads_) {
         t->Finalize();
     }
@@ -246,6 +276,15 @@ bool CowWriterV3::OpenForWrite() {
         }
     }
 
+    if (header_.dictionary_size) {
+        if (!android::base::WriteFullyAtOffset(fd_, options_.compression_dictionary.data(),
+                                               header_.dictionary_size,
+                                               GetDictionaryOffset(header_))) {
+            PLOG(ERROR) << "writing compression dictionary failed";
+            return false;
+        }
+    }
+
     resume_points_ = std::make_shared<std::vector<ResumePoint>>();
 
     if (!Sync()) {
@@ -265,6 +304,10 @@ bool CowWriterV3::OpenForAppend(uint64_t label) {
 
     header_ = header_v3;
 
+    if (!CheckCompressionDictionary()) {
+        return false;
+    }
+
     CHECK(label >= 0);
     CowParserV3 parser;
     if (!parser.Parse(fd_, header_, label)) {
@@ -287,6 +330,31 @@ bool CowWriterV3::OpenForAppend(uint64_t label) {
     return true;
 }
 
+// The compressors were set up with the dictionary from the options; make sure
+// it is the one stored in the COW being appended to.
+bool CowWriterV3::CheckCompressionDictionary() {
+    if (header_.dictionary_size != options_.compression_dictionary.size()) {
+        LOG(ERROR) << "Compression dictionary size mismatch, COW: " << header_.dictionary_size
+                   << ", options: " << options_.compression_dictionary.size();
+        return false;
+    }
+    if (!header_.dictionary_size) {
+        return true;
+    }
+
+    std::vector<uint8_t> dictionary(header_.dictionary_size);
+    if (!android::base::ReadFullyAtOffset(fd_, dictionary.data(), dictionary.size(),
+                                          GetDictionaryOffset(header_))) {
+        PLOG(ERROR) << "read compression dictionary failed";
+        return false;
+    }
+    if (dictionary != options_.compression_dictionary) {
+        LOG(ERROR) << "Compression dictionary does not match the one in the COW";
+        return false;
+    }
+    return true;
+}
+
 bool CowWriterV3::CheckOpCount(size_t op_count) {
     if (IsEstimating()) {
         return true;
@@ -310,6 +378,9 @@ size_t CowWriterV3::CachedDataSize() const {
 }
 
 bool CowWriterV3::EmitCopy(uint64_t new_block, uint64_t old_block, uint64_t num_blocks) {
+    if (!DrainPendingWrites()) {
+        return false;
+    }
     if (!CheckOpCount(num_blocks)) {
         return false;
     }
@@ -348,13 +419,20 @@ bool CowWriterV3::NeedsFlush() const {
 bool CowWriterV3::ConstructCowOpCompressedBuffers(uint64_t new_block_start, const void* data,
                                                   uint64_t old_block, uint16_t offset,
                                                   CowOperationType type, size_t blocks_to_write) {
-    size_t compressed_bytes = 0;
     auto&& blocks = CompressBlocks(blocks_to_write, data, type);
     if (blocks.empty()) {
         LOG(ERROR) << "Failed to compress blocks " << new_block_start << ", " << blocks_to_write
                    << ", actual number of blocks received from compressor " << blocks.size();
         return false;
     }
+    return AddCompressedOps(new_block_start, old_block, offset, type, blocks_to_write,
+                            std::move(blocks));
+}
+
+bool CowWriterV3::AddCompressedOps(uint64_t new_block_start, uint64_t old_block, uint16_t offset,
+                                   CowOperationType type, size_t blocks_to_write,
+                                   std::vector<CompressedBuffer>&& blocks) {
+    size_t compressed_bytes = 0;
     if (!CheckOpCount(blocks.size())) {
         return false;
     }
@@ -395,6 +473,10 @@ bool CowWriterV3::EmitBlocks(uint64_t new_block_start, const void* data, size_t
                    << " but compressor is uninitialized.";
         return false;
     }
+    if (compression_pool_) {
+        return QueueBlocks(new_block_start, data, size, old_block, offset, type);
+    }
+
     const auto bytes = reinterpret_cast<const uint8_t*>(data);
     size_t num_blocks = (size / header_.block_size);
     size_t total_written = 0;
@@ -418,7 +500,87 @@ bool CowWriterV3::EmitBlocks(uint64_t new_block_start, const void* data, size_t
     return true;
 }
 
+// Same as the synchronous path of EmitBlocks, except that each chunk is
+// handed to the compression pool. Chunks are split into compression units
+// and committed exactly as EmitBlocks would, so the resulting COW is
+// identical.
+bool CowWriterV3::QueueBlocks(uint64_t new_block_start, const void* data, size_t size,
+                              uint64_t old_block, uint16_t offset, CowOperationType type) {
+    const auto bytes = reinterpret_cast<const uint8_t*>(data);
+    size_t num_blocks = (size / header_.block_size);
+    size_t total_written = 0;
+    while (total_written < num_blocks) {
+        size_t chunk = std::min(num_blocks - total_written, batch_size_);
+        const uint8_t* chunk_data = bytes + header_.block_size * total_written;
+
+        auto job = std::make_shared<CompressJob>();
+        job->data.assign(chunk_data, chunk_data + chunk * header_.block_size);
+        size_t blocks_to_compress = chunk;
+        while (blocks_to_compress) {
+            const size_t compression_factor = GetCompressionFactor(blocks_to_compress, type);
+            job->unit_sizes.emplace_back(compression_factor);
+            blocks_to_compress -= compression_factor / header_.block_size;
+        }
+
+        compression_pool_->Submit(job);
+        pending_writes_.push_back({
+                .new_block_start = new_block_start + total_written,
+                .old_block = old_block + total_written,
+                .offset = offset,
+                .type = type,
+                .num_blocks = chunk,
+                .job = std::move(job),
+        });
+        total_written += chunk;
+
+        // Commit whatever has finished, and throttle the caller once enough
+        // work is queued to keep every thread busy.
+        if (!CommitPendingWrites(compression_pool_->num_threads() * 2)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CowWriterV3::CommitPendingWrites(size_t max_pending) {
+    while (!pending_writes_.empty()) {
+        PendingWrite& write = pending_writes_.front();
+        if (pending_writes_.size() <= max_pending && !compression_pool_->IsDone(write.job.get())) {
+            break;
+        }
+        if (!compression_pool_->Wait(write.job.get())) {
+            LOG(ERROR) << "Failed to compress blocks " << write.new_block_start << ", "
+                       << write.num_blocks;
+            return false;
+        }
+
+        std::vector<CompressedBuffer> blocks;
+        blocks.reserve(write.job->unit_sizes.size());
+        for (size_t i = 0; i < write.job->unit_sizes.size(); i++) {
+            blocks.push_back({
+                    .compression_factor = write.job->unit_sizes[i],
+                    .compressed_data = std::move(write.job->compressed[i]),
+            });
+        }
+        if (!AddCompressedOps(write.new_block_start, write.old_block, write.offset, write.type,
+                              write.num_blocks, std::move(blocks))) {
+            return false;
+        }
+        if (NeedsFlush() && !FlushCacheOps()) {
+            LOG(ERROR) << "EmitBlocks with compression: write failed. new block: "
+                       << write.new_block_start << " compression: " << compression_.algorithm
+                       << ", op type: " << write.type;
+            return false;
+        }
+        pending_writes_.pop_front();
+    }
+    return true;
+}
+
 bool CowWriterV3::EmitZeroBlocks(uint64_t new_block_start, const uint64_t num_blocks) {
+    if (!DrainPendingWrites()) {
+        return false;
+    }
     if (!CheckOpCount(num_blocks)) {
         return false;
     }
@@ -439,7 +601,7 @@ bool CowWriterV3::EmitLabel(uint64_t label) {
     // remove all labels greater than this current one. we want to avoid the situation of adding
     // in
     // duplicate labels with differing op values
-    if (!FlushCacheOps()) {
+    if (!DrainPendingWrites() || !FlushCacheOps()) {
         LOG(ERROR) << "Failed to flush cached ops before emitting label " << label;
         return false;
     }
@@ -470,7 +632,7 @@ bool CowWriterV3::EmitLabel(uint64_t label) {
 }
 
 bool CowWriterV3::EmitSequenceData(size_t num_ops, const uint32_t* data) {
-    if (header_.op_count > 0 || !cached_ops_.empty()) {
+    if (header_.op_count > 0 || !cached_ops_.empty() || !pending_writes_.empty()) {
         LOG(ERROR) << "There's " << header_.op_count << " operations written to disk and "
                    << cached_ops_.size()
                    << " ops cached in memory. Writing sequence data is only allowed before all "
@@ -746,9 +908,9 @@ bool CowWriterV3::WriteOperation(std::span<const CowOperationV3> ops,
 }
 
 bool CowWriterV3::Finalize() {
-    CHECK_GE(header_.prefix.header_size, sizeof(CowHeaderV3));
+    CHECK_GE(header_.prefix.header_size, kCowHeaderV3BaseSize);
     CHECK_LE(header_.prefix.header_size, sizeof(header_));
-    if (!FlushCacheOps()) {
+    if (!DrainPendingWrites() || !FlushCacheOps()) {
         return false;
     }
     if (!android::base::WriteFullyAtOffset(fd_, &header_, header_.prefix.header_size, 0)) {
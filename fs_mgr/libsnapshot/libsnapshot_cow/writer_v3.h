@@ -15,6 +15,7 @@
 #pragma once
 
 #include <android-base/logging.h>
+#include <deque>
 #include <span>
 #include <string_view>
 #include <thread>
@@ -22,6 +23,7 @@
 
 #include <libsnapshot/cow_format.h>
 #include <storage_literals/storage_literals.h>
+#include "compression_pool.h"
 #include "writer_base.h"
 
 namespace android {
@@ -55,6 +57,16 @@ class CowWriterV3 : public CowWriterBase {
         size_t compression_factor;
         std::vector<uint8_t> compressed_data;
     };
+    // Data ops handed to the compression pool, waiting to be added to the
+    // op cache in submission order.
+    struct PendingWrite {
+        uint64_t new_block_start;
+        uint64_t old_block;
+        uint16_t offset;
+        CowOperationType type;
+        size_t num_blocks;
+        std::shared_ptr<CompressJob> job;
+    };
     void SetupHeaders();
     bool NeedsFlush() const;
     bool ParseOptions();
@@ -66,7 +78,17 @@ class CowWriterV3 : public CowWriterBase {
     bool ConstructCowOpCompressedBuffers(uint64_t new_block_start, const void* data,
                                          uint64_t old_block, uint16_t offset, CowOperationType type,
                                          size_t blocks_to_write);
+    bool AddCompressedOps(uint64_t new_block_start, uint64_t old_block, uint16_t offset,
+                          CowOperationType type, size_t blocks_to_write,
+                          std::vector<CompressedBuffer>&& blocks);
     bool CheckOpCount(size_t op_count);
+    bool CheckCompressionDictionary();
+
+    bool InitCompressionPool();
+    bool QueueBlocks(uint64_t new_block_start, const void* data, size_t size, uint64_t old_block,
+                     uint16_t offset, CowOperationType type);
+    bool CommitPendingWrites(size_t max_pending);
+    bool DrainPendingWrites() { return CommitPendingWrites(0); }
 
   private:
     std::vector<CompressedBuffer> ProcessBlocksWithNoCompression(const size_t num_blocks,
@@ -118,6 +140,13 @@ class CowWriterV3 : public CowWriterBase {
     std::vector<struct iovec> data_vec_;
 
     std::vector<std::thread> threads_;
+
+    // Pipelined compression: data ops are compressed on |compression_pool_|
+    // while the caller keeps submitting, and are added to the op cache in
+    // order as they complete. Callers must call Finalize() to flush them;
+    // writes still pending at destruction are dropped.
+    std::unique_ptr<CompressionPool> compression_pool_;
+    std::deque<PendingWrite> pending_writes_;
 };
 
 }  // namespace snapshot
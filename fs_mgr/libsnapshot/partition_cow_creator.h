@@ -71,6 +71,9 @@ struct PartitionCowCreator {
     // True if COW writes should be batched in memory
     bool batched_writes;
 
+    // True if data ops should be compressed in the background (v3 only)
+    bool pipelined_compression = false;
+
     struct Return {
         SnapshotStatus snapshot_status;
         std::vector<Interval> cow_partition_usable_regions;
@@ -23,7 +23,9 @@
 #include <sys/xattr.h>
 
 #include <chrono>
+#include <condition_variable>
 #include <filesystem>
+#include <mutex>
 #include <optional>
 #include <thread>
 
@@ -58,6 +60,7 @@ namespace snapshot {
 using aidl::android::hardware::boot::MergeStatus;
 using android::base::unique_fd;
 using android::dm::DeviceMapper;
+using android::dm::DmDeviceSnapshot;
 using android::dm::DmDeviceState;
 using android::dm::DmTable;
 using android::dm::DmTargetLinear;
@@ -69,6 +72,7 @@ using android::fiemap::FiemapStatus;
 using android::fiemap::IImageManager;
 using android::fs_mgr::CreateDmTable;
 using android::fs_mgr::CreateLogicalPartition;
+using android::fs_mgr::CreateLogicalPartitions;
 using android::fs_mgr::CreateLogicalPartitionParams;
 using android::fs_mgr::GetPartitionGroupName;
 using android::fs_mgr::GetPartitionName;
@@ -93,6 +97,9 @@ static constexpr char kBootIndicatorPath[] = "/metadata/ota/snapshot-boot";
 static constexpr char kRollbackIndicatorPath[] = "/metadata/ota/rollback-indicator";
 static constexpr char kSnapuserdFromSystem[] = "/metadata/ota/snapuserd-from-system";
 static constexpr auto kUpdateStateCheckInterval = 2s;
+// The merge rate only ends up in the final merge stats, so the daemon is asked
+// for it much less often than the merge state is polled.
+static constexpr auto kMergeRateStatsInterval = 30s;
 static constexpr char kOtaFileContext[] = "u:object_r:ota_metadata_file:s0";
 
 /*
@@ -476,6 +483,9 @@ bool SnapshotManager::CreateSnapshot(LockedFile* lock, PartitionCowCreator* cow_
     if (cow_creator->batched_writes) {
         status->set_batched_writes(cow_creator->batched_writes);
     }
+    if (cow_creator->pipelined_compression) {
+        status->set_pipelined_compression(cow_creator->pipelined_compression);
+    }
 
     if (!WriteSnapshotStatus(lock, *status)) {
         PLOG(ERROR) << "Could not write snapshot status: " << status->name();
@@ -484,7 +494,8 @@ bool SnapshotManager::CreateSnapshot(LockedFile* lock, PartitionCowCreator* cow_
     return true;
 }
 
-Return SnapshotManager::CreateCowImage(LockedFile* lock, const std::string& name) {
+Return SnapshotManager::CreateCowImage(LockedFile* lock, const std::string& name,
+                                       std::function<bool(uint64_t, uint64_t)>&& on_progress) {
     CHECK(lock);
     CHECK(lock->lock_mode() == LOCK_EX);
     if (!EnsureImageManager()) return Return::Error();
@@ -503,7 +514,8 @@ Return SnapshotManager::CreateCowImage(LockedFile* lock, const std::string& name
 
     std::string cow_image_name = GetCowImageDeviceName(name);
     int cow_flags = IImageManager::CREATE_IMAGE_DEFAULT;
-    return Return(images_->CreateBackingImage(cow_image_name, status.cow_file_size(), cow_flags));
+    return Return(images_->CreateBackingImage(cow_image_name, status.cow_file_size(), cow_flags,
+                                              std::move(on_progress)));
 }
 
 bool SnapshotManager::MapDmUserCow(LockedFile* lock, const std::string& name,
@@ -1056,17 +1068,28 @@ MergeFailureCode SnapshotManager::RewriteSnapshotDeviceTable(const std::string&
 }
 
 bool SnapshotManager::GetSingleTarget(const std::string& dm_name, TableQuery query,
-                                      DeviceMapper::TargetInfo* target) {
-    if (dm_.GetState(dm_name) == DmDeviceState::INVALID) {
-        return false;
-    }
-
+                                      DeviceMapper::TargetInfo* target,
+                                      const DmDeviceSnapshot* devices) {
     std::vector<DeviceMapper::TargetInfo> targets;
     bool result;
-    if (query == TableQuery::Status) {
-        result = dm_.GetTableStatus(dm_name, &targets);
+    if (devices) {
+        if (devices->GetState(dm_name) == DmDeviceState::INVALID) {
+            return false;
+        }
+        if (query == TableQuery::Status) {
+            result = devices->GetTableStatus(dm_name, &targets);
+        } else {
+            result = devices->GetTableInfo(dm_name, &targets);
+        }
     } else {
-        result = dm_.GetTableInfo(dm_name, &targets);
+        if (dm_.GetState(dm_name) == DmDeviceState::INVALID) {
+            return false;
+        }
+        if (query == TableQuery::Status) {
+            result = dm_.GetTableStatus(dm_name, &targets);
+        } else {
+            result = dm_.GetTableInfo(dm_name, &targets);
+        }
     }
     if (!result) {
         LOG(ERROR) << "Could not query device: " << dm_name;
@@ -1080,9 +1103,10 @@ bool SnapshotManager::GetSingleTarget(const std::string& dm_name, TableQuery que
     return true;
 }
 
-bool SnapshotManager::IsSnapshotDevice(const std::string& dm_name, TargetInfo* target) {
+bool SnapshotManager::IsSnapshotDevice(const std::string& dm_name, TargetInfo* target,
+                                       const DmDeviceSnapshot* devices) {
     DeviceMapper::TargetInfo snap_target;
-    if (!GetSingleTarget(dm_name, TableQuery::Status, &snap_target)) {
+    if (!GetSingleTarget(dm_name, TableQuery::Status, &snap_target, devices)) {
         return false;
     }
     auto type = DeviceMapper::GetTargetType(snap_target.spec);
@@ -1125,9 +1149,10 @@ auto SnapshotManager::UpdateStateToStr(const enum UpdateState state) {
 }
 
 bool SnapshotManager::QuerySnapshotStatus(const std::string& dm_name, std::string* target_type,
-                                          DmTargetSnapshot::Status* status) {
+                                          DmTargetSnapshot::Status* status,
+                                          const DmDeviceSnapshot* devices) {
     DeviceMapper::TargetInfo target;
-    if (!IsSnapshotDevice(dm_name, &target)) {
+    if (!IsSnapshotDevice(dm_name, &target, devices)) {
         LOG(ERROR) << "Device " << dm_name << " is not a snapshot or snapshot-merge device";
         return false;
     }
@@ -1150,6 +1175,7 @@ bool SnapshotManager::QuerySnapshotStatus(const std::string& dm_name, std::strin
 // the problem was transient, we might manage to get a new outcome.
 UpdateState SnapshotManager::ProcessUpdateState(const std::function<bool()>& callback,
                                                 const std::function<bool()>& before_cancel) {
+    auto last_merge_rate_update = std::chrono::steady_clock::now() - kMergeRateStatsInterval;
     while (true) {
         auto result = CheckMergeState(before_cancel);
         LOG(INFO) << "ProcessUpdateState handling state: " << UpdateStateToStr(result.state);
@@ -1170,6 +1196,12 @@ UpdateState SnapshotManager::ProcessUpdateState(const std::function<bool()>& cal
             return result.state;
         }
 
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_merge_rate_update >= kMergeRateStatsInterval) {
+            UpdateMergeRateStats();
+            last_merge_rate_update = now;
+        }
+
         if (callback && !callback()) {
             return result.state;
         }
@@ -1239,6 +1271,12 @@ auto SnapshotManager::CheckMergeState(LockedFile* lock,
 
     auto current_slot_suffix = device_->GetSlotSuffix();
 
+    // Read the status of every device at once, instead of several ioctls per
+    // snapshot. Each snapshot only changes its own devices below, so the view
+    // stays valid for the ones not checked yet.
+    DmDeviceSnapshot devices;
+    bool have_devices = dm_.QueryDevices(android::dm::kDmQueryStatus, &devices);
+
     bool cancelled = false;
     bool merging = false;
     bool needs_reboot = false;
@@ -1251,7 +1289,8 @@ auto SnapshotManager::CheckMergeState(LockedFile* lock,
             continue;
         }
 
-        auto result = CheckTargetMergeState(lock, snapshot, update_status);
+        auto result = CheckTargetMergeState(lock, snapshot, update_status,
+                                            have_devices ? &devices : nullptr);
         LOG(INFO) << "CheckTargetMergeState for " << snapshot
                   << " returned: " << UpdateStateToStr(result.state);
 
@@ -1322,8 +1361,8 @@ auto SnapshotManager::CheckMergeState(LockedFile* lock,
 }
 
 auto SnapshotManager::CheckTargetMergeState(LockedFile* lock, const std::string& name,
-                                            const SnapshotUpdateStatus& update_status)
-        -> MergeResult {
+                                            const SnapshotUpdateStatus& update_status,
+                                            const DmDeviceSnapshot* devices) -> MergeResult {
     SnapshotStatus snapshot_status;
     if (!ReadSnapshotStatus(lock, name, &snapshot_status)) {
         return MergeResult(UpdateState::MergeFailed, MergeFailureCode::ReadStatus);
@@ -1331,7 +1370,7 @@ auto SnapshotManager::CheckTargetMergeState(LockedFile* lock, const std::string&
 
     std::unique_ptr<LpMetadata> current_metadata;
 
-    if (!IsSnapshotDevice(name)) {
+    if (!IsSnapshotDevice(name, nullptr, devices)) {
         if (!current_metadata) {
             current_metadata = ReadCurrentMetadata();
         }
@@ -1424,7 +1463,7 @@ auto SnapshotManager::CheckTargetMergeState(LockedFile* lock, const std::string&
         // dm-snapshot in the kernel
         std::string target_type;
         DmTargetSnapshot::Status status;
-        if (!QuerySnapshotStatus(name, &target_type, &status)) {
+        if (!QuerySnapshotStatus(name, &target_type, &status, devices)) {
             return MergeResult(UpdateState::MergeFailed, MergeFailureCode::QuerySnapshotStatus);
         }
         if (target_type == "snapshot" &&
@@ -1801,6 +1840,25 @@ bool SnapshotManager::PerformInitTransition(InitTransition transition,
             snapuserd_argv->emplace_back("-num_verify_threads=" +
                                          std::to_string(num_verify_threads));
         }
+        uint32_t num_decompress_threads = GetNumDecompressThreads(lock.get());
+        if (num_decompress_threads != 0) {
+            snapuserd_argv->emplace_back("-num_decompress_threads=" +
+                                         std::to_string(num_decompress_threads));
+        }
+        uint32_t block_server_queue_depth = GetBlockServerQueueDepth(lock.get());
+        if (block_server_queue_depth != 0) {
+            snapuserd_argv->emplace_back("-block_server_queue_depth=" +
+                                         std::to_string(block_server_queue_depth));
+        }
+        uint64_t block_cache_size = GetBlockCacheSize(lock.get());
+        if (block_cache_size != 0) {
+            snapuserd_argv->emplace_back("-block_cache_size=" + std::to_string(block_cache_size));
+        }
+        uint32_t merge_io_pressure_target = GetMergeIoPressureTarget(lock.get());
+        if (merge_io_pressure_target != 0) {
+            snapuserd_argv->emplace_back("-merge_io_pressure_target=" +
+                                         std::to_string(merge_io_pressure_target));
+        }
     }
 
     size_t num_cows = 0;
@@ -2184,12 +2242,16 @@ UpdateState SnapshotManager::GetUpdateState(double* progress) {
             return state;
         }
 
+        DmDeviceSnapshot devices;
+        bool have_devices = dm_.QueryDevices(android::dm::kDmQueryStatus, &devices);
+
         DmTargetSnapshot::Status fake_snapshots_status = {};
         for (const auto& snapshot : snapshots) {
             DmTargetSnapshot::Status current_status;
+            const DmDeviceSnapshot* view = have_devices ? &devices : nullptr;
 
-            if (!IsSnapshotDevice(snapshot)) continue;
-            if (!QuerySnapshotStatus(snapshot, nullptr, &current_status)) continue;
+            if (!IsSnapshotDevice(snapshot, nullptr, view)) continue;
+            if (!QuerySnapshotStatus(snapshot, nullptr, &current_status, view)) continue;
 
             fake_snapshots_status.sectors_allocated += current_status.sectors_allocated;
             fake_snapshots_status.total_sectors += current_status.total_sectors;
@@ -2259,6 +2321,26 @@ uint32_t SnapshotManager::GetNumVerificationThreads(LockedFile* lock) {
     return update_status.num_verification_threads();
 }
 
+uint32_t SnapshotManager::GetNumDecompressThreads(LockedFile* lock) {
+    SnapshotUpdateStatus update_status = ReadSnapshotUpdateStatus(lock);
+    return update_status.num_decompress_threads();
+}
+
+uint32_t SnapshotManager::GetBlockServerQueueDepth(LockedFile* lock) {
+    SnapshotUpdateStatus update_status = ReadSnapshotUpdateStatus(lock);
+    return update_status.block_server_queue_depth();
+}
+
+uint64_t SnapshotManager::GetBlockCacheSize(LockedFile* lock) {
+    SnapshotUpdateStatus update_status = ReadSnapshotUpdateStatus(lock);
+    return update_status.block_cache_size();
+}
+
+uint32_t SnapshotManager::GetMergeIoPressureTarget(LockedFile* lock) {
+    SnapshotUpdateStatus update_status = ReadSnapshotUpdateStatus(lock);
+    return update_status.merge_io_pressure_target();
+}
+
 bool SnapshotManager::MarkSnapuserdFromSystem() {
     auto path = GetSnapuserdFromSystemPath();
 
@@ -2532,6 +2614,9 @@ bool SnapshotManager::MapAllPartitions(LockedFile* lock, const std::string& supe
         return false;
     }
 
+    // Partitions without a live snapshot are a single dm-linear device each,
+    // so they are created in one batch and waited for together.
+    std::vector<CreateLogicalPartitionParams> linear_partitions;
     for (const auto& partition : metadata->partitions) {
         if (GetPartitionGroupName(metadata->groups[partition.group_index]) == kCowGroupName) {
             LOG(INFO) << "Skip mapping partition " << GetPartitionName(partition) << " in group "
@@ -2552,11 +2637,36 @@ bool SnapshotManager::MapAllPartitions(LockedFile* lock, const std::string& supe
                 .timeout_ms = timeout_ms,
                 .partition_opener = &opener,
         };
+
+        if (!partition.num_extents) {
+            LOG(INFO) << "Skipping zero-length logical partition: " << params.GetPartitionName();
+            continue;
+        }
+        std::optional<SnapshotStatus> live_snapshot_status;
+        if (!GetLiveSnapshotStatus(lock, params, &live_snapshot_status)) {
+            return false;
+        }
+        if (!live_snapshot_status.has_value()) {
+            linear_partitions.emplace_back(std::move(params));
+            continue;
+        }
+
         if (!MapPartitionWithSnapshot(lock, std::move(params), SnapshotContext::Mount, nullptr)) {
             return false;
         }
     }
 
+    if (!linear_partitions.empty()) {
+        std::vector<std::string> paths;
+        if (!CreateLogicalPartitions(linear_partitions, &paths)) {
+            LOG(ERROR) << "Could not create logical partitions without snapshots";
+            return false;
+        }
+        if (!WaitForDevices(paths, timeout_ms)) {
+            return false;
+        }
+    }
+
     LOG(INFO) << "Created logical partitions with snapshot.";
     return true;
 }
@@ -2578,6 +2688,49 @@ static std::chrono::milliseconds GetRemainingTime(
     return remaining_time;
 }
 
+bool SnapshotManager::GetLiveSnapshotStatus(LockedFile* lock,
+                                            const CreateLogicalPartitionParams& params,
+                                            std::optional<SnapshotStatus>* status) {
+    status->reset();
+
+    if (!IsSnapshotWithoutSlotSwitch() &&
+        !(params.partition->attributes & LP_PARTITION_ATTR_UPDATED)) {
+        LOG(INFO) << "Detected re-flashing of partition, will skip snapshot: "
+                  << params.GetPartitionName();
+        return true;
+    }
+    auto file_path = GetSnapshotStatusFilePath(params.GetPartitionName());
+    if (access(file_path.c_str(), F_OK) != 0) {
+        if (errno != ENOENT) {
+            PLOG(INFO) << "Can't map snapshot for " << params.GetPartitionName()
+                       << ": Can't access " << file_path;
+            return false;
+        }
+        return true;
+    }
+
+    SnapshotStatus snapshot_status;
+    if (!ReadSnapshotStatus(lock, params.GetPartitionName(), &snapshot_status)) {
+        return false;
+    }
+    // No live snapshot if merge is completed.
+    if (snapshot_status.state() == SnapshotState::MERGE_COMPLETED) {
+        return true;
+    }
+
+    if (snapshot_status.state() == SnapshotState::NONE ||
+        snapshot_status.cow_partition_size() + snapshot_status.cow_file_size() == 0) {
+        LOG(WARNING) << "Snapshot status for " << params.GetPartitionName()
+                     << " is invalid, ignoring: state = "
+                     << SnapshotState_Name(snapshot_status.state())
+                     << ", cow_partition_size = " << snapshot_status.cow_partition_size()
+                     << ", cow_file_size = " << snapshot_status.cow_file_size();
+        return true;
+    }
+    *status = std::move(snapshot_status);
+    return true;
+}
+
 bool SnapshotManager::MapPartitionWithSnapshot(LockedFile* lock,
                                                CreateLogicalPartitionParams params,
                                                SnapshotContext context, SnapshotPaths* paths) {
@@ -2603,46 +2756,10 @@ bool SnapshotManager::MapPartitionWithSnapshot(LockedFile* lock,
         return true;  // leave path empty to indicate that nothing is mapped.
     }
 
-    // Determine if there is a live snapshot for the SnapshotStatus of the partition; i.e. if the
-    // partition still has a snapshot that needs to be mapped.  If no live snapshot or merge
-    // completed, live_snapshot_status is set to nullopt.
     std::optional<SnapshotStatus> live_snapshot_status;
-    do {
-        if (!IsSnapshotWithoutSlotSwitch() &&
-            !(params.partition->attributes & LP_PARTITION_ATTR_UPDATED)) {
-            LOG(INFO) << "Detected re-flashing of partition, will skip snapshot: "
-                      << params.GetPartitionName();
-            break;
-        }
-        auto file_path = GetSnapshotStatusFilePath(params.GetPartitionName());
-        if (access(file_path.c_str(), F_OK) != 0) {
-            if (errno != ENOENT) {
-                PLOG(INFO) << "Can't map snapshot for " << params.GetPartitionName()
-                           << ": Can't access " << file_path;
-                return false;
-            }
-            break;
-        }
-        live_snapshot_status = std::make_optional<SnapshotStatus>();
-        if (!ReadSnapshotStatus(lock, params.GetPartitionName(), &*live_snapshot_status)) {
-            return false;
-        }
-        // No live snapshot if merge is completed.
-        if (live_snapshot_status->state() == SnapshotState::MERGE_COMPLETED) {
-            live_snapshot_status.reset();
-        }
-
-        if (live_snapshot_status->state() == SnapshotState::NONE ||
-            live_snapshot_status->cow_partition_size() + live_snapshot_status->cow_file_size() ==
-                    0) {
-            LOG(WARNING) << "Snapshot status for " << params.GetPartitionName()
-                         << " is invalid, ignoring: state = "
-                         << SnapshotState_Name(live_snapshot_status->state())
-                         << ", cow_partition_size = " << live_snapshot_status->cow_partition_size()
-                         << ", cow_file_size = " << live_snapshot_status->cow_file_size();
-            live_snapshot_status.reset();
-        }
-    } while (0);
+    if (!GetLiveSnapshotStatus(lock, params, &live_snapshot_status)) {
+        return false;
+    }
 
     if (live_snapshot_status.has_value()) {
         // dm-snapshot requires the base device to be writable.
@@ -3254,6 +3371,10 @@ bool SnapshotManager::WriteUpdateState(LockedFile* lock, UpdateState state,
         status.set_num_worker_threads(old_status.num_worker_threads());
         status.set_verify_block_size(old_status.verify_block_size());
         status.set_num_verification_threads(old_status.num_verification_threads());
+        status.set_num_decompress_threads(old_status.num_decompress_threads());
+        status.set_block_server_queue_depth(old_status.block_server_queue_depth());
+        status.set_block_cache_size(old_status.block_cache_size());
+        status.set_merge_io_pressure_target(old_status.merge_io_pressure_target());
     }
     return WriteSnapshotUpdateStatus(lock, status);
 }
@@ -3421,7 +3542,112 @@ static Return AddRequiredSpace(Return orig,
     return Return::NoSpace(sum);
 }
 
+// Run |job| for each index of |weights|, on up to |max_jobs| threads. A job
+// only starts if the weights of the running jobs plus its own fit in
+// |budget| (0 is no limit), or if nothing else is running. No new job starts
+// once one has failed.
+static bool RunCowJobs(const std::vector<uint64_t>& weights, uint32_t max_jobs, uint64_t budget,
+                       const std::function<bool(size_t)>& job) {
+    if (!max_jobs) {
+        max_jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    std::mutex m;
+    std::condition_variable cv;
+    size_t next = 0;
+    size_t running = 0;
+    uint64_t in_flight = 0;
+    bool ok = true;
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> guard(m);
+        while (ok && next < weights.size()) {
+            size_t index = next;
+            uint64_t weight = weights[index];
+            if (budget && running && in_flight + weight > budget) {
+                cv.wait(guard);
+                continue;
+            }
+            next++;
+            running++;
+            in_flight += weight;
+
+            guard.unlock();
+            bool result = job(index);
+            guard.lock();
+
+            running--;
+            in_flight -= weight;
+            if (!result) ok = false;
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min<size_t>(max_jobs, weights.size()); i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return ok;
+}
+
+uint32_t SnapshotManager::GetCowJobLimit(const CreateUpdateSnapshotsOptions& options) {
+    // gsid serializes its image calls, so jobs using ImageManagerBinder would
+    // only queue up behind each other.
+    if (!device_->IsRecovery() && !device_->IsFirstStageInit()) {
+        return 1;
+    }
+    return options.max_jobs;
+}
+
+// Sums up the progress of concurrent jobs and forwards it to the progress
+// callback of CreateUpdateSnapshotsOptions, one call at a time.
+class CowJobsProgress {
+  public:
+    CowJobsProgress(const CreateUpdateSnapshotsOptions& options,
+                    CreateSnapshotsProgress::Stage stage, const std::vector<uint64_t>& totals)
+        : callback_(options.progress), done_(totals.size()) {
+        progress_.stage = stage;
+        progress_.done = 0;
+        progress_.total = 0;
+        for (const auto& total : totals) {
+            progress_.total += total;
+        }
+    }
+
+    // Record that job |index| has done |done| units. Returns false if the
+    // callback asked to cancel, now or before.
+    bool Update(size_t index, uint64_t done) {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (cancelled_) return false;
+        if (!callback_) return true;
+
+        progress_.done = progress_.done - done_[index] + done;
+        done_[index] = done;
+        if (!callback_(progress_)) {
+            LOG(ERROR) << "CreateUpdateSnapshots cancelled by the caller";
+            cancelled_ = true;
+        }
+        return !cancelled_;
+    }
+
+  private:
+    const std::function<bool(const CreateSnapshotsProgress&)>& callback_;
+    std::mutex lock_;
+    CreateSnapshotsProgress progress_;
+    std::vector<uint64_t> done_;
+    bool cancelled_ = false;
+};
+
 Return SnapshotManager::CreateUpdateSnapshots(const DeltaArchiveManifest& manifest) {
+    return CreateUpdateSnapshots(manifest, CreateUpdateSnapshotsOptions{});
+}
+
+Return SnapshotManager::CreateUpdateSnapshots(const DeltaArchiveManifest& manifest,
+                                              const CreateUpdateSnapshotsOptions& options) {
     auto lock = LockExclusive();
     if (!lock) return Return::Error();
 
@@ -3568,14 +3794,18 @@ Return SnapshotManager::CreateUpdateSnapshots(const DeltaArchiveManifest& manife
     if (dap_metadata.vabc_feature_set().has_batch_writes()) {
         cow_creator.batched_writes = dap_metadata.vabc_feature_set().batch_writes();
     }
+    // The OTA's feature set has no bit for this, so it is a device opt-in. It only matters
+    // with threaded compression and v3 COWs, and doesn't change what is written.
+    cow_creator.pipelined_compression =
+            android::base::GetBoolProperty("ro.virtual_ab.compression.pipelined", false);
 
     // In case of error, automatically delete devices that are created along the way.
     // Note that "lock" is destroyed after "created_devices", so it is safe to use |lock| for
     // these devices.
     AutoDeviceList created_devices;
     std::map<std::string, SnapshotStatus> all_snapshot_status;
-    auto ret = CreateUpdateSnapshotsInternal(lock.get(), manifest, &cow_creator, &created_devices,
-                                             &all_snapshot_status);
+    auto ret = CreateUpdateSnapshotsInternal(lock.get(), manifest, options, &cow_creator,
+                                             &created_devices, &all_snapshot_status);
     if (!ret.is_ok()) {
         LOG(ERROR) << "CreateUpdateSnapshotsInternal failed: " << ret.string();
         return ret;
@@ -3588,7 +3818,7 @@ Return SnapshotManager::CreateUpdateSnapshots(const DeltaArchiveManifest& manife
     }
 
     ret = InitializeUpdateSnapshots(lock.get(), dap_metadata.cow_version(), target_metadata.get(),
-                                    exported_target_metadata.get(), target_suffix,
+                                    exported_target_metadata.get(), target_suffix, options,
                                     all_snapshot_status);
     if (!ret.is_ok()) return ret;
 
@@ -3648,6 +3878,14 @@ Return SnapshotManager::CreateUpdateSnapshots(const DeltaArchiveManifest& manife
                 android::base::GetUintProperty<uint32_t>("ro.virtual_ab.verify_block_size", 0));
         status.set_num_verification_threads(
                 android::base::GetUintProperty<uint32_t>("ro.virtual_ab.num_verify_threads", 0));
+        status.set_num_decompress_threads(android::base::GetUintProperty<uint32_t>(
+                "ro.virtual_ab.num_decompress_threads", 0));
+        status.set_block_server_queue_depth(android::base::GetUintProperty<uint32_t>(
+                "ro.virtual_ab.block_server_queue_depth", 0));
+        status.set_block_cache_size(
+                android::base::GetUintProperty<uint64_t>("ro.virtual_ab.block_cache_size", 0));
+        status.set_merge_io_pressure_target(android::base::GetUintProperty<uint32_t>(
+                "ro.virtual_ab.merge_io_pressure_target", 0));
     } else if (legacy_compression) {
         LOG(INFO) << "Virtual A/B using legacy snapuserd";
     } else {
@@ -3681,7 +3919,8 @@ Return SnapshotManager::CreateUpdateSnapshots(const DeltaArchiveManifest& manife
 }
 
 Return SnapshotManager::CreateUpdateSnapshotsInternal(
-        LockedFile* lock, const DeltaArchiveManifest& manifest, PartitionCowCreator* cow_creator,
+        LockedFile* lock, const DeltaArchiveManifest& manifest,
+        const CreateUpdateSnapshotsOptions& options, PartitionCowCreator* cow_creator,
         AutoDeviceList* created_devices,
         std::map<std::string, SnapshotStatus>* all_snapshot_status) {
     CHECK(lock);
@@ -3813,17 +4052,46 @@ Return SnapshotManager::CreateUpdateSnapshotsInternal(
 
     LOG(INFO) << "Allocating CoW images.";
 
+    // Create the backing COW images where necessary. The images are
+    // independent of each other, so they can be allocated concurrently.
+    std::vector<std::string> names;
+    std::vector<uint64_t> sizes;
     for (auto&& [name, snapshot_status] : *all_snapshot_status) {
-        // Create the backing COW image if necessary.
         if (snapshot_status.cow_file_size() > 0) {
-            auto ret = CreateCowImage(lock, name);
-            if (!ret.is_ok()) {
-                LOG(ERROR) << "CreateCowImage failed: " << ret.string();
-                return AddRequiredSpace(ret, *all_snapshot_status);
-            }
+            names.emplace_back(name);
+            sizes.emplace_back(snapshot_status.cow_file_size());
+        } else {
+            LOG(INFO) << "Successfully created snapshot for " << name;
+        }
+    }
+    if (!names.empty() && !EnsureImageManager()) return Return::Error();
+
+    CowJobsProgress progress(options, CreateSnapshotsProgress::Stage::AllocatingCowImages, sizes);
+    std::mutex failure_lock;
+    Return failure = Return::Ok();
+    auto create_image = [&](size_t index) -> bool {
+        auto on_progress = [&, index](uint64_t done, uint64_t) -> bool {
+            return progress.Update(index, done);
+        };
+        auto ret = Return::Error();
+        if (progress.Update(index, 0)) {
+            ret = CreateCowImage(lock, names[index], on_progress);
+        }
+        if (ret.is_ok() && !progress.Update(index, sizes[index])) {
+            ret = Return::Error();
+        }
+        if (!ret.is_ok()) {
+            LOG(ERROR) << "CreateCowImage failed: " << ret.string();
+            std::lock_guard<std::mutex> guard(failure_lock);
+            if (failure.is_ok()) failure = ret;
+            return false;
         }
 
-        LOG(INFO) << "Successfully created snapshot for " << name;
+        LOG(INFO) << "Successfully created snapshot for " << names[index];
+        return true;
+    };
+    if (!RunCowJobs(sizes, GetCowJobLimit(options), options.io_budget, create_image)) {
+        return AddRequiredSpace(failure, *all_snapshot_status);
     }
 
     return Return::Ok();
@@ -3832,6 +4100,7 @@ Return SnapshotManager::CreateUpdateSnapshotsInternal(
 Return SnapshotManager::InitializeUpdateSnapshots(
         LockedFile* lock, uint32_t cow_version, MetadataBuilder* target_metadata,
         const LpMetadata* exported_target_metadata, const std::string& target_suffix,
+        const CreateUpdateSnapshotsOptions& options,
         const std::map<std::string, SnapshotStatus>& all_snapshot_status) {
     CHECK(lock);
 
@@ -3841,9 +4110,8 @@ Return SnapshotManager::InitializeUpdateSnapshots(
             .timeout_ms = std::chrono::milliseconds::max(),
             .partition_opener = &device_->GetPartitionOpener(),
     };
+    std::vector<const SnapshotStatus*> snapshots;
     for (auto* target_partition : ListPartitionsWithSuffix(target_metadata, target_suffix)) {
-        AutoDeviceList created_devices_for_cow;
-
         if (!UnmapPartitionWithSnapshot(lock, target_partition->name())) {
             LOG(ERROR) << "Cannot unmap existing COW devices before re-mapping them for zero-fill: "
                        << target_partition->name();
@@ -3852,56 +4120,95 @@ Return SnapshotManager::InitializeUpdateSnapshots(
 
         auto it = all_snapshot_status.find(target_partition->name());
         if (it == all_snapshot_status.end()) continue;
-        cow_params.partition_name = target_partition->name();
-        std::string cow_name;
-        if (!MapCowDevices(lock, cow_params, it->second, &created_devices_for_cow, &cow_name)) {
-            return Return::Error();
+        snapshots.emplace_back(&it->second);
+    }
+    if (!snapshots.empty() && !EnsureImageManager()) return Return::Error();
+
+    // Each snapshot is mapped, initialized and unmapped on its own, so they can
+    // be initialized concurrently. The header writes are small; only the number
+    // of jobs is bounded.
+    std::vector<uint64_t> weights(snapshots.size(), 1);
+    CowJobsProgress progress(options, CreateSnapshotsProgress::Stage::InitializingSnapshots,
+                             weights);
+    std::mutex failure_lock;
+    Return failure = Return::Ok();
+    auto initialize = [&](size_t index) -> bool {
+        CreateLogicalPartitionParams params = cow_params;
+        params.partition_name = snapshots[index]->name();
+
+        auto ret = Return::Error();
+        if (progress.Update(index, 0)) {
+            ret = InitializeUpdateSnapshot(lock, cow_version, params, *snapshots[index]);
+        }
+        if (ret.is_ok() && !progress.Update(index, 1)) {
+            ret = Return::Error();
+        }
+        if (!ret.is_ok()) {
+            std::lock_guard<std::mutex> guard(failure_lock);
+            if (failure.is_ok()) failure = ret;
+            return false;
         }
+        return true;
+    };
+    if (!RunCowJobs(weights, GetCowJobLimit(options), 0, initialize)) {
+        return AddRequiredSpace(failure, all_snapshot_status);
+    }
+    return Return::Ok();
+}
 
-        std::string cow_path;
-        if (!images_->GetMappedImageDevice(cow_name, &cow_path)) {
-            LOG(ERROR) << "Cannot determine path for " << cow_name;
-            return Return::Error();
-        }
+Return SnapshotManager::InitializeUpdateSnapshot(LockedFile* lock, uint32_t cow_version,
+                                                 const CreateLogicalPartitionParams& cow_params,
+                                                 const SnapshotStatus& status) {
+    // Let destructor of created_devices_for_cow to unmap the COW devices.
+    AutoDeviceList created_devices_for_cow;
 
-        if (!android::fs_mgr::WaitForFile(cow_path, 6s)) {
-            LOG(ERROR) << "Timed out waiting for device to appear: " << cow_path;
+    std::string cow_name;
+    if (!MapCowDevices(lock, cow_params, status, &created_devices_for_cow, &cow_name)) {
+        return Return::Error();
+    }
+
+    std::string cow_path;
+    if (!images_->GetMappedImageDevice(cow_name, &cow_path)) {
+        LOG(ERROR) << "Cannot determine path for " << cow_name;
+        return Return::Error();
+    }
+
+    if (!android::fs_mgr::WaitForFile(cow_path, 6s)) {
+        LOG(ERROR) << "Timed out waiting for device to appear: " << cow_path;
+        return Return::Error();
+    }
+
+    if (status.using_snapuserd()) {
+        unique_fd fd(open(cow_path.c_str(), O_RDWR | O_CLOEXEC));
+        if (fd < 0) {
+            PLOG(ERROR) << "open " << cow_path << " failed for snapshot "
+                        << cow_params.partition_name;
             return Return::Error();
         }
 
-        if (it->second.using_snapuserd()) {
-            unique_fd fd(open(cow_path.c_str(), O_RDWR | O_CLOEXEC));
-            if (fd < 0) {
-                PLOG(ERROR) << "open " << cow_path << " failed for snapshot "
-                            << cow_params.partition_name;
-                return Return::Error();
-            }
-
-            CowOptions options;
-            if (device()->IsTestDevice()) {
-                options.scratch_space = false;
-            }
-            options.compression = it->second.compression_algorithm();
-            if (cow_version >= 3) {
-                options.op_count_max = it->second.estimated_ops_buffer_size();
-                options.max_blocks = {it->second.device_size() / options.block_size};
-            }
+        CowOptions options;
+        if (device()->IsTestDevice()) {
+            options.scratch_space = false;
+        }
+        options.compression = status.compression_algorithm();
+        if (cow_version >= 3) {
+            options.op_count_max = status.estimated_ops_buffer_size();
+            options.max_blocks = {status.device_size() / options.block_size};
+        }
 
-            auto writer = CreateCowWriter(cow_version, options, std::move(fd));
-            if (!writer->Finalize()) {
-                LOG(ERROR) << "Could not initialize COW device for " << target_partition->name();
-                return Return::Error();
-            }
-        } else {
-            auto ret = InitializeKernelCow(cow_path);
-            if (!ret.is_ok()) {
-                LOG(ERROR) << "Can't zero-fill COW device for " << target_partition->name() << ": "
-                           << cow_path;
-                return AddRequiredSpace(ret, all_snapshot_status);
-            }
+        auto writer = CreateCowWriter(cow_version, options, std::move(fd));
+        if (!writer->Finalize()) {
+            LOG(ERROR) << "Could not initialize COW device for " << cow_params.partition_name;
+            return Return::Error();
         }
-        // Let destructor of created_devices_for_cow to unmap the COW devices.
-    };
+    } else {
+        auto ret = InitializeKernelCow(cow_path);
+        if (!ret.is_ok()) {
+            LOG(ERROR) << "Can't zero-fill COW device for " << cow_params.partition_name << ": "
+                       << cow_path;
+            return ret;
+        }
+    }
     return Return::Ok();
 }
 
@@ -3997,6 +4304,7 @@ std::unique_ptr<ICowWriter> SnapshotManager::OpenCompressedSnapshotWriter(
     cow_options.max_blocks = {status.device_size() / cow_options.block_size};
     cow_options.batch_write = status.batched_writes();
     cow_options.num_compress_threads = status.enable_threading() ? 2 : 1;
+    cow_options.pipelined_compression = status.pipelined_compression();
     cow_options.op_count_max = status.estimated_ops_buffer_size();
     cow_options.compression_factor = status.compression_factor();
     // Disable scratch space for vts tests
@@ -4088,6 +4396,10 @@ bool SnapshotManager::Dump(std::ostream& os) {
     ss << "Worker thread count: " << update_status.num_worker_threads() << std::endl;
     ss << "Num verification threads: " << update_status.num_verification_threads() << std::endl;
     ss << "Verify block size: " << update_status.verify_block_size() << std::endl;
+    ss << "Num decompression threads: " << update_status.num_decompress_threads() << std::endl;
+    ss << "Block server queue depth: " << update_status.block_server_queue_depth() << std::endl;
+    ss << "Block cache size: " << update_status.block_cache_size() << std::endl;
+    ss << "Merge I/O pressure target: " << update_status.merge_io_pressure_target() << std::endl;
     ss << "Using XOR compression: " << GetXorCompressionEnabledProperty() << std::endl;
     ss << "Current slot: " << device_->GetSlotSuffix() << std::endl;
     ss << "Boot indicator: booting from " << GetCurrentSlot() << " slot" << std::endl;
@@ -4104,7 +4416,16 @@ bool SnapshotManager::Dump(std::ostream& os) {
         if (!EnsureSnapuserdConnected()) {
             ss << "N/A";
         } else {
-            ss << snapuserd_client_->GetMergePercent() << "%";
+            MergeProgressStats progress;
+            ss << snapuserd_client_->GetMergePercent(&progress) << "%";
+            if (update_status.merge_io_pressure_target()) {
+                ss << ", merge governor: " << progress.merge_rate_kbps << " KiB/s, backed off "
+                   << progress.merge_throttle_count << " times";
+            }
+            if (update_status.block_cache_size()) {
+                ss << ", block cache: " << progress.block_cache_hits << " hits, "
+                   << progress.block_cache_misses << " misses";
+            }
         }
         ss << std::endl;
         ss << "Merge phase: " << update_status.merge_phase() << std::endl;
@@ -4345,6 +4666,9 @@ bool SnapshotManager::EnsureNoOverflowSnapshot(LockedFile* lock) {
         return false;
     }
 
+    DmDeviceSnapshot devices;
+    bool have_devices = dm_.QueryDevices(android::dm::kDmQueryStatus, &devices);
+
     for (const auto& snapshot : snapshots) {
         SnapshotStatus status;
         if (!ReadSnapshotStatus(lock, snapshot, &status)) {
@@ -4355,7 +4679,9 @@ bool SnapshotManager::EnsureNoOverflowSnapshot(LockedFile* lock) {
         }
 
         std::vector<DeviceMapper::TargetInfo> targets;
-        if (!dm_.GetTableStatus(snapshot, &targets)) {
+        bool ok = have_devices ? devices.GetTableStatus(snapshot, &targets)
+                               : dm_.GetTableStatus(snapshot, &targets);
+        if (!ok) {
             LOG(ERROR) << "Could not read snapshot device table: " << snapshot;
             return false;
         }
@@ -4475,6 +4801,31 @@ bool SnapshotManager::GetMappedImageDeviceStringOrPath(const std::string& device
     return true;
 }
 
+bool SnapshotManager::WaitForDevices(const std::vector<std::string>& devices,
+                                     std::chrono::milliseconds timeout_ms) {
+    if (!uevent_regen_batch_callback_) {
+        for (const auto& device : devices) {
+            if (!WaitForDevice(device, timeout_ms)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::string> paths;
+    for (const auto& device : devices) {
+        if (android::base::StartsWith(device, "/")) {
+            paths.emplace_back(device);
+        }
+    }
+    if (!paths.empty() && !uevent_regen_batch_callback_(paths)) {
+        LOG(ERROR) << "Failed to find devices after regenerating uevents: "
+                   << android::base::Join(paths, ", ");
+        return false;
+    }
+    return true;
+}
+
 bool SnapshotManager::WaitForDevice(const std::string& device,
                                     std::chrono::milliseconds timeout_ms) {
     if (!android::base::StartsWith(device, "/")) {
@@ -4636,6 +4987,30 @@ void SnapshotManager::UpdateCowStats(ISnapshotMergeStats* stats) {
     stats->report()->set_estimated_cow_size_bytes(estimated_cow_size);
 }
 
+void SnapshotManager::UpdateMergeRateStats() {
+    auto lock = LockShared();
+    if (!lock) return;
+
+    if (!UpdateUsesUserSnapshots(lock.get()) || !GetMergeIoPressureTarget(lock.get())) {
+        return;
+    }
+    if (!EnsureSnapuserdConnected()) {
+        return;
+    }
+
+    MergeProgressStats progress;
+    snapuserd_client_->GetMergePercent(&progress);
+    // The daemon only knows about the handlers still merging; keep the last
+    // rate seen once they are gone.
+    if (!progress.merge_rate_kbps) {
+        return;
+    }
+
+    auto stats = GetSnapshotMergeStatsInstance();
+    stats->report()->set_merge_governor_rate_kbps(progress.merge_rate_kbps);
+    stats->report()->set_merge_governor_throttle_count(progress.merge_throttle_count);
+}
+
 void SnapshotManager::SetMergeStatsFeatures(ISnapshotMergeStats* stats) {
     auto lock = LockExclusive();
     if (!lock) return;
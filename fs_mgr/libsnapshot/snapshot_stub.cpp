@@ -64,6 +64,12 @@ Return SnapshotManagerStub::CreateUpdateSnapshots(const DeltaArchiveManifest&) {
     return Return::Error();
 }
 
+Return SnapshotManagerStub::CreateUpdateSnapshots(const DeltaArchiveManifest&,
+                                                  const CreateUpdateSnapshotsOptions&) {
+    LOG(ERROR) << __FUNCTION__ << " should never be called.";
+    return Return::Error();
+}
+
 bool SnapshotManagerStub::MapUpdateSnapshot(const CreateLogicalPartitionParams&, std::string*) {
     LOG(ERROR) << __FUNCTION__ << " should never be called.";
     return false;
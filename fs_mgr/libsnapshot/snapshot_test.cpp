@@ -1443,6 +1443,76 @@ TEST_F(SnapshotUpdateTest, FullUpdateFlow) {
     }
 }
 
+// Test that COW images can be created concurrently, with progress reported
+// for every stage, and that the result is usable like a serial update.
+TEST_F(SnapshotUpdateTest, ParallelCreateUpdateSnapshots) {
+    // Make sure every partition needs a COW image.
+    constexpr uint64_t partition_size = 3788_KiB;
+    SetSize(sys_, partition_size);
+    SetSize(vnd_, partition_size);
+    SetSize(prd_, partition_size);
+    sys_->set_estimate_cow_size(30_MiB);
+    vnd_->set_estimate_cow_size(30_MiB);
+    prd_->set_estimate_cow_size(30_MiB);
+
+    AddOperationForPartitions();
+
+    std::map<CreateSnapshotsProgress::Stage, CreateSnapshotsProgress> last;
+    CreateUpdateSnapshotsOptions options{
+            .max_jobs = 0,
+            .io_budget = 40_MiB,
+            .progress = [&](const CreateSnapshotsProgress& progress) -> bool {
+                auto& prev = last[progress.stage];
+                EXPECT_LE(progress.done, progress.total);
+                EXPECT_GE(progress.done, prev.done);
+                prev = progress;
+                return true;
+            },
+    };
+
+    ASSERT_TRUE(sm->BeginUpdate());
+    ASSERT_TRUE(sm->CreateUpdateSnapshots(manifest_, options));
+
+    ASSERT_EQ(last.size(), 2u);
+    for (const auto& [stage, progress] : last) {
+        EXPECT_GT(progress.total, 0u);
+        EXPECT_EQ(progress.done, progress.total);
+    }
+    EXPECT_EQ(last[CreateSnapshotsProgress::Stage::InitializingSnapshots].total, 3u);
+
+    ASSERT_TRUE(WriteSnapshots());
+    ASSERT_TRUE(sm->FinishedSnapshotWrites(false));
+    ASSERT_TRUE(UnmapAll());
+
+    auto init = NewManagerForFirstStageMount("_b");
+    ASSERT_NE(init, nullptr);
+    ASSERT_TRUE(init->NeedSnapshotsInFirstStageMount());
+    ASSERT_TRUE(init->CreateLogicalAndSnapshotPartitions("super", snapshot_timeout_));
+    for (const auto& name : {"sys_b", "vnd_b", "prd_b"}) {
+        ASSERT_TRUE(IsPartitionUnchanged(name));
+    }
+}
+
+// Test that returning false from the progress callback cancels the creation
+// and cleans up.
+TEST_F(SnapshotUpdateTest, CancelCreateUpdateSnapshots) {
+    AddOperationForPartitions();
+
+    CreateUpdateSnapshotsOptions options{
+            .max_jobs = 0,
+            .progress = [](const CreateSnapshotsProgress&) -> bool { return false; },
+    };
+
+    ASSERT_TRUE(sm->BeginUpdate());
+    ASSERT_FALSE(sm->CreateUpdateSnapshots(manifest_, options));
+
+    ASSERT_TRUE(AcquireLock());
+    auto local_lock = std::move(lock_);
+    std::vector<std::string> snapshots;
+    ASSERT_TRUE(sm->ListSnapshots(local_lock.get(), &snapshots));
+    ASSERT_TRUE(snapshots.empty());
+}
+
 TEST_F(SnapshotUpdateTest, DuplicateOps) {
     if (!snapuserd_required_) {
         GTEST_SKIP() << "snapuserd-only test";
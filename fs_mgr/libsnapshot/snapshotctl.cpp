@@ -38,6 +38,7 @@
 #include <android-base/strings.h>
 #include <android/snapshot/snapshot.pb.h>
 
+#include <fs_avb/fs_avb_hashtree.h>
 #include <fs_avb/fs_avb_util.h>
 #include <fs_mgr.h>
 #include <fs_mgr_dm_linear.h>
@@ -47,8 +48,6 @@
 #include <libsnapshot/snapshot.h>
 #include <storage_literals/storage_literals.h>
 
-#include <openssl/sha.h>
-
 #include "partition_cow_creator.h"
 #include "scratch_super.h"
 
@@ -716,52 +715,29 @@ static bool GetBlockHashFromMerkelTree(android::base::borrowed_fd image_fd, uint
     return true;
 }
 
-static bool CalculateDigest(const void* buffer, size_t size, const void* salt, uint32_t salt_length,
-                            uint8_t* digest) {
-    SHA256_CTX ctx;
-    if (SHA256_Init(&ctx) != 1) {
-        return false;
-    }
-    if (SHA256_Update(&ctx, salt, salt_length) != 1) {
-        return false;
-    }
-    if (SHA256_Update(&ctx, buffer, size) != 1) {
+// Rebuild the hashtree from the data blocks, on all CPUs, and check both the
+// root digest and every data block digest read from the on-disk tree.
+bool verify_data_blocks(android::base::borrowed_fd fd, const std::vector<std::string>& block_hash,
+                        std::unique_ptr<android::fs_mgr::FsAvbHashtreeDescriptor>& descriptor) {
+    auto tree = android::fs_mgr::Hashtree::Build(fd, *descriptor);
+    if (!tree) {
+        LOG(ERROR) << "Failed to build hashtree for: " << descriptor->partition_name;
         return false;
     }
-    if (SHA256_Final(digest, &ctx) != 1) {
+    std::vector<uint8_t> root_digest;
+    if (!android::base::HexToBytes(descriptor->root_digest, &root_digest) ||
+        tree->root_digest() != std::string(root_digest.begin(), root_digest.end())) {
+        LOG(ERROR) << "Root digest mismatch for: " << descriptor->partition_name;
         return false;
     }
-    return true;
-}
-
-bool verify_data_blocks(android::base::borrowed_fd fd, const std::vector<std::string>& block_hash,
-                        std::unique_ptr<android::fs_mgr::FsAvbHashtreeDescriptor>& descriptor,
-                        const std::vector<uint8_t>& salt) {
-    uint64_t data_block_count = descriptor->image_size / descriptor->data_block_size;
-    uint64_t foffset = 0;
-    uint64_t blk = 0;
-
-    std::string hash_block(descriptor->hash_block_size, '\0');
-    while (blk < data_block_count) {
-        if (!android::base::ReadFullyAtOffset(fd, hash_block.data(), descriptor->hash_block_size,
-                                              foffset)) {
-            LOG(ERROR) << "Failed to read from offset: " << foffset;
-            return false;
-        }
 
-        std::string digest(32, '\0');
-        CalculateDigest(hash_block.data(), descriptor->hash_block_size, salt.data(), salt.size(),
-                        reinterpret_cast<uint8_t*>(digest.data()));
-        if (digest != block_hash[blk]) {
-            LOG(ERROR) << "Hash mismatch for block: " << blk << " Expected: " << block_hash[blk]
-                       << " Received: " << digest;
+    for (uint64_t blk = 0; blk < tree->num_data_blocks(); blk++) {
+        std::string digest = tree->GetDataBlockDigest(blk);
+        if (blk >= block_hash.size() || digest != block_hash[blk].substr(0, digest.size())) {
+            LOG(ERROR) << "Hash mismatch for block: " << blk;
             return false;
         }
-
-        foffset += descriptor->hash_block_size;
-        blk += 1;
     }
-
     return true;
 }
 
@@ -844,6 +820,12 @@ bool DumpVerityHash(int argc, char** argv) {
                        << " isn't multiple of: " << descriptor->data_block_size;
             return false;
         }
+        // The FEC region is hashed in hash_block_size units below.
+        if (fec_size % descriptor->hash_block_size != 0) {
+            LOG(ERROR) << "fec_size: " << fec_size
+                       << " isn't multiple of: " << descriptor->hash_block_size;
+            return false;
+        }
 
         std::vector<uint8_t> salt;
         const std::string& salt_str = descriptor->salt;
@@ -852,20 +834,37 @@ bool DumpVerityHash(int argc, char** argv) {
             LOG(ERROR) << "HexToBytes conversion failed";
             return false;
         }
+        // The FEC region is hashed as well, so that it can be compared
+        // offline. It is read in large chunks and hashed on all CPUs.
+        auto hasher = android::fs_mgr::HashtreeHasher::Create("sha256", salt);
+        if (!hasher) {
+            return false;
+        }
+        const uint64_t chunk_size =
+                1_MiB / descriptor->hash_block_size * descriptor->hash_block_size;
+        const uint32_t num_threads = std::max(std::thread::hardware_concurrency(), 1u);
         uint64_t file_offset = descriptor->image_size;
-        std::vector<uint8_t> hash_block(descriptor->hash_block_size, 0);
+        std::vector<uint8_t> chunk(chunk_size);
         while (file_offset < dev_sz) {
-            if (!android::base::ReadFullyAtOffset(fd, hash_block.data(),
-                                                  descriptor->hash_block_size, file_offset)) {
+            size_t len = std::min(chunk_size, dev_sz - file_offset);
+            if (!android::base::ReadFullyAtOffset(fd, chunk.data(), len, file_offset)) {
                 LOG(ERROR) << "Failed to read tree block at offset: " << file_offset;
                 return false;
             }
-            std::string digest(32, '\0');
-            CalculateDigest(hash_block.data(), descriptor->hash_block_size, salt.data(),
-                            salt.size(), reinterpret_cast<uint8_t*>(digest.data()));
-            block_hash.push_back(digest);
-            file_offset += descriptor->hash_block_size;
-            fec_size -= descriptor->hash_block_size;
+            size_t num_blocks = len / descriptor->hash_block_size;
+            std::string digests(num_blocks * hasher->digest_size(), '\0');
+            if (!hasher->HashBlocks(chunk.data(), len, descriptor->hash_block_size,
+                                    reinterpret_cast<uint8_t*>(digests.data()),
+                                    hasher->digest_size(), num_threads)) {
+                LOG(ERROR) << "Failed to hash blocks at offset: " << file_offset;
+                return false;
+            }
+            for (size_t i = 0; i < num_blocks; i++) {
+                block_hash.push_back(
+                        digests.substr(i * hasher->digest_size(), hasher->digest_size()));
+            }
+            file_offset += len;
+            fec_size -= len;
         }
 
         if (fec_size != 0) {
@@ -874,7 +873,7 @@ bool DumpVerityHash(int argc, char** argv) {
         }
 
         if (verification_required) {
-            if (!verify_data_blocks(fd, block_hash, descriptor, salt)) {
+            if (!verify_data_blocks(fd, block_hash, descriptor)) {
                 LOG(ERROR) << "verify_data_blocks failed";
                 return false;
             }
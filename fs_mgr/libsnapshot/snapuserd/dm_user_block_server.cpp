@@ -16,8 +16,10 @@
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <snapuserd/dm_user_uring_block_server.h>
 #include <snapuserd/snapuserd_kernel.h>
 #include "snapuserd_logging.h"
+#include "utility.h"
 
 namespace android {
 namespace snapshot {
@@ -150,5 +152,14 @@ std::shared_ptr<IBlockServerOpener> DmUserBlockServerFactory::CreateOpener(
     return std::make_shared<DmUserBlockServerOpener>(misc_name, dm_path);
 }
 
+std::shared_ptr<IBlockServerOpener> DmUserBlockServerFactory::CreateQueuedOpener(
+        const std::string& misc_name, uint32_t queue_depth) {
+    if (queue_depth <= 1 || !KernelSupportsIoUring()) {
+        return CreateOpener(misc_name);
+    }
+    auto dm_path = "/dev/dm-user/" + misc_name;
+    return std::make_shared<DmUserUringBlockServerOpener>(misc_name, dm_path, queue_depth);
+}
+
 }  // namespace snapshot
 }  // namespace android
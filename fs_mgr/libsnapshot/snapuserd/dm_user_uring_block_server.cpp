@@ -0,0 +1,452 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <snapuserd/dm_user_uring_block_server.h>
+
+#include <fcntl.h>
+#include <string.h>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <liburing.h>
+#include <snapuserd/dm_user_block_server.h>
+#include <snapuserd/snapuserd_kernel.h>
+#include "snapuserd_logging.h"
+
+namespace android {
+namespace snapshot {
+
+using android::base::unique_fd;
+
+// The low bits of user_data tell header reads, response writes and data reads
+// apart; the rest is the slot index.
+static constexpr uint64_t kHeaderReadTag = 0;
+static constexpr uint64_t kWriteTag = 1;
+static constexpr uint64_t kDataReadTag = 2;
+static constexpr uint64_t kTagMask = 3;
+static constexpr int kTagShift = 2;
+// Completions which need no processing, e.g. a response dropped in SendError.
+static constexpr uint64_t kNopTag = ~0ULL;
+
+DmUserUringBlockServer::DmUserUringBlockServer(const std::string& misc_name, unique_fd&& ctrl_fd,
+                                               Delegate* delegate, size_t buffer_size,
+                                               int queue_depth)
+    : misc_name_(misc_name),
+      ctrl_fd_(std::move(ctrl_fd)),
+      delegate_(delegate),
+      buffer_size_(buffer_size),
+      queue_depth_(queue_depth) {}
+
+DmUserUringBlockServer::~DmUserUringBlockServer() {
+    if (!ring_) {
+        return;
+    }
+    // Data reads land in the slot buffers; wait for them before the buffers
+    // go away. Header reads may never complete and are cancelled on exit.
+    while (data_reads_in_flight_) {
+        struct io_uring_cqe* cqe;
+        if (io_uring_wait_cqe(ring_.get(), &cqe)) {
+            break;
+        }
+        if (cqe->user_data != kNopTag && (cqe->user_data & kTagMask) == kDataReadTag) {
+            data_reads_in_flight_--;
+        }
+        io_uring_cqe_seen(ring_.get(), cqe);
+    }
+    io_uring_queue_exit(ring_.get());
+}
+
+bool DmUserUringBlockServer::Initialize() {
+    auto ring = std::make_unique<struct io_uring>();
+
+    // Each slot has at most its data reads, one response write and one header
+    // read queued.
+    int ret = io_uring_queue_init(queue_depth_ * (kMaxQueuedReads + 2), ring.get(), 0);
+    if (ret) {
+        SNAP_LOG(ERROR) << "io_uring_queue_init failed with ret: " << ret;
+        return false;
+    }
+    ring_ = std::move(ring);
+
+    slots_.resize(queue_depth_);
+    for (auto& slot : slots_) {
+        slot.buffer.Initialize(sizeof(struct dm_user_header), buffer_size_);
+        slot.queued_reads.reserve(kMaxQueuedReads);
+    }
+
+    SNAP_LOG(INFO) << "dm-user block server: io_uring initialized with queue depth: "
+                   << queue_depth_;
+    return true;
+}
+
+struct io_uring_sqe* DmUserUringBlockServer::GetSqe() {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring_.get());
+    if (!sqe) {
+        SNAP_LOG(ERROR) << "io_uring_get_sqe failed";
+    }
+    return sqe;
+}
+
+bool DmUserUringBlockServer::QueueHeaderRead(size_t slot_index) {
+    struct io_uring_sqe* sqe = GetSqe();
+    if (!sqe) {
+        return false;
+    }
+
+    void* header = slots_[slot_index].buffer.GetHeaderPtr();
+    io_uring_prep_read(sqe, ctrl_fd_.get(), header, sizeof(struct dm_user_header), 0);
+    // Reads block until dm-user has a request; don't bother trying them
+    // non-blocking first.
+    sqe->flags |= IOSQE_ASYNC;
+    sqe->user_data = (slot_index << kTagShift) | kHeaderReadTag;
+    return true;
+}
+
+bool DmUserUringBlockServer::ProcessRequests() {
+    if (!armed_) {
+        for (size_t i = 0; i < slots_.size(); i++) {
+            if (!QueueHeaderRead(i)) {
+                return false;
+            }
+        }
+        int ret = io_uring_submit(ring_.get());
+        if (ret < 0) {
+            SNAP_LOG(ERROR) << "io_uring_submit failed: " << strerror(-ret);
+            return false;
+        }
+        armed_ = true;
+    }
+
+    while (ready_slots_.empty()) {
+        if (!ReapCompletion()) {
+            return false;
+        }
+    }
+
+    size_t slot_index = ready_slots_.front();
+    ready_slots_.pop_front();
+
+    struct dm_user_header* header =
+            reinterpret_cast<struct dm_user_header*>(slots_[slot_index].buffer.GetHeaderPtr());
+
+    SNAP_LOG(DEBUG) << "Daemon: msg->seq: " << std::dec << header->seq;
+    SNAP_LOG(DEBUG) << "Daemon: msg->len: " << std::dec << header->len;
+    SNAP_LOG(DEBUG) << "Daemon: msg->sector: " << std::dec << header->sector;
+    SNAP_LOG(DEBUG) << "Daemon: msg->type: " << std::dec << header->type;
+    SNAP_LOG(DEBUG) << "Daemon: msg->flags: " << std::dec << header->flags;
+
+    if (!ProcessRequest(slot_index)) {
+        if (header->type != DM_USER_RESP_ERROR) {
+            SendError(slot_index);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool DmUserUringBlockServer::ProcessRequest(size_t slot_index) {
+    Slot& slot = slots_[slot_index];
+    struct dm_user_header* header =
+            reinterpret_cast<struct dm_user_header*>(slot.buffer.GetHeaderPtr());
+
+    // Use the same header buffer as the response header.
+    int request_type = header->type;
+    header->type = DM_USER_RESP_SUCCESS;
+    slot.header_response = true;
+
+    // Reset the output buffer.
+    slot.buffer.ResetBufferOffset();
+    current_slot_ = slot_index;
+
+    switch (request_type) {
+        case DM_USER_REQ_MAP_READ:
+            if (!delegate_->RequestSectors(header->sector, header->len)) {
+                return false;
+            }
+            break;
+
+        case DM_USER_REQ_MAP_WRITE:
+            // We should not get any write request to dm-user as we mount all
+            // partitions as read-only.
+            SNAP_LOG(ERROR) << "Unexpected write request from dm-user";
+            return false;
+
+        default:
+            SNAP_LOG(ERROR) << "Unexpected request from dm-user: " << request_type;
+            return false;
+    }
+
+    if (!slot.queued_write) {
+        SNAP_LOG(ERROR) << "No response queued for request at sector: " << header->sector;
+        return false;
+    }
+
+    // Chain the read of the slot's next request behind the final response
+    // write, so the header is not overwritten before the kernel consumed it,
+    // and submit the whole chain at once.
+    slot.queued_write->flags |= IOSQE_IO_LINK;
+    slot.queued_write = nullptr;
+    slot.write_in_flight = true;
+    size_t num_reads = slot.queued_reads.size();
+    slot.queued_reads.clear();
+
+    if (!QueueHeaderRead(slot_index)) {
+        return false;
+    }
+
+    int ret = io_uring_submit(ring_.get());
+    if (ret < 0) {
+        SNAP_LOG(ERROR) << "io_uring_submit failed: " << strerror(-ret);
+        return false;
+    }
+    data_reads_in_flight_ += num_reads;
+    return true;
+}
+
+bool DmUserUringBlockServer::ReapCompletion() {
+    struct io_uring_cqe* cqe;
+
+    int ret = io_uring_wait_cqe(ring_.get(), &cqe);
+    if (ret) {
+        SNAP_LOG(ERROR) << "io_uring_wait_cqe failed: " << strerror(-ret);
+        return false;
+    }
+
+    uint64_t user_data = cqe->user_data;
+    int res = cqe->res;
+    io_uring_cqe_seen(ring_.get(), cqe);
+
+    if (user_data == kNopTag) {
+        return true;
+    }
+
+    size_t slot_index = user_data >> kTagShift;
+    Slot& slot = slots_[slot_index];
+    if ((user_data & kTagMask) == kDataReadTag) {
+        data_reads_in_flight_--;
+        // A failed or short read cancels the rest of the chain; the error is
+        // reported when the response write is reaped.
+        if (res < 0 && res != -ECANCELED) {
+            errno = -res;
+            SNAP_PLOG(ERROR) << "Read of response data failed";
+        }
+        return true;
+    }
+    if ((user_data & kTagMask) == kWriteTag) {
+        slot.write_in_flight = false;
+        if (res == -ECANCELED) {
+            SNAP_LOG(ERROR) << "Response data could not be read, size: " << slot.write_size;
+            // The header didn't reach dm-user, so the error still can.
+            if (slot.write_has_header) {
+                slot.header_response = true;
+                SendError(slot_index);
+            }
+            return false;
+        }
+        if (res < 0 || static_cast<size_t>(res) != slot.write_size) {
+            errno = (res < 0) ? -res : EIO;
+            SNAP_PLOG(ERROR) << "Write to dm-user failed size: " << slot.write_size
+                             << " res: " << res;
+            return false;
+        }
+        return true;
+    }
+
+    if (res < 0) {
+        errno = -res;
+        if (errno != ENOTBLK) {
+            SNAP_PLOG(ERROR) << "Control-read failed";
+        }
+
+        SNAP_PLOG(DEBUG) << "ReadDmUserHeader failed....";
+        return false;
+    }
+    if (res != sizeof(struct dm_user_header)) {
+        SNAP_LOG(ERROR) << "Short control-read: " << res;
+        return false;
+    }
+
+    // The linked response write has completed by the time the read is
+    // posted.
+    slot.write_in_flight = false;
+    ready_slots_.push_back(slot_index);
+    return true;
+}
+
+bool DmUserUringBlockServer::FlushQueuedWrite(Slot* slot) {
+    if (slot->queued_write) {
+        slot->queued_write = nullptr;
+        slot->write_in_flight = true;
+        size_t num_reads = slot->queued_reads.size();
+        slot->queued_reads.clear();
+
+        int ret = io_uring_submit(ring_.get());
+        if (ret < 0) {
+            SNAP_LOG(ERROR) << "io_uring_submit failed: " << strerror(-ret);
+            return false;
+        }
+        data_reads_in_flight_ += num_reads;
+    }
+
+    while (slot->write_in_flight) {
+        if (!ReapCompletion()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void* DmUserUringBlockServer::GetResponseBuffer(size_t size, size_t to_write) {
+    Slot& slot = slots_[current_slot_];
+
+    // A previous chunk of this request still owns the buffer; wait for it to
+    // reach the driver before reusing the buffer.
+    if (slot.queued_write || slot.write_in_flight) {
+        if (!FlushQueuedWrite(&slot)) {
+            return nullptr;
+        }
+        slot.buffer.ResetBufferOffset();
+    }
+    return slot.buffer.AcquireBuffer(size, to_write);
+}
+
+bool DmUserUringBlockServer::SendBufferedIo() {
+    Slot& slot = slots_[current_slot_];
+
+    // Responses to a single request must reach dm-user in order.
+    if (!FlushQueuedWrite(&slot)) {
+        return false;
+    }
+
+    size_t payload_size = slot.buffer.GetPayloadBytesWritten();
+    void* buf = slot.buffer.GetPayloadBufPtr();
+    if (slot.header_response) {
+        payload_size += sizeof(struct dm_user_header);
+        buf = slot.buffer.GetBufPtr();
+    }
+
+    struct io_uring_sqe* sqe = GetSqe();
+    if (!sqe) {
+        return false;
+    }
+    io_uring_prep_write(sqe, ctrl_fd_.get(), buf, payload_size, 0);
+    sqe->user_data = (current_slot_ << kTagShift) | kWriteTag;
+
+    slot.queued_write = sqe;
+    slot.write_has_header = slot.header_response;
+    slot.write_size = payload_size;
+
+    // After the first header is sent in response to a request, we cannot
+    // send any additional headers.
+    slot.header_response = false;
+    return true;
+}
+
+bool DmUserUringBlockServer::QueueRead(int fd, void* buffer, size_t size, uint64_t offset) {
+    Slot& slot = slots_[current_slot_];
+    uint8_t* data = reinterpret_cast<uint8_t*>(buffer);
+
+    // Extend the last read if this one continues it, both on disk and in the
+    // buffer, as runs of unchanged blocks do.
+    if (!slot.queued_reads.empty() && fd == slot.queued_read_fd && data == slot.queued_read_end &&
+        offset == slot.queued_read_end_offset) {
+        slot.queued_reads.back()->len += size;
+    } else {
+        if (slot.queued_reads.size() == kMaxQueuedReads) {
+            return false;
+        }
+        struct io_uring_sqe* sqe = GetSqe();
+        if (!sqe) {
+            return false;
+        }
+        io_uring_prep_read(sqe, fd, data, size, offset);
+        // The response write must not start before the data is in.
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe->user_data = (current_slot_ << kTagShift) | kDataReadTag;
+        slot.queued_reads.emplace_back(sqe);
+        slot.queued_read_fd = fd;
+    }
+    slot.queued_read_end = data + size;
+    slot.queued_read_end_offset = offset + size;
+    return true;
+}
+
+void DmUserUringBlockServer::DropQueuedIo(Slot* slot) {
+    for (auto sqe : slot->queued_reads) {
+        io_uring_prep_nop(sqe);
+        sqe->flags = 0;
+        sqe->user_data = kNopTag;
+    }
+    slot->queued_reads.clear();
+
+    // If the dropped response carried the header, the error response can
+    // take its place.
+    if (slot->queued_write) {
+        io_uring_prep_nop(slot->queued_write);
+        slot->queued_write->flags = 0;
+        slot->queued_write->user_data = kNopTag;
+        slot->queued_write = nullptr;
+        if (slot->write_has_header) {
+            slot->header_response = true;
+        }
+    }
+}
+
+void DmUserUringBlockServer::SendError(size_t slot_index) {
+    Slot& slot = slots_[slot_index];
+    struct dm_user_header* header =
+            reinterpret_cast<struct dm_user_header*>(slot.buffer.GetHeaderPtr());
+
+    DropQueuedIo(&slot);
+
+    // Same limitation as DmUserBlockServer::SendError: once the header has
+    // been sent, the error cannot be propagated to dm-user.
+    if (!slot.header_response) {
+        SNAP_LOG(ERROR) << "Cannot report I/O error, response header already sent";
+        return;
+    }
+
+    header->type = DM_USER_RESP_ERROR;
+    if (!android::base::WriteFully(ctrl_fd_, header, sizeof(*header))) {
+        SNAP_PLOG(ERROR) << "Write to dm-user failed size: " << sizeof(*header);
+    }
+    slot.header_response = false;
+}
+
+DmUserUringBlockServerOpener::DmUserUringBlockServerOpener(const std::string& misc_name,
+                                                           const std::string& dm_user_path,
+                                                           int queue_depth)
+    : misc_name_(misc_name), dm_user_path_(dm_user_path), queue_depth_(queue_depth) {}
+
+std::unique_ptr<IBlockServer> DmUserUringBlockServerOpener::Open(IBlockServer::Delegate* delegate,
+                                                                 size_t buffer_size) {
+    unique_fd fd(open(dm_user_path_.c_str(), O_RDWR | O_CLOEXEC));
+    if (fd < 0) {
+        SNAP_PLOG(ERROR) << "Could not open dm-user path: " << dm_user_path_;
+        return nullptr;
+    }
+
+    auto server = std::make_unique<DmUserUringBlockServer>(misc_name_, std::move(fd), delegate,
+                                                           buffer_size, queue_depth_);
+    if (server->Initialize()) {
+        return server;
+    }
+
+    SNAP_LOG(ERROR) << "Falling back to synchronous dm-user block server";
+    DmUserBlockServerOpener opener(misc_name_, dm_user_path_);
+    return opener.Open(delegate, buffer_size);
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -69,6 +69,19 @@ class IBlockServer {
     // If false is returned, an error is automatically reported to the driver.
     virtual bool SendBufferedIo() = 0;
 
+    // Queue a read of |size| bytes at |offset| in |fd| into |buffer|, which
+    // must have been returned by GetResponseBuffer() for the current request.
+    // The buffer is sent by the next SendBufferedIo() once the read has
+    // completed, and must not be touched by the caller after this call.
+    //
+    // Returns false if the read can't be queued, in which case the caller
+    // must fill |buffer| itself. Servers which handle one request at a time
+    // never queue reads.
+    virtual bool QueueRead([[maybe_unused]] int fd, [[maybe_unused]] void* buffer,
+                           [[maybe_unused]] size_t size, [[maybe_unused]] uint64_t offset) {
+        return false;
+    }
+
     void* GetResponseBuffer(size_t size) { return GetResponseBuffer(size, size); }
 };
 
@@ -89,6 +102,13 @@ class IBlockServerFactory {
 
     // Return a new IBlockServerOpener given a unique device name.
     virtual std::shared_ptr<IBlockServerOpener> CreateOpener(const std::string& misc_name) = 0;
+
+    // Same as CreateOpener(), for a server which may keep up to |queue_depth|
+    // requests in flight. By default, requests are served one at a time.
+    virtual std::shared_ptr<IBlockServerOpener> CreateQueuedOpener(
+            const std::string& misc_name, [[maybe_unused]] uint32_t queue_depth) {
+        return CreateOpener(misc_name);
+    }
 };
 
 }  // namespace snapshot
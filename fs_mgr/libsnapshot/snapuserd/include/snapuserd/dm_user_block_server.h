@@ -63,6 +63,10 @@ class DmUserBlockServerOpener : public IBlockServerOpener {
 class DmUserBlockServerFactory : public IBlockServerFactory {
   public:
     std::shared_ptr<IBlockServerOpener> CreateOpener(const std::string& misc_name) override;
+    // Uses a DmUserUringBlockServer if |queue_depth| > 1 and the kernel
+    // supports io_uring.
+    std::shared_ptr<IBlockServerOpener> CreateQueuedOpener(const std::string& misc_name,
+                                                           uint32_t queue_depth) override;
 };
 
 }  // namespace snapshot
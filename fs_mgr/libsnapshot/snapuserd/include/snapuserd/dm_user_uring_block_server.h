@@ -0,0 +1,126 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <android-base/unique_fd.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <snapuserd/block_server.h>
+#include <snapuserd/snapuserd_buffer.h>
+#include <snapuserd/snapuserd_kernel.h>
+
+struct io_uring;
+struct io_uring_sqe;
+
+namespace android {
+namespace snapshot {
+
+// Block server which keeps several dm-user requests in flight on an io_uring.
+//
+// Each slot owns a request header and a response buffer. A header read is
+// queued on every slot up front, so requests that arrive while the worker is
+// busy are already sitting in the completion queue when it comes back.
+//
+// The delegate may hand reads of the response data back through QueueRead().
+// They are queued on the same ring, linked ahead of the response write, which
+// is in turn linked ahead of the read of the slot's next request header. The
+// whole chain is submitted with a single syscall, and the worker moves on to
+// the next request while the reads are in flight, so the data reads of up to
+// |queue_depth| requests overlap. Data the delegate produces itself, e.g. by
+// decompressing COW ops, is still read synchronously.
+class DmUserUringBlockServer : public IBlockServer {
+  public:
+    DmUserUringBlockServer(const std::string& misc_name, android::base::unique_fd&& ctrl_fd,
+                           Delegate* delegate, size_t buffer_size, int queue_depth);
+    ~DmUserUringBlockServer();
+
+    bool Initialize();
+
+    bool ProcessRequests() override;
+    void* GetResponseBuffer(size_t size, size_t to_write) override;
+    bool SendBufferedIo() override;
+    bool QueueRead(int fd, void* buffer, size_t size, uint64_t offset) override;
+
+  private:
+    // Reads queued per response before the delegate has to read synchronously.
+    static constexpr size_t kMaxQueuedReads = 16;
+
+    struct Slot {
+        BufferSink buffer;
+        // First write of the current request carries the header.
+        bool header_response = false;
+        // Reads for the pending response, prepared in the SQ but not
+        // submitted.
+        std::vector<struct io_uring_sqe*> queued_reads;
+        // Where the last queued read ends, so that a read which continues it
+        // can be merged into it.
+        int queued_read_fd = -1;
+        uint8_t* queued_read_end = nullptr;
+        uint64_t queued_read_end_offset = 0;
+        // A write for this slot has been prepared in the SQ but not submitted.
+        struct io_uring_sqe* queued_write = nullptr;
+        // A write for this slot has been submitted and not yet reaped.
+        bool write_in_flight = false;
+        // The last write prepared for this slot carries the header.
+        bool write_has_header = false;
+        size_t write_size = 0;
+    };
+
+    bool QueueHeaderRead(size_t slot_index);
+    bool ProcessRequest(size_t slot_index);
+    bool ReapCompletion();
+    bool FlushQueuedWrite(Slot* slot);
+    void DropQueuedIo(Slot* slot);
+    void SendError(size_t slot_index);
+    struct io_uring_sqe* GetSqe();
+
+    std::string misc_name_;
+    android::base::unique_fd ctrl_fd_;
+    Delegate* delegate_;
+    size_t buffer_size_;
+    int queue_depth_;
+
+    std::unique_ptr<struct io_uring> ring_;
+    std::vector<Slot> slots_;
+    // Slots whose request header has been read and is waiting to be served.
+    std::deque<size_t> ready_slots_;
+    // Slot of the request currently being served by the delegate.
+    size_t current_slot_ = 0;
+    bool armed_ = false;
+    // Data reads submitted and not yet reaped.
+    size_t data_reads_in_flight_ = 0;
+};
+
+class DmUserUringBlockServerOpener : public IBlockServerOpener {
+  public:
+    DmUserUringBlockServerOpener(const std::string& misc_name, const std::string& dm_user_path,
+                                 int queue_depth);
+
+    // Falls back to a DmUserBlockServer if the io_uring cannot be set up.
+    std::unique_ptr<IBlockServer> Open(IBlockServer::Delegate* delegate,
+                                       size_t buffer_size) override;
+
+  private:
+    std::string misc_name_;
+    std::string dm_user_path_;
+    int queue_depth_;
+};
+
+}  // namespace snapshot
+}  // namespace android
@@ -33,6 +33,18 @@ static constexpr char kDaemonAliveIndicator[] = "daemon-alive-indicator";
 // Ensure that the second-stage daemon for snapuserd is running.
 bool EnsureSnapuserdStarted();
 
+// Counters reported by the daemon along with the merge percentage, summed
+// over all the handlers. They are 0 if the daemon doesn't report them.
+struct MergeProgressStats {
+    // Merge rate chosen by the merge governors, in KiB/s, and the number of
+    // times they backed off.
+    uint64_t merge_rate_kbps = 0;
+    uint64_t merge_throttle_count = 0;
+    // Decompressed block cache lookups.
+    uint64_t block_cache_hits = 0;
+    uint64_t block_cache_misses = 0;
+};
+
 class SnapuserdClient {
   private:
     android::base::unique_fd sockfd_;
@@ -88,8 +100,9 @@ class SnapuserdClient {
     // Returns true if the merge is started(or resumed from crash).
     bool InitiateMerge(const std::string& misc_name);
 
-    // Returns Merge completion percentage
-    double GetMergePercent();
+    // Returns Merge completion percentage. If given, |stats| is filled with
+    // the counters the daemon reports along with it.
+    double GetMergePercent(MergeProgressStats* stats = nullptr);
 
     // Return the status of the snapshot
     std::string QuerySnapshotStatus(const std::string& misc_name);
@@ -114,6 +127,9 @@ class SnapuserdClient {
 
     // Resume Merge threads
     bool ResumeMerge();
+
+    // Return the metadata memory usage of all the handlers
+    std::string QueryMemoryStats();
 };
 
 }  // namespace snapshot
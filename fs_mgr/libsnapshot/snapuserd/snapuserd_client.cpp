@@ -304,7 +304,9 @@ bool SnapuserdClient::InitiateMerge(const std::string& misc_name) {
     return response == "success";
 }
 
-double SnapuserdClient::GetMergePercent() {
+double SnapuserdClient::GetMergePercent(MergeProgressStats* stats) {
+    if (stats) *stats = {};
+
     std::string msg = "merge_percent";
     if (!Sendmsg(msg)) {
         LOG(ERROR) << "Failed to send message " << msg << " to snapuserd";
@@ -317,7 +319,19 @@ double SnapuserdClient::GetMergePercent() {
     if (response.empty()) {
         return 0.0;
     }
-    return std::stod(response);
+
+    // Older daemons only send the percentage.
+    std::vector<std::string> parts = android::base::Split(response, ",");
+    if (stats && parts.size() == 5) {
+        if (!android::base::ParseUint(parts[1], &stats->merge_rate_kbps) ||
+            !android::base::ParseUint(parts[2], &stats->merge_throttle_count) ||
+            !android::base::ParseUint(parts[3], &stats->block_cache_hits) ||
+            !android::base::ParseUint(parts[4], &stats->block_cache_misses)) {
+            LOG(ERROR) << "Invalid merge_percent response: " << response;
+            *stats = {};
+        }
+    }
+    return std::stod(parts[0]);
 }
 
 std::string SnapuserdClient::QuerySnapshotStatus(const std::string& misc_name) {
@@ -408,5 +422,14 @@ bool SnapuserdClient::ResumeMerge() {
     return response == "success";
 }
 
+std::string SnapuserdClient::QueryMemoryStats() {
+    std::string msg = "memory_stats";
+    if (!Sendmsg(msg)) {
+        LOG(ERROR) << "Failed to send message " << msg << " to snapuserd";
+        return {};
+    }
+    return Receivemsg();
+}
+
 }  // namespace snapshot
 }  // namespace android
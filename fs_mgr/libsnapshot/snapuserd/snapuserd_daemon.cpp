@@ -41,6 +41,13 @@ DEFINE_int32(worker_count, android::snapshot::kNumWorkerThreads,
              "number of worker threads used to serve I/O requests to dm-user");
 DEFINE_int32(verify_block_size, 1_MiB, "block sized used during verification of snapshots");
 DEFINE_int32(num_verify_threads, 3, "number of threads used during verification phase");
+DEFINE_int32(num_decompress_threads, 0,
+             "number of threads used to decompress read-ahead data during merge");
+DEFINE_int32(block_server_queue_depth, 0,
+             "number of dm-user requests kept in flight per worker thread using io_uring");
+DEFINE_uint64(block_cache_size, 0, "size in bytes of the decompressed block cache; 0 to disable");
+DEFINE_int32(merge_io_pressure_target, 0,
+             "percentage of I/O stall time the merge governor holds; 0 to disable");
 
 namespace android {
 namespace snapshot {
@@ -128,6 +135,10 @@ bool Daemon::StartServerForUserspaceSnapshots(int arg_start, int argc, char** ar
                 .cow_op_merge_size = static_cast<uint32_t>(FLAGS_cow_op_merge_size),
                 .verify_block_size = static_cast<uint32_t>(FLAGS_verify_block_size),
                 .num_verification_threads = static_cast<uint32_t>(FLAGS_num_verify_threads),
+                .num_decompress_threads = static_cast<uint32_t>(FLAGS_num_decompress_threads),
+                .block_server_queue_depth = static_cast<uint32_t>(FLAGS_block_server_queue_depth),
+                .block_cache_size = FLAGS_block_cache_size,
+                .merge_io_pressure_target = static_cast<uint32_t>(FLAGS_merge_io_pressure_target),
         };
         auto handler = user_server_.AddHandler(parts[0], parts[1], parts[2], parts[3], options);
         if (!handler || !user_server_.StartHandler(parts[0])) {
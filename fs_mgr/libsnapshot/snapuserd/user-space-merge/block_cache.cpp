@@ -0,0 +1,91 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "block_cache.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <snapuserd/snapuserd_kernel.h>
+
+namespace android {
+namespace snapshot {
+
+BlockCache::BlockCache(uint64_t cache_size) {
+    blocks_per_shard_ = (cache_size / BLOCK_SZ) / kNumShards;
+    if (!blocks_per_shard_) {
+        blocks_per_shard_ = 1;
+    }
+}
+
+bool BlockCache::Get(uint64_t block, void* buffer, size_t size) {
+    CHECK(size <= BLOCK_SZ);
+
+    Shard& shard = GetShard(block);
+    {
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto it = shard.map.find(block);
+        if (it != shard.map.end()) {
+            // Move to the front of the LRU list
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            memcpy(buffer, it->second->data.get(), size);
+            hits_++;
+            return true;
+        }
+    }
+    misses_++;
+    return false;
+}
+
+void BlockCache::Put(uint64_t block, const void* data) {
+    Shard& shard = GetShard(block);
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    auto it = shard.map.find(block);
+    if (it != shard.map.end()) {
+        // Another worker raced us to it; the data is the same.
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+
+    std::unique_ptr<uint8_t[]> buffer;
+    if (shard.lru.size() >= blocks_per_shard_) {
+        // Recycle the buffer of the least recently used block
+        Entry& victim = shard.lru.back();
+        shard.map.erase(victim.block);
+        buffer = std::move(victim.data);
+        shard.lru.pop_back();
+    } else {
+        buffer = std::make_unique<uint8_t[]>(BLOCK_SZ);
+    }
+    memcpy(buffer.get(), data, BLOCK_SZ);
+
+    shard.lru.push_front(Entry{block, std::move(buffer)});
+    shard.map[block] = shard.lru.begin();
+}
+
+std::string BlockCache::GetStats() const {
+    uint64_t hits = hits_;
+    uint64_t misses = misses_;
+    uint64_t total = hits + misses;
+    double hit_rate = total ? (hits * 100.0) / total : 0.0;
+    return android::base::StringPrintf("capacity: %zu blocks hits: %" PRIu64 " misses: %" PRIu64
+                                       " hit-rate: %.2f%%",
+                                       capacity(), hits, misses, hit_rate);
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,83 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace android {
+namespace snapshot {
+
+// Bounded LRU cache of decompressed 4K blocks, keyed by the block number in
+// the snapshot device. It is shared by all the read workers of a
+// SnapshotHandler so that hot blocks which are read repeatedly before merge
+// completes are only decompressed once.
+//
+// The cache is split into shards, each with its own lock and LRU list, so
+// that workers serving unrelated blocks do not contend.
+class BlockCache {
+  public:
+    // |cache_size| is in bytes and is rounded down to whole blocks.
+    explicit BlockCache(uint64_t cache_size);
+
+    // Copy |size| bytes of |block| into |buffer|. Returns false on a miss.
+    bool Get(uint64_t block, void* buffer, size_t size);
+
+    // Insert a full block of data, evicting the least recently used block
+    // of the shard if it is full.
+    void Put(uint64_t block, const void* data);
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    size_t capacity() const { return num_shards() * blocks_per_shard_; }
+
+    // Human readable summary, e.g. for the daemon status output.
+    std::string GetStats() const;
+
+  private:
+    static constexpr size_t kNumShards = 16;
+
+    struct Entry {
+        uint64_t block;
+        std::unique_ptr<uint8_t[]> data;
+    };
+
+    struct Shard {
+        std::mutex lock;
+        // Most recently used entry at the front.
+        std::list<Entry> lru;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> map;
+    };
+
+    size_t num_shards() const { return shards_.size(); }
+    Shard& GetShard(uint64_t block) { return shards_[block % kNumShards]; }
+
+    std::array<Shard, kNumShards> shards_;
+    size_t blocks_per_shard_;
+
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+};
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,71 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "block_index.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <android-base/logging.h>
+
+namespace android {
+namespace snapshot {
+
+bool BlockIndex::Add(uint64_t block, uint32_t value) {
+    CHECK(blocks_.empty()) << "BlockIndex already finalized";
+    if (block > std::numeric_limits<uint32_t>::max()) {
+        return false;
+    }
+    entries_.push_back((block << 32) | value);
+    return true;
+}
+
+void BlockIndex::Finalize() {
+    std::sort(entries_.begin(), entries_.end());
+
+    blocks_.resize(entries_.size());
+    values_.resize(entries_.size());
+    for (size_t i = 0; i < entries_.size(); i++) {
+        blocks_[i] = static_cast<uint32_t>(entries_[i] >> 32);
+        values_[i] = static_cast<uint32_t>(entries_[i]);
+    }
+
+    entries_.clear();
+    entries_.shrink_to_fit();
+}
+
+size_t BlockIndex::LowerBound(uint64_t block) const {
+    if (block > std::numeric_limits<uint32_t>::max()) {
+        return blocks_.size();
+    }
+    auto it = std::lower_bound(blocks_.begin(), blocks_.end(), static_cast<uint32_t>(block));
+    return it - blocks_.begin();
+}
+
+bool BlockIndex::Find(uint64_t block, uint32_t* value) const {
+    size_t pos = LowerBound(block);
+    if (pos == blocks_.size() || blocks_[pos] != block) {
+        return false;
+    }
+    *value = values_[pos];
+    return true;
+}
+
+size_t BlockIndex::MemoryUsage() const {
+    return entries_.capacity() * sizeof(uint64_t) + blocks_.capacity() * sizeof(uint32_t) +
+           values_.capacity() * sizeof(uint32_t);
+}
+
+}  // namespace snapshot
+}  // namespace android
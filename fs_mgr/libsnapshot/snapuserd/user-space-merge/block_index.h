@@ -0,0 +1,66 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace android {
+namespace snapshot {
+
+// Sorted table mapping a 32-bit block number to a 32-bit value, e.g. the
+// index of a COW operation or of a read-ahead group.
+//
+// Keys and values are kept in separate packed arrays: a lookup binary
+// searches the key array only, and an entry costs 8 bytes instead of the
+// 16 bytes of a (sector, pointer) pair or the ~40 bytes of a hash map node.
+//
+// The table is built in two steps: Add() every entry, then Finalize() to
+// sort it. Lookups are only valid after Finalize(), and the table is
+// immutable from then on, so it can be shared by threads without locking.
+class BlockIndex {
+  public:
+    void Reserve(size_t count) { entries_.reserve(count); }
+    // Returns false if |block| does not fit in 32 bits.
+    [[nodiscard]] bool Add(uint64_t block, uint32_t value);
+    void Finalize();
+
+    // Position of the first entry whose block is >= |block|, or size().
+    size_t LowerBound(uint64_t block) const;
+
+    // Returns true and sets |value| if |block| is in the table.
+    bool Find(uint64_t block, uint32_t* value) const;
+
+    uint64_t block(size_t pos) const { return blocks_[pos]; }
+    uint32_t value(size_t pos) const { return values_[pos]; }
+    size_t size() const { return blocks_.size(); }
+    bool empty() const { return blocks_.empty(); }
+
+    // Bytes of heap memory held by the table.
+    size_t MemoryUsage() const;
+
+  private:
+    // Staging area used until Finalize(): block in the upper 32 bits, value
+    // in the lower 32 bits, so sorting the packed entries sorts by block.
+    std::vector<uint64_t> entries_;
+
+    std::vector<uint32_t> blocks_;
+    std::vector<uint32_t> values_;
+};
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,157 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "decompress_pool.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <algorithm>
+
+#include "snapuserd_core.h"
+#include "utility.h"
+
+namespace android {
+namespace snapshot {
+
+using android::base::unique_fd;
+
+// Number of ops a thread claims at a time. Claiming a handful of ops at once
+// keeps lock traffic low without letting one thread hog the whole window.
+static constexpr size_t kOpsPerClaim = 8;
+
+DecompressPool::DecompressPool(const std::string& cow_device, const std::string& misc_name,
+                               std::shared_ptr<SnapshotHandler> snapuserd, int num_threads)
+    : cow_device_(cow_device),
+      misc_name_(misc_name),
+      snapuserd_(snapuserd),
+      num_threads_(num_threads) {}
+
+DecompressPool::~DecompressPool() {
+    Stop();
+}
+
+bool DecompressPool::Init() {
+    for (int i = 0; i < num_threads_; i++) {
+        unique_fd cow_fd(open(cow_device_.c_str(), O_RDONLY | O_CLOEXEC));
+        if (cow_fd < 0) {
+            SNAP_PLOG(ERROR) << "Open Failed: " << cow_device_;
+            return false;
+        }
+
+        auto reader = snapuserd_->CloneReaderForWorker();
+        if (!reader->InitForMerge(std::move(cow_fd))) {
+            SNAP_LOG(ERROR) << "Failed to initialize reader for decompression thread";
+            return false;
+        }
+        readers_.push_back(std::move(reader));
+    }
+
+    for (auto& reader : readers_) {
+        threads_.emplace_back(&DecompressPool::ThreadLoop, this, reader.get());
+    }
+
+    SNAP_LOG(INFO) << "Read-ahead: decompression pool started with " << threads_.size()
+                   << " threads";
+    return true;
+}
+
+void DecompressPool::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stopped_ = true;
+    }
+    work_cv_.notify_all();
+
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+
+    for (auto& reader : readers_) {
+        reader->CloseCowFd();
+    }
+}
+
+void DecompressPool::Submit(std::vector<const CowOperation*> ops, void* buffer) {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        CHECK(next_op_ == ops_.size() && ops_completed_ == ops_.size());
+
+        ops_ = std::move(ops);
+        buffer_ = reinterpret_cast<uint8_t*>(buffer);
+        next_op_ = 0;
+        ops_completed_ = 0;
+        failed_ = false;
+    }
+    work_cv_.notify_all();
+}
+
+bool DecompressPool::Wait() {
+    std::unique_lock<std::mutex> lock(lock_);
+    done_cv_.wait(lock, [this]() -> bool { return ops_completed_ == ops_.size(); });
+    return !failed_;
+}
+
+void DecompressPool::ThreadLoop(CowReader* reader) {
+    pthread_setname_np(pthread_self(), "RADecompress");
+
+    if (!SetThreadPriority(ANDROID_PRIORITY_BACKGROUND)) {
+        SNAP_PLOG(ERROR) << "Failed to set thread priority";
+    }
+
+    if (!SetProfiles({"CPUSET_SP_BACKGROUND"})) {
+        SNAP_PLOG(ERROR) << "Failed to assign task profile to decompression thread";
+    }
+
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true) {
+        work_cv_.wait(lock, [this]() -> bool { return stopped_ || next_op_ < ops_.size(); });
+        if (stopped_) {
+            return;
+        }
+
+        size_t start = next_op_;
+        size_t end = std::min(start + kOpsPerClaim, ops_.size());
+        next_op_ = end;
+        uint8_t* buffer = buffer_;
+        lock.unlock();
+
+        bool ok = true;
+        for (size_t i = start; i < end; i++) {
+            const CowOperation* op = ops_[i];
+            void* bufptr = buffer + (i * BLOCK_SZ);
+            if (ssize_t rv = reader->ReadData(op, bufptr, BLOCK_SZ); rv != BLOCK_SZ) {
+                SNAP_LOG(ERROR) << "ReadAhead - decompression failed for block: "
+                                << op->new_block << ", return value: " << rv;
+                ok = false;
+                break;
+            }
+        }
+
+        lock.lock();
+        if (!ok) {
+            failed_ = true;
+        }
+        ops_completed_ += (end - start);
+        if (ops_completed_ == ops_.size()) {
+            done_cv_.notify_all();
+        }
+    }
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,87 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libsnapshot/cow_reader.h>
+
+namespace android {
+namespace snapshot {
+
+class SnapshotHandler;
+
+// Pool of threads used by the read-ahead thread to decompress the COW data
+// of a read-ahead window in parallel.
+//
+// Each thread owns a private CowReader (and thus a private COW fd) since
+// CowReader::ReadData is not thread-safe. Ops are handed out in small
+// batches and may complete in any order; the data of ops[i] always lands at
+// block i of the caller's buffer, so the caller sees the data in op order.
+class DecompressPool {
+  public:
+    DecompressPool(const std::string& cow_device, const std::string& misc_name,
+                   std::shared_ptr<SnapshotHandler> snapuserd, int num_threads);
+    ~DecompressPool();
+
+    bool Init();
+
+    // Queue |ops| for decompression. The data of each op is written to
+    // |buffer| + (index * BLOCK_SZ); |buffer| must hold ops.size() blocks
+    // and stay valid until Wait() returns. Only one batch may be
+    // outstanding at a time.
+    void Submit(std::vector<const CowOperation*> ops, void* buffer);
+
+    // Wait for the outstanding batch to finish. Returns false if any of the
+    // ops failed to decompress.
+    bool Wait();
+
+    size_t num_threads() const { return threads_.size(); }
+
+  private:
+    void ThreadLoop(CowReader* reader);
+    void Stop();
+
+    std::string cow_device_;
+    std::string misc_name_;  // Needed for SNAP_LOG.
+    std::shared_ptr<SnapshotHandler> snapuserd_;
+    int num_threads_;
+
+    std::vector<std::unique_ptr<CowReader>> readers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex lock_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+
+    // State of the current batch; guarded by |lock_|.
+    std::vector<const CowOperation*> ops_;
+    uint8_t* buffer_ = nullptr;
+    size_t next_op_ = 0;
+    size_t ops_completed_ = 0;
+    bool failed_ = false;
+    bool stopped_ = false;
+};
+
+}  // namespace snapshot
+}  // namespace android
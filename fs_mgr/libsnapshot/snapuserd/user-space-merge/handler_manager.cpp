@@ -257,6 +257,50 @@ void SnapshotHandlerManager::MonitorMerge() {
     LOG(INFO) << "Exiting MonitorMerge: size: " << merge_handlers_.size();
 }
 
+void SnapshotHandlerManager::GetBlockCacheCounters(uint64_t* hits, uint64_t* misses) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    *hits = 0;
+    *misses = 0;
+    for (auto iter = dm_users_.begin(); iter != dm_users_.end(); iter++) {
+        auto& snapuserd = (*iter)->snapuserd();
+        if (!snapuserd || !snapuserd->GetBlockCache()) {
+            continue;
+        }
+        *hits += snapuserd->GetBlockCache()->hits();
+        *misses += snapuserd->GetBlockCache()->misses();
+    }
+}
+
+std::string SnapshotHandlerManager::GetMemoryStats() {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    std::string stats;
+    for (auto iter = dm_users_.begin(); iter != dm_users_.end(); iter++) {
+        auto& snapuserd = (*iter)->snapuserd();
+        if (!snapuserd) {
+            continue;
+        }
+        stats += (*iter)->misc_name() + ": " + snapuserd->GetMemoryStats() + "\n";
+    }
+    return stats;
+}
+
+void SnapshotHandlerManager::GetMergeRate(uint64_t* rate_kbps, uint64_t* throttle_count) {
+    std::lock_guard<std::mutex> lock(lock_);
+
+    *rate_kbps = 0;
+    *throttle_count = 0;
+    for (auto iter = dm_users_.begin(); iter != dm_users_.end(); iter++) {
+        auto& snapuserd = (*iter)->snapuserd();
+        if (!snapuserd || !snapuserd->GetMergeGovernor()) {
+            continue;
+        }
+        *rate_kbps += snapuserd->GetMergeGovernor()->rate_kbps();
+        *throttle_count += snapuserd->GetMergeGovernor()->throttle_count();
+    }
+}
+
 std::string SnapshotHandlerManager::GetMergeStatus(const std::string& misc_name) {
     std::lock_guard<std::mutex> lock(lock_);
     auto iter = FindHandler(&lock, misc_name);
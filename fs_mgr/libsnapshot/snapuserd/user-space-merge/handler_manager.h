@@ -35,6 +35,10 @@ struct HandlerOptions {
     uint32_t cow_op_merge_size{};
     uint32_t verify_block_size{};
     uint32_t num_verification_threads{};
+    uint32_t num_decompress_threads{};
+    uint32_t block_server_queue_depth{};
+    uint64_t block_cache_size{};
+    uint32_t merge_io_pressure_target{};
 };
 
 class SnapshotHandler;
@@ -103,6 +107,16 @@ class ISnapshotHandlerManager {
 
     // Resume Merge threads
     virtual void ResumeMerge() = 0;
+
+    // Sum of the decompressed block cache hits and misses of every handler.
+    virtual void GetBlockCacheCounters(uint64_t* hits, uint64_t* misses) = 0;
+
+    // Returns the metadata memory usage of every handler.
+    virtual std::string GetMemoryStats() = 0;
+
+    // Sum of the merge rates chosen by the governors, in KiB/s, and of the
+    // number of times they backed off.
+    virtual void GetMergeRate(uint64_t* rate_kbps, uint64_t* throttle_count) = 0;
 };
 
 class SnapshotHandlerManager final : public ISnapshotHandlerManager {
@@ -126,6 +140,9 @@ class SnapshotHandlerManager final : public ISnapshotHandlerManager {
     void DisableVerification() override { perform_verification_ = false; }
     void PauseMerge() override;
     void ResumeMerge() override;
+    void GetBlockCacheCounters(uint64_t* hits, uint64_t* misses) override;
+    std::string GetMemoryStats() override;
+    void GetMergeRate(uint64_t* rate_kbps, uint64_t* throttle_count) override;
 
   private:
     bool StartHandler(const std::shared_ptr<HandlerThread>& handler);
@@ -0,0 +1,154 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "merge_governor.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <snapuserd/snapuserd_kernel.h>
+
+namespace android {
+namespace snapshot {
+
+using namespace std::chrono_literals;
+
+namespace {
+
+class SteadyClock final : public MergeGovernor::Clock {
+  public:
+    std::chrono::steady_clock::time_point Now() override {
+        return std::chrono::steady_clock::now();
+    }
+    void SleepFor(std::chrono::milliseconds duration) override {
+        std::this_thread::sleep_for(duration);
+    }
+};
+
+}  // namespace
+
+MergeGovernor::MergeGovernor(uint32_t target_pressure, uint32_t max_merge_ops,
+                             const std::string& psi_path, std::shared_ptr<Clock> clock)
+    : target_pressure_(std::clamp(target_pressure, 1u, 100u)),
+      max_merge_ops_(std::max(max_merge_ops, kMinMergeOps)),
+      psi_path_(psi_path),
+      clock_(clock ? std::move(clock) : std::make_shared<SteadyClock>()),
+      merge_ops_(max_merge_ops_) {}
+
+bool MergeGovernor::Init() {
+    if (!ReadStallTime(&last_stall_us_)) {
+        return false;
+    }
+    last_sample_time_ = clock_->Now();
+    LOG(INFO) << "Merge governor: target I/O pressure: " << target_pressure_
+              << "% max merge ops: " << max_merge_ops_;
+    return true;
+}
+
+// The first line of the file looks like:
+//
+//   some avg10=0.00 avg60=0.00 avg300=0.00 total=123456
+//
+// where total is the cumulative stall time in microseconds.
+bool MergeGovernor::ReadStallTime(uint64_t* stall_us) {
+    std::string content;
+    if (!android::base::ReadFileToString(psi_path_, &content)) {
+        PLOG(ERROR) << "Failed to read " << psi_path_;
+        return false;
+    }
+
+    for (const auto& line : android::base::Split(content, "\n")) {
+        if (!android::base::StartsWith(line, "some ")) {
+            continue;
+        }
+        auto pos = line.find("total=");
+        if (pos != std::string::npos &&
+            sscanf(line.c_str() + pos, "total=%" SCNu64, stall_us) == 1) {
+            return true;
+        }
+    }
+    LOG(ERROR) << "Unexpected I/O pressure format: " << content;
+    return false;
+}
+
+void MergeGovernor::BatchMerged(uint64_t blocks) {
+    auto now = clock_->Now();
+    int64_t expected = 0;
+    start_time_ns_.compare_exchange_strong(
+            expected, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              now.time_since_epoch())
+                              .count());
+    blocks_merged_ += blocks;
+
+    auto elapsed = now - last_sample_time_;
+    if (elapsed >= kSampleInterval) {
+        uint64_t stall_us;
+        if (ReadStallTime(&stall_us)) {
+            auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed);
+            double pressure = ((stall_us - last_stall_us_) * 100.0) / elapsed_us.count();
+            Adjust(pressure);
+            last_stall_us_ = stall_us;
+        }
+        last_sample_time_ = now;
+    }
+
+    if (delay_ms_) {
+        clock_->SleepFor(std::chrono::milliseconds(delay_ms_));
+    }
+}
+
+void MergeGovernor::Adjust(double pressure) {
+    if (pressure > target_pressure_) {
+        merge_ops_ = std::max(merge_ops_ / 2, kMinMergeOps);
+        delay_ms_ = std::min(std::max(delay_ms_ * 2, kMinDelay.count()), kMaxDelay.count());
+        throttle_count_ += 1;
+        LOG(DEBUG) << "Merge governor: I/O pressure " << pressure << "%, backing off to "
+                   << merge_ops_ << " ops with " << delay_ms_ << "ms delay";
+    } else if (pressure < target_pressure_ / 2.0) {
+        merge_ops_ = std::min(merge_ops_ + kMergeOpsStep, max_merge_ops_);
+        delay_ms_ = (delay_ms_ / 2 < kMinDelay.count()) ? 0 : delay_ms_ / 2;
+    }
+}
+
+uint64_t MergeGovernor::rate_kbps() const {
+    int64_t start_ns = start_time_ns_;
+    if (!start_ns) {
+        return 0;
+    }
+    auto now = clock_->Now().time_since_epoch();
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              now - std::chrono::nanoseconds(start_ns))
+                              .count();
+    if (elapsed_ms <= 0) {
+        return 0;
+    }
+    return (blocks_merged_ * (BLOCK_SZ / 1024) * 1000) / elapsed_ms;
+}
+
+std::string MergeGovernor::GetStats() const {
+    return android::base::StringPrintf("rate: %" PRIu64 " KiB/s merge-ops: %u delay: %" PRId64
+                                       "ms throttled: %" PRIu64,
+                                       rate_kbps(), merge_ops(), delay_ms_.load(),
+                                       throttle_count());
+}
+
+}  // namespace snapshot
+}  // namespace android
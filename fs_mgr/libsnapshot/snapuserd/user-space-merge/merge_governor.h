@@ -0,0 +1,106 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace android {
+namespace snapshot {
+
+// Adapts the merge rate to the I/O pressure of the system, so that merging
+// in the background does not regress foreground I/O latency, e.g. app
+// launches.
+//
+// The governor samples the "some" line of /proc/pressure/io, the cumulative
+// time during which at least one task was stalled on I/O. If the stalled
+// share of the time since the previous sample is above the target, the merge
+// batch size is halved and the delay between batches doubled. Once the
+// pressure drops below half the target, the batch size grows back linearly
+// and the delay is halved.
+class MergeGovernor {
+  public:
+    static constexpr char kIoPressurePath[] = "/proc/pressure/io";
+
+    // Time source of the governor. Tests replace it to drive the governor
+    // without depending on wall-clock time.
+    class Clock {
+      public:
+        virtual ~Clock() = default;
+        virtual std::chrono::steady_clock::time_point Now() = 0;
+        virtual void SleepFor(std::chrono::milliseconds duration) = 0;
+    };
+
+    // |target_pressure| is the percentage of stalled time to hold, and
+    // |max_merge_ops| the batch size used when there is no pressure. If
+    // |clock| is null, the steady clock is used.
+    MergeGovernor(uint32_t target_pressure, uint32_t max_merge_ops,
+                  const std::string& psi_path = kIoPressurePath,
+                  std::shared_ptr<Clock> clock = nullptr);
+
+    // Returns false if I/O pressure is not available on this kernel.
+    bool Init();
+
+    // Maximum number of ops the next merge batch should write.
+    uint32_t merge_ops() const { return merge_ops_; }
+
+    // Called by the merge thread after each batch of |blocks| blocks. Updates
+    // the batch size and sleeps for the current inter-batch delay.
+    void BatchMerged(uint64_t blocks);
+
+    // Average merge rate since the first batch, in KiB/s.
+    uint64_t rate_kbps() const;
+    // Number of times the governor backed off.
+    uint64_t throttle_count() const { return throttle_count_; }
+    // Current delay between batches.
+    std::chrono::milliseconds delay() const { return std::chrono::milliseconds(delay_ms_); }
+
+    // Human readable summary, e.g. for the daemon status output.
+    std::string GetStats() const;
+
+  private:
+    // Minimum time between two pressure samples; shorter windows are too
+    // noisy to act on.
+    static constexpr std::chrono::milliseconds kSampleInterval{100};
+    static constexpr std::chrono::milliseconds kMinDelay{5};
+    static constexpr std::chrono::milliseconds kMaxDelay{500};
+    static constexpr uint32_t kMinMergeOps = 8;
+    static constexpr uint32_t kMergeOpsStep = 8;
+
+    bool ReadStallTime(uint64_t* stall_us);
+    void Adjust(double pressure);
+
+    uint32_t target_pressure_;
+    uint32_t max_merge_ops_;
+    std::string psi_path_;
+    std::shared_ptr<Clock> clock_;
+
+    std::chrono::steady_clock::time_point last_sample_time_;
+    uint64_t last_stall_us_ = 0;
+
+    // Written by the merge thread, read by the daemon for stats.
+    std::atomic<uint32_t> merge_ops_;
+    std::atomic<int64_t> delay_ms_ = 0;
+    std::atomic<uint64_t> blocks_merged_ = 0;
+    std::atomic<uint64_t> throttle_count_ = 0;
+    std::atomic<int64_t> start_time_ns_ = 0;
+};
+
+}  // namespace snapshot
+}  // namespace android
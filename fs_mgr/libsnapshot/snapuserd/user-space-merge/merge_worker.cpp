@@ -40,8 +40,12 @@ int MergeWorker::PrepareMerge(uint64_t* source_offset, int* pending_ops,
                               std::vector<const CowOperation*>* replace_zero_vec) {
     int num_ops = *pending_ops;
     // 0 indicates ro.virtual_ab.cow_op_merge_size was not set in the build
-    if (cow_op_merge_size_ != 0) {
-        num_ops = std::min(cow_op_merge_size_, static_cast<uint32_t>(*pending_ops));
+    uint32_t merge_size = cow_op_merge_size_;
+    if (MergeGovernor* governor = snapuserd_->GetMergeGovernor()) {
+        merge_size = governor->merge_ops();
+    }
+    if (merge_size != 0) {
+        num_ops = std::min(merge_size, static_cast<uint32_t>(*pending_ops));
     }
 
     int nr_consecutive = 0;
@@ -194,6 +198,8 @@ bool MergeWorker::MergeReplaceZeroOps() {
 
         // Safe to check if there is a pause request.
         snapuserd_->PauseMergeIfRequired();
+
+        ThrottleMerge(linear_blocks);
     }
 
     // Any left over ops not flushed yet.
@@ -398,6 +404,8 @@ bool MergeWorker::MergeOrderedOpsAsync() {
         // window
         snapuserd_->NotifyRAForMergeReady();
 
+        ThrottleMerge(snapuserd_->GetTotalBlocksToMerge());
+
         // Get the next block
         ra_block_index_ += 1;
     }
@@ -491,6 +499,8 @@ bool MergeWorker::MergeOrderedOps() {
         // window
         snapuserd_->NotifyRAForMergeReady();
 
+        ThrottleMerge(snapuserd_->GetTotalBlocksToMerge());
+
         // Get the next block
         ra_block_index_ += 1;
     }
@@ -570,6 +580,12 @@ bool MergeWorker::Merge() {
     return true;
 }
 
+void MergeWorker::ThrottleMerge(uint64_t blocks_merged) {
+    if (MergeGovernor* governor = snapuserd_->GetMergeGovernor()) {
+        governor->BatchMerged(blocks_merged);
+    }
+}
+
 bool MergeWorker::InitializeIouring() {
     if (!snapuserd_->IsIouringSupported()) {
         return false;
@@ -634,7 +650,8 @@ bool MergeWorker::Run() {
     CloseFds();
     reader_->CloseCowFd();
 
-    SNAP_LOG(INFO) << "Snapshot-Merge completed";
+    SNAP_LOG(INFO) << "Snapshot-Merge completed, merge governor: "
+                   << snapuserd_->GetMergeGovernorStats();
 
     return true;
 }
@@ -36,6 +36,8 @@ class MergeWorker : public Worker {
     bool Merge();
     bool AsyncMerge();
     bool SyncMerge();
+    // Let the merge governor, if any, adjust the merge rate after a batch.
+    void ThrottleMerge(uint64_t blocks_merged);
     bool InitializeIouring();
     void FinalizeIouring();
 
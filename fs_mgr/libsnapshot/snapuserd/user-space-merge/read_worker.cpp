@@ -192,12 +192,19 @@ bool ReadWorker::ProcessCowOp(const CowOperation* cow_op, void* buffer) {
 
     switch (cow_op->type()) {
         case kCowReplaceOp: {
+            BlockCache* cache = snapuserd_->GetBlockCache();
+            if (cache && cache->Get(cow_op->new_block, buffer, BLOCK_SZ)) {
+                return true;
+            }
             size_t buffer_size = CowOpCompressionSize(cow_op, BLOCK_SZ);
             uint8_t chunk[buffer_size];
             if (!ProcessReplaceOp(cow_op, chunk, buffer_size)) {
                 return false;
             }
             std::memcpy(buffer, chunk, BLOCK_SZ);
+            if (cache) {
+                cache->Put(cow_op->new_block, chunk);
+            }
             return true;
         }
 
@@ -300,6 +307,17 @@ bool ReadWorker::ReadDataFromBaseDevice(sector_t sector, void* buffer, size_t re
     return true;
 }
 
+// Blocks the OTA didn't change are read from the base device. If the block
+// server can queue the read, the response goes out once it completes and the
+// worker moves on to the next request in the meantime.
+bool ReadWorker::ReadUnchangedBlocks(sector_t sector, void* buffer, size_t read_size) {
+    if (block_server_->QueueRead(base_path_merge_fd_.get(), buffer, read_size,
+                                 sector << SECTOR_SHIFT)) {
+        return true;
+    }
+    return ReadDataFromBaseDevice(sector, buffer, read_size);
+}
+
 bool ReadWorker::GetCowOpBlockOffset(const CowOperation* cow_op, uint64_t io_block,
                                      off_t* block_offset) {
     // If this is a replace op, get the block offset of this I/O
@@ -314,9 +332,82 @@ bool ReadWorker::GetCowOpBlockOffset(const CowOperation* cow_op, uint64_t io_blo
     return false;
 }
 
+bool ReadWorker::IsMultiBlockReplaceOp(const CowOperation* cow_op) {
+    return cow_op && cow_op->type() == kCowReplaceOp &&
+           CowOpCompressionSize(cow_op, BLOCK_SZ) > BLOCK_SZ;
+}
+
+// Read the blocks of a multi-block replace op starting at |io_block|, at most
+// |read_size| bytes, into the response buffer. The op is decompressed once
+// for all the blocks it covers. Returns the number of bytes read, or -1.
+ssize_t ReadWorker::ReadReplaceOpBlocks(const CowOperation* cow_op, uint64_t io_block,
+                                        off_t block_offset, size_t read_size) {
+    // Get the CowOperation actual compression size
+    size_t compression_size = CowOpCompressionSize(cow_op, BLOCK_SZ);
+    // Offset cannot be greater than the compression size
+    if (block_offset >= compression_size) {
+        SNAP_LOG(ERROR) << "Invalid I/O block found. io_block: " << io_block
+                        << " CowOperation-new-block: " << cow_op->new_block
+                        << " compression-size: " << compression_size;
+        return -1;
+    }
+
+    const size_t op_remaining = compression_size - block_offset;
+    const size_t to_write = std::min(op_remaining, read_size);
+
+    auto buffer = reinterpret_cast<uint8_t*>(block_server_->GetResponseBuffer(to_write, to_write));
+    if (!buffer) {
+        SNAP_LOG(ERROR) << "AcquireBuffer failed in ReadReplaceOpBlocks";
+        return -1;
+    }
+
+    BlockCache* cache = snapuserd_->GetBlockCache();
+    if (cache) {
+        size_t offset = 0;
+        for (; offset < to_write; offset += BLOCK_SZ) {
+            size_t size = std::min(BLOCK_SZ, to_write - offset);
+            if (!cache->Get(io_block + (offset / BLOCK_SZ), buffer + offset, size)) {
+                break;
+            }
+        }
+        if (offset >= to_write) {
+            return to_write;
+        }
+    }
+
+    if (to_write == op_remaining) {
+        // The request covers the rest of the op; decompress straight into
+        // the response buffer.
+        ssize_t size = reader_->ReadData(cow_op, buffer, to_write, block_offset);
+        if (size != to_write) {
+            SNAP_LOG(ERROR) << "ReadReplaceOpBlocks failed for block " << cow_op->new_block
+                            << " offset: " << block_offset << " size: " << to_write
+                            << ", return value: " << size;
+            return -1;
+        }
+    } else {
+        // Not every decompressor can stop short of the end of the op, so
+        // decompress all of it and copy out what was asked for.
+        ssize_t size = reader_->ReadData(cow_op, decompressed_buffer_.get(), compression_size);
+        if (size != compression_size) {
+            SNAP_LOG(ERROR) << "ReadReplaceOpBlocks failed for block " << cow_op->new_block
+                            << " size: " << compression_size << ", return value: " << size;
+            return -1;
+        }
+        std::memcpy(buffer, decompressed_buffer_.get() + block_offset, to_write);
+    }
+
+    if (cache) {
+        for (size_t offset = 0; offset + BLOCK_SZ <= to_write; offset += BLOCK_SZ) {
+            cache->Put(io_block + (offset / BLOCK_SZ), buffer + offset);
+        }
+    }
+    return to_write;
+}
+
 bool ReadWorker::ReadAlignedSector(sector_t sector, size_t sz) {
     size_t remaining_size = sz;
-    std::vector<std::pair<sector_t, const CowOperation*>>& chunk_vec = snapuserd_->GetChunkVec();
+    const BlockIndex& op_index = snapuserd_->GetOpIndex();
     int ret = 0;
 
     do {
@@ -324,55 +415,41 @@ bool ReadWorker::ReadAlignedSector(sector_t sector, size_t sz) {
         size_t read_size = std::min(PAYLOAD_BUFFER_SZ, remaining_size);
 
         size_t total_bytes_read = 0;
-        const CowOperation* prev_op = nullptr;
         while (read_size) {
             // We need to check every 4k block to verify if it is
             // present in the mapping.
             size_t size = std::min(BLOCK_SZ, read_size);
 
-            auto it = std::lower_bound(chunk_vec.begin(), chunk_vec.end(),
-                                       std::make_pair(sector, nullptr), SnapshotHandler::compare);
-            const bool sector_not_found = (it == chunk_vec.end() || it->first != sector);
+            // Find the 4k block
+            uint64_t io_block = SectorToChunk(sector);
+            size_t pos = op_index.LowerBound(io_block);
+            const bool sector_not_found =
+                    (pos == op_index.size() || op_index.block(pos) != io_block);
 
-            void* buffer = block_server_->GetResponseBuffer(BLOCK_SZ, size);
-            if (!buffer) {
-                SNAP_LOG(ERROR) << "AcquireBuffer failed in ReadAlignedSector";
-                return false;
-            }
+            const CowOperation* cow_op = nullptr;
+            // Relative offset within the compressed multiple blocks
+            off_t block_offset = 0;
 
             if (sector_not_found) {
-                // Find the 4k block
-                uint64_t io_block = SectorToChunk(sector);
-                // Get the previous iterator. Since the vector is sorted, the
+                // Get the previous entry. Since the index is sorted, the
                 // lookup of this sector can fall in a range of blocks if
                 // CowOperation has compressed multiple blocks.
-                if (it != chunk_vec.begin()) {
-                    std::advance(it, -1);
+                if (pos != 0) {
+                    pos -= 1;
                 }
 
-                bool is_mapping_present = true;
-
-                // Vector itself is empty. This can happen if the block was not
+                // Index itself is empty. This can happen if the block was not
                 // changed per the OTA or if the merge was already complete but
                 // snapshot table was not yet collapsed.
-                if (it == chunk_vec.end()) {
-                    is_mapping_present = false;
-                }
-
-                const CowOperation* cow_op = nullptr;
-                // Relative offset within the compressed multiple blocks
-                off_t block_offset = 0;
-                if (is_mapping_present) {
-                    // Get the nearest operation found in the vector
-                    cow_op = it->second;
-                    is_mapping_present = GetCowOpBlockOffset(cow_op, io_block, &block_offset);
-                }
+                if (pos != op_index.size() &&
+                    GetCowOpBlockOffset(reader_->GetOp(op_index.value(pos)), io_block,
+                                        &block_offset)) {
+                    // Thus, we have a case wherein sector was not found in the
+                    // sorted index; however, we indeed have a mapping of this
+                    // sector embedded in one of the CowOperation which spans
+                    // multiple block size.
+                    cow_op = reader_->GetOp(op_index.value(pos));
 
-                // Thus, we have a case wherein sector was not found in the sorted
-                // vector; however, we indeed have a mapping of this sector
-                // embedded in one of the CowOperation which spans multiple
-                // block size.
-                if (is_mapping_present) {
                     // block_offset = 0 would mean that the CowOperation should
                     // already be in the sorted vector. Hence, lookup should
                     // have already found it. If not, this is a bug.
@@ -381,58 +458,45 @@ bool ReadWorker::ReadAlignedSector(sector_t sector, size_t sz) {
                                 << "GetBlockOffset returned offset 0 for io_block: " << io_block;
                         return false;
                     }
+                }
+            } else {
+                cow_op = reader_->GetOp(op_index.value(pos));
+            }
 
-                    // Get the CowOperation actual compression size
-                    size_t compression_size = CowOpCompressionSize(cow_op, BLOCK_SZ);
-                    // Offset cannot be greater than the compression size
-                    if (block_offset > compression_size) {
-                        SNAP_LOG(ERROR) << "Invalid I/O block found. io_block: " << io_block
-                                        << " CowOperation-new-block: " << cow_op->new_block
-                                        << " compression-size: " << compression_size;
-                        return false;
-                    }
+            if (IsMultiBlockReplaceOp(cow_op)) {
+                // Serve every block of this request covered by the op from a
+                // single decompression.
+                ret = ReadReplaceOpBlocks(cow_op, io_block, block_offset, read_size);
+                if (ret < 0) {
+                    SNAP_LOG(ERROR) << "ReadReplaceOpBlocks failed, sector = " << sector
+                                    << ", size = " << sz;
+                    return false;
+                }
+            } else {
+                void* buffer = block_server_->GetResponseBuffer(BLOCK_SZ, size);
+                if (!buffer) {
+                    SNAP_LOG(ERROR) << "AcquireBuffer failed in ReadAlignedSector";
+                    return false;
+                }
 
-                    // Cached copy of the previous iteration. Just retrieve the
-                    // data
-                    if (prev_op && prev_op->new_block == cow_op->new_block) {
-                        std::memcpy(buffer, (char*)decompressed_buffer_.get() + block_offset, size);
-                    } else {
-                        // Get the data from the disk based on the compression
-                        // size
-                        if (!ProcessReplaceOp(cow_op, decompressed_buffer_.get(),
-                                              compression_size)) {
-                            return false;
-                        }
-                        // Copy the data from the decompressed buffer relative
-                        // to the i/o block offset.
-                        std::memcpy(buffer, (char*)decompressed_buffer_.get() + block_offset, size);
-                        // Cache this CowOperation pointer for successive I/O
-                        // operation. Since the request is sequential and the
-                        // block is already decompressed, subsequest I/O blocks
-                        // can fetch the data directly from this decompressed
-                        // buffer.
-                        prev_op = cow_op;
+                if (cow_op) {
+                    // We found the sector in mapping. Check the type of COW OP
+                    // and process it.
+                    if (!ProcessCowOp(cow_op, buffer)) {
+                        SNAP_LOG(ERROR)
+                                << "ProcessCowOp failed, sector = " << sector << ", size = " << sz;
+                        return false;
                     }
                 } else {
                     // Block not found in map - which means this block was not
                     // changed as per the OTA. Just route the I/O to the base
                     // device.
-                    if (!ReadDataFromBaseDevice(sector, buffer, size)) {
+                    if (!ReadUnchangedBlocks(sector, buffer, size)) {
                         SNAP_LOG(ERROR) << "ReadDataFromBaseDevice failed";
                         return false;
                     }
                 }
                 ret = size;
-            } else {
-                // We found the sector in mapping. Check the type of COW OP and
-                // process it.
-                if (!ProcessCowOp(it->second, buffer)) {
-                    SNAP_LOG(ERROR)
-                            << "ProcessCowOp failed, sector = " << sector << ", size = " << sz;
-                    return false;
-                }
-
-                ret = std::min(BLOCK_SZ, read_size);
             }
 
             read_size -= ret;
@@ -465,16 +529,14 @@ bool ReadWorker::IsMappingPresent(const CowOperation* cow_op, loff_t requested_o
     return false;
 }
 
-int ReadWorker::ReadUnalignedSector(
-        sector_t sector, size_t size,
-        std::vector<std::pair<sector_t, const CowOperation*>>::iterator& it) {
+int ReadWorker::ReadUnalignedSector(sector_t sector, size_t size, const CowOperation* cow_op) {
+    const sector_t op_sector = ChunkToSector(cow_op->new_block);
     SNAP_LOG(DEBUG) << "ReadUnalignedSector: sector " << sector << " size: " << size
-                    << " Aligned sector: " << it->first;
+                    << " Aligned sector: " << op_sector;
 
     loff_t requested_offset = sector << SECTOR_SHIFT;
-    loff_t final_offset = (it->first) << SECTOR_SHIFT;
+    loff_t final_offset = op_sector << SECTOR_SHIFT;
 
-    const CowOperation* cow_op = it->second;
     if (IsMappingPresent(cow_op, requested_offset, final_offset)) {
         size_t buffer_size = CowOpCompressionSize(cow_op, BLOCK_SZ);
         uint8_t chunk[buffer_size];
@@ -496,7 +558,7 @@ int ReadWorker::ReadUnalignedSector(
         return write_sz;
     }
 
-    int num_sectors_skip = sector - it->first;
+    int num_sectors_skip = sector - op_sector;
     size_t skip_size = num_sectors_skip << SECTOR_SHIFT;
     size_t write_size = std::min(size, BLOCK_SZ - skip_size);
     auto buffer =
@@ -506,16 +568,16 @@ int ReadWorker::ReadUnalignedSector(
         return -1;
     }
 
-    if (!ProcessCowOp(it->second, buffer)) {
+    if (!ProcessCowOp(cow_op, buffer)) {
         SNAP_LOG(ERROR) << "ReadUnalignedSector: " << sector << " failed of size: " << size
-                        << " Aligned sector: " << it->first;
+                        << " Aligned sector: " << op_sector;
         return -1;
     }
 
     if (skip_size) {
         if (skip_size == BLOCK_SZ) {
             SNAP_LOG(ERROR) << "Invalid un-aligned IO request at sector: " << sector
-                            << " Base-sector: " << it->first;
+                            << " Base-sector: " << op_sector;
             return -1;
         }
         memmove(buffer, buffer + skip_size, write_size);
@@ -524,10 +586,10 @@ int ReadWorker::ReadUnalignedSector(
 }
 
 bool ReadWorker::ReadUnalignedSector(sector_t sector, size_t size) {
-    std::vector<std::pair<sector_t, const CowOperation*>>& chunk_vec = snapuserd_->GetChunkVec();
+    const BlockIndex& op_index = snapuserd_->GetOpIndex();
 
-    auto it = std::lower_bound(chunk_vec.begin(), chunk_vec.end(), std::make_pair(sector, nullptr),
-                               SnapshotHandler::compare);
+    const uint64_t io_block = SectorToChunk(sector);
+    size_t pos = op_index.LowerBound(io_block);
 
     // |-------|-------|-------|
     // 0       1       2       3
@@ -536,10 +598,10 @@ bool ReadWorker::ReadUnalignedSector(sector_t sector, size_t size) {
     // Block 1 - op 2
     // Block 2 - op 3
     //
-    // chunk_vec will have block 0, 1, 2 which maps to relavant COW ops.
+    // op_index will have block 0, 1, 2 which maps to relavant COW ops.
     //
     // Each block is 4k bytes. Thus, the last block will span 8 sectors
-    // ranging till block 3 (However, block 3 won't be in chunk_vec as
+    // ranging till block 3 (However, block 3 won't be in op_index as
     // it doesn't have any mapping to COW ops. Now, if we get an I/O request for a sector
     // spanning between block 2 and block 3, we need to step back
     // and get hold of the last element.
@@ -550,22 +612,24 @@ bool ReadWorker::ReadUnalignedSector(sector_t sector, size_t size) {
     // to any COW ops. In that case, we just need to read from the base
     // device.
     bool merge_complete = false;
-    if (it == chunk_vec.end()) {
-        if (chunk_vec.size() > 0) {
+    if (pos == op_index.size()) {
+        if (op_index.size() > 0) {
             // I/O request beyond the last mapped sector
-            it = std::prev(chunk_vec.end());
+            pos = op_index.size() - 1;
         } else {
             // This can happen when a partition merge is complete but snapshot
             // state in /metadata is not yet deleted; during this window if the
             // device is rebooted, subsequent attempt will mount the snapshot.
             // However, since the merge was completed we wouldn't have any
-            // mapping to COW ops thus chunk_vec will be empty. In that case,
+            // mapping to COW ops thus op_index will be empty. In that case,
             // mark this as merge_complete and route the I/O to the base device.
             merge_complete = true;
         }
-    } else if (it->first != sector) {
-        if (it != chunk_vec.begin()) {
-            --it;
+    } else if (ChunkToSector(op_index.block(pos)) != sector) {
+        // The request starts in the middle of |io_block|; if that block is
+        // not mapped, the closest mapping is the one before.
+        if (op_index.block(pos) != io_block && pos != 0) {
+            pos -= 1;
         }
     } else {
         return ReadAlignedSector(sector, size);
@@ -574,8 +638,10 @@ bool ReadWorker::ReadUnalignedSector(sector_t sector, size_t size) {
     loff_t requested_offset = sector << SECTOR_SHIFT;
 
     loff_t final_offset = 0;
+    const CowOperation* cow_op = nullptr;
     if (!merge_complete) {
-        final_offset = it->first << SECTOR_SHIFT;
+        cow_op = reader_->GetOp(op_index.value(pos));
+        final_offset = ChunkToSector(cow_op->new_block) << SECTOR_SHIFT;
     }
 
     // Since a COW op span 4k block size, we need to make sure that the requested
@@ -595,15 +661,14 @@ bool ReadWorker::ReadUnalignedSector(sector_t sector, size_t size) {
     size_t remaining_size = size;
     int ret = 0;
 
-    const CowOperation* cow_op = it->second;
     if (!merge_complete && (requested_offset >= final_offset) &&
         (((requested_offset - final_offset) < BLOCK_SZ) ||
          IsMappingPresent(cow_op, requested_offset, final_offset))) {
         // Read the partial un-aligned data
-        ret = ReadUnalignedSector(sector, remaining_size, it);
+        ret = ReadUnalignedSector(sector, remaining_size, cow_op);
         if (ret < 0) {
             SNAP_LOG(ERROR) << "ReadUnalignedSector failed for sector: " << sector
-                            << " size: " << size << " it->sector: " << it->first;
+                            << " size: " << size << " op-block: " << cow_op->new_block;
             return false;
         }
 
@@ -636,7 +701,7 @@ bool ReadWorker::ReadUnalignedSector(sector_t sector, size_t size) {
             SNAP_LOG(ERROR) << "AcquireBuffer failed in ReadUnalignedSector";
             return false;
         }
-        if (!ReadDataFromBaseDevice(sector, buffer, read_size)) {
+        if (!ReadUnchangedBlocks(sector, buffer, read_size)) {
             return false;
         }
         if (!SendBufferedIo()) {
@@ -50,12 +50,15 @@ class ReadWorker : public Worker, public IBlockServer::Delegate {
     bool IsMappingPresent(const CowOperation* cow_op, loff_t requested_offset,
                           loff_t cow_op_offset);
     bool GetCowOpBlockOffset(const CowOperation* cow_op, uint64_t io_block, off_t* block_offset);
+    bool IsMultiBlockReplaceOp(const CowOperation* cow_op);
+    ssize_t ReadReplaceOpBlocks(const CowOperation* cow_op, uint64_t io_block, off_t block_offset,
+                                size_t read_size);
     bool ReadAlignedSector(sector_t sector, size_t sz);
     bool ReadUnalignedSector(sector_t sector, size_t size);
-    int ReadUnalignedSector(sector_t sector, size_t size,
-                            std::vector<std::pair<sector_t, const CowOperation*>>::iterator& it);
+    int ReadUnalignedSector(sector_t sector, size_t size, const CowOperation* cow_op);
     bool ReadFromSourceDevice(const CowOperation* cow_op, void* buffer);
     bool ReadDataFromBaseDevice(sector_t sector, void* buffer, size_t read_size);
+    bool ReadUnchangedBlocks(sector_t sector, void* buffer, size_t read_size);
 
     constexpr bool IsBlockAligned(uint64_t size) { return ((size & (BLOCK_SZ - 1)) == 0); }
     constexpr sector_t ChunkToSector(chunk_t chunk) { return chunk << CHUNK_SHIFT; }
@@ -0,0 +1,366 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Host benchmarks for the snapuserd I/O paths.
+//
+// A synthetic COW is generated for every combination of format version,
+// compression and op mix, and served by a SnapshotHandler through the
+// HostTestHarness block server, the same way snapuserd_test and
+// snapuserd_extractor drive it. Everything runs out of temporary files, so
+// the numbers measure snapuserd itself (op lookup, decompression, XOR,
+// read-ahead and merge bookkeeping) rather than the storage underneath.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <libsnapshot/cow_writer.h>
+#include <storage_literals/storage_literals.h>
+#include "read_worker.h"
+#include "snapuserd_core.h"
+#include "testing/host_harness.h"
+
+namespace android {
+namespace snapshot {
+
+using android::base::unique_fd;
+using namespace android::storage_literals;
+
+// The snapshot device is kTargetSize; COPY and XOR ops read from a disjoint
+// source region of the base device, so ops never overlap and can be merged
+// in any order.
+static constexpr uint64_t kTargetSize = 64_MiB;
+static constexpr uint64_t kTargetBlocks = kTargetSize / BLOCK_SZ;
+static constexpr uint64_t kSourceStart = kTargetBlocks;
+static constexpr uint64_t kBaseSize = 2 * kTargetSize + 1_MiB;
+// Ops are emitted in runs of this many blocks, roughly the size of an
+// update_engine install operation.
+static constexpr uint64_t kRunBlocks = 64;
+static constexpr uint16_t kXorOffset = 512;
+// Size of each request in the sequential read benchmark; this is the default
+// block layer read-ahead window.
+static constexpr uint64_t kSequentialReadSize = 128_KiB;
+
+struct CowMix {
+    int copy_percent;
+    int xor_percent;
+    // The rest are REPLACE ops.
+};
+
+// Somewhat compressible data: random runs of repeated bytes.
+static std::string GenerateData(size_t size, uint32_t seed) {
+    std::string data(size, '\0');
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> run(1, 32);
+    size_t i = 0;
+    while (i < data.size()) {
+        char value = static_cast<char>(byte(gen));
+        size_t len = std::min<size_t>(run(gen), data.size() - i);
+        std::fill(data.begin() + i, data.begin() + i + len, value);
+        i += len;
+    }
+    return data;
+}
+
+static uint64_t Percentile(std::vector<uint64_t>* samples, double percentile) {
+    if (samples->empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(percentile * (samples->size() - 1));
+    std::nth_element(samples->begin(), samples->begin() + index, samples->end());
+    return (*samples)[index];
+}
+
+static void ReportLatency(benchmark::State& state, std::vector<uint64_t>* latencies_us) {
+    state.counters["p50_us"] = Percentile(latencies_us, 0.50);
+    state.counters["p99_us"] = Percentile(latencies_us, 0.99);
+}
+
+class BenchmarkDevice final {
+  public:
+    ~BenchmarkDevice();
+
+    bool Init(uint32_t cow_version, const std::string& compression, const CowMix& mix);
+    bool ReadSectors(sector_t sector, uint64_t size);
+    bool Merge(std::chrono::microseconds* duration);
+
+  private:
+    bool CreateBaseDevice();
+    bool CreateCowDevice(uint32_t cow_version, const std::string& compression, const CowMix& mix);
+    bool StartHandler();
+
+    std::unique_ptr<TemporaryFile> base_;
+    std::unique_ptr<TemporaryFile> cow_;
+    std::string control_name_ = "snapuserd-benchmark";
+
+    TestBlockServerFactory factory_;
+    std::shared_ptr<SnapshotHandler> handler_;
+    std::unique_ptr<ReadWorker> read_worker_;
+    TestBlockServer* block_server_ = nullptr;
+    std::future<bool> handler_thread_;
+};
+
+BenchmarkDevice::~BenchmarkDevice() {
+    if (handler_thread_.valid()) {
+        factory_.DeleteQueue(control_name_);
+        handler_thread_.get();
+    }
+}
+
+bool BenchmarkDevice::Init(uint32_t cow_version, const std::string& compression,
+                           const CowMix& mix) {
+    return CreateBaseDevice() && CreateCowDevice(cow_version, compression, mix) && StartHandler();
+}
+
+bool BenchmarkDevice::CreateBaseDevice() {
+    base_ = std::make_unique<TemporaryFile>();
+    if (base_->fd < 0) {
+        PLOG(ERROR) << "Could not create base device";
+        return false;
+    }
+    std::string data = GenerateData(kBaseSize, 1);
+    if (!android::base::WriteFully(base_->fd, data.data(), data.size())) {
+        PLOG(ERROR) << "Could not write base device";
+        return false;
+    }
+    return true;
+}
+
+bool BenchmarkDevice::CreateCowDevice(uint32_t cow_version, const std::string& compression,
+                                      const CowMix& mix) {
+    cow_ = std::make_unique<TemporaryFile>();
+    if (cow_->fd < 0) {
+        PLOG(ERROR) << "Could not create COW device";
+        return false;
+    }
+
+    CowOptions options;
+    options.compression = compression;
+    if (cow_version >= 3) {
+        options.op_count_max = kTargetBlocks;
+        options.compression_factor = 64_KiB;
+        options.batch_write = true;
+    }
+
+    auto writer = CreateCowWriter(cow_version, options, unique_fd(dup(cow_->fd)));
+    if (!writer) {
+        LOG(ERROR) << "Could not create COW writer";
+        return false;
+    }
+
+    std::string data = GenerateData(kTargetSize, 2);
+    std::mt19937 gen(3);
+    std::uniform_int_distribution<int> dist(0, 99);
+
+    for (uint64_t block = 0; block < kTargetBlocks; block += kRunBlocks) {
+        const char* run_data = data.data() + block * BLOCK_SZ;
+        const size_t run_size = kRunBlocks * BLOCK_SZ;
+
+        int pick = dist(gen);
+        bool ok;
+        if (pick < mix.copy_percent) {
+            ok = writer->AddCopy(block, kSourceStart + block, kRunBlocks);
+        } else if (pick < mix.copy_percent + mix.xor_percent) {
+            ok = writer->AddXorBlocks(block, run_data, run_size, kSourceStart + block, kXorOffset);
+        } else {
+            ok = writer->AddRawBlocks(block, run_data, run_size);
+        }
+        if (!ok) {
+            LOG(ERROR) << "Could not add ops for block " << block;
+            return false;
+        }
+    }
+    return writer->Finalize();
+}
+
+bool BenchmarkDevice::StartHandler() {
+    auto opener = factory_.CreateTestOpener(control_name_);
+    if (!opener) {
+        return false;
+    }
+
+    HandlerOptions options;
+    handler_ = std::make_shared<SnapshotHandler>(control_name_, cow_->path, base_->path,
+                                                 base_->path, opener, options);
+    if (!handler_->InitCowDevice() || !handler_->InitializeWorkers()) {
+        return false;
+    }
+
+    read_worker_ = std::make_unique<ReadWorker>(cow_->path, base_->path, control_name_,
+                                                base_->path, handler_->GetSharedPtr(), opener);
+    if (!read_worker_->Init()) {
+        return false;
+    }
+    block_server_ = static_cast<TestBlockServer*>(read_worker_->block_server());
+
+    handler_thread_ = std::async(std::launch::async, &SnapshotHandler::Start, handler_.get());
+    return true;
+}
+
+bool BenchmarkDevice::ReadSectors(sector_t sector, uint64_t size) {
+    if (!read_worker_->RequestSectors(sector, size)) {
+        return false;
+    }
+    std::string result = std::move(block_server_->sent_io());
+    return result.size() == size;
+}
+
+bool BenchmarkDevice::Merge(std::chrono::microseconds* duration) {
+    auto start = std::chrono::steady_clock::now();
+    handler_->InitiateMerge();
+    handler_->WaitForMergeComplete();
+    *duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+    return handler_->GetMergePercentage() >= 100.0;
+}
+
+static void BM_RandomRead(benchmark::State& state, uint32_t cow_version,
+                          const std::string& compression, CowMix mix) {
+    BenchmarkDevice device;
+    if (!device.Init(cow_version, compression, mix)) {
+        state.SkipWithError("Failed to set up snapshot device");
+        return;
+    }
+
+    std::mt19937 gen(4);
+    std::uniform_int_distribution<uint64_t> dist(0, kTargetBlocks - 1);
+    std::vector<uint64_t> latencies_us;
+
+    for (auto _ : state) {
+        sector_t sector = dist(gen) * (BLOCK_SZ >> SECTOR_SHIFT);
+        auto start = std::chrono::steady_clock::now();
+        if (!device.ReadSectors(sector, BLOCK_SZ)) {
+            state.SkipWithError("Read failed");
+            return;
+        }
+        latencies_us.emplace_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                                          std::chrono::steady_clock::now() - start)
+                                          .count());
+    }
+    // items_per_second is the IOPS.
+    state.SetItemsProcessed(state.iterations());
+    ReportLatency(state, &latencies_us);
+}
+
+static void BM_SequentialRead(benchmark::State& state, uint32_t cow_version,
+                              const std::string& compression, CowMix mix) {
+    BenchmarkDevice device;
+    if (!device.Init(cow_version, compression, mix)) {
+        state.SkipWithError("Failed to set up snapshot device");
+        return;
+    }
+
+    std::vector<uint64_t> latencies_us;
+    for (auto _ : state) {
+        for (uint64_t offset = 0; offset < kTargetSize; offset += kSequentialReadSize) {
+            auto start = std::chrono::steady_clock::now();
+            if (!device.ReadSectors(offset >> SECTOR_SHIFT, kSequentialReadSize)) {
+                state.SkipWithError("Read failed");
+                return;
+            }
+            latencies_us.emplace_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                                              std::chrono::steady_clock::now() - start)
+                                              .count());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * kTargetSize);
+    ReportLatency(state, &latencies_us);
+}
+
+// Merge of the whole snapshot. COPY and XOR ops are merged from the
+// read-ahead buffer, so with a mix of only those ops this is the read-ahead
+// throughput.
+static void BM_Merge(benchmark::State& state, uint32_t cow_version,
+                     const std::string& compression, CowMix mix) {
+    std::vector<uint64_t> latencies_us;
+    for (auto _ : state) {
+        // A merge cannot be repeated, so every iteration needs a fresh
+        // device.
+        BenchmarkDevice device;
+        if (!device.Init(cow_version, compression, mix)) {
+            state.SkipWithError("Failed to set up snapshot device");
+            return;
+        }
+
+        std::chrono::microseconds duration;
+        if (!device.Merge(&duration)) {
+            state.SkipWithError("Merge failed");
+            return;
+        }
+        state.SetIterationTime(duration.count() / 1e6);
+        latencies_us.emplace_back(duration.count());
+    }
+    state.SetBytesProcessed(state.iterations() * kTargetSize);
+    ReportLatency(state, &latencies_us);
+}
+
+static constexpr CowMix kReplaceOnly = {0, 0};
+static constexpr CowMix kCopyHeavy = {70, 10};
+static constexpr CowMix kXorHeavy = {20, 60};
+static constexpr CowMix kOrderedOnly = {50, 50};
+
+static void ReadArgs(benchmark::internal::Benchmark* b) {
+    b->Unit(benchmark::kMicrosecond);
+    b->UseRealTime();
+}
+
+static void MergeArgs(benchmark::internal::Benchmark* b) {
+    b->Unit(benchmark::kMillisecond);
+    b->UseManualTime();
+    b->Iterations(5);
+}
+
+#define SNAPUSERD_BENCHMARK(func, args, name, version, compression, mix)                 \
+    BENCHMARK_CAPTURE(func, v##version##_##name, version, std::string(compression), mix) \
+            ->Apply(args)
+
+#define SNAPUSERD_BENCHMARK_MIXES(func, args, version, compression)                               \
+    SNAPUSERD_BENCHMARK(func, args, compression##_replace, version, #compression, kReplaceOnly);  \
+    SNAPUSERD_BENCHMARK(func, args, compression##_copy_heavy, version, #compression, kCopyHeavy); \
+    SNAPUSERD_BENCHMARK(func, args, compression##_xor_heavy, version, #compression, kXorHeavy)
+
+#define SNAPUSERD_BENCHMARK_ALL(func, args)           \
+    SNAPUSERD_BENCHMARK_MIXES(func, args, 2, lz4);    \
+    SNAPUSERD_BENCHMARK_MIXES(func, args, 2, zstd);   \
+    SNAPUSERD_BENCHMARK_MIXES(func, args, 2, gz);     \
+    SNAPUSERD_BENCHMARK_MIXES(func, args, 2, brotli); \
+    SNAPUSERD_BENCHMARK_MIXES(func, args, 3, lz4);    \
+    SNAPUSERD_BENCHMARK_MIXES(func, args, 3, zstd);   \
+    SNAPUSERD_BENCHMARK_MIXES(func, args, 3, gz);     \
+    SNAPUSERD_BENCHMARK_MIXES(func, args, 3, brotli)
+
+SNAPUSERD_BENCHMARK_ALL(BM_RandomRead, ReadArgs);
+SNAPUSERD_BENCHMARK_ALL(BM_SequentialRead, ReadArgs);
+SNAPUSERD_BENCHMARK_ALL(BM_Merge, MergeArgs);
+
+// Read-ahead throughput: only ordered ops, so the merge is paced by the
+// read-ahead thread.
+SNAPUSERD_BENCHMARK(BM_Merge, MergeArgs, readahead_lz4, 2, "lz4", kOrderedOnly);
+SNAPUSERD_BENCHMARK(BM_Merge, MergeArgs, readahead_lz4, 3, "lz4", kOrderedOnly);
+
+}  // namespace snapshot
+}  // namespace android
+
+BENCHMARK_MAIN();
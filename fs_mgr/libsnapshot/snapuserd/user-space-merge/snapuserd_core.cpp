@@ -48,6 +48,11 @@ SnapshotHandler::SnapshotHandler(std::string misc_name, std::string cow_device,
 }
 
 bool SnapshotHandler::InitializeWorkers() {
+    if (handler_options_.block_cache_size) {
+        block_cache_ = std::make_unique<BlockCache>(handler_options_.block_cache_size);
+        SNAP_LOG(INFO) << "Decompressed block cache: " << block_cache_->capacity() << " blocks";
+    }
+
     for (int i = 0; i < num_worker_threads_; i++) {
         auto wt = std::make_unique<ReadWorker>(cow_device_, backing_store_device_, misc_name_,
                                                base_path_merge_, GetSharedPtr(),
@@ -59,13 +64,26 @@ bool SnapshotHandler::InitializeWorkers() {
 
         worker_threads_.push_back(std::move(wt));
     }
+    if (handler_options_.merge_io_pressure_target) {
+        uint32_t max_merge_ops = handler_options_.cow_op_merge_size
+                                         ? handler_options_.cow_op_merge_size
+                                         : (PAYLOAD_BUFFER_SZ / BLOCK_SZ);
+        auto governor = std::make_unique<MergeGovernor>(
+                handler_options_.merge_io_pressure_target, max_merge_ops);
+        if (governor->Init()) {
+            merge_governor_ = std::move(governor);
+        } else {
+            SNAP_LOG(ERROR) << "I/O pressure not available, merge governor disabled";
+        }
+    }
+
     merge_thread_ =
             std::make_unique<MergeWorker>(cow_device_, misc_name_, base_path_merge_, GetSharedPtr(),
                                           handler_options_.cow_op_merge_size);
 
-    read_ahead_thread_ =
-            std::make_unique<ReadAhead>(cow_device_, backing_store_device_, misc_name_,
-                                        GetSharedPtr(), handler_options_.cow_op_merge_size);
+    read_ahead_thread_ = std::make_unique<ReadAhead>(
+            cow_device_, backing_store_device_, misc_name_, GetSharedPtr(),
+            handler_options_.cow_op_merge_size, handler_options_.num_decompress_threads);
 
     update_verify_ = std::make_unique<UpdateVerify>(misc_name_, handler_options_.verify_block_size,
                                                     handler_options_.num_verification_threads);
@@ -211,11 +229,17 @@ bool SnapshotHandler::ReadMetadata() {
             xor_ops += 1;
         }
 
-        chunk_vec_.push_back(std::make_pair(ChunkToSector(cow_op->new_block), cow_op));
+        if (!op_index_.Add(cow_op->new_block, reader_->GetOpIndex(cow_op))) {
+            SNAP_LOG(ERROR) << "COW op block out of range: " << cow_op->new_block;
+            return false;
+        }
 
         if (IsOrderedOp(*cow_op)) {
             ra_thread_ = true;
-            block_to_ra_index_[cow_op->new_block] = ra_index;
+            if (!block_to_ra_index_.Add(cow_op->new_block, ra_index)) {
+                SNAP_LOG(ERROR) << "COW op block out of range: " << cow_op->new_block;
+                return false;
+            }
             num_ra_ops_per_iter -= 1;
 
             if ((ra_index + 1) - merge_blk_state_.size() == 1) {
@@ -234,18 +258,18 @@ bool SnapshotHandler::ReadMetadata() {
         cowop_iter->Next();
     }
 
-    chunk_vec_.shrink_to_fit();
-
-    // Sort the vector based on sectors as we need this during un-aligned access
-    std::sort(chunk_vec_.begin(), chunk_vec_.end(), compare);
+    // Sort by block as we need this during un-aligned access
+    op_index_.Finalize();
+    block_to_ra_index_.Finalize();
 
     PrepareReadAhead();
 
     SNAP_LOG(INFO) << "Merged-ops: " << header.num_merge_ops
                    << " Total-data-ops: " << reader_->get_num_total_data_ops()
-                   << " Unmerged-ops: " << chunk_vec_.size() << " Copy-ops: " << copy_ops
+                   << " Unmerged-ops: " << op_index_.size() << " Copy-ops: " << copy_ops
                    << " Zero-ops: " << zero_ops << " Replace-ops: " << replace_ops
                    << " Xor-ops: " << xor_ops;
+    SNAP_LOG(INFO) << "Metadata memory: " << GetMemoryStats();
 
     return true;
 }
@@ -360,6 +384,7 @@ bool SnapshotHandler::Start() {
     SNAP_LOG(INFO) << "Worker threads terminated with ret: " << ret
                    << " Merge-thread with ret: " << merge_thread_status
                    << " RA-thread with ret: " << read_ahead_retval;
+    SNAP_LOG(INFO) << "Decompressed block cache: " << GetBlockCacheStats();
     return ret;
 }
 
@@ -437,6 +462,36 @@ bool SnapshotHandler::IsIouringSupported() {
     return android::base::GetBoolProperty("ro.virtual_ab.io_uring.enabled", false);
 }
 
+std::string SnapshotHandler::GetBlockCacheStats() {
+    if (!block_cache_) {
+        return "disabled";
+    }
+    return block_cache_->GetStats();
+}
+
+std::string SnapshotHandler::GetMemoryStats() {
+    size_t cow_ops = reader_ ? reader_->GetMemoryUsage() : 0;
+    size_t op_index = op_index_.MemoryUsage();
+    size_t ra_index = block_to_ra_index_.MemoryUsage();
+    size_t merge_groups = merge_blk_state_.capacity() * sizeof(merge_blk_state_[0]) +
+                          merge_blk_state_.size() * sizeof(MergeGroupState);
+    size_t block_cache = block_cache_ ? block_cache_->capacity() * BLOCK_SZ : 0;
+    size_t total = cow_ops + op_index + ra_index + merge_groups + block_cache;
+
+    return android::base::StringPrintf(
+            "cow-ops: %zu KiB op-index: %zu KiB (%zu entries) ra-index: %zu KiB merge-groups: "
+            "%zu KiB block-cache: %zu KiB total: %zu KiB",
+            cow_ops / 1024, op_index / 1024, op_index_.size(), ra_index / 1024,
+            merge_groups / 1024, block_cache / 1024, total / 1024);
+}
+
+std::string SnapshotHandler::GetMergeGovernorStats() {
+    if (!merge_governor_) {
+        return "disabled";
+    }
+    return merge_governor_->GetStats();
+}
+
 bool SnapshotHandler::CheckPartitionVerification() {
     return update_verify_->CheckPartitionVerification();
 }
@@ -45,6 +45,9 @@
 #include <storage_literals/storage_literals.h>
 #include <system/thread_defs.h>
 #include <user-space-merge/handler_manager.h>
+#include "block_cache.h"
+#include "block_index.h"
+#include "merge_governor.h"
 #include "snapuserd_readahead.h"
 #include "snapuserd_verify.h"
 
@@ -121,12 +124,9 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
     std::unique_ptr<CowReader> CloneReaderForWorker();
     std::shared_ptr<SnapshotHandler> GetSharedPtr() { return shared_from_this(); }
 
-    std::vector<std::pair<sector_t, const CowOperation*>>& GetChunkVec() { return chunk_vec_; }
-
-    static bool compare(std::pair<sector_t, const CowOperation*> p1,
-                        std::pair<sector_t, const CowOperation*> p2) {
-        return p1.first < p2.first;
-    }
+    // Sorted new_block -> op table of the unmerged COW operations. Values
+    // are positions in the reader's operation table (CowReader::GetOp).
+    const BlockIndex& GetOpIndex() { return op_index_; }
 
     void UnmapBufferRegion();
     bool MmapMetadata();
@@ -187,6 +187,17 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
     bool CheckPartitionVerification();
     std::mutex& GetBufferLock() { return buffer_lock_; }
 
+    // Decompressed block cache shared by the read workers; null if disabled.
+    BlockCache* GetBlockCache() { return block_cache_.get(); }
+    std::string GetBlockCacheStats();
+
+    // Heap memory held by the handler's metadata, for the daemon status.
+    std::string GetMemoryStats();
+
+    // Adaptive merge rate governor; null if disabled.
+    MergeGovernor* GetMergeGovernor() { return merge_governor_.get(); }
+    std::string GetMergeGovernorStats();
+
   private:
     bool ReadMetadata();
     sector_t ChunkToSector(chunk_t chunk) { return chunk << CHUNK_SHIFT; }
@@ -209,9 +220,8 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
 
     std::unique_ptr<CowReader> reader_;
 
-    // chunk_vec stores the pseudo mapping of sector
-    // to COW operations.
-    std::vector<std::pair<sector_t, const CowOperation*>> chunk_vec_;
+    // Maps a block of the snapshot device to its COW operation.
+    BlockIndex op_index_;
 
     std::mutex lock_;
     std::condition_variable cv;
@@ -223,6 +233,8 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
     size_t total_mapped_addr_length_;
 
     std::vector<std::unique_ptr<ReadWorker>> worker_threads_;
+    std::unique_ptr<BlockCache> block_cache_;
+    std::unique_ptr<MergeGovernor> merge_governor_;
     // Read-ahead related
     bool populate_data_from_cow_ = false;
     bool ra_thread_ = false;
@@ -233,7 +245,7 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
     std::unordered_map<uint64_t, void*> read_ahead_buffer_map_;
 
     // user-space-merging
-    std::unordered_map<uint64_t, int> block_to_ra_index_;
+    BlockIndex block_to_ra_index_;
 
     // Merge Block state
     std::vector<std::unique_ptr<MergeGroupState>> merge_blk_state_;
@@ -31,12 +31,13 @@ using android::base::unique_fd;
 
 ReadAhead::ReadAhead(const std::string& cow_device, const std::string& backing_device,
                      const std::string& misc_name, std::shared_ptr<SnapshotHandler> snapuserd,
-                     uint32_t cow_op_merge_size) {
+                     uint32_t cow_op_merge_size, int num_decompress_threads) {
     cow_device_ = cow_device;
     backing_store_device_ = backing_device;
     misc_name_ = misc_name;
     snapuserd_ = snapuserd;
     cow_op_merge_size_ = cow_op_merge_size;
+    num_decompress_threads_ = num_decompress_threads;
 }
 
 void ReadAhead::CheckOverlap(const CowOperation* cow_op) {
@@ -358,7 +359,16 @@ bool ReadAhead::ReadAheadAsyncIO() {
             }
 
             // Fetch I/O completions
-            if (!ReapIoCompletions(pending_ios_to_complete)) {
+            bool io_completed = ReapIoCompletions(pending_ios_to_complete);
+
+            // Decompression threads may still be writing to bufsink_; wait
+            // for them even if the I/O failed.
+            if (xor_processing_required && !WaitForXorData()) {
+                SNAP_LOG(ERROR) << "WaitForXorData failed";
+                return false;
+            }
+
+            if (!io_completed) {
                 SNAP_LOG(ERROR) << "ReapIoCompletions failed";
                 return false;
             }
@@ -496,6 +506,22 @@ void ReadAhead::ProcessXorData(size_t& block_xor_index, size_t& xor_index,
 
 bool ReadAhead::ReadXorData(size_t block_index, size_t xor_op_index,
                             std::vector<const CowOperation*>& xor_op_vec) {
+    // Fan out the pending XOR ops to the decompression threads. All the XOR
+    // ops from |xor_op_index| onwards belong to the blocks queued in the ring,
+    // so they land in bufsink_ in the same order ProcessXorData consumes them.
+    if (decompress_pool_) {
+        std::vector<const CowOperation*> ops(xor_op_vec.begin() + xor_op_index,
+                                             xor_op_vec.end());
+        void* buffer = bufsink_.AcquireBuffer(ops.size() * BLOCK_SZ);
+        if (!buffer) {
+            SNAP_LOG(ERROR) << "ReadAhead - failed to allocate buffer for " << ops.size()
+                            << " xor ops";
+            return false;
+        }
+        decompress_pool_->Submit(std::move(ops), buffer);
+        return true;
+    }
+
     // Process the XOR ops in parallel - We will be reading data
     // from COW file for XOR ops processing.
     while (block_index < blocks_.size()) {
@@ -525,6 +551,13 @@ bool ReadAhead::ReadXorData(size_t block_index, size_t xor_op_index,
     return true;
 }
 
+bool ReadAhead::WaitForXorData() {
+    if (!decompress_pool_) {
+        return true;
+    }
+    return decompress_pool_->Wait();
+}
+
 bool ReadAhead::ReadAheadSyncIO() {
     int num_ops = (snapuserd_->GetBufferDataSize()) / BLOCK_SZ;
     loff_t buffer_offset = 0;
@@ -594,6 +627,16 @@ bool ReadAhead::ReadAheadSyncIO() {
     BufferSink bufsink;
     bufsink.Initialize(BLOCK_SZ * 2);
 
+    // Decompress all the XOR ops of this window up front; ra_xor_buffer_
+    // then holds the data of xor_op_vec[i] at block i.
+    if (decompress_pool_ && !xor_op_vec.empty()) {
+        decompress_pool_->Submit(xor_op_vec, ra_xor_buffer_.get());
+        if (!decompress_pool_->Wait()) {
+            SNAP_LOG(ERROR) << "ReadAhead - XorOp decompression failed";
+            return false;
+        }
+    }
+
     for (size_t block_index = 0; block_index < blocks_.size(); block_index++) {
         void* bufptr = static_cast<void*>((char*)ra_temp_buffer_.get() + offset);
         uint64_t new_block = blocks_[block_index];
@@ -603,22 +646,27 @@ bool ReadAhead::ReadAheadSyncIO() {
 
             // Check if this block is an XOR op
             if (xor_op->new_block == new_block) {
-                // Read the xor'ed data from COW
-                void* buffer = bufsink.GetPayloadBuffer(BLOCK_SZ);
-                if (!buffer) {
-                    SNAP_LOG(ERROR) << "ReadAhead - failed to allocate buffer";
-                    return false;
-                }
-                if (ssize_t rv = reader_->ReadData(xor_op, buffer, BLOCK_SZ); rv != BLOCK_SZ) {
-                    SNAP_LOG(ERROR)
-                            << " ReadAhead - XorOp Read failed for block: " << xor_op->new_block
-                            << ", return value: " << rv;
-                    return false;
+                // Get the xor'ed data read from COW device
+                uint8_t* xor_data;
+                if (decompress_pool_) {
+                    xor_data = ra_xor_buffer_.get() + (xor_index * BLOCK_SZ);
+                } else {
+                    // Read the xor'ed data from COW
+                    void* buffer = bufsink.GetPayloadBuffer(BLOCK_SZ);
+                    if (!buffer) {
+                        SNAP_LOG(ERROR) << "ReadAhead - failed to allocate buffer";
+                        return false;
+                    }
+                    if (ssize_t rv = reader_->ReadData(xor_op, buffer, BLOCK_SZ);
+                        rv != BLOCK_SZ) {
+                        SNAP_LOG(ERROR) << " ReadAhead - XorOp Read failed for block: "
+                                        << xor_op->new_block << ", return value: " << rv;
+                        return false;
+                    }
+                    xor_data = reinterpret_cast<uint8_t*>(bufsink.GetPayloadBufPtr());
                 }
                 // Pointer to the data read from base device
                 uint8_t* read_buffer = reinterpret_cast<uint8_t*>(bufptr);
-                // Get the xor'ed data read from COW device
-                uint8_t* xor_data = reinterpret_cast<uint8_t*>(bufsink.GetPayloadBufPtr());
 
                 // Retrieve the original data
                 for (size_t byte_offset = 0; byte_offset < BLOCK_SZ; byte_offset++) {
@@ -774,6 +822,23 @@ void ReadAhead::FinalizeIouring() {
     }
 }
 
+bool ReadAhead::InitializeDecompressPool() {
+    if (num_decompress_threads_ <= 0) {
+        return false;
+    }
+
+    auto pool = std::make_unique<DecompressPool>(cow_device_, misc_name_, snapuserd_,
+                                                 num_decompress_threads_);
+    if (!pool->Init()) {
+        SNAP_LOG(ERROR) << "Failed to start decompression pool - decompressing inline";
+        return false;
+    }
+
+    decompress_pool_ = std::move(pool);
+    ra_xor_buffer_ = std::make_unique<uint8_t[]>(snapuserd_->GetBufferDataSize());
+    return true;
+}
+
 bool ReadAhead::RunThread() {
     SNAP_LOG(INFO) << "ReadAhead thread started.";
 
@@ -793,6 +858,8 @@ bool ReadAhead::RunThread() {
 
     InitializeIouring();
 
+    InitializeDecompressPool();
+
     if (!SetThreadPriority(ANDROID_PRIORITY_BACKGROUND)) {
         SNAP_PLOG(ERROR) << "Failed to set thread priority";
     }
@@ -809,6 +876,7 @@ bool ReadAhead::RunThread() {
     }
 
     FinalizeIouring();
+    decompress_pool_ = nullptr;
     CloseFds();
     reader_->CloseCowFd();
 
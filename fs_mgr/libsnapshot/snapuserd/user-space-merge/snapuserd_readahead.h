@@ -27,6 +27,8 @@
 #include <liburing.h>
 #include <snapuserd/snapuserd_buffer.h>
 
+#include "decompress_pool.h"
+
 namespace android {
 namespace snapshot {
 
@@ -36,7 +38,7 @@ class ReadAhead {
   public:
     ReadAhead(const std::string& cow_device, const std::string& backing_device,
               const std::string& misc_name, std::shared_ptr<SnapshotHandler> snapuserd,
-              uint32_t cow_op_merge_size);
+              uint32_t cow_op_merge_size, int num_decompress_threads);
     bool RunThread();
 
   private:
@@ -63,6 +65,7 @@ class ReadAhead {
     bool ReapIoCompletions(int pending_ios_to_complete);
     bool ReadXorData(size_t block_index, size_t xor_op_index,
                      std::vector<const CowOperation*>& xor_op_vec);
+    bool WaitForXorData();
     void ProcessXorData(size_t& block_xor_index, size_t& xor_index,
                         std::vector<const CowOperation*>& xor_op_vec, void* buffer,
                         loff_t& buffer_offset);
@@ -71,6 +74,7 @@ class ReadAhead {
     bool ReadAheadSyncIO();
     bool InitializeIouring();
     void FinalizeIouring();
+    bool InitializeDecompressPool();
 
     void* read_ahead_buffer_;
     void* metadata_buffer_;
@@ -109,6 +113,12 @@ class ReadAhead {
     int queue_depth_ = 8;
     uint32_t cow_op_merge_size_;
     std::unique_ptr<struct io_uring> ring_;
+
+    // Parallel decompression of XOR data. When |num_decompress_threads_| is
+    // zero, the data is decompressed inline on the read-ahead thread.
+    int num_decompress_threads_ = 0;
+    std::unique_ptr<DecompressPool> decompress_pool_;
+    std::unique_ptr<uint8_t[]> ra_xor_buffer_;
 };
 
 }  // namespace snapshot
@@ -210,8 +210,19 @@ bool UserSnapshotServer::Receivemsg(android::base::borrowed_fd fd, const std::st
         }
         return Sendmsg(fd, "fail");
     } else if (cmd == "merge_percent") {
+        // Message format: merge_percent
+        //
+        // Response: <percentage>,<merge rate in KiB/s>,<number of times the
+        // merge governors backed off>,<block cache hits>,<block cache misses>.
+        // Older clients only parse the percentage.
         double percentage = handlers_->GetMergePercentage();
-        return Sendmsg(fd, std::to_string(percentage));
+        uint64_t rate_kbps, throttle_count, cache_hits, cache_misses;
+        handlers_->GetMergeRate(&rate_kbps, &throttle_count);
+        handlers_->GetBlockCacheCounters(&cache_hits, &cache_misses);
+        return Sendmsg(fd, std::to_string(percentage) + "," + std::to_string(rate_kbps) + "," +
+                                   std::to_string(throttle_count) + "," +
+                                   std::to_string(cache_hits) + "," +
+                                   std::to_string(cache_misses));
     } else if (cmd == "getstatus") {
         // Message format:
         // getstatus,<misc_name>
@@ -235,6 +246,11 @@ bool UserSnapshotServer::Receivemsg(android::base::borrowed_fd fd, const std::st
     } else if (cmd == "resume_merge") {
         handlers_->ResumeMerge();
         return Sendmsg(fd, "success");
+    } else if (cmd == "memory_stats") {
+        // Message format: memory_stats
+        //
+        // One line per handler with the heap memory held by its metadata.
+        return Sendmsg(fd, handlers_->GetMemoryStats());
     } else {
         LOG(ERROR) << "Received unknown message type from client";
         Sendmsg(fd, "fail");
@@ -372,7 +388,9 @@ std::shared_ptr<HandlerThread> UserSnapshotServer::AddHandler(const std::string&
         handlers_->DisableVerification();
     }
 
-    auto opener = block_server_factory_->CreateOpener(misc_name);
+    // Keep several dm-user requests in flight per worker if requested.
+    auto opener =
+            block_server_factory_->CreateQueuedOpener(misc_name, options.block_server_queue_depth);
 
     return handlers_->AddHandler(misc_name, cow_device_path, backing_device, base_path_merge,
                                  opener, options);
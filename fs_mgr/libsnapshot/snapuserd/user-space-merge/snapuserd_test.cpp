@@ -18,6 +18,7 @@
 #include <fcntl.h>
 #include <linux/fs.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -26,6 +27,7 @@
 #include <chrono>
 #include <future>
 #include <memory>
+#include <set>
 
 #include <android-base/file.h>
 #include <android-base/properties.h>
@@ -36,11 +38,13 @@
 #include <libdm/loop_control.h>
 #include <libsnapshot/cow_writer.h>
 #include <snapuserd/dm_user_block_server.h>
+#include <snapuserd/dm_user_uring_block_server.h>
 #include <storage_literals/storage_literals.h>
 #include "handler_manager.h"
 #include "merge_worker.h"
 #include "read_worker.h"
 #include "snapuserd_core.h"
+#include "snapuserd_verify.h"
 #include "testing/dm_user_harness.h"
 #include "testing/host_harness.h"
 #include "utility.h"
@@ -68,6 +72,8 @@ struct TestParam {
     uint32_t cow_op_merge_size;
     uint32_t verification_block_size;
     uint32_t num_verification_threads;
+    uint32_t num_decompress_threads{};
+    uint64_t block_cache_size{};
 };
 
 class SnapuserdTestBase : public ::testing::TestWithParam<TestParam> {
@@ -738,6 +744,8 @@ void SnapuserdTest::InitCowDevice() {
             .cow_op_merge_size = params.cow_op_merge_size,
             .verify_block_size = params.verification_block_size,
             .num_verification_threads = params.num_verification_threads,
+            .num_decompress_threads = params.num_decompress_threads,
+            .block_cache_size = params.block_cache_size,
     };
     auto handler =
             handlers_->AddHandler(system_device_ctrl_name_, cow_system_->path, base_dev_->GetPath(),
@@ -1288,6 +1296,8 @@ void HandlerTest::InitializeDevice() {
             .cow_op_merge_size = params.cow_op_merge_size,
             .verify_block_size = params.verification_block_size,
             .num_verification_threads = params.num_verification_threads,
+            .num_decompress_threads = params.num_decompress_threads,
+            .block_cache_size = params.block_cache_size,
     };
     handler_ = std::make_shared<SnapshotHandler>(system_device_ctrl_name_, cow_system_->path,
                                                  base_dev_->GetPath(), base_dev_->GetPath(),
@@ -1556,6 +1566,15 @@ std::vector<TestParam> GetTestConfigs() {
         param.o_direct = true;
         testParams.push_back(std::move(param));
     }
+
+    // Read-ahead with parallel decompression of XOR ops
+    for (bool config : uring_configs) {
+        TestParam param;
+        param.io_uring = config;
+        param.o_direct = false;
+        param.num_decompress_threads = 2;
+        testParams.push_back(std::move(param));
+    }
     return testParams;
 }
 
@@ -1585,9 +1604,403 @@ std::vector<TestParam> GetVariableBlockTestConfigs() {
         }
     }
 
+    // Decompressed block cache shared by the worker threads
+    for (auto block : block_sizes) {
+        TestParam param;
+        param.block_size = block;
+        param.compression = "lz4";
+        param.num_threads = 2;
+        param.io_uring = false;
+        param.o_direct = false;
+        param.cow_op_merge_size = 0;
+        param.block_cache_size = 1_MiB;
+        testParams.push_back(std::move(param));
+    }
+
     return testParams;
 }
 
+TEST(BlockIndexTest, Lookup) {
+    BlockIndex index;
+    // Added out of order; Finalize() sorts by block.
+    for (uint32_t block : {40, 10, 30, 20}) {
+        ASSERT_TRUE(index.Add(block, block * 2));
+    }
+    // Blocks beyond 32 bits come from a corrupt COW and are rejected.
+    ASSERT_FALSE(index.Add(1ULL << 32, 0));
+    index.Finalize();
+
+    ASSERT_EQ(index.size(), 4);
+    for (size_t i = 0; i < index.size(); i++) {
+        ASSERT_EQ(index.block(i), (i + 1) * 10);
+        ASSERT_EQ(index.value(i), (i + 1) * 20);
+    }
+
+    uint32_t value;
+    ASSERT_TRUE(index.Find(30, &value));
+    ASSERT_EQ(value, 60);
+    ASSERT_FALSE(index.Find(31, &value));
+    ASSERT_FALSE(index.Find(1ULL << 40, &value));
+
+    ASSERT_EQ(index.LowerBound(0), 0);
+    ASSERT_EQ(index.LowerBound(10), 0);
+    ASSERT_EQ(index.LowerBound(11), 1);
+    ASSERT_EQ(index.LowerBound(40), 3);
+    ASSERT_EQ(index.LowerBound(41), 4);
+    ASSERT_EQ(index.LowerBound(1ULL << 40), 4);
+
+    BlockIndex empty;
+    empty.Finalize();
+    ASSERT_TRUE(empty.empty());
+    ASSERT_EQ(empty.LowerBound(0), 0);
+}
+
+// Serves every read with the low byte of its sector, one 4K chunk at a time.
+// If |fd| is set, reads are queued from it instead, block by block, and sent
+// as a single response.
+class PatternDelegate final : public IBlockServer::Delegate {
+  public:
+    bool RequestSectors(uint64_t sector, uint64_t size) override {
+        if (fd >= 0) {
+            return QueueSectors(sector, size);
+        }
+        for (uint64_t offset = 0; offset < size; offset += BLOCK_SZ) {
+            size_t chunk = std::min<uint64_t>(BLOCK_SZ, size - offset);
+            void* buffer = server->GetResponseBuffer(chunk, chunk);
+            if (!buffer) {
+                return false;
+            }
+            memset(buffer, static_cast<int>(sector & 0xff), chunk);
+            if (!server->SendBufferedIo()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool QueueSectors(uint64_t sector, uint64_t size) {
+        uint8_t* buffer = reinterpret_cast<uint8_t*>(server->GetResponseBuffer(size, size));
+        if (!buffer) {
+            return false;
+        }
+        for (uint64_t offset = 0; offset < size; offset += BLOCK_SZ) {
+            size_t chunk = std::min<uint64_t>(BLOCK_SZ, size - offset);
+            if (!server->QueueRead(fd, buffer + offset, chunk, (sector << SECTOR_SHIFT) + offset)) {
+                return false;
+            }
+        }
+        return server->SendBufferedIo();
+    }
+
+    IBlockServer* server = nullptr;
+    int fd = -1;
+};
+
+// A SOCK_SEQPACKET pair stands in for the dm-user control device: each
+// request header is one message, and each response write arrives as one.
+class DmUserUringBlockServerTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        if (!KernelSupportsIoUring()) {
+            GTEST_SKIP() << "io_uring is not supported";
+        }
+        int fds[2];
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds), 0);
+        unique_fd server_fd(fds[0]);
+        dm_user_fd_.reset(fds[1]);
+
+        server_ = std::make_unique<DmUserUringBlockServer>("test", std::move(server_fd),
+                                                           &delegate_, 64_KiB, kQueueDepth);
+        ASSERT_TRUE(server_->Initialize());
+        delegate_.server = server_.get();
+    }
+
+    void TearDown() override {
+        // Header reads still queued on the ring see EOF.
+        dm_user_fd_ = {};
+        server_ = nullptr;
+    }
+
+    void SendRequest(uint64_t seq, uint64_t type, uint64_t sector, uint64_t len) {
+        struct dm_user_header header = {
+                .seq = seq,
+                .type = type,
+                .flags = 0,
+                .sector = sector,
+                .len = len,
+        };
+        ASSERT_EQ(send(dm_user_fd_.get(), &header, sizeof(header), 0),
+                  static_cast<ssize_t>(sizeof(header)));
+    }
+
+    // Receives one response message; |payload| gets whatever follows the
+    // header if |has_header|, or the whole message otherwise.
+    void ReceiveResponse(bool has_header, struct dm_user_header* header, std::string* payload) {
+        std::string message(128_KiB, '\0');
+        ssize_t rv = recv(dm_user_fd_.get(), message.data(), message.size(), 0);
+        ASSERT_GT(rv, 0);
+        message.resize(rv);
+        if (has_header) {
+            ASSERT_GE(message.size(), sizeof(*header));
+            memcpy(header, message.data(), sizeof(*header));
+            message.erase(0, sizeof(*header));
+        }
+        *payload = std::move(message);
+    }
+
+    static constexpr int kQueueDepth = 4;
+
+    unique_fd dm_user_fd_;
+    PatternDelegate delegate_;
+    std::unique_ptr<DmUserUringBlockServer> server_;
+};
+
+TEST_F(DmUserUringBlockServerTest, ServesQueuedRequests) {
+    // More requests than slots are waiting before the server starts.
+    static constexpr uint64_t kNumRequests = kQueueDepth + 2;
+    for (uint64_t i = 0; i < kNumRequests; i++) {
+        ASSERT_NO_FATAL_FAILURE(SendRequest(i, DM_USER_REQ_MAP_READ, i * 8, BLOCK_SZ));
+    }
+
+    // Slots pick up requests in any order, so match responses by seq.
+    std::set<uint64_t> served;
+    for (uint64_t i = 0; i < kNumRequests; i++) {
+        ASSERT_TRUE(server_->ProcessRequests());
+
+        struct dm_user_header header;
+        std::string payload;
+        ASSERT_NO_FATAL_FAILURE(ReceiveResponse(true, &header, &payload));
+        ASSERT_LT(header.seq, kNumRequests);
+        ASSERT_EQ(header.type, DM_USER_RESP_SUCCESS);
+        ASSERT_EQ(payload, std::string(BLOCK_SZ, static_cast<char>(header.seq * 8)));
+        ASSERT_TRUE(served.insert(header.seq).second);
+    }
+}
+
+TEST_F(DmUserUringBlockServerTest, MultiChunkResponse) {
+    ASSERT_NO_FATAL_FAILURE(SendRequest(7, DM_USER_REQ_MAP_READ, 3, BLOCK_SZ * 3));
+    ASSERT_TRUE(server_->ProcessRequests());
+
+    // The header goes out with the first chunk only, and the chunks arrive
+    // in order.
+    struct dm_user_header header;
+    std::string payload;
+    ASSERT_NO_FATAL_FAILURE(ReceiveResponse(true, &header, &payload));
+    ASSERT_EQ(header.seq, 7);
+    ASSERT_EQ(header.type, DM_USER_RESP_SUCCESS);
+    ASSERT_EQ(payload, std::string(BLOCK_SZ, '\3'));
+    for (int i = 0; i < 2; i++) {
+        ASSERT_NO_FATAL_FAILURE(ReceiveResponse(false, &header, &payload));
+        ASSERT_EQ(payload, std::string(BLOCK_SZ, '\3'));
+    }
+
+    // The slot is reused for the next request.
+    ASSERT_NO_FATAL_FAILURE(SendRequest(8, DM_USER_REQ_MAP_READ, 9, BLOCK_SZ));
+    ASSERT_TRUE(server_->ProcessRequests());
+    ASSERT_NO_FATAL_FAILURE(ReceiveResponse(true, &header, &payload));
+    ASSERT_EQ(header.seq, 8);
+    ASSERT_EQ(payload, std::string(BLOCK_SZ, '\11'));
+}
+
+TEST_F(DmUserUringBlockServerTest, WriteRequestFails) {
+    ASSERT_NO_FATAL_FAILURE(SendRequest(1, DM_USER_REQ_MAP_WRITE, 0, BLOCK_SZ));
+    ASSERT_FALSE(server_->ProcessRequests());
+
+    struct dm_user_header header;
+    std::string payload;
+    ASSERT_NO_FATAL_FAILURE(ReceiveResponse(true, &header, &payload));
+    ASSERT_EQ(header.seq, 1);
+    ASSERT_EQ(header.type, DM_USER_RESP_ERROR);
+    ASSERT_TRUE(payload.empty());
+}
+
+TEST_F(DmUserUringBlockServerTest, QueuedReads) {
+    // Block i of the file is filled with 'a' + i.
+    static constexpr uint64_t kNumBlocks = kQueueDepth * 2;
+    TemporaryFile file;
+    ASSERT_GE(file.fd, 0);
+    for (uint64_t i = 0; i < kNumBlocks; i++) {
+        std::string block(BLOCK_SZ, static_cast<char>('a' + i));
+        ASSERT_TRUE(android::base::WriteFully(file.fd, block.data(), block.size()));
+    }
+    delegate_.fd = file.fd;
+
+    // Every slot gets a request for two blocks, whose reads are merged into
+    // one. All of them are in flight before the first response is read.
+    for (uint64_t i = 0; i < kQueueDepth; i++) {
+        ASSERT_NO_FATAL_FAILURE(SendRequest(i, DM_USER_REQ_MAP_READ, i * 16, BLOCK_SZ * 2));
+    }
+    for (uint64_t i = 0; i < kQueueDepth; i++) {
+        ASSERT_TRUE(server_->ProcessRequests());
+    }
+
+    std::set<uint64_t> served;
+    for (uint64_t i = 0; i < kQueueDepth; i++) {
+        struct dm_user_header header;
+        std::string payload;
+        ASSERT_NO_FATAL_FAILURE(ReceiveResponse(true, &header, &payload));
+        ASSERT_LT(header.seq, kQueueDepth);
+        ASSERT_EQ(header.type, DM_USER_RESP_SUCCESS);
+        std::string expected = std::string(BLOCK_SZ, static_cast<char>('a' + header.seq * 2)) +
+                               std::string(BLOCK_SZ, static_cast<char>('a' + header.seq * 2 + 1));
+        ASSERT_EQ(payload, expected);
+        ASSERT_TRUE(served.insert(header.seq).second);
+    }
+}
+
+TEST_F(DmUserUringBlockServerTest, QueuedReadFails) {
+    TemporaryFile file;
+    ASSERT_GE(file.fd, 0);
+    delegate_.fd = file.fd;
+
+    // The read hits EOF; the response write is cancelled, and the error is
+    // sent once the server notices.
+    ASSERT_NO_FATAL_FAILURE(SendRequest(3, DM_USER_REQ_MAP_READ, 0, BLOCK_SZ));
+    ASSERT_TRUE(server_->ProcessRequests());
+    ASSERT_FALSE(server_->ProcessRequests());
+
+    struct dm_user_header header;
+    std::string payload;
+    ASSERT_NO_FATAL_FAILURE(ReceiveResponse(true, &header, &payload));
+    ASSERT_EQ(header.seq, 3);
+    ASSERT_EQ(header.type, DM_USER_RESP_ERROR);
+    ASSERT_TRUE(payload.empty());
+}
+
+static void WriteIoPressure(const std::string& path, uint64_t stall_us) {
+    std::string content = "some avg10=0.00 avg60=0.00 avg300=0.00 total=" +
+                          std::to_string(stall_us) +
+                          "\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+    ASSERT_TRUE(android::base::WriteStringToFile(content, path));
+}
+
+// Only moves when the test advances it, or when the governor sleeps.
+class FakeMergeClock final : public MergeGovernor::Clock {
+  public:
+    std::chrono::steady_clock::time_point Now() override { return now_; }
+    void SleepFor(std::chrono::milliseconds duration) override {
+        now_ += duration;
+        slept_ += duration;
+    }
+
+    void Advance(std::chrono::milliseconds duration) { now_ += duration; }
+    std::chrono::milliseconds slept() const { return slept_; }
+
+  private:
+    std::chrono::steady_clock::time_point now_{1s};
+    std::chrono::milliseconds slept_{0};
+};
+
+TEST(MergeGovernorTest, AdaptsToIoPressure) {
+    TemporaryFile psi;
+    ASSERT_NO_FATAL_FAILURE(WriteIoPressure(psi.path, 0));
+
+    auto clock = std::make_shared<FakeMergeClock>();
+    MergeGovernor governor(10, 256, psi.path, clock);
+    ASSERT_TRUE(governor.Init());
+    ASSERT_EQ(governor.merge_ops(), 256);
+
+    // Within the sample window: nothing changes.
+    clock->Advance(50ms);
+    ASSERT_NO_FATAL_FAILURE(WriteIoPressure(psi.path, 50000));
+    governor.BatchMerged(256);
+    ASSERT_EQ(governor.merge_ops(), 256);
+    ASSERT_EQ(governor.throttle_count(), 0);
+
+    // Stalled for the whole sample window: back off.
+    clock->Advance(100ms);
+    ASSERT_NO_FATAL_FAILURE(WriteIoPressure(psi.path, 150000));
+    governor.BatchMerged(256);
+    ASSERT_EQ(governor.merge_ops(), 128);
+    ASSERT_EQ(governor.throttle_count(), 1);
+    ASSERT_EQ(governor.delay(), 5ms);
+    ASSERT_EQ(clock->slept(), 5ms);
+
+    // No stall since: grow back, and stop sleeping between batches.
+    clock->Advance(150ms);
+    governor.BatchMerged(128);
+    ASSERT_EQ(governor.merge_ops(), 136);
+    ASSERT_EQ(governor.throttle_count(), 1);
+    ASSERT_EQ(governor.delay(), 0ms);
+    ASSERT_EQ(clock->slept(), 5ms);
+
+    // 640 blocks of 4 KiB since the first batch, 255ms ago.
+    ASSERT_EQ(governor.rate_kbps(), 640 * 4 * 1000 / 255);
+}
+
+TEST(MergeGovernorTest, NoIoPressure) {
+    MergeGovernor governor(10, 256, "/does/not/exist");
+    ASSERT_FALSE(governor.Init());
+}
+
+class UpdateVerifyTest : public ::testing::Test {
+  protected:
+    UpdateVerify verify_{"system_b-verify", 1_MiB, 0};
+
+    uint64_t ChooseBlockSize(uint64_t bytes_per_sec, uint64_t dev_sz) {
+        return verify_.ChooseBlockSize(bytes_per_sec, dev_sz);
+    }
+    int GetQueueDepth(uint64_t block_size, uint64_t dev_sz) {
+        return verify_.GetQueueDepth(block_size, dev_sz);
+    }
+    bool ProbeBandwidth(const std::string& path, uint64_t size, uint64_t* bytes_per_sec) {
+        return verify_.ProbeBandwidth("system", path, size, size, bytes_per_sec);
+    }
+    bool VerifyBlocks(const std::string& path, uint64_t end, uint64_t block_size) {
+        return verify_.VerifyBlocks("system", path, 0, block_size, end, block_size, 4);
+    }
+};
+
+TEST_F(UpdateVerifyTest, ChooseBlockSize) {
+    // Reads should take about 1ms, within [128K, verify_block_size].
+    ASSERT_EQ(ChooseBlockSize(0, 4_GiB), 128_KiB);
+    ASSERT_EQ(ChooseBlockSize(64_MiB, 4_GiB), 128_KiB);
+    ASSERT_EQ(ChooseBlockSize(500_MiB, 4_GiB), 512_KiB);
+    ASSERT_EQ(ChooseBlockSize(4_GiB, 4_GiB), 1_MiB);
+
+    // Small partitions read at most a quarter of verify_block_size.
+    ASSERT_EQ(ChooseBlockSize(4_GiB, 1_GiB), 256_KiB);
+    ASSERT_EQ(ChooseBlockSize(64_MiB, 1_GiB), 128_KiB);
+}
+
+TEST_F(UpdateVerifyTest, GetQueueDepth) {
+    // 4 x 1MiB in flight, whatever the block size.
+    ASSERT_EQ(GetQueueDepth(1_MiB, 4_GiB), 4);
+    ASSERT_EQ(GetQueueDepth(512_KiB, 4_GiB), 8);
+    ASSERT_EQ(GetQueueDepth(128_KiB, 4_GiB), 32);
+
+    // An eighth of that for small partitions, so that low-memory devices
+    // keep 2 x 256K in flight as before.
+    ASSERT_EQ(GetQueueDepth(256_KiB, 1_GiB), 2);
+    ASSERT_EQ(GetQueueDepth(128_KiB, 1_GiB), 4);
+    ASSERT_EQ(GetQueueDepth(1_MiB, 1_GiB), 1);
+}
+
+TEST_F(UpdateVerifyTest, ProbeBandwidth) {
+    if (!KernelSupportsIoUring()) {
+        GTEST_SKIP() << "io_uring not supported";
+    }
+
+    TemporaryFile file;
+    ASSERT_GE(file.fd, 0);
+    std::string data(4_MiB, 'x');
+    ASSERT_TRUE(android::base::WriteFully(file.fd, data.data(), data.size()));
+    ASSERT_EQ(fsync(file.fd), 0);
+
+    unique_fd direct(open(file.path, O_RDONLY | O_DIRECT));
+    if (direct < 0) {
+        GTEST_SKIP() << "O_DIRECT not supported for " << file.path;
+    }
+
+    uint64_t bytes_per_sec = 0;
+    ASSERT_TRUE(ProbeBandwidth(file.path, data.size(), &bytes_per_sec));
+    ASSERT_GT(bytes_per_sec, 0);
+
+    ASSERT_TRUE(VerifyBlocks(file.path, data.size(), 128_KiB));
+    // Reads past the end of the file come back short.
+    ASSERT_FALSE(VerifyBlocks(file.path, data.size() + 4_KiB, 128_KiB));
+}
+
 INSTANTIATE_TEST_SUITE_P(Io, SnapuserdVariableBlockSizeTest,
                          ::testing::ValuesIn(GetVariableBlockTestConfigs()));
 INSTANTIATE_TEST_SUITE_P(Io, HandlerTestV3, ::testing::ValuesIn(GetVariableBlockTestConfigs()));
@@ -649,12 +649,11 @@ void SnapshotHandler::SetMergeFailed(size_t ra_index) {
 // Block. If there are no more in-flight I/Os, wake up merge thread
 // to resume merging.
 void SnapshotHandler::NotifyIOCompletion(uint64_t new_block) {
-    auto it = block_to_ra_index_.find(new_block);
-    CHECK(it != block_to_ra_index_.end()) << " invalid block: " << new_block;
+    uint32_t ra_index;
+    CHECK(block_to_ra_index_.Find(new_block, &ra_index)) << " invalid block: " << new_block;
 
     bool pending_ios = true;
 
-    int ra_index = it->second;
     MergeGroupState* blk_state = merge_blk_state_[ra_index].get();
     {
         std::unique_lock<std::mutex> lock(blk_state->m_lock);
@@ -691,12 +690,11 @@ bool SnapshotHandler::GetRABuffer(std::unique_lock<std::mutex>* lock, uint64_t b
 // Invoked by worker threads in the I/O path. This is called when a sector
 // is mapped to a COPY/XOR COW op.
 MERGE_GROUP_STATE SnapshotHandler::ProcessMergingBlock(uint64_t new_block, void* buffer) {
-    auto it = block_to_ra_index_.find(new_block);
-    if (it == block_to_ra_index_.end()) {
+    uint32_t ra_index;
+    if (!block_to_ra_index_.Find(new_block, &ra_index)) {
         return MERGE_GROUP_STATE::GROUP_INVALID;
     }
 
-    int ra_index = it->second;
     MergeGroupState* blk_state = merge_blk_state_[ra_index].get();
     {
         std::unique_lock<std::mutex> lock(blk_state->m_lock);
@@ -18,8 +18,10 @@
 
 #include <android-base/chrono_utils.h>
 #include <android-base/scopeguard.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 
+#include <algorithm>
 #include <future>
 
 #include "snapuserd_core.h"
@@ -101,27 +103,56 @@ void UpdateVerify::VerifyUpdatePartition() {
     succeeded = true;
 }
 
-bool UpdateVerify::VerifyBlocks(const std::string& partition_name,
-                                const std::string& dm_block_device, off_t offset, int skip_blocks,
-                                uint64_t dev_sz) {
-    unique_fd fd(TEMP_FAILURE_RETRY(open(dm_block_device.c_str(), O_RDONLY | O_DIRECT)));
-    if (fd < 0) {
-        SNAP_LOG(ERROR) << "open failed: " << dm_block_device;
-        return false;
+uint64_t UpdateVerify::ChooseBlockSize(uint64_t bytes_per_sec, uint64_t dev_sz) {
+    uint64_t max_block_size = verify_block_size_;
+    if (dev_sz < threshold_size_) {
+        max_block_size >>= 2;
     }
+    max_block_size = std::max(max_block_size, kMinVerifyBlockSize);
+    uint64_t target = bytes_per_sec * kTargetReadTime.count() / 1000000;
 
-    int queue_depth = std::max(queue_depth_, 1);
-    int verify_block_size = verify_block_size_;
+    uint64_t block_size = kMinVerifyBlockSize;
+    while (block_size < target && block_size < max_block_size) {
+        block_size <<= 1;
+    }
+    block_size = std::min(block_size, max_block_size);
 
-    // Smaller partitions don't need a bigger queue-depth.
-    // This is required for low-memory devices.
+    if (!IsBlockAligned(block_size)) {
+        block_size = EXT4_ALIGN(block_size, BLOCK_SZ);
+    }
+    return block_size;
+}
+
+int UpdateVerify::GetQueueDepth(uint64_t block_size, uint64_t dev_sz) {
+    uint64_t bytes_in_flight = std::max(queue_depth_, 1) * verify_block_size_;
+
+    // Smaller partitions don't need as much I/O in flight: half the queue
+    // depth with a quarter of the block size. This is required for
+    // low-memory devices.
     if (dev_sz < threshold_size_) {
-        queue_depth = std::max(queue_depth / 2, 1);
-        verify_block_size >>= 2;
+        bytes_in_flight /= 8;
     }
 
-    if (!IsBlockAligned(verify_block_size)) {
-        verify_block_size = EXT4_ALIGN(verify_block_size, BLOCK_SZ);
+    uint64_t queue_depth = bytes_in_flight / block_size;
+    return std::clamp<uint64_t>(queue_depth, 1, kMaxQueueDepth);
+}
+
+/*
+ * Read [offset, end) in chunks of |block_size|, skipping |stride| bytes from
+ * the start of one chunk to the start of the next. The queue is kept full:
+ * every completion immediately frees its registered buffer for the next
+ * read, which is submitted along with the wait for the following completion.
+ *
+ * Returns false if any read fails or comes back short.
+ */
+bool UpdateVerify::VerifyBlocks(const std::string& partition_name,
+                                const std::string& dm_block_device, uint64_t offset,
+                                uint64_t stride, uint64_t end, uint64_t block_size,
+                                int queue_depth) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(dm_block_device.c_str(), O_RDONLY | O_DIRECT)));
+    if (fd < 0) {
+        SNAP_LOG(ERROR) << "open failed: " << dm_block_device;
+        return false;
     }
 
     std::unique_ptr<io_uring_cpp::IoUringInterface> ring =
@@ -136,14 +167,14 @@ bool UpdateVerify::VerifyBlocks(const std::string& partition_name,
     for (int i = 0; i < queue_depth; i++) {
         void* addr;
         ssize_t page_size = getpagesize();
-        if (posix_memalign(&addr, page_size, verify_block_size) < 0) {
+        if (posix_memalign(&addr, page_size, block_size) < 0) {
             LOG(ERROR) << "posix_memalign failed";
             return false;
         }
 
         buffers.emplace_back(addr, ::free);
         vecs[i].iov_base = addr;
-        vecs[i].iov_len = verify_block_size;
+        vecs[i].iov_len = block_size;
     }
 
     auto ret = ring->RegisterBuffers(vecs.get(), queue_depth);
@@ -152,69 +183,84 @@ bool UpdateVerify::VerifyBlocks(const std::string& partition_name,
         return false;
     }
 
-    loff_t file_offset = offset;
-    const uint64_t read_sz = verify_block_size;
-    uint64_t total_read = 0;
-    int num_submitted = 0;
-
     SNAP_LOG(DEBUG) << "VerifyBlocks: queue_depth: " << queue_depth
-                    << " verify_block_size: " << verify_block_size << " dev_sz: " << dev_sz
-                    << " file_offset: " << file_offset << " skip_blocks: " << skip_blocks;
-
-    while (file_offset < dev_sz) {
-        for (size_t i = 0; i < queue_depth; i++) {
-            uint64_t to_read = std::min((dev_sz - file_offset), read_sz);
-            if (to_read <= 0) break;
-
-            const auto sqe =
-                    ring->PrepReadFixed(fd.get(), vecs[i].iov_base, to_read, file_offset, i);
-            if (!sqe.IsOk()) {
-                SNAP_PLOG(ERROR) << "PrepReadFixed failed";
-                return false;
-            }
-            file_offset += (skip_blocks * to_read);
-            total_read += to_read;
-            num_submitted += 1;
-            if (file_offset >= dev_sz) {
-                break;
-            }
+                    << " block_size: " << block_size << " offset: " << offset
+                    << " stride: " << stride << " end: " << end;
+
+    uint64_t file_offset = offset;
+    uint64_t total_read = 0;
+    int in_flight = 0;
+    std::vector<uint64_t> read_size(queue_depth);
+
+    auto queue_read = [&](int slot) -> bool {
+        uint64_t to_read = std::min(end - file_offset, block_size);
+        auto sqe = ring->PrepReadFixed(fd.get(), vecs[slot].iov_base, to_read, file_offset, slot);
+        if (!sqe.IsOk()) {
+            SNAP_PLOG(ERROR) << "PrepReadFixed failed";
+            return false;
         }
+        sqe.SetData(static_cast<uint64_t>(slot));
 
-        if (num_submitted == 0) {
-            break;
+        read_size[slot] = to_read;
+        file_offset += stride;
+        in_flight += 1;
+        return true;
+    };
+
+    for (int i = 0; i < queue_depth && file_offset < end; i++) {
+        if (!queue_read(i)) {
+            return false;
         }
+    }
 
-        const auto io_submit = ring->SubmitAndWait(num_submitted);
+    while (in_flight) {
+        const auto io_submit = ring->SubmitAndWait(1);
         if (!io_submit.IsOk()) {
             SNAP_LOG(ERROR) << "SubmitAndWait failed: " << io_submit.ErrMsg()
-                            << " for: " << num_submitted << " entries.";
+                            << " in flight: " << in_flight;
             return false;
         }
 
-        SNAP_LOG(DEBUG) << "io_uring_submit: " << total_read << "num_submitted: " << num_submitted
-                        << "ret: " << ret;
+        const auto cqe = ring->PopCQE();
+        if (cqe.IsErr()) {
+            SNAP_LOG(ERROR) << "PopCqe failed: " << cqe.GetError().ErrMsg();
+            return false;
+        }
+        const int slot = cqe.GetResult().userdata;
+        const int res = cqe.GetResult().res;
+        in_flight -= 1;
 
-        const auto cqes = ring->PopCQE(num_submitted);
-        if (cqes.IsErr()) {
-            SNAP_LOG(ERROR) << "PopCqe failed for: " << num_submitted
-                            << " error: " << cqes.GetError().ErrMsg();
+        if (res < 0 || static_cast<uint64_t>(res) != read_size[slot]) {
+            SNAP_LOG(ERROR) << "I/O failed: cqe->res: " << res << " expected: " << read_size[slot];
             return false;
         }
-        for (const auto& cqe : cqes.GetResult()) {
-            if (cqe.res < 0) {
-                SNAP_LOG(ERROR) << "I/O failed: cqe->res: " << cqe.res;
-                return false;
-            }
-            num_submitted -= 1;
+        total_read += res;
+
+        if (file_offset < end && !queue_read(slot)) {
+            return false;
         }
     }
 
-    SNAP_LOG(DEBUG) << "Verification success with io_uring: " << " dev_sz: " << dev_sz
-                    << " partition_name: " << partition_name << " total_read: " << total_read;
+    SNAP_LOG(DEBUG) << "Verification success with io_uring: " << " partition_name: "
+                    << partition_name << " total_read: " << total_read;
 
     return true;
 }
 
+bool UpdateVerify::ProbeBandwidth(const std::string& partition_name,
+                                  const std::string& dm_block_device, uint64_t probe_end,
+                                  uint64_t dev_sz, uint64_t* bytes_per_sec) {
+    auto probe_start = std::chrono::steady_clock::now();
+    if (!VerifyBlocks(partition_name, dm_block_device, 0, kProbeBlockSize, probe_end,
+                      kProbeBlockSize, GetQueueDepth(kProbeBlockSize, dev_sz))) {
+        return false;
+    }
+    auto probe_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - probe_start);
+    *bytes_per_sec = probe_end * 1000000 / std::max<int64_t>(probe_us.count(), 1);
+    return true;
+}
+
 bool UpdateVerify::VerifyPartition(const std::string& partition_name,
                                    const std::string& dm_block_device) {
     android::base::Timer timer;
@@ -251,6 +297,17 @@ bool UpdateVerify::VerifyPartition(const std::string& partition_name,
         return false;
     }
 
+    // Measure the bandwidth of the device over the start of the partition;
+    // this part of the partition needs to be read anyway.
+    const uint64_t probe_end = std::min(dev_sz, kProbeSize);
+    uint64_t bytes_per_sec;
+    if (!ProbeBandwidth(partition_name, dm_block_device, probe_end, dev_sz, &bytes_per_sec)) {
+        return false;
+    }
+
+    const uint64_t block_size = ChooseBlockSize(bytes_per_sec, dev_sz);
+    const int queue_depth = GetQueueDepth(block_size, dev_sz);
+
     int num_threads = kMinThreadsToVerify;
     if (dev_sz > threshold_size_) {
         num_threads = kMaxThreadsToVerify;
@@ -259,19 +316,20 @@ bool UpdateVerify::VerifyPartition(const std::string& partition_name,
         }
     }
 
+    SNAP_LOG(INFO) << "VerifyPartition: " << partition_name << " probe bandwidth: "
+                   << (bytes_per_sec / 1_MiB) << " MiB/s block_size: " << block_size
+                   << " queue_depth: " << queue_depth << " threads: " << num_threads;
+
     std::vector<std::future<bool>> threads;
-    off_t start_offset = 0;
-    const int skip_blocks = num_threads;
+    uint64_t start_offset = probe_end;
+    const uint64_t stride = num_threads * block_size;
 
-    while (num_threads) {
+    while (num_threads && start_offset < dev_sz) {
         threads.emplace_back(std::async(std::launch::async, &UpdateVerify::VerifyBlocks, this,
-                                        partition_name, dm_block_device, start_offset, skip_blocks,
-                                        dev_sz));
-        start_offset += verify_block_size_;
+                                        partition_name, dm_block_device, start_offset, stride,
+                                        dev_sz, block_size, queue_depth));
+        start_offset += block_size;
         num_threads -= 1;
-        if (start_offset >= dev_sz) {
-            break;
-        }
     }
 
     bool ret = true;
@@ -282,9 +340,14 @@ bool UpdateVerify::VerifyPartition(const std::string& partition_name,
     if (ret) {
         succeeded = true;
         UpdatePartitionVerificationState(UpdateVerifyState::VERIFY_SUCCESS);
+
+        auto duration_ms = timer.duration().count();
+        double throughput = static_cast<double>(dev_sz) / std::max<int64_t>(duration_ms, 1) / 1e6;
         SNAP_LOG(INFO) << "Partition verification success: " << partition_name
                        << " Block-device: " << dm_block_device << " Size: " << dev_sz
-                       << " Duration : " << timer.duration().count() << " ms";
+                       << " Duration : " << duration_ms << " ms"
+                       << " Throughput: " << android::base::StringPrintf("%.2f", throughput)
+                       << " GB/s";
         return true;
     }
 
@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <string>
@@ -40,6 +41,8 @@ class UpdateVerify {
     bool CheckPartitionVerification();
 
   private:
+    friend class UpdateVerifyTest;
+
     enum class UpdateVerifyState {
         VERIFY_UNKNOWN,
         VERIFY_FAILED,
@@ -70,11 +73,31 @@ class UpdateVerify {
     uint32_t num_verification_threads_;
     int queue_depth_ = 4;
 
+    /*
+     * The read size is picked from the bandwidth measured over the start of
+     * the partition: fast devices (UFS) get large reads so that per-request
+     * overhead is amortized, slow devices (eMMC) get smaller reads so that
+     * more of them can be kept in flight. verify_block_size_ is the upper
+     * bound (a quarter of it below threshold_size_), and the bytes in flight
+     * per thread (queue_depth_ * verify_block_size_, an eighth of that below
+     * threshold_size_) stay the same whatever the read size.
+     */
+    static constexpr uint64_t kProbeSize = 32_MiB;
+    static constexpr uint64_t kProbeBlockSize = 256_KiB;
+    static constexpr uint64_t kMinVerifyBlockSize = 128_KiB;
+    static constexpr std::chrono::microseconds kTargetReadTime{1000};
+    static constexpr int kMaxQueueDepth = 32;
+
     bool IsBlockAligned(uint64_t read_size) { return ((read_size & (BLOCK_SZ - 1)) == 0); }
     void UpdatePartitionVerificationState(UpdateVerifyState state);
     bool VerifyPartition(const std::string& partition_name, const std::string& dm_block_device);
+    bool ProbeBandwidth(const std::string& partition_name, const std::string& dm_block_device,
+                        uint64_t probe_end, uint64_t dev_sz, uint64_t* bytes_per_sec);
+    uint64_t ChooseBlockSize(uint64_t bytes_per_sec, uint64_t dev_sz);
+    int GetQueueDepth(uint64_t block_size, uint64_t dev_sz);
     bool VerifyBlocks(const std::string& partition_name, const std::string& dm_block_device,
-                      off_t offset, int skip_blocks, uint64_t dev_sz);
+                      uint64_t offset, uint64_t stride, uint64_t end, uint64_t block_size,
+                      int queue_depth);
 };
 
 }  // namespace snapshot
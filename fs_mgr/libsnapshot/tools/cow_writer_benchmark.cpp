@@ -0,0 +1,110 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <libsnapshot/cow_writer.h>
+#include <storage_literals/storage_literals.h>
+
+namespace android {
+namespace snapshot {
+
+using android::base::unique_fd;
+using namespace android::storage_literals;
+
+static constexpr size_t kBlockSize = 4_KiB;
+static constexpr size_t kImageSize = 64_MiB;
+// Size of each AddRawBlocks() call, similar to what update_engine submits
+// for a large REPLACE operation.
+static constexpr size_t kWriteSize = 2_MiB;
+
+// Somewhat compressible data: random runs of repeated bytes.
+static const std::vector<uint8_t>& GetImageData() {
+    static std::vector<uint8_t> data = []() {
+        std::vector<uint8_t> data(kImageSize);
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<int> byte(0, 255);
+        std::uniform_int_distribution<int> run(1, 32);
+        size_t i = 0;
+        while (i < data.size()) {
+            uint8_t value = byte(gen);
+            size_t len = std::min<size_t>(run(gen), data.size() - i);
+            std::fill(data.begin() + i, data.begin() + i + len, value);
+            i += len;
+        }
+        return data;
+    }();
+    return data;
+}
+
+static void BM_CowWriteV3(benchmark::State& state, const std::string& compression) {
+    const auto& data = GetImageData();
+
+    CowOptions options;
+    options.compression = compression;
+    options.block_size = kBlockSize;
+    options.compression_factor = 64_KiB;
+    options.num_compress_threads = state.range(0);
+    options.pipelined_compression = state.range(1);
+    options.op_count_max = kImageSize / kBlockSize;
+    options.scratch_space = false;
+
+    for (auto _ : state) {
+        TemporaryFile cow;
+        auto writer = CreateCowWriter(3, options, unique_fd(dup(cow.fd)));
+        if (!writer) {
+            state.SkipWithError("Failed to create COW writer");
+            return;
+        }
+        for (size_t offset = 0; offset < data.size(); offset += kWriteSize) {
+            if (!writer->AddRawBlocks(offset / kBlockSize, data.data() + offset, kWriteSize)) {
+                state.SkipWithError("AddRawBlocks failed");
+                return;
+            }
+        }
+        if (!writer->Finalize()) {
+            state.SkipWithError("Finalize failed");
+            return;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+// Arguments: number of compression threads, pipelined compression.
+static void CowWriteArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"threads", "pipelined"});
+    b->Args({1, 0});
+    b->Args({4, 0});
+    b->Args({4, 1});
+    b->Args({8, 1});
+    b->Unit(benchmark::kMillisecond);
+    b->UseRealTime();
+}
+
+BENCHMARK_CAPTURE(BM_CowWriteV3, lz4, std::string("lz4"))->Apply(CowWriteArgs);
+BENCHMARK_CAPTURE(BM_CowWriteV3, zstd, std::string("zstd"))->Apply(CowWriteArgs);
+BENCHMARK_CAPTURE(BM_CowWriteV3, gz, std::string("gz"))->Apply(CowWriteArgs);
+
+}  // namespace snapshot
+}  // namespace android
+
+BENCHMARK_MAIN();
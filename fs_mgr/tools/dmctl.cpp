@@ -19,6 +19,7 @@
 #include <getopt.h>
 #include <linux/dm-ioctl.h>
 #include <sys/ioctl.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -397,31 +398,25 @@ static int DmListTargets(DeviceMapper& dm, [[maybe_unused]] int argc,
 }
 
 static int DmListDevices(DeviceMapper& dm, int argc, char** argv) {
-    std::vector<DmBlockDevice> devices;
-    if (!dm.GetAvailableDevices(&devices)) {
+    bool verbose = (argc && (argv[0] == "-v"s));
+
+    DmDeviceSnapshot snapshot;
+    if (!dm.QueryDevices(verbose ? kDmQueryTable : 0, &snapshot)) {
         std::cerr << "Failed to read available device mapper devices" << std::endl;
         return -errno;
     }
     std::cout << "Available Device Mapper Devices:" << std::endl;
-    if (devices.empty()) {
+    if (snapshot.devices().empty()) {
         std::cout << "  <empty>" << std::endl;
         return 0;
     }
 
-    bool verbose = (argc && (argv[0] == "-v"s));
-    for (const auto& dev : devices) {
-        std::cout << std::left << std::setw(20) << dev.name() << " : " << dev.Major() << ":"
-                  << dev.Minor() << std::endl;
+    for (const auto& dev : snapshot.devices()) {
+        std::cout << std::left << std::setw(20) << dev.name << " : " << major(dev.dev) << ":"
+                  << minor(dev.dev) << std::endl;
         if (verbose) {
-            std::vector<DeviceMapper::TargetInfo> table;
-            if (!dm.GetTableInfo(dev.name(), &table)) {
-                std::cerr << "Could not query table status for device \"" << dev.name() << "\"."
-                          << std::endl;
-                return -EINVAL;
-            }
-
             uint32_t target_num = 1;
-            for (const auto& target : table) {
+            for (const auto& target : dev.table) {
                 std::cout << "  target#" << target_num << ": ";
                 std::cout << target.spec.sector_start << "-"
                           << (target.spec.sector_start + target.spec.length) << ": "
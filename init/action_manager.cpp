@@ -16,6 +16,8 @@
 
 #include "action_manager.h"
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 
 namespace android {
@@ -37,9 +39,112 @@ ActionManager& ActionManager::GetInstance() {
 }
 
 void ActionManager::AddAction(std::unique_ptr<Action> action) {
+    IndexAction(action.get());
     actions_.emplace_back(std::move(action));
 }
 
+void ActionManager::IndexAction(const Action* action) {
+    action_order_[action] = next_action_order_++;
+
+    if (!action->event_trigger().empty()) {
+        event_trigger_index_[action->event_trigger()].emplace_back(action);
+        return;
+    }
+    property_actions_.emplace_back(action);
+    if (action->property_triggers().empty()) {
+        untriggered_actions_.emplace_back(action);
+    }
+    for (const auto& [name, value] : action->property_triggers()) {
+        property_trigger_index_[name].emplace_back(action);
+    }
+}
+
+void ActionManager::UnindexAction(const Action* action) {
+    auto erase_from = [action](auto* map, const std::string& key) {
+        auto it = map->find(key);
+        if (it == map->end()) return;
+        auto& list = it->second;
+        list.erase(std::remove(list.begin(), list.end(), action), list.end());
+        if (list.empty()) map->erase(it);
+    };
+
+    action_order_.erase(action);
+    if (!action->event_trigger().empty()) {
+        erase_from(&event_trigger_index_, action->event_trigger());
+        return;
+    }
+    property_actions_.erase(std::remove(property_actions_.begin(), property_actions_.end(), action),
+                            property_actions_.end());
+    untriggered_actions_.erase(
+            std::remove(untriggered_actions_.begin(), untriggered_actions_.end(), action),
+            untriggered_actions_.end());
+    for (const auto& [name, value] : action->property_triggers()) {
+        erase_from(&property_trigger_index_, name);
+    }
+}
+
+void ActionManager::RebuildIndex() {
+    event_trigger_index_.clear();
+    property_trigger_index_.clear();
+    property_actions_.clear();
+    untriggered_actions_.clear();
+    action_order_.clear();
+    next_action_order_ = 0;
+    for (const auto& action : actions_) {
+        IndexAction(action.get());
+    }
+}
+
+void ActionManager::QueueMatchingActions(const EventTrigger& event_trigger) {
+    auto it = event_trigger_index_.find(event_trigger);
+    if (it == event_trigger_index_.end()) return;
+    for (const auto* action : it->second) {
+        if (action->CheckEvent(event_trigger)) {
+            current_executing_actions_.emplace(action);
+        }
+    }
+}
+
+void ActionManager::QueueMatchingActions(const PropertyChange& property_change) {
+    // An empty name, from QueueAllPropertyActions(), checks every property action.
+    if (property_change.first.empty()) {
+        for (const auto* action : property_actions_) {
+            if (action->CheckEvent(property_change)) {
+                current_executing_actions_.emplace(action);
+            }
+        }
+        return;
+    }
+
+    static const std::vector<const Action*> kNoActions;
+    auto it = property_trigger_index_.find(property_change.first);
+    const auto& triggered = it != property_trigger_index_.end() ? it->second : kNoActions;
+
+    // Actions without triggers are rare, so there is almost never anything to merge.
+    std::vector<const Action*> merged;
+    const auto* candidates = &triggered;
+    if (!untriggered_actions_.empty()) {
+        merged.resize(triggered.size() + untriggered_actions_.size());
+        std::merge(triggered.begin(), triggered.end(), untriggered_actions_.begin(),
+                   untriggered_actions_.end(), merged.begin(),
+                   [this](const Action* a, const Action* b) {
+                       return action_order_[a] < action_order_[b];
+                   });
+        candidates = &merged;
+    }
+    for (const auto* action : *candidates) {
+        if (action->CheckEvent(property_change)) {
+            current_executing_actions_.emplace(action);
+        }
+    }
+}
+
+void ActionManager::QueueMatchingActions(const BuiltinAction& builtin_action) {
+    if (action_order_.count(builtin_action)) {
+        current_executing_actions_.emplace(builtin_action);
+    }
+}
+
 void ActionManager::QueueEventTrigger(const std::string& trigger) {
     auto lock = std::lock_guard{event_queue_lock_};
     event_queue_.emplace(trigger);
@@ -61,6 +166,7 @@ void ActionManager::QueueBuiltinAction(BuiltinFunction func, const std::string&
     action->AddCommand(std::move(func), {name}, 0);
 
     event_queue_.emplace(action.get());
+    IndexAction(action.get());
     actions_.emplace_back(std::move(action));
 }
 
@@ -69,12 +175,8 @@ void ActionManager::ExecuteOneCommand() {
         auto lock = std::lock_guard{event_queue_lock_};
         // Loop through the event queue until we have an action to execute
         while (current_executing_actions_.empty() && !event_queue_.empty()) {
-            for (const auto& action : actions_) {
-                if (std::visit([&action](const auto& event) { return action->CheckEvent(event); },
-                               event_queue_.front())) {
-                    current_executing_actions_.emplace(action.get());
-                }
-            }
+            std::visit([this](const auto& event) { QueueMatchingActions(event); },
+                       event_queue_.front());
             event_queue_.pop();
         }
     }
@@ -101,6 +203,7 @@ void ActionManager::ExecuteOneCommand() {
         current_executing_actions_.pop();
         current_command_ = 0;
         if (action->oneshot()) {
+            UnindexAction(action);
             auto eraser = [&action](std::unique_ptr<Action>& a) { return a.get() == action; };
             actions_.erase(std::remove_if(actions_.begin(), actions_.end(), eraser),
                            actions_.end());
@@ -18,6 +18,7 @@
 
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/thread_annotations.h>
@@ -40,6 +41,7 @@ class ActionManager {
     template <class UnaryPredicate>
     void RemoveActionIf(UnaryPredicate predicate) {
         actions_.erase(std::remove_if(actions_.begin(), actions_.end(), predicate), actions_.end());
+        RebuildIndex();
     }
     void QueueEventTrigger(const std::string& trigger);
     void QueuePropertyChange(const std::string& name, const std::string& value);
@@ -55,7 +57,27 @@ class ActionManager {
     ActionManager(ActionManager const&) = delete;
     void operator=(ActionManager const&) = delete;
 
+    void IndexAction(const Action* action);
+    void UnindexAction(const Action* action);
+    void RebuildIndex();
+    void QueueMatchingActions(const EventTrigger& event_trigger);
+    void QueueMatchingActions(const PropertyChange& property_change);
+    void QueueMatchingActions(const BuiltinAction& builtin_action);
+
     std::vector<std::unique_ptr<Action>> actions_;
+
+    // Index of |actions_| by trigger, so that an event only checks the actions it may match.
+    // Each list keeps the order of |actions_|, which is the order the actions run in.
+    std::unordered_map<std::string, std::vector<const Action*>> event_trigger_index_;
+    std::unordered_map<std::string, std::vector<const Action*>> property_trigger_index_;
+    // Actions without an event trigger, all checked by QueueAllPropertyActions().
+    std::vector<const Action*> property_actions_;
+    // Actions without any trigger, which match every property change.
+    std::vector<const Action*> untriggered_actions_;
+    // Position of each action in |actions_|, to merge lists in that order.
+    std::unordered_map<const Action*, size_t> action_order_;
+    size_t next_action_order_ = 0;
+
     std::queue<std::variant<EventTrigger, PropertyChange, BuiltinAction>> event_queue_
             GUARDED_BY(event_queue_lock_);
     mutable std::mutex event_queue_lock_;
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "action_manager.h"
+
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+using android::base::StringPrintf;
+
+namespace android {
+namespace init {
+
+// Fill |am| with actions shaped like those of a device's rc files: mostly
+// property triggers, some with wildcards or several conditions, and a set of
+// boot stage events.
+static void AddRcCorpus(ActionManager* am, int num_actions) {
+    static const char* kEvents[] = {"early-init", "init",         "late-init",
+                                    "post-fs",    "post-fs-data", "zygote-start",
+                                    "boot",       "early-boot",   "charger"};
+
+    for (int i = 0; i < num_actions; i++) {
+        std::string event_trigger;
+        std::map<std::string, std::string> property_triggers;
+        switch (i % 10) {
+            case 0:
+                event_trigger = kEvents[i % std::size(kEvents)];
+                break;
+            case 1:
+                event_trigger = kEvents[i % std::size(kEvents)];
+                property_triggers.emplace(StringPrintf("ro.vendor.feature%d", i), "1");
+                break;
+            case 2:
+                property_triggers.emplace(StringPrintf("vendor.service%d.enable", i), "*");
+                break;
+            case 3:
+                property_triggers.emplace("sys.boot_completed", "1");
+                property_triggers.emplace(StringPrintf("persist.vendor.option%d", i), "1");
+                break;
+            default:
+                property_triggers.emplace(StringPrintf("vendor.hal%d.state", i % 97),
+                                          StringPrintf("state%d", i));
+                break;
+        }
+        am->AddAction(std::make_unique<Action>(false, nullptr, "/vendor/etc/init/bench.rc", i,
+                                               event_trigger, property_triggers));
+    }
+}
+
+// A property change that no action triggers on, as for most sets.
+static void BenchmarkUnwatchedPropertyChange(benchmark::State& state) {
+    ActionManager am;
+    AddRcCorpus(&am, state.range(0));
+
+    for (auto _ : state) {
+        am.QueuePropertyChange("sys.unwatched.property", "1");
+        am.ExecuteOneCommand();
+    }
+}
+BENCHMARK(BenchmarkUnwatchedPropertyChange)->Arg(100)->Arg(1000)->Arg(4000);
+
+// A property change that some actions trigger on, with a value none wait for.
+static void BenchmarkWatchedPropertyChange(benchmark::State& state) {
+    ActionManager am;
+    AddRcCorpus(&am, state.range(0));
+
+    for (auto _ : state) {
+        am.QueuePropertyChange("vendor.hal4.state", "unknown");
+        am.ExecuteOneCommand();
+    }
+}
+BENCHMARK(BenchmarkWatchedPropertyChange)->Arg(100)->Arg(1000)->Arg(4000);
+
+// An event trigger that no action waits for.
+static void BenchmarkUnwatchedEventTrigger(benchmark::State& state) {
+    ActionManager am;
+    AddRcCorpus(&am, state.range(0));
+
+    for (auto _ : state) {
+        am.QueueEventTrigger("unwatched-event");
+        am.ExecuteOneCommand();
+    }
+}
+BENCHMARK(BenchmarkUnwatchedEventTrigger)->Arg(100)->Arg(1000)->Arg(4000);
+
+}  // namespace init
+}  // namespace android
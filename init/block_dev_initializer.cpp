@@ -17,6 +17,7 @@
 #include <vector>
 
 #include <android-base/chrono_utils.h>
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 #include <fs_mgr.h>
@@ -203,11 +204,94 @@ bool BlockDevInitializer::InitDevices(std::set<std::string> devices) {
     return true;
 }
 
+static std::string GetDmDeviceUuid(const std::string& device_name) {
+    std::string uuid;
+    if (!android::base::ReadFileToString("/sys/block/" + device_name + "/dm/uuid", &uuid)) {
+        return {};
+    }
+    return android::base::Trim(uuid);
+}
+
+// dm-N names are reused once a device is deleted, so a node is only known to
+// be current if the device still has the uuid it had when it was initialized.
+bool BlockDevInitializer::IsDmDeviceInitialized(const std::string& device_name) {
+    auto iter = dm_devices_.find(device_name);
+    if (iter == dm_devices_.end()) {
+        return false;
+    }
+    if (iter->second.empty() || iter->second != GetDmDeviceUuid(device_name) ||
+        access(("/dev/block/" + device_name).c_str(), F_OK) != 0) {
+        dm_devices_.erase(iter);
+        return false;
+    }
+    return true;
+}
+
 // Creates "/dev/block/dm-XX" for dm nodes by running coldboot on /sys/block/dm-XX.
 bool BlockDevInitializer::InitDmDevice(const std::string& device) {
     const std::string device_name(basename(device.c_str()));
+    if (IsDmDeviceInitialized(device_name)) {
+        return true;
+    }
     const std::string syspath = "/sys/block/" + device_name;
-    return InitDevice(syspath, device_name);
+    if (!InitDevice(syspath, device_name)) {
+        return false;
+    }
+    dm_devices_[device_name] = GetDmDeviceUuid(device_name);
+    return true;
+}
+
+// Same as InitDmDevice, for several devices. Uevents are regenerated for each
+// device that is still missing, and any uevent of the set seen while doing so
+// is handled, so devices which are not ready yet share a single wait.
+bool BlockDevInitializer::InitDmDevices(const std::vector<std::string>& devices) {
+    std::set<std::string> pending;
+    for (const auto& device : devices) {
+        std::string device_name(basename(device.c_str()));
+        if (!IsDmDeviceInitialized(device_name)) {
+            pending.emplace(std::move(device_name));
+        }
+    }
+    if (pending.empty()) {
+        return true;
+    }
+
+    std::vector<std::string> found;
+    auto uevent_callback = [&, this](const Uevent& uevent) -> ListenerAction {
+        auto iter = pending.find(uevent.device_name);
+        if (iter != pending.end()) {
+            LOG(VERBOSE) << "Creating device : " << uevent.device_name;
+            device_handler_->HandleUevent(uevent);
+            found.emplace_back(*iter);
+            pending.erase(iter);
+        }
+        return pending.empty() ? ListenerAction::kStop : ListenerAction::kContinue;
+    };
+
+    const std::vector<std::string> names(pending.begin(), pending.end());
+    for (const auto& device_name : names) {
+        if (pending.count(device_name)) {
+            uevent_listener_.RegenerateUeventsForPath("/sys/block/" + device_name,
+                                                      uevent_callback);
+        }
+    }
+    if (!pending.empty()) {
+        LOG(INFO) << "dm device(s) not found in /sys, waiting for their uevent(s): "
+                  << android::base::Join(pending, ", ");
+        Timer t;
+        uevent_listener_.Poll(uevent_callback, 10s);
+        LOG(INFO) << "wait for dm devices returned after " << t;
+    }
+
+    for (const auto& device_name : found) {
+        dm_devices_[device_name] = GetDmDeviceUuid(device_name);
+    }
+    if (!pending.empty()) {
+        LOG(ERROR) << "dm device(s) not found after polling timeout: "
+                   << android::base::Join(pending, ", ");
+        return false;
+    }
+    return true;
 }
 
 bool BlockDevInitializer::InitPlatformDevice(const std::string& dev_name) {
@@ -14,9 +14,11 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "devices.h"
 #include "uevent_listener.h"
@@ -34,6 +36,7 @@ class BlockDevInitializer final {
     bool InitDmUser(const std::string& name);
     bool InitDevices(std::set<std::string> devices);
     bool InitDmDevice(const std::string& device);
+    bool InitDmDevices(const std::vector<std::string>& devices);
     bool InitPlatformDevice(const std::string& device);
     bool InitHvcDevice(const std::string& device);
 
@@ -42,9 +45,12 @@ class BlockDevInitializer final {
 
     bool InitMiscDevice(const std::string& name);
     bool InitDevice(const std::string& syspath, const std::string& device);
+    bool IsDmDeviceInitialized(const std::string& device_name);
 
     std::unique_ptr<DeviceHandler> device_handler_;
     UeventListener uevent_listener_;
+    // dm-N name to the dm uuid of the device its node was created for.
+    std::map<std::string, std::string> dm_devices_;
 };
 
 }  // namespace init
@@ -98,6 +98,7 @@ class FirstStageMountVBootV2 : public FirstStageMount {
 
     bool MountPartitions();
     bool TrySwitchSystemAsRoot();
+    void InitLogicalPartitionDevices();
     bool IsDmLinearEnabled();
     void GetSuperDeviceName(std::set<std::string>* devices);
     bool InitDmLinearBackingDevices(const android::fs_mgr::LpMetadata& metadata);
@@ -410,7 +411,7 @@ bool FirstStageMountVBootV2::CreateSnapshotPartitions(SnapshotManager* sm) {
         LaunchFirstStageSnapuserd();
     }
 
-    sm->SetUeventRegenCallback([this](const std::string& device) -> bool {
+    auto init_device = [this](const std::string& device) -> bool {
         if (android::base::StartsWith(device, "/dev/block/dm-")) {
             return block_dev_init_.InitDmDevice(device);
         }
@@ -418,7 +419,20 @@ bool FirstStageMountVBootV2::CreateSnapshotPartitions(SnapshotManager* sm) {
             return block_dev_init_.InitDmUser(android::base::Basename(device));
         }
         return block_dev_init_.InitDevices({device});
-    });
+    };
+    sm->SetUeventRegenCallback(init_device);
+    sm->SetUeventRegenBatchCallback(
+            [this, init_device](const std::vector<std::string>& devices) -> bool {
+                std::vector<std::string> dm_devices;
+                for (const auto& device : devices) {
+                    if (android::base::StartsWith(device, "/dev/block/dm-")) {
+                        dm_devices.emplace_back(device);
+                    } else if (!init_device(device)) {
+                        return false;
+                    }
+                }
+                return block_dev_init_.InitDmDevices(dm_devices);
+            });
     if (!sm->CreateLogicalAndSnapshotPartitions(super_path_)) {
         return false;
     }
@@ -530,6 +544,8 @@ bool FirstStageMountVBootV2::TrySwitchSystemAsRoot() {
     UseDsuIfPresent();
     // Preloading all AVB keys from the ramdisk before switching root to /system.
     PreloadAvbKeys();
+    // The fstab is final once DSU has been applied.
+    InitLogicalPartitionDevices();
 
     auto system_partition = std::find_if(fstab_.begin(), fstab_.end(), [](const auto& entry) {
         return entry.mount_point == "/system";
@@ -555,6 +571,25 @@ bool FirstStageMountVBootV2::TrySwitchSystemAsRoot() {
     return true;
 }
 
+// Creates the device nodes of all logical partitions in the fstab at once, so
+// the InitDmDevice() calls in MountPartition() find them ready. Failures are
+// not fatal here, MountPartition() reports them for the affected entry.
+void FirstStageMountVBootV2::InitLogicalPartitionDevices() {
+    std::vector<std::string> devices;
+    for (const auto& entry : fstab_) {
+        if (!entry.fs_mgr_flags.logical) {
+            continue;
+        }
+        FstabEntry logical_entry = entry;
+        if (fs_mgr_update_logical_partition(&logical_entry)) {
+            devices.emplace_back(logical_entry.blk_device);
+        }
+    }
+    if (!devices.empty()) {
+        block_dev_init_.InitDmDevices(devices);
+    }
+}
+
 static bool MaybeDeriveMicrodroidVendorDiceNode(Fstab* fstab) {
     std::optional<std::string> microdroid_vendor_block_dev;
     for (auto entry = fstab->begin(); entry != fstab->end(); entry++) {
@@ -884,6 +919,11 @@ bool FirstStageMountVBootV2::InitAvbHandle() {
     }
     // Sets INIT_AVB_VERSION here for init to set ro.boot.avb_version in the second stage.
     setenv("INIT_AVB_VERSION", avb_handle_->avb_version().c_str(), 1);
+    // Hands the verified chain over to second stage init and vold, so that their
+    // AvbHandle::Open() doesn't verify it again.
+    if (!avb_handle_->SaveToCache()) {
+        LOG(WARNING) << "Failed to cache vbmeta images for later stages";
+    }
     return true;
 }
 
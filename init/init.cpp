@@ -268,6 +268,7 @@ static class ShutdownState {
 void DumpState() {
     ServiceList::GetInstance().DumpState();
     ActionManager::GetInstance().DumpState();
+    DumpPropertyServiceState();
 }
 
 Parser CreateParser(ActionManager& action_manager, ServiceList& service_list) {
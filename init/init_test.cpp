@@ -175,6 +175,66 @@ execute_third
     EXPECT_EQ(3, num_executed);
 }
 
+TEST(init, PropertyTriggerOrder) {
+    std::string init_script =
+            R"init(
+on property:init.test.a=1
+execute_first
+
+on property:init.test.b=1
+execute_never
+
+on property:init.test.a=*
+execute_second
+
+on boot && property:init.test.a=1
+execute_never
+
+on property:init.test.a=2
+execute_never
+
+on property:init.test.a=1
+execute_third
+
+)init";
+
+    int num_executed = 0;
+    auto do_execute_first = [&num_executed](const BuiltinArguments&) {
+        EXPECT_EQ(0, num_executed++);
+        return Result<void>{};
+    };
+    auto do_execute_second = [&num_executed](const BuiltinArguments&) {
+        EXPECT_EQ(1, num_executed++);
+        return Result<void>{};
+    };
+    auto do_execute_third = [&num_executed](const BuiltinArguments&) {
+        EXPECT_EQ(2, num_executed++);
+        return Result<void>{};
+    };
+    auto do_execute_never = [](const BuiltinArguments&) {
+        ADD_FAILURE() << "Unexpected action executed";
+        return Result<void>{};
+    };
+
+    BuiltinFunctionMap test_function_map = {
+            {"execute_first", {0, 0, {false, do_execute_first}}},
+            {"execute_second", {0, 0, {false, do_execute_second}}},
+            {"execute_third", {0, 0, {false, do_execute_third}}},
+            {"execute_never", {0, 0, {false, do_execute_never}}},
+    };
+
+    ActionManagerCommand set_property = [](ActionManager& am) {
+        am.QueuePropertyChange("init.test.c", "1");
+        am.QueuePropertyChange("init.test.a", "1");
+    };
+    std::vector<ActionManagerCommand> commands{set_property};
+
+    ActionManager action_manager;
+    ServiceList service_list;
+    TestInitText(init_script, test_function_map, commands, &action_manager, &service_list);
+    EXPECT_EQ(3, num_executed);
+}
+
 TEST(init, OverrideService) {
     std::string init_script = R"init(
 service A something
@@ -250,6 +250,53 @@ void WritePersistentProperty(const std::string& name, const std::string& value)
     }
 }
 
+void PersistentPropertyWriter::Load() {
+    auto persistent_properties = LoadPersistentPropertyFile();
+    if (!persistent_properties.ok()) {
+        LOG(ERROR) << "Recovering persistent properties from memory: "
+                   << persistent_properties.error();
+        persistent_properties = LoadPersistentPropertiesFromMemory();
+    }
+    persistent_properties_ = std::move(*persistent_properties);
+
+    index_.clear();
+    for (int i = 0; i < persistent_properties_.properties_size(); i++) {
+        // Like WritePersistentProperty(), update the first record of a name.
+        index_.emplace(persistent_properties_.properties(i).name(), i);
+    }
+    loaded_ = true;
+}
+
+void PersistentPropertyWriter::Write(
+        const std::vector<std::pair<std::string, std::string>>& properties) {
+    if (!loaded_) {
+        Load();
+    }
+
+    bool changed = false;
+    for (const auto& [name, value] : properties) {
+        auto it = index_.find(name);
+        if (it != index_.end()) {
+            auto record = persistent_properties_.mutable_properties(it->second);
+            if (record->value() == value) {
+                continue;
+            }
+            record->set_value(value);
+        } else {
+            index_.emplace(name, persistent_properties_.properties_size());
+            AddPersistentProperty(name, value, &persistent_properties_);
+        }
+        changed = true;
+    }
+    if (!changed) {
+        return;
+    }
+
+    if (auto result = WritePersistentPropertyFile(persistent_properties_); !result.ok()) {
+        LOG(ERROR) << "Could not store persistent properties: " << result.error();
+    }
+}
+
 PersistentProperties LoadPersistentProperties() {
     auto persistent_properties = LoadPersistentPropertyFile();
 
@@ -18,6 +18,9 @@
 #define _INIT_PERSISTENT_PROPERTIES_H
 
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "result.h"
 #include "system/core/init/persistent_properties.pb.h"
@@ -29,6 +32,25 @@ PersistentProperties LoadPersistentProperties();
 void WritePersistentProperty(const std::string& name, const std::string& value);
 PersistentProperties LoadPersistentPropertiesFromMemory();
 
+// Writes batches of persistent properties. The file is read once, then the
+// copy kept in memory is authoritative, so each batch costs a single write
+// and fsync no matter how many properties it holds. Nothing else may write the
+// persistent property file while a writer is in use.
+class PersistentPropertyWriter {
+  public:
+    // Apply |properties| in order and store the result. The file is not
+    // written if nothing changed.
+    void Write(const std::vector<std::pair<std::string, std::string>>& properties);
+
+  private:
+    void Load();
+
+    bool loaded_ = false;
+    PersistentProperties persistent_properties_;
+    // Index of each property in |persistent_properties_|.
+    std::unordered_map<std::string, int> index_;
+};
+
 // Exposed only for testing
 Result<PersistentProperties> LoadPersistentPropertyFile();
 Result<void> WritePersistentPropertyFile(const PersistentProperties& persistent_properties);
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "persistent_properties.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+using android::base::StringPrintf;
+
+namespace android {
+namespace init {
+
+// A persistent property file of a realistic size, with 200 properties.
+static void FillPersistentPropertyFile() {
+    PersistentProperties persistent_properties;
+    for (int i = 0; i < 200; i++) {
+        auto record = persistent_properties.add_properties();
+        record->set_name(StringPrintf("persist.benchmark.initial%d", i));
+        record->set_value("initial");
+    }
+    WritePersistentPropertyFile(persistent_properties);
+}
+
+// The sets of one batch. Values change on every iteration so that each batch
+// has to be written.
+static std::vector<std::pair<std::string, std::string>> MakeBatch(int size, int iteration) {
+    std::vector<std::pair<std::string, std::string>> batch;
+    for (int i = 0; i < size; i++) {
+        batch.emplace_back(StringPrintf("persist.benchmark.prop%d", i),
+                           StringPrintf("%d", iteration));
+    }
+    return batch;
+}
+
+// One read-modify-write-fsync cycle per set, as done without group commit.
+static void BenchmarkWritePersistentProperty(benchmark::State& state) {
+    TemporaryFile tf;
+    persistent_property_filename = tf.path;
+    FillPersistentPropertyFile();
+
+    int iteration = 0;
+    for (auto _ : state) {
+        for (const auto& [name, value] : MakeBatch(state.range(0), iteration++)) {
+            WritePersistentProperty(name, value);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BenchmarkWritePersistentProperty)->Arg(1)->Arg(8)->Arg(64);
+
+// One write and fsync per batch of sets.
+static void BenchmarkPersistentPropertyWriter(benchmark::State& state) {
+    TemporaryFile tf;
+    persistent_property_filename = tf.path;
+    FillPersistentPropertyFile();
+
+    PersistentPropertyWriter writer;
+    int iteration = 0;
+    for (auto _ : state) {
+        writer.Write(MakeBatch(state.range(0), iteration++));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BenchmarkPersistentPropertyWriter)->Arg(1)->Arg(8)->Arg(64);
+
+}  // namespace init
+}  // namespace android
@@ -183,6 +183,66 @@ TEST(persistent_properties, NopUpdateDoesntWriteFile) {
     ASSERT_EQ(last_modified(), t);
 }
 
+TEST(persistent_properties, WriterBatch) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties = {
+            {"persist.sys.locale", "en-US"},
+            {"persist.sys.timezone", "America/Los_Angeles"},
+    };
+    ASSERT_RESULT_OK(
+            WritePersistentPropertyFile(VectorToPersistentProperties(persistent_properties)));
+
+    PersistentPropertyWriter writer;
+    writer.Write({
+            {"persist.sys.locale", "pt-BR"},
+            {"persist.test.numbers", "12345"},
+            {"persist.sys.locale", "fr-FR"},
+    });
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties_expected = {
+            {"persist.sys.locale", "fr-FR"},
+            {"persist.sys.timezone", "America/Los_Angeles"},
+            {"persist.test.numbers", "12345"},
+    };
+    auto read_back_properties = LoadPersistentProperties();
+    CheckPropertiesEqual(persistent_properties_expected, read_back_properties);
+
+    // Later batches build on the copy in memory.
+    writer.Write({{"persist.test.numbers", "54321"}});
+    persistent_properties_expected[2].second = "54321";
+    read_back_properties = LoadPersistentProperties();
+    CheckPropertiesEqual(persistent_properties_expected, read_back_properties);
+}
+
+TEST(persistent_properties, WriterNopBatchDoesntWriteFile) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+
+    auto last_modified = [&tf]() -> time_t {
+        struct stat buf;
+        EXPECT_EQ(fstat(tf.fd, &buf), 0);
+        return buf.st_mtime;
+    };
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties = {
+            {"persist.sys.locale", "en-US"},
+            {"persist.sys.timezone", "America/Los_Angeles"},
+    };
+    ASSERT_RESULT_OK(
+            WritePersistentPropertyFile(VectorToPersistentProperties(persistent_properties)));
+
+    time_t t = last_modified();
+    sleep(2);
+    PersistentPropertyWriter writer;
+    writer.Write(persistent_properties);
+    // Ensure that the file was not modified
+    ASSERT_EQ(last_modified(), t);
+}
+
 TEST(persistent_properties, RejectNonPersistProperty) {
     TemporaryFile tf;
     ASSERT_TRUE(tf.fd != -1);
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "property_permission_cache.h"
+
+#include <string.h>
+
+#include <utility>
+
+#include <android-base/logging.h>
+#include <selinux/selinux.h>
+
+namespace android {
+namespace init {
+
+namespace {
+
+class LibSelinux final : public PropertyPermissionCache::Selinux {
+  public:
+    bool OpenStatus() override { return selinux_status_open(1) >= 0; }
+    int StatusPolicyload() override { return selinux_status_policyload(); }
+    int StatusEnforcing() override { return selinux_status_getenforce(); }
+    int KernelEnforcing() override { return security_getenforce(); }
+
+    bool ComputeAccess(const char* source_context, const char* target_context,
+                       const char* tclass, const char* perm, access_vector_t* av,
+                       struct av_decision* avd) override {
+        security_id_t source_sid;
+        security_id_t target_sid;
+        if (avc_context_to_sid(source_context, &source_sid) != 0 ||
+            avc_context_to_sid(target_context, &target_sid) != 0) {
+            return false;
+        }
+        security_class_t cls = string_to_security_class(tclass);
+        *av = cls ? string_to_av_perm(cls, perm) : 0;
+        if (!*av) {
+            return false;
+        }
+        return avc_has_perm_noaudit(source_sid, target_sid, cls, *av, nullptr, avd) == 0;
+    }
+};
+
+}  // namespace
+
+PropertyPermissionCache::PropertyPermissionCache(std::unique_ptr<Selinux> selinux)
+    : selinux_(selinux ? std::move(selinux) : std::make_unique<LibSelinux>()) {}
+
+std::string PropertyPermissionCache::MakeKey(const char* source_context,
+                                             const char* target_context, const char* tclass,
+                                             const char* perm) {
+    std::string key;
+    key.reserve(strlen(source_context) + strlen(target_context) + strlen(tclass) + strlen(perm) +
+                3);
+    key.append(source_context).push_back('\0');
+    key.append(target_context).push_back('\0');
+    key.append(tclass).push_back('\0');
+    key.append(perm);
+    return key;
+}
+
+// Drops the cache if the policy has been reloaded or the enforcing mode has changed since it was
+// filled. Returns true if the cache may be used, which is only the case while enforcing.
+//
+// selinux_status_updated() can't be used for this: the AVC calls it too, and consumes the
+// updates before the cache gets to see them.
+bool PropertyPermissionCache::Validate() {
+    if (!status_opened_) {
+        status_opened_ = true;
+        if (!selinux_->OpenStatus()) {
+            PLOG(ERROR) << "Unable to open the SELinux status page, not caching permission checks";
+            return false;
+        }
+        policyload_ = selinux_->StatusPolicyload();
+        enforcing_ = selinux_->StatusEnforcing();
+    }
+    if (policyload_ < 0) {
+        return false;
+    }
+    int policyload = selinux_->StatusPolicyload();
+    int enforcing = selinux_->StatusEnforcing();
+    if (policyload != policyload_ || enforcing != enforcing_) {
+        allowed_.clear();
+        policyload_ = policyload;
+        enforcing_ = enforcing;
+        invalidations_++;
+    }
+    return policyload_ >= 0 && enforcing_ == 1;
+}
+
+bool PropertyPermissionCache::Lookup(const char* source_context, const char* target_context,
+                                     const char* tclass, const char* perm) {
+    if (!Validate()) {
+        return false;
+    }
+    if (allowed_.count(MakeKey(source_context, target_context, tclass, perm))) {
+        hits_++;
+        return true;
+    }
+    misses_++;
+    return false;
+}
+
+// A decision is only cached if the policy grants it outright. Once selinux_check_access() has
+// allowed something in a permissive domain or on a permissive device, the AVC reports it as
+// allowed too, so the domain's permissive flag and the kernel's enforcing mode are checked
+// explicitly. Decisions the policy asks to audit aren't cached either.
+void PropertyPermissionCache::Insert(const char* source_context, const char* target_context,
+                                     const char* tclass, const char* perm) {
+    if (!Validate()) {
+        return;
+    }
+    if (selinux_->KernelEnforcing() != 1) {
+        return;
+    }
+
+    access_vector_t av;
+    struct av_decision avd;
+    if (!selinux_->ComputeAccess(source_context, target_context, tclass, perm, &av, &avd) ||
+        (avd.flags & SELINUX_AVD_FLAGS_PERMISSIVE) || (avd.allowed & av) != av ||
+        (avd.auditallow & av) != 0) {
+        return;
+    }
+
+    if (allowed_.size() >= kMaxEntries) {
+        allowed_.clear();
+        evictions_++;
+    }
+    allowed_.emplace(MakeKey(source_context, target_context, tclass, perm));
+}
+
+void PropertyPermissionCache::DumpState() const {
+    auto lookups = hits_ + misses_;
+    LOG(INFO) << "property permission cache: " << allowed_.size() << "/" << kMaxEntries
+              << " entries, " << hits_ << "/" << lookups << " hits ("
+              << (lookups ? hits_ * 100 / lookups : 0) << "%), " << invalidations_
+              << " policy or enforcing changes, " << evictions_ << " evictions";
+}
+
+}  // namespace init
+}  // namespace android
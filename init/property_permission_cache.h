@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <selinux/avc.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+namespace android {
+namespace init {
+
+// Remembers the SELinux decisions that allowed a property access, so that a process which sets
+// the same property over and over doesn't go through libselinux each time. Denials are never
+// cached, so every one of them is still audited. Nothing is cached or looked up unless the
+// device is enforcing, and the cache is dropped whenever the policy, a boolean or the enforcing
+// mode changes. Not thread safe.
+class PropertyPermissionCache {
+  public:
+    // The parts of libselinux the cache relies on. Replaced in tests.
+    class Selinux {
+      public:
+        virtual ~Selinux() = default;
+        // selinux_status_open(); returns false if the status page can't be mapped.
+        virtual bool OpenStatus() = 0;
+        // selinux_status_policyload() and selinux_status_getenforce().
+        virtual int StatusPolicyload() = 0;
+        virtual int StatusEnforcing() = 0;
+        // security_getenforce().
+        virtual int KernelEnforcing() = 0;
+        // Sets |av| to the requested permission and |avd| to the AVC's decision for it, without
+        // auditing. Returns false if the contexts, class or permission are unknown.
+        virtual bool ComputeAccess(const char* source_context, const char* target_context,
+                                   const char* tclass, const char* perm, access_vector_t* av,
+                                   struct av_decision* avd) = 0;
+    };
+
+    // Uses libselinux if |selinux| is null.
+    explicit PropertyPermissionCache(std::unique_ptr<Selinux> selinux = nullptr);
+
+    bool Lookup(const char* source_context, const char* target_context, const char* tclass,
+                const char* perm);
+    // Records a decision that selinux_check_access() allowed.
+    void Insert(const char* source_context, const char* target_context, const char* tclass,
+                const char* perm);
+    void DumpState() const;
+
+    size_t size() const { return allowed_.size(); }
+
+  private:
+    static constexpr size_t kMaxEntries = 1024;
+
+    static std::string MakeKey(const char* source_context, const char* target_context,
+                               const char* tclass, const char* perm);
+    bool Validate();
+
+    std::unique_ptr<Selinux> selinux_;
+    std::unordered_set<std::string> allowed_;
+    // The policyload count and enforcing mode of the SELinux status page when allowed_ was
+    // filled. policyload_ is -1 if the status page couldn't be opened, in which case nothing is
+    // cached.
+    int policyload_ = -1;
+    int enforcing_ = -1;
+    bool status_opened_ = false;
+
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t invalidations_ = 0;
+    uint64_t evictions_ = 0;
+};
+
+}  // namespace init
+}  // namespace android
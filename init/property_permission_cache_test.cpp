@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "property_permission_cache.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace init {
+
+namespace {
+
+constexpr const char* kSource = "u:r:system_server:s0";
+constexpr const char* kTarget = "u:object_r:system_prop:s0";
+
+// Grants every access, like the AVC does once selinux_check_access() has allowed it.
+struct FakeSelinux : public PropertyPermissionCache::Selinux {
+    bool OpenStatus() override { return true; }
+    int StatusPolicyload() override { return policyload; }
+    int StatusEnforcing() override { return status_enforcing; }
+    int KernelEnforcing() override { return kernel_enforcing; }
+
+    bool ComputeAccess(const char*, const char*, const char*, const char*, access_vector_t* av,
+                       struct av_decision* avd) override {
+        *av = 1;
+        *avd = {};
+        avd->allowed = 1;
+        avd->flags = flags;
+        return true;
+    }
+
+    int policyload = 0;
+    int status_enforcing = 1;
+    int kernel_enforcing = 1;
+    uint32_t flags = 0;
+};
+
+class PropertyPermissionCacheTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        auto selinux = std::make_unique<FakeSelinux>();
+        selinux_ = selinux.get();
+        cache_ = std::make_unique<PropertyPermissionCache>(std::move(selinux));
+    }
+
+    bool Lookup() { return cache_->Lookup(kSource, kTarget, "property_service", "set"); }
+    void Insert() { cache_->Insert(kSource, kTarget, "property_service", "set"); }
+
+    FakeSelinux* selinux_;
+    std::unique_ptr<PropertyPermissionCache> cache_;
+};
+
+}  // namespace
+
+TEST_F(PropertyPermissionCacheTest, CachesGrants) {
+    ASSERT_FALSE(Lookup());
+    Insert();
+    ASSERT_TRUE(Lookup());
+
+    selinux_->policyload++;
+    ASSERT_FALSE(Lookup());
+}
+
+TEST_F(PropertyPermissionCacheTest, PermissiveDomain) {
+    selinux_->flags = SELINUX_AVD_FLAGS_PERMISSIVE;
+    ASSERT_FALSE(Lookup());
+    Insert();
+    ASSERT_FALSE(Lookup());
+    ASSERT_EQ(cache_->size(), 0);
+}
+
+TEST_F(PropertyPermissionCacheTest, PermissiveDevice) {
+    selinux_->status_enforcing = 0;
+    selinux_->kernel_enforcing = 0;
+    Insert();
+    ASSERT_EQ(cache_->size(), 0);
+
+    // The status page may lag behind the kernel.
+    selinux_->status_enforcing = 1;
+    Insert();
+    ASSERT_EQ(cache_->size(), 0);
+}
+
+TEST_F(PropertyPermissionCacheTest, SetenforceDropsCache) {
+    Insert();
+    ASSERT_TRUE(Lookup());
+
+    // setenforce 0 doesn't change the policyload count.
+    selinux_->status_enforcing = 0;
+    selinux_->kernel_enforcing = 0;
+    ASSERT_FALSE(Lookup());
+    ASSERT_EQ(cache_->size(), 0);
+
+    // Grants made while permissive aren't trusted after setenforce 1.
+    Insert();
+    selinux_->status_enforcing = 1;
+    selinux_->kernel_enforcing = 1;
+    ASSERT_FALSE(Lookup());
+}
+
+}  // namespace init
+}  // namespace android
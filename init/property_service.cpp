@@ -37,6 +37,9 @@
 #include <unistd.h>
 #include <wchar.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -67,6 +70,7 @@
 #include "epoll.h"
 #include "init.h"
 #include "persistent_properties.h"
+#include "property_permission_cache.h"
 #include "property_type.h"
 #include "proto_utils.h"
 #include "second_stage_resources.h"
@@ -110,8 +114,9 @@ constexpr auto ID_PROP = "ro.build.id";
 constexpr auto LEGACY_ID_PROP = "ro.build.legacy.id";
 constexpr auto VBMETA_DIGEST_PROP = "ro.boot.vbmeta.digest";
 constexpr auto DIGEST_SIZE_USED = 8;
+constexpr size_t kMaxPropertyWorkerThreads = 16;
 
-static bool persistent_properties_loaded = false;
+static std::atomic<bool> persistent_properties_loaded = false;
 
 static int from_init_socket = -1;
 static int init_socket = -1;
@@ -119,6 +124,11 @@ static bool accept_messages = false;
 static bool weaken_prop_security = false;
 static std::mutex accept_messages_lock;
 static std::mutex selinux_check_access_lock;
+// Serializes changes to the property area and the change notifications sent to init. Everything
+// before that, including the permission checks, may run on several threads at once.
+static std::mutex property_set_lock;
+// Serializes the synchronous writes to the persistent property file.
+static std::mutex persistent_write_lock;
 static std::thread property_service_thread;
 static std::thread property_service_for_system_thread;
 
@@ -152,6 +162,30 @@ void StopSendingMessages() {
     accept_messages = false;
 }
 
+// Must only be used with selinux_check_access_lock held.
+static PropertyPermissionCache permission_cache;
+
+// selinux_check_access(), through the permission cache.
+static bool CheckSelinuxAccess(const char* source_context, const char* target_context,
+                               const char* tclass, const char* perm, PropertyAuditData* audit_data) {
+    auto lock = std::lock_guard{selinux_check_access_lock};
+    if (target_context && permission_cache.Lookup(source_context, target_context, tclass, perm)) {
+        return true;
+    }
+    if (selinux_check_access(source_context, target_context, tclass, perm, audit_data) != 0) {
+        return false;
+    }
+    if (target_context) {
+        permission_cache.Insert(source_context, target_context, tclass, perm);
+    }
+    return true;
+}
+
+void DumpPropertyServiceState() {
+    auto lock = std::lock_guard{selinux_check_access_lock};
+    permission_cache.DumpState();
+}
+
 bool CanReadProperty(const std::string& source_context, const std::string& name) {
     const char* target_context = nullptr;
     property_info_area->GetPropertyInfo(name.c_str(), &target_context, nullptr);
@@ -163,9 +197,7 @@ bool CanReadProperty(const std::string& source_context, const std::string& name)
     ucred cr = {.pid = 0, .uid = 0, .gid = 0};
     audit_data.cr = &cr;
 
-    auto lock = std::lock_guard{selinux_check_access_lock};
-    return selinux_check_access(source_context.c_str(), target_context, "file", "read",
-                                &audit_data) == 0;
+    return CheckSelinuxAccess(source_context.c_str(), target_context, "file", "read", &audit_data);
 }
 
 static bool CheckMacPerms(const std::string& name, const char* target_context,
@@ -179,9 +211,8 @@ static bool CheckMacPerms(const std::string& name, const char* target_context,
     audit_data.name = name.c_str();
     audit_data.cr = &cr;
 
-    auto lock = std::lock_guard{selinux_check_access_lock};
-    return selinux_check_access(source_context, target_context, "property_service", "set",
-                                &audit_data) == 0;
+    return CheckSelinuxAccess(source_context, target_context, "property_service", "set",
+                              &audit_data);
 }
 
 void NotifyPropertyChange(const std::string& name, const std::string& value) {
@@ -380,6 +411,7 @@ class PersistWriteThread {
     std::mutex mutex_;
     std::condition_variable cv_;
     std::deque<std::tuple<std::string, std::string, SocketConnection>> work_;
+    PersistentPropertyWriter writer_;
 };
 
 static std::unique_ptr<PersistWriteThread> persist_write_thread;
@@ -398,6 +430,8 @@ static std::optional<uint32_t> PropertySet(const std::string& name, const std::s
         return {PROP_ERROR_INVALID_VALUE};
     }
 
+    bool write_persistent = false;
+    auto lock = std::unique_lock{property_set_lock};
     if (name == "sys.powerctl") {
         // No action here - NotifyPropertyChange will trigger the appropriate action, and since this
         // can come to the second thread, we mustn't call out to the __system_property_* functions
@@ -428,11 +462,20 @@ static std::optional<uint32_t> PropertySet(const std::string& name, const std::s
                 persist_write_thread->Write(name, value, std::move(*socket));
                 return {};
             }
-            WritePersistentProperty(name, value);
+            write_persistent = true;
         }
     }
 
     NotifyPropertyChange(name, value);
+    lock.unlock();
+
+    // The file is written outside of property_set_lock, so that other properties can be set
+    // meanwhile. Writes are still serialized, and each one stores whatever value is current by
+    // then, so that two racing sets of the same property can't leave the older value on disk.
+    if (write_persistent) {
+        auto persistent_lock = std::lock_guard{persistent_write_lock};
+        WritePersistentProperty(name, android::base::GetProperty(name, value));
+    }
     return {PROP_SUCCESS};
 }
 
@@ -594,12 +637,10 @@ uint32_t HandlePropertySetNoSocket(const std::string& name, const std::string& v
     return *ret;
 }
 
-static void handle_property_set_fd(int fd) {
-    static constexpr uint32_t kDefaultSocketTimeout = 5000; /* ms */
-
+static std::optional<SocketConnection> AcceptPropertySetConnection(int fd) {
     int s = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
     if (s == -1) {
-        return;
+        return {};
     }
 
     ucred cr;
@@ -607,10 +648,16 @@ static void handle_property_set_fd(int fd) {
     if (getsockopt(s, SOL_SOCKET, SO_PEERCRED, &cr, &cr_size) < 0) {
         close(s);
         PLOG(ERROR) << "sys_prop: unable to get SO_PEERCRED";
-        return;
+        return {};
     }
 
-    SocketConnection socket(s, cr);
+    return SocketConnection(s, cr);
+}
+
+// Reads a single request from |socket|, checks its permissions and applies it.
+static void HandlePropertySetConnection(SocketConnection socket) {
+    static constexpr uint32_t kDefaultSocketTimeout = 5000; /* ms */
+
     uint32_t timeout_ms = kDefaultSocketTimeout;
 
     uint32_t cmd = 0;
@@ -691,6 +738,63 @@ static void handle_property_set_fd(int fd) {
     }
 }
 
+static void handle_property_set_fd(int fd) {
+    if (auto socket = AcceptPropertySetConnection(fd)) {
+        HandlePropertySetConnection(std::move(*socket));
+    }
+}
+
+// Handles the connections accepted on one property service socket on a fixed set of threads, so
+// that a client which is slow to send its request only holds up one of them.
+class PropertyWorkerPool {
+  public:
+    explicit PropertyWorkerPool(size_t num_threads);
+    void Queue(SocketConnection socket);
+
+  private:
+    void Work();
+
+    // Past this many pending connections, the accepting thread waits and new clients back up
+    // in the socket's listen queue instead.
+    static constexpr size_t kMaxPendingConnections = 64;
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable space_cv_;
+    std::deque<SocketConnection> work_;
+};
+
+PropertyWorkerPool::PropertyWorkerPool(size_t num_threads) {
+    for (size_t i = 0; i < num_threads; i++) {
+        threads_.emplace_back([this]() -> void { Work(); });
+    }
+}
+
+void PropertyWorkerPool::Work() {
+    while (true) {
+        SocketConnection socket;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [this] { return !work_.empty(); });
+            socket = std::move(work_.front());
+            work_.pop_front();
+        }
+        space_cv_.notify_one();
+
+        HandlePropertySetConnection(std::move(socket));
+    }
+}
+
+void PropertyWorkerPool::Queue(SocketConnection socket) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        space_cv_.wait(lock, [this] { return work_.size() < kMaxPendingConnections; });
+        work_.emplace_back(std::move(socket));
+    }
+    work_cv_.notify_one();
+}
+
 uint32_t InitPropertySet(const std::string& name, const std::string& value) {
     ucred cr = {.pid = 1, .uid = 0, .gid = 0};
     std::string error;
@@ -1509,14 +1613,24 @@ static void HandleInitSocket() {
     }
 }
 
-static void PropertyServiceThread(int fd, bool listen_init) {
+static void PropertyServiceThread(int fd, bool listen_init, size_t num_workers) {
     Epoll epoll;
     if (auto result = epoll.Open(); !result.ok()) {
         LOG(FATAL) << result.error();
     }
 
-    if (auto result = epoll.RegisterHandler(fd, std::bind(handle_property_set_fd, fd));
-        !result.ok()) {
+    Epoll::Handler handler = std::bind(handle_property_set_fd, fd);
+    std::unique_ptr<PropertyWorkerPool> worker_pool;
+    if (num_workers > 0) {
+        worker_pool = std::make_unique<PropertyWorkerPool>(num_workers);
+        handler = [fd, pool = worker_pool.get()]() -> void {
+            if (auto socket = AcceptPropertySetConnection(fd)) {
+                pool->Queue(std::move(*socket));
+            }
+        };
+    }
+
+    if (auto result = epoll.RegisterHandler(fd, std::move(handler)); !result.ok()) {
         LOG(FATAL) << result.error();
     }
 
@@ -1541,9 +1655,9 @@ PersistWriteThread::PersistWriteThread() {
 
 void PersistWriteThread::Work() {
     while (true) {
-        std::tuple<std::string, std::string, SocketConnection> item;
+        std::deque<std::tuple<std::string, std::string, SocketConnection>> items;
 
-        // Grab the next item within the lock.
+        // Grab every pending item within the lock.
         {
             std::unique_lock<std::mutex> lock(mutex_);
 
@@ -1551,16 +1665,26 @@ void PersistWriteThread::Work() {
                 cv_.wait(lock);
             }
 
-            item = std::move(work_.front());
-            work_.pop_front();
+            items.swap(work_);
+        }
+
+        // Perform a single write/fsync for the whole batch outside the lock.
+        std::vector<std::pair<std::string, std::string>> properties;
+        properties.reserve(items.size());
+        for (const auto& item : items) {
+            properties.emplace_back(std::get<0>(item), std::get<1>(item));
         }
+        writer_.Write(properties);
 
-        // Perform write/fsync outside the lock.
-        WritePersistentProperty(std::get<0>(item), std::get<1>(item));
-        NotifyPropertyChange(std::get<0>(item), std::get<1>(item));
+        for (auto& item : items) {
+            {
+                auto lock = std::lock_guard{property_set_lock};
+                NotifyPropertyChange(std::get<0>(item), std::get<1>(item));
+            }
 
-        SocketConnection& socket = std::get<2>(item);
-        socket.SendUint32(PROP_SUCCESS);
+            SocketConnection& socket = std::get<2>(item);
+            socket.SendUint32(PROP_SUCCESS);
+        }
     }
 }
 
@@ -1572,7 +1696,8 @@ void PersistWriteThread::Write(std::string name, std::string value, SocketConnec
     cv_.notify_all();
 }
 
-void StartThread(const char* name, int mode, int gid, std::thread& t, bool listen_init) {
+void StartThread(const char* name, int mode, int gid, std::thread& t, bool listen_init,
+                 size_t num_workers) {
     int fd = -1;
     if (auto result = CreateSocket(name, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
                                    /*passcred=*/false, /*should_listen=*/false, mode, /*uid=*/0,
@@ -1585,7 +1710,7 @@ void StartThread(const char* name, int mode, int gid, std::thread& t, bool liste
 
     listen(fd, 8);
 
-    auto new_thread = std::thread(PropertyServiceThread, fd, listen_init);
+    auto new_thread = std::thread(PropertyServiceThread, fd, listen_init, num_workers);
     t.swap(new_thread);
 }
 
@@ -1600,16 +1725,22 @@ void StartPropertyService(int* epoll_socket) {
     init_socket = sockets[1];
     StartSendingMessages();
 
-    StartThread(PROP_SERVICE_FOR_SYSTEM_NAME, 0660, AID_SYSTEM, property_service_for_system_thread,
-                true);
-    StartThread(PROP_SERVICE_NAME, 0666, 0, property_service_thread, false);
+    // When set, connections on each socket are read and permission checked on this many worker
+    // threads rather than on the thread that accepts them.
+    auto num_workers = android::base::GetUintProperty<size_t>(
+            "ro.property_service.worker_threads", 0, kMaxPropertyWorkerThreads);
 
+    // Set up before the socket threads start, since they use it.
     auto async_persist_writes =
             android::base::GetBoolProperty("ro.property_service.async_persist_writes", false);
 
     if (async_persist_writes) {
         persist_write_thread = std::make_unique<PersistWriteThread>();
     }
+
+    StartThread(PROP_SERVICE_FOR_SYSTEM_NAME, 0660, AID_SYSTEM, property_service_for_system_thread,
+                true, num_workers);
+    StartThread(PROP_SERVICE_NAME, 0666, 0, property_service_thread, false, num_workers);
 }
 
 }  // namespace init
@@ -39,5 +39,7 @@ void StartPropertyService(int* epoll_socket);
 void StartSendingMessages();
 void StopSendingMessages();
 
+void DumpPropertyServiceState();
+
 }  // namespace init
 }  // namespace android
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// These benchmarks talk to the running property service, so they measure it as
+// configured on the device, e.g. with or without ro.property_service.worker_threads.
+
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/system_properties.h>
+#include <sys/un.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+
+using android::base::SetProperty;
+using android::base::StringPrintf;
+using android::base::unique_fd;
+
+namespace android {
+namespace init {
+
+// Opens a connection to the property service that never sends a request. The
+// property service gives up on it after its socket timeout.
+static unique_fd ConnectStalledClient() {
+    unique_fd fd(socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (fd < 0) {
+        return {};
+    }
+    sockaddr_un addr = {.sun_family = AF_LOCAL};
+    strlcpy(addr.sun_path, "/dev/socket/" PROP_SERVICE_NAME, sizeof(addr.sun_path));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        return {};
+    }
+    return fd;
+}
+
+// Every thread sets its own property as fast as it can.
+static void BenchmarkSetPropertyStorm(benchmark::State& state) {
+    auto name = StringPrintf("debug.init.benchmark.storm%d", state.thread_index());
+    int i = 0;
+    for (auto _ : state) {
+        if (!SetProperty(name, std::to_string(i++))) {
+            state.SkipWithError("SetProperty failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BenchmarkSetPropertyStorm)->ThreadRange(1, 32)->UseRealTime();
+
+// As above, while clients that connect and then send nothing keep arriving.
+// With a single handler thread, each of them holds up every other set.
+static void BenchmarkSetPropertyStormWithStalledClients(benchmark::State& state) {
+    auto name = StringPrintf("debug.init.benchmark.stalled%d", state.thread_index());
+    std::vector<unique_fd> stalled;
+    int i = 0;
+    for (auto _ : state) {
+        if (state.thread_index() == 0) {
+            state.PauseTiming();
+            stalled.emplace_back(ConnectStalledClient());
+            state.ResumeTiming();
+        }
+        if (!SetProperty(name, std::to_string(i++))) {
+            state.SkipWithError("SetProperty failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BenchmarkSetPropertyStormWithStalledClients)
+        ->ThreadRange(1, 8)
+        ->Iterations(8)
+        ->UseRealTime();
+
+}  // namespace init
+}  // namespace android
@@ -491,6 +491,8 @@ void SelinuxRestoreContext() {
     // adb remount, snapshot-based updates, and DSUs all create files during
     // first-stage init.
     RestoreconIfExists(SnapshotManager::GetGlobalRollbackIndicatorPath().c_str(), 0);
+    // The vbmeta cache that first stage hands over to AvbHandle::Open().
+    RestoreconIfExists("/dev/fs_avb", SELINUX_ANDROID_RESTORECON_RECURSE);
     RestoreconIfExists("/metadata/gsi",
                        SELINUX_ANDROID_RESTORECON_RECURSE | SELINUX_ANDROID_RESTORECON_SKIP_SEHASH);
 }
@@ -16,24 +16,27 @@
 
 #ifndef _LIBSPARSE_SPARSE_FORMAT_H_
 #define _LIBSPARSE_SPARSE_FORMAT_H_
-#include "sparse_defs.h"
+
+#include <stdint.h>
+
+/* The on-disk layout of Android sparse images. */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct sparse_header {
-  __le32 magic;          /* 0xed26ff3a */
-  __le16 major_version;  /* (0x1) - reject images with higher major versions */
-  __le16 minor_version;  /* (0x0) - allow images with higer minor versions */
-  __le16 file_hdr_sz;    /* 28 bytes for first revision of the file format */
-  __le16 chunk_hdr_sz;   /* 12 bytes for first revision of the file format */
-  __le32 blk_sz;         /* block size in bytes, must be a multiple of 4 (4096) */
-  __le32 total_blks;     /* total blocks in the non-sparse output image */
-  __le32 total_chunks;   /* total chunks in the sparse input image */
-  __le32 image_checksum; /* CRC32 checksum of the original data, counting "don't care" */
-                         /* as 0. Standard 802.3 polynomial, use a Public Domain */
-                         /* table implementation */
+  uint32_t magic;          /* 0xed26ff3a */
+  uint16_t major_version;  /* (0x1) - reject images with higher major versions */
+  uint16_t minor_version;  /* (0x0) - allow images with higer minor versions */
+  uint16_t file_hdr_sz;    /* 28 bytes for first revision of the file format */
+  uint16_t chunk_hdr_sz;   /* 12 bytes for first revision of the file format */
+  uint32_t blk_sz;         /* block size in bytes, must be a multiple of 4 (4096) */
+  uint32_t total_blks;     /* total blocks in the non-sparse output image */
+  uint32_t total_chunks;   /* total chunks in the sparse input image */
+  uint32_t image_checksum; /* CRC32 checksum of the original data, counting "don't care" */
+                           /* as 0. Standard 802.3 polynomial, use a Public Domain */
+                           /* table implementation */
 } sparse_header_t;
 
 #define SPARSE_HEADER_MAGIC 0xed26ff3a
@@ -44,10 +47,10 @@ typedef struct sparse_header {
 #define CHUNK_TYPE_CRC32 0xCAC4
 
 typedef struct chunk_header {
-  __le16 chunk_type; /* 0xCAC1 -> raw; 0xCAC2 -> fill; 0xCAC3 -> don't care */
-  __le16 reserved1;
-  __le32 chunk_sz; /* in blocks in output image */
-  __le32 total_sz; /* in bytes of chunk input file including chunk header and data */
+  uint16_t chunk_type; /* 0xCAC1 -> raw; 0xCAC2 -> fill; 0xCAC3 -> don't care */
+  uint16_t reserved1;
+  uint32_t chunk_sz; /* in blocks in output image */
+  uint32_t total_sz; /* in bytes of chunk input file including chunk header and data */
 } chunk_header_t;
 
 /* Following a Raw or Fill or CRC32 chunk is data.
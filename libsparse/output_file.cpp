@@ -30,10 +30,12 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#include <sparse/sparse_format.h>
+
 #include "defs.h"
 #include "output_file.h"
 #include "sparse_crc32.h"
-#include "sparse_format.h"
+#include "sparse_defs.h"
 
 #include <android-base/mapped_file.h>
 
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 
 #include <sparse/sparse.h>
+#include <sparse/sparse_format.h>
 
 #include "defs.h"
 #include "sparse_file.h"
@@ -25,7 +26,6 @@
 #include "backed_block.h"
 #include "output_file.h"
 #include "sparse_defs.h"
-#include "sparse_format.h"
 
 struct sparse_file* sparse_file_new(unsigned int block_size, int64_t len) {
   struct sparse_file* s = reinterpret_cast<sparse_file*>(calloc(sizeof(struct sparse_file), 1));
@@ -29,13 +29,14 @@
 #include <string>
 
 #include <sparse/sparse.h>
+#include <sparse/sparse_format.h>
 
 #include "android-base/stringprintf.h"
 #include "defs.h"
 #include "output_file.h"
 #include "sparse_crc32.h"
 #include "sparse_file.h"
-#include "sparse_format.h"
+#include "sparse_defs.h"
 
 #if defined(__APPLE__) && defined(__MACH__)
 #define lseek64 lseek
@@ -54,6 +54,13 @@ struct TrieNodeInternal {
   // Exact matches are a sorted list of exact matches at this node_; binary search them.
   uint32_t num_exact_matches;
   uint32_t exact_match_entries;
+
+  // Version 2 and later: the prefixes again, sorted alphabetically, and for each of them the index
+  // within that list of the longest other prefix at this node that it starts with, or ~0u.
+  // The longest prefix of a name is then the last one sorting at or before it, or one of the
+  // prefixes it starts with.
+  uint32_t sorted_prefix_entries;
+  uint32_t sorted_prefix_parents;
 };
 
 struct PropertyInfoAreaHeader {
@@ -65,8 +72,47 @@ struct PropertyInfoAreaHeader {
   uint32_t contexts_offset;
   uint32_t types_offset;
   uint32_t root_offset;
+  // Version 2 and later: the offset of an ExactMatchTable, or 0 if there isn't one.
+  uint32_t exact_match_table_offset;
+};
+
+// A perfect hash table of every exact match in the trie, keyed by the full property name.
+// A name's hash picks a bucket and the seed of that bucket picks the only slot the name can be in.
+struct ExactMatchTable {
+  uint32_t num_buckets;
+  uint32_t num_slots;
+  // An array of num_buckets seeds.
+  uint32_t seeds;
+  // An array of num_slots property entry offsets, 0 for an empty slot. Each entry holds the full
+  // property name along with the context and type a trie lookup resolves it to.
+  uint32_t slots;
 };
 
+// The hash functions of ExactMatchTable. These are part of the serialized format.
+inline uint64_t ExactMatchHash(const char* name, uint32_t* namelen) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  const char* p = name;
+  for (; *p != '\0'; ++p) {
+    hash = (hash ^ static_cast<unsigned char>(*p)) * 0x100000001b3ULL;
+  }
+  *namelen = p - name;
+  return hash;
+}
+
+inline uint64_t ExactMatchMix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+inline uint32_t ExactMatchBucket(uint64_t hash, uint32_t num_buckets) {
+  return ExactMatchMix(hash) % num_buckets;
+}
+
+inline uint32_t ExactMatchSlot(uint64_t hash, uint32_t seed, uint32_t num_slots) {
+  return ExactMatchMix(hash ^ ((seed + 1ULL) * 0x9e3779b97f4a7c15ULL)) % num_slots;
+}
+
 class SerializedData {
  public:
   uint32_t size() const {
@@ -133,6 +179,17 @@ class TrieNode {
                                                   exact_match_entry_offset);
   }
 
+  // Only present in version 2 and later.
+  const PropertyEntry* sorted_prefix(int n) const {
+    uint32_t prefix_entry_offset =
+        serialized_data_->uint32_array(trie_node_base_->sorted_prefix_entries)[n];
+    return reinterpret_cast<const PropertyEntry*>(serialized_data_->data_base() +
+                                                  prefix_entry_offset);
+  }
+  uint32_t sorted_prefix_parent(int n) const {
+    return serialized_data_->uint32_array(trie_node_base_->sorted_prefix_parents)[n];
+  }
+
  private:
   const PropertyEntry* node_property_entry() const {
     return reinterpret_cast<const PropertyEntry*>(serialized_data_->data_base() +
@@ -176,6 +233,18 @@ class PropertyInfoArea : private SerializedData {
  private:
   void CheckPrefixMatch(const char* remaining_name, const TrieNode& trie_node,
                         uint32_t* context_index, uint32_t* type_index) const;
+  bool FindExactMatch(const ExactMatchTable& table, const char* name, uint32_t* context_index,
+                      uint32_t* type_index) const;
+
+  bool has_lookup_tables() const { return current_version() >= 2; }
+  const ExactMatchTable* exact_match_table() const {
+    if (!has_lookup_tables()) return nullptr;
+    uint32_t offset = header()->exact_match_table_offset;
+    if (offset == 0 || offset + sizeof(ExactMatchTable) > size()) return nullptr;
+    auto table = reinterpret_cast<const ExactMatchTable*>(data_base() + offset);
+    if (table->num_buckets == 0 || table->num_slots == 0) return nullptr;
+    return table;
+  }
 
   const PropertyInfoAreaHeader* header() const {
     return reinterpret_cast<const PropertyInfoAreaHeader*>(data_base());
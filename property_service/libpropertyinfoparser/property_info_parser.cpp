@@ -90,25 +90,82 @@ bool TrieNode::FindChildForString(const char* name, uint32_t namelen, TrieNode*
 
 void PropertyInfoArea::CheckPrefixMatch(const char* remaining_name, const TrieNode& trie_node,
                                         uint32_t* context_index, uint32_t* type_index) const {
+  const uint32_t num_prefixes = trie_node.num_prefixes();
+  if (num_prefixes == 0) return;
+
+  auto apply_match = [context_index, type_index](const PropertyEntry* prefix) {
+    if (prefix->context_index != ~0u) {
+      *context_index = prefix->context_index;
+    }
+    if (prefix->type_index != ~0u) {
+      *type_index = prefix->type_index;
+    }
+  };
+
+  if (has_lookup_tables()) {
+    // Find the last prefix sorting at or before remaining_name, then walk up the prefixes it
+    // starts with until one matches.
+    uint32_t candidate = ~0u;
+    int bottom = 0;
+    int top = num_prefixes - 1;
+    while (top >= bottom) {
+      int search = (top + bottom) / 2;
+      if (strcmp(c_string(trie_node.sorted_prefix(search)->name_offset), remaining_name) <= 0) {
+        candidate = search;
+        bottom = search + 1;
+      } else {
+        top = search - 1;
+      }
+    }
+    for (; candidate != ~0u; candidate = trie_node.sorted_prefix_parent(candidate)) {
+      auto prefix = trie_node.sorted_prefix(candidate);
+      if (!strncmp(c_string(prefix->name_offset), remaining_name, prefix->namelen)) {
+        apply_match(prefix);
+        return;
+      }
+    }
+    return;
+  }
+
   const uint32_t remaining_name_size = strlen(remaining_name);
-  for (uint32_t i = 0; i < trie_node.num_prefixes(); ++i) {
+  for (uint32_t i = 0; i < num_prefixes; ++i) {
     auto prefix_len = trie_node.prefix(i)->namelen;
     if (prefix_len > remaining_name_size) continue;
 
     if (!strncmp(c_string(trie_node.prefix(i)->name_offset), remaining_name, prefix_len)) {
-      if (trie_node.prefix(i)->context_index != ~0u) {
-        *context_index = trie_node.prefix(i)->context_index;
-      }
-      if (trie_node.prefix(i)->type_index != ~0u) {
-        *type_index = trie_node.prefix(i)->type_index;
-      }
+      apply_match(trie_node.prefix(i));
       return;
     }
   }
 }
 
+// Look up a full property name in the exact match table. The entries there already hold the
+// result of the trie walk, so a hit needs nothing else.
+bool PropertyInfoArea::FindExactMatch(const ExactMatchTable& table, const char* name,
+                                      uint32_t* context_index, uint32_t* type_index) const {
+  uint32_t namelen;
+  uint64_t hash = ExactMatchHash(name, &namelen);
+  uint32_t seed = uint32_array(table.seeds)[ExactMatchBucket(hash, table.num_buckets)];
+  uint32_t entry_offset = uint32_array(table.slots)[ExactMatchSlot(hash, seed, table.num_slots)];
+  if (entry_offset == 0) return false;
+
+  auto entry = reinterpret_cast<const PropertyEntry*>(data_base() + entry_offset);
+  if (entry->namelen != namelen || strcmp(c_string(entry->name_offset), name)) return false;
+
+  if (context_index != nullptr) *context_index = entry->context_index;
+  if (type_index != nullptr) *type_index = entry->type_index;
+  return true;
+}
+
 void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* context_index,
                                               uint32_t* type_index) const {
+  // If there is an exact match table, any exact match is in it, so the walk below only has to
+  // consider prefixes.
+  const ExactMatchTable* table = exact_match_table();
+  if (table != nullptr && FindExactMatch(*table, name, context_index, type_index)) {
+    return;
+  }
+
   uint32_t return_context_index = ~0u;
   uint32_t return_type_index = ~0u;
   const char* remaining_name = name;
@@ -144,24 +201,29 @@ void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* contex
 
   // We've made it to a leaf node, so check contents and return appropriately.
   // Check exact matches
-  for (uint32_t i = 0; i < trie_node.num_exact_matches(); ++i) {
-    if (!strcmp(c_string(trie_node.exact_match(i)->name_offset), remaining_name)) {
-      if (context_index != nullptr) {
-        if (trie_node.exact_match(i)->context_index != ~0u) {
-          *context_index = trie_node.exact_match(i)->context_index;
-        } else {
-          *context_index = return_context_index;
-        }
+  int exact_match = -1;
+  if (table == nullptr) {
+    exact_match = Find(trie_node.num_exact_matches(), [this, &trie_node, remaining_name](auto i) {
+      return strcmp(c_string(trie_node.exact_match(i)->name_offset), remaining_name);
+    });
+  }
+  if (exact_match != -1) {
+    auto entry = trie_node.exact_match(exact_match);
+    if (context_index != nullptr) {
+      if (entry->context_index != ~0u) {
+        *context_index = entry->context_index;
+      } else {
+        *context_index = return_context_index;
       }
-      if (type_index != nullptr) {
-        if (trie_node.exact_match(i)->type_index != ~0u) {
-          *type_index = trie_node.exact_match(i)->type_index;
-        } else {
-          *type_index = return_type_index;
-        }
+    }
+    if (type_index != nullptr) {
+      if (entry->type_index != ~0u) {
+        *type_index = entry->type_index;
+      } else {
+        *type_index = return_type_index;
       }
-      return;
     }
+    return;
   }
   // Check prefix matches for prefixes not deliminated with '.'
   CheckPrefixMatch(remaining_name, trie_node, &return_context_index, &return_type_index);
@@ -0,0 +1,151 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "property_info_serializer/property_info_serializer.h"
+
+#include "property_info_parser/property_info_parser.h"
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+namespace android {
+namespace properties {
+
+// The property_contexts files init builds the property info area from.
+static constexpr const char* kPropertyContextsFiles[] = {
+    "/system/etc/selinux/plat_property_contexts",
+    "/system_ext/etc/selinux/system_ext_property_contexts",
+    "/vendor/etc/selinux/vendor_property_contexts",
+    "/product/etc/selinux/product_property_contexts",
+    "/odm/etc/selinux/odm_property_contexts",
+};
+
+struct PropertyInfoFixture {
+  // The parsed property_contexts entries.
+  std::vector<PropertyInfoEntry> property_infos;
+  // The serialized trie, as written now and as a version 1 reader sees it.
+  std::string trie;
+  std::string version1_trie;
+  // Every name in the property_contexts files, with prefixes extended to a full property name.
+  std::vector<std::string> names;
+};
+
+static const PropertyInfoFixture* GetFixture() {
+  static const PropertyInfoFixture* fixture = [] {
+    auto fixture = new PropertyInfoFixture;
+    auto& property_infos = fixture->property_infos;
+    for (const auto& file : kPropertyContextsFiles) {
+      std::string contents;
+      if (!android::base::ReadFileToString(file, &contents)) continue;
+      std::vector<std::string> errors;
+      ParsePropertyInfoFile(contents, false, &property_infos, &errors);
+    }
+
+    std::string error;
+    if (property_infos.empty() ||
+        !BuildTrie(property_infos, "u:object_r:default_prop:s0", "string", &fixture->trie,
+                   &error)) {
+      delete fixture;
+      return static_cast<PropertyInfoFixture*>(nullptr);
+    }
+    fixture->version1_trie = fixture->trie;
+    reinterpret_cast<PropertyInfoAreaHeader*>(fixture->version1_trie.data())->current_version = 1;
+
+    for (const auto& property_info : property_infos) {
+      fixture->names.emplace_back(property_info.exact_match ? property_info.name
+                                                            : property_info.name + "benchmark");
+    }
+    return fixture;
+  }();
+  return fixture;
+}
+
+// Looks up every name once per iteration. Arg 0 selects the version 1 lookup, without the exact
+// match table and the sorted prefix lists.
+static void BM_GetPropertyInfo(benchmark::State& state) {
+  auto fixture = GetFixture();
+  if (fixture == nullptr) {
+    state.SkipWithError("Unable to build a trie from the property_contexts files");
+    return;
+  }
+  const auto& trie = state.range(0) ? fixture->trie : fixture->version1_trie;
+  auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(trie.data());
+
+  for (auto _ : state) {
+    for (const auto& name : fixture->names) {
+      const char* context;
+      const char* type;
+      property_info_area->GetPropertyInfo(name.c_str(), &context, &type);
+      benchmark::DoNotOptimize(context);
+      benchmark::DoNotOptimize(type);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * fixture->names.size());
+}
+BENCHMARK(BM_GetPropertyInfo)->Arg(0)->Arg(1);
+
+// The area init actually serialized for this boot.
+static void BM_GetPropertyInfo_Device(benchmark::State& state) {
+  auto fixture = GetFixture();
+  PropertyInfoAreaFile property_info_area;
+  if (fixture == nullptr || !property_info_area.LoadDefaultPath()) {
+    state.SkipWithError("Unable to load the property info area");
+    return;
+  }
+
+  for (auto _ : state) {
+    for (const auto& name : fixture->names) {
+      const char* context;
+      const char* type;
+      property_info_area->GetPropertyInfo(name.c_str(), &context, &type);
+      benchmark::DoNotOptimize(context);
+      benchmark::DoNotOptimize(type);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * fixture->names.size());
+}
+BENCHMARK(BM_GetPropertyInfo_Device);
+
+// Builds and serializes the trie, as init does at boot. This includes the seed search of the exact
+// match table.
+static void BM_BuildTrie(benchmark::State& state) {
+  auto fixture = GetFixture();
+  if (fixture == nullptr) {
+    state.SkipWithError("Unable to build a trie from the property_contexts files");
+    return;
+  }
+
+  for (auto _ : state) {
+    std::string trie;
+    std::string error;
+    if (!BuildTrie(fixture->property_infos, "u:object_r:default_prop:s0", "string", &trie,
+                   &error)) {
+      state.SkipWithError(error.c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(trie);
+  }
+  state.SetItemsProcessed(state.iterations() * fixture->property_infos.size());
+}
+BENCHMARK(BM_BuildTrie);
+
+}  // namespace properties
+}  // namespace android
+
+BENCHMARK_MAIN();
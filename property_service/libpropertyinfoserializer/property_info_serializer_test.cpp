@@ -20,6 +20,9 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 namespace android {
 namespace properties {
 
@@ -39,7 +42,7 @@ TEST(propertyinfoserializer, TrieNodeCheck) {
   auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(serialized_trie.data());
 
   // Initial checks for property area.
-  EXPECT_EQ(1U, property_info_area->current_version());
+  EXPECT_EQ(2U, property_info_area->current_version());
   EXPECT_EQ(1U, property_info_area->minimum_supported_version());
 
   // Check the root node
@@ -886,5 +889,79 @@ TEST(propertyinfoserializer, GetPropertyInfo_empty_context_and_type) {
   EXPECT_STREQ("5th", type);
 }
 
+TEST(propertyinfoserializer, GetPropertyInfo_nested_prefixes) {
+  auto property_info = std::vector<PropertyInfoEntry>{
+      {"persist.ab", "1st", "1st", false},  {"persist.abc", "2nd", "2nd", false},
+      {"persist.abd", "3rd", "3rd", false}, {"persist.abcd", "4th", "4th", false},
+      {"persist.b", "5th", "5th", false},
+  };
+
+  auto serialized_trie = std::string();
+  auto build_trie_error = std::string();
+  ASSERT_TRUE(BuildTrie(property_info, "default", "default", &serialized_trie, &build_trie_error))
+      << build_trie_error;
+
+  auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(serialized_trie.data());
+
+  const char* context;
+  property_info_area->GetPropertyInfo("persist.a", &context, nullptr);
+  EXPECT_STREQ("default", context);
+  property_info_area->GetPropertyInfo("persist.abb", &context, nullptr);
+  EXPECT_STREQ("1st", context);
+  property_info_area->GetPropertyInfo("persist.abce", &context, nullptr);
+  EXPECT_STREQ("2nd", context);
+  property_info_area->GetPropertyInfo("persist.abcde", &context, nullptr);
+  EXPECT_STREQ("4th", context);
+  property_info_area->GetPropertyInfo("persist.abe", &context, nullptr);
+  EXPECT_STREQ("1st", context);
+  property_info_area->GetPropertyInfo("persist.abz.sub", &context, nullptr);
+  EXPECT_STREQ("1st", context);
+  property_info_area->GetPropertyInfo("persist.bz", &context, nullptr);
+  EXPECT_STREQ("5th", context);
+  property_info_area->GetPropertyInfo("persist.c", &context, nullptr);
+  EXPECT_STREQ("default", context);
+}
+
+// Version 1 readers ignore the lookup tables of version 2, and must get the same answers.
+TEST(propertyinfoserializer, GetPropertyInfo_version1_compatible) {
+  auto property_info = std::vector<PropertyInfoEntry>{
+      {"test.", "1st", "1st", false},       {"test.test", "2nd", "2nd", false},
+      {"test.test2.", "6th", "6th", false}, {"test.test", "5th", "5th", true},
+      {"test.test1", "3rd", "3rd", true},   {"test.test2", "7th", "7th", true},
+      {"test.test3", "3rd", "", true},      {"this.is.a.long.string", "4th", "4th", true},
+      {"testoneword", "8th", "8th", true},  {"testwordprefix", "9th", "9th", false},
+      {"testwordprefixlonger", "", "10th", false},
+      {"test.test2.exact", "", "", true},
+  };
+
+  auto serialized_trie = std::string();
+  auto build_trie_error = std::string();
+  ASSERT_TRUE(BuildTrie(property_info, "default", "default", &serialized_trie, &build_trie_error))
+      << build_trie_error;
+
+  auto version1_trie = serialized_trie;
+  reinterpret_cast<PropertyInfoAreaHeader*>(version1_trie.data())->current_version = 1;
+
+  auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(serialized_trie.data());
+  auto version1_area = reinterpret_cast<const PropertyInfoArea*>(version1_trie.data());
+
+  std::vector<std::string> names;
+  for (const auto& entry : property_info) {
+    names.emplace_back(entry.name);
+    names.emplace_back(entry.name + "a");
+    names.emplace_back(entry.name + ".a");
+    names.emplace_back(entry.name.substr(0, entry.name.size() - 1));
+  }
+  for (const auto& name : names) {
+    uint32_t context_index, type_index;
+    uint32_t version1_context_index, version1_type_index;
+    property_info_area->GetPropertyInfoIndexes(name.c_str(), &context_index, &type_index);
+    version1_area->GetPropertyInfoIndexes(name.c_str(), &version1_context_index,
+                                          &version1_type_index);
+    EXPECT_EQ(version1_context_index, context_index) << name;
+    EXPECT_EQ(version1_type_index, type_index) << name;
+  }
+}
+
 }  // namespace properties
 }  // namespace android
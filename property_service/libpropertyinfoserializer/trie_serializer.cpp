@@ -18,6 +18,8 @@
 
 #include <algorithm>
 
+#include <android-base/logging.h>
+
 namespace android {
 namespace properties {
 
@@ -57,7 +59,8 @@ uint32_t TrieSerializer::WritePropertyEntry(const PropertyEntryBuilder& property
   return offset;
 }
 
-uint32_t TrieSerializer::WriteTrieNode(const TrieBuilderNode& builder_node) {
+uint32_t TrieSerializer::WriteTrieNode(const TrieBuilderNode& builder_node,
+                                       const std::string& path) {
   uint32_t trie_offset;
   auto trie = arena_->AllocateObject<TrieNodeInternal>(&trie_offset);
 
@@ -74,9 +77,40 @@ uint32_t TrieSerializer::WriteTrieNode(const TrieBuilderNode& builder_node) {
   uint32_t prefix_entries_array_offset = arena_->AllocateUint32Array(sorted_prefix_matches.size());
   trie->prefix_entries = prefix_entries_array_offset;
 
+  std::vector<uint32_t> prefix_entry_offsets;
   for (unsigned int i = 0; i < sorted_prefix_matches.size(); ++i) {
     uint32_t property_entry_offset = WritePropertyEntry(sorted_prefix_matches[i]);
     arena_->uint32_array(prefix_entries_array_offset)[i] = property_entry_offset;
+    prefix_entry_offsets.emplace_back(property_entry_offset);
+  }
+
+  // Write the same prefixes sorted alphabetically, each with the longest other prefix that it
+  // starts with. Those sort right before it, so the closest preceding one is the longest.
+  std::vector<unsigned int> alphabetical(sorted_prefix_matches.size());
+  for (unsigned int i = 0; i < alphabetical.size(); ++i) {
+    alphabetical[i] = i;
+  }
+  std::sort(alphabetical.begin(), alphabetical.end(), [&](auto lhs, auto rhs) {
+    return sorted_prefix_matches[lhs].name < sorted_prefix_matches[rhs].name;
+  });
+
+  uint32_t sorted_prefix_entries_array_offset = arena_->AllocateUint32Array(alphabetical.size());
+  trie->sorted_prefix_entries = sorted_prefix_entries_array_offset;
+  uint32_t sorted_prefix_parents_array_offset = arena_->AllocateUint32Array(alphabetical.size());
+  trie->sorted_prefix_parents = sorted_prefix_parents_array_offset;
+
+  for (unsigned int i = 0; i < alphabetical.size(); ++i) {
+    const auto& name = sorted_prefix_matches[alphabetical[i]].name;
+    uint32_t parent = ~0u;
+    for (unsigned int j = i; j-- > 0;) {
+      if (name.starts_with(sorted_prefix_matches[alphabetical[j]].name)) {
+        parent = j;
+        break;
+      }
+    }
+    arena_->uint32_array(sorted_prefix_entries_array_offset)[i] =
+        prefix_entry_offsets[alphabetical[i]];
+    arena_->uint32_array(sorted_prefix_parents_array_offset)[i] = parent;
   }
 
   // Write exact matches
@@ -94,6 +128,7 @@ uint32_t TrieSerializer::WriteTrieNode(const TrieBuilderNode& builder_node) {
   for (unsigned int i = 0; i < sorted_exact_matches.size(); ++i) {
     uint32_t property_entry_offset = WritePropertyEntry(sorted_exact_matches[i]);
     arena_->uint32_array(exact_match_entries_array_offset)[i] = property_entry_offset;
+    exact_match_names_.emplace_back(path + sorted_exact_matches[i].name);
   }
 
   // Write children
@@ -106,18 +141,137 @@ uint32_t TrieSerializer::WriteTrieNode(const TrieBuilderNode& builder_node) {
   trie->child_nodes = children_offset_array_offset;
 
   for (unsigned int i = 0; i < sorted_children.size(); ++i) {
-    arena_->uint32_array(children_offset_array_offset)[i] = WriteTrieNode(sorted_children[i]);
+    arena_->uint32_array(children_offset_array_offset)[i] =
+        WriteTrieNode(sorted_children[i], path + sorted_children[i].name() + ".");
   }
   return trie_offset;
 }
 
+uint32_t TrieSerializer::WriteExactMatchTable() {
+  const auto& names = exact_match_names_;
+  if (names.empty()) return 0;
+
+  std::vector<uint64_t> hashes;
+  for (const auto& name : names) {
+    uint32_t namelen;
+    hashes.emplace_back(ExactMatchHash(name.c_str(), &namelen));
+  }
+  // Names with the same hash can never be told apart by a seed.
+  auto sorted_hashes = hashes;
+  std::sort(sorted_hashes.begin(), sorted_hashes.end());
+  if (std::adjacent_find(sorted_hashes.begin(), sorted_hashes.end()) != sorted_hashes.end()) {
+    return 0;
+  }
+
+  // Place the largest buckets first, each with the first seed that puts all of its names into
+  // free slots. If a bucket can't be placed, retry with more slots. This runs in init at boot, so
+  // the total number of slots probed is capped; a placement normally takes a few per name, and
+  // lookups only get slower without the table.
+  static constexpr uint32_t kMaxSeed = 1 << 16;
+  static constexpr uint64_t kMaxProbesPerName = 1024;
+  const uint64_t max_probes = names.size() * kMaxProbesPerName;
+  uint64_t probes = 0;
+  const uint32_t num_buckets = names.size() / 4 + 1;
+  std::vector<std::vector<unsigned int>> buckets(num_buckets);
+  for (unsigned int i = 0; i < names.size(); ++i) {
+    buckets[ExactMatchBucket(hashes[i], num_buckets)].emplace_back(i);
+  }
+  std::vector<uint32_t> bucket_order(num_buckets);
+  for (uint32_t i = 0; i < num_buckets; ++i) {
+    bucket_order[i] = i;
+  }
+  std::stable_sort(bucket_order.begin(), bucket_order.end(), [&](auto lhs, auto rhs) {
+    return buckets[lhs].size() > buckets[rhs].size();
+  });
+
+  std::vector<uint32_t> seeds;
+  std::vector<int> slot_names;
+  bool placed = false;
+  for (uint32_t num_slots = names.size() + names.size() / 4 + 1;
+       !placed && num_slots <= names.size() * 8 + 1 && probes < max_probes; num_slots *= 2) {
+    seeds.assign(num_buckets, 0);
+    slot_names.assign(num_slots, -1);
+    placed = true;
+    for (auto bucket : bucket_order) {
+      if (buckets[bucket].empty()) break;
+
+      bool seed_found = false;
+      std::vector<uint32_t> slots;
+      for (uint32_t seed = 0; seed < kMaxSeed && !seed_found && probes < max_probes; ++seed) {
+        slots.clear();
+        seed_found = true;
+        for (auto name : buckets[bucket]) {
+          probes++;
+          uint32_t slot = ExactMatchSlot(hashes[name], seed, num_slots);
+          if (slot_names[slot] != -1 || std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+            seed_found = false;
+            break;
+          }
+          slots.emplace_back(slot);
+        }
+        if (seed_found) seeds[bucket] = seed;
+      }
+      if (!seed_found) {
+        placed = false;
+        break;
+      }
+      for (unsigned int i = 0; i < slots.size(); ++i) {
+        slot_names[slots[i]] = buckets[bucket][i];
+      }
+    }
+  }
+  if (!placed) {
+    if (probes >= max_probes) {
+      LOG(WARNING) << "Gave up placing " << names.size() << " exact matches after " << probes
+                   << " probes, not writing an exact match table";
+    }
+    return 0;
+  }
+
+  // Each entry holds what a walk of the trie resolves its name to, so that a lookup that hits the
+  // table doesn't have to walk the trie at all.
+  std::vector<uint32_t> entry_offsets;
+  for (const auto& name : names) {
+    uint32_t context_index;
+    uint32_t type_index;
+    serialized_info()->GetPropertyInfoIndexes(name.c_str(), &context_index, &type_index);
+
+    uint32_t offset;
+    auto entry = arena_->AllocateObject<PropertyEntry>(&offset);
+    entry->name_offset = arena_->AllocateAndWriteString(name);
+    entry->namelen = name.size();
+    entry->context_index = context_index;
+    entry->type_index = type_index;
+    entry_offsets.emplace_back(offset);
+  }
+
+  uint32_t table_offset;
+  auto table = arena_->AllocateObject<ExactMatchTable>(&table_offset);
+  table->num_buckets = num_buckets;
+  table->num_slots = slot_names.size();
+
+  uint32_t seeds_array_offset = arena_->AllocateUint32Array(seeds.size());
+  table->seeds = seeds_array_offset;
+  std::copy(seeds.begin(), seeds.end(), arena_->uint32_array(seeds_array_offset));
+
+  uint32_t slots_array_offset = arena_->AllocateUint32Array(slot_names.size());
+  table->slots = slots_array_offset;
+  for (unsigned int i = 0; i < slot_names.size(); ++i) {
+    arena_->uint32_array(slots_array_offset)[i] =
+        slot_names[i] == -1 ? 0 : entry_offsets[slot_names[i]];
+  }
+  return table_offset;
+}
+
 TrieSerializer::TrieSerializer() {}
 
 std::string TrieSerializer::SerializeTrie(const TrieBuilder& trie_builder) {
   arena_.reset(new TrieNodeArena());
 
   auto header = arena_->AllocateObject<PropertyInfoAreaHeader>(nullptr);
-  header->current_version = 1;
+  // Version 2 adds the sorted prefix lists and the exact match table. Version 1 readers ignore
+  // them, so the minimum supported version stays at 1.
+  header->current_version = 2;
   header->minimum_supported_version = 1;
 
   // Store where we're about to write the contexts.
@@ -131,9 +285,17 @@ std::string TrieSerializer::SerializeTrie(const TrieBuilder& trie_builder) {
   // We need to store size() up to this point now for Find*Offset() to work.
   header->size = arena_->size();
 
-  uint32_t root_trie_offset = WriteTrieNode(trie_builder.builder_root());
+  exact_match_names_.clear();
+  uint32_t root_trie_offset = WriteTrieNode(trie_builder.builder_root(), "");
   header->root_offset = root_trie_offset;
 
+  // The exact match table is filled in by looking names up in the trie written so far, so the
+  // size has to cover it first.
+  header->size = arena_->size();
+  header->exact_match_table_offset = 0;
+  uint32_t exact_match_table_offset = WriteExactMatchTable();
+  header->exact_match_table_offset = exact_match_table_offset;
+
   // Record the real size now that we've written everything
   header->size = arena_->size();
 
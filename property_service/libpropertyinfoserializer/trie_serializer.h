@@ -38,15 +38,22 @@ class TrieSerializer {
   void SerializeStrings(const std::set<std::string>& strings);
   uint32_t WritePropertyEntry(const PropertyEntryBuilder& property_entry);
 
-  // Writes a new TrieNode to arena, and recursively writes its children.
+  // Writes a new TrieNode to arena, and recursively writes its children. |path| is the name of
+  // the node followed by a dot, or empty for the root.
   // Returns the offset within arena.
-  uint32_t WriteTrieNode(const TrieBuilderNode& builder_node);
+  uint32_t WriteTrieNode(const TrieBuilderNode& builder_node, const std::string& path);
+
+  // Writes the ExactMatchTable for every exact match written by WriteTrieNode().
+  // Returns the offset within arena, or 0 if no table could be built.
+  uint32_t WriteExactMatchTable();
 
   const PropertyInfoArea* serialized_info() const {
     return reinterpret_cast<const PropertyInfoArea*>(arena_->data().data());
   }
 
   std::unique_ptr<TrieNodeArena> arena_;
+  // The full names of the exact matches written so far.
+  std::vector<std::string> exact_match_names_;
 };
 
 }  // namespace properties